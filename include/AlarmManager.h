@@ -2,14 +2,76 @@
 #define ALARM_MANAGER_H
 
 #include <Arduino.h>
+#include <atomic>
 #include "ConfigStorage.h"
+#include "Counter.h"
+#include "BreathDetector.h"
+#include "StateRecord.h"
 
+// Breath-level alarm engine. evaluate() runs exactly once per produced
+// sample; everything else reads the cached status word it publishes.
+// Each condition needs its value past the threshold for ON_DELAY_MS to
+// raise, and back inside threshold -/+ hysteresis for OFF_DELAY_MS to
+// clear. With latching on, a raised alarm stays active until acknowledged.
+// Past the no-breath timeout the breath values count as zero: the low
+// conditions raise and the high ones clear.
 class AlarmManager {
+public:
+  enum Condition : uint8_t {
+    ETCO2_HIGH = 0,
+    ETCO2_LOW,
+    RR_HIGH,
+    RR_LOW,
+    CONDITION_COUNT
+  };
+  
+  enum Priority : uint8_t {
+    PRIORITY_NONE = 0,
+    PRIORITY_LOW,
+    PRIORITY_MEDIUM,
+    PRIORITY_HIGH
+  };
+  
+  // Status word: bit n = condition n active, bits 8-9 = highest priority
+  static const uint16_t STATUS_PRIORITY_SHIFT = 8;
+  static const uint8_t STATUS_BYTE1_ALARM = 0x08;
+  
 private:
+  struct ConditionState {
+    bool enabled;
+    bool active;
+    bool latched;
+    bool pending;
+    uint32_t since;         // start of the pending on/off transition
+  };
+  
   float highThreshold;
   float lowThreshold;
-  bool highEnabled;
-  bool lowEnabled;
+  float rrHighThreshold;
+  float rrLowThreshold;
+  bool latching;
+  
+  // Thresholds in 0.1 units, the resolution evaluate() compares at
+  int32_t highTenths;
+  int32_t lowTenths;
+  int32_t rrHighTenths;
+  int32_t rrLowTenths;
+  
+  ConditionState conditions[CONDITION_COUNT];
+  std::atomic<uint16_t> statusWord;
+  Counter raisedCount[CONDITION_COUNT];
+  Counter clearedCount[CONDITION_COUNT];
+  
+  static const uint32_t ON_DELAY_MS = 2000;
+  static const uint32_t OFF_DELAY_MS = 2000;
+  static const int32_t ETCO2_HYSTERESIS = 10;   // 1 mmHg
+  static const int32_t RR_HYSTERESIS = 10;      // 1 br/min
+  static const Priority PRIORITIES[CONDITION_COUNT];
+  static const char* const NAMES[CONDITION_COUNT];
+  
+  void step(Condition id, bool violated, bool cleared, uint32_t now);
+  void publish();
+  void updateThresholds();
   
 public:
   AlarmManager();
@@ -18,14 +80,42 @@ public:
   void setLowThreshold(float value);
   void enableHigh(bool enable);
   void enableLow(bool enable);
+  void setRRHighThreshold(float value);
+  void setRRLowThreshold(float value);
+  void enableRRHigh(bool enable);
+  void enableRRLow(bool enable);
+  void setLatching(bool enable);
   
   float getHighThreshold() const;
   float getLowThreshold() const;
   bool isHighEnabled() const;
   bool isLowEnabled() const;
+  float getRRHighThreshold() const;
+  float getRRLowThreshold() const;
+  bool isRRHighEnabled() const;
+  bool isRRLowEnabled() const;
+  bool isLatching() const;
+  
+  // Called once per sample with the latest breath values
+  // (etco2 in 0.1 mmHg, respRate in br/min) and whether they are current
+  void evaluate(uint32_t now, uint16_t etco2, uint16_t respRate, BreathDetector::Status breath);
+  void acknowledge();
+  
+  uint16_t getStatusWord() const { return statusWord.load(std::memory_order_relaxed); }
+  bool isAlarmActive() const { return (getStatusWord() & ((1 << CONDITION_COUNT) - 1)) != 0; }
+  Priority getHighestPriority() const { return (Priority)(getStatusWord() >> STATUS_PRIORITY_SHIFT); }
+  uint8_t applyStatusByte1(uint8_t statusByte) const;
+  static const char* conditionName(uint8_t id);
+  uint32_t getRaisedCount(uint8_t id) const { return id < CONDITION_COUNT ? raisedCount[id].get() : 0; }
+  uint32_t getClearedCount(uint8_t id) const { return id < CONDITION_COUNT ? clearedCount[id].get() : 0; }
+  void printStatus(Print& out) const;
   
-  bool checkAlarms(float value, uint8_t& statusByte) const;
   void loadFromConfig(const ConfigStorage::Config& cfg);
+  void saveToConfig(ConfigStorage::Config& cfg) const;
+  
+  // Thresholds plus the live per-condition state, for StateSnapshot
+  void captureState(AlarmSnapshot& s, uint32_t now) const;
+  void restoreState(const AlarmSnapshot& s, uint32_t now);
 };
 
 #endif // ALARM_MANAGER_H
@@ -0,0 +1,128 @@
+#ifndef BINARY_CHANNEL_H
+#define BINARY_CHANNEL_H
+
+#include <Arduino.h>
+#include "WaveformGenerator.h"
+#include "AlarmManager.h"
+#include "DeviceState.h"
+#include "ConfigStorage.h"
+#include "StateSnapshot.h"
+#include "SettingLimits.h"
+
+// Framed binary control and sample-streaming protocol on the command port,
+// for test rigs. Shares the port with the text CLI: a SOF byte at the start
+// of a line (or the 'binary' command) switches to binary mode, and a
+// MODE_TEXT frame switches back.
+//
+// Frame: SOF | type | len | payload[len] | crc16 (LE, CCITT over type..payload)
+// Multi-byte fields are little-endian. Replies use type | 0x80.
+class BinaryChannel {
+public:
+  static const uint8_t SOF = 0xA5;
+  static const uint8_t MAX_PAYLOAD = 240;
+  
+  enum Type : uint8_t {
+    TYPE_PING      = 0x01,  // payload echoed back
+    TYPE_SET       = 0x02,  // n x (id u8, value f32), applied all-or-nothing
+    TYPE_GET       = 0x03,  // reply: every parameter as (id u8, value f32)
+    TYPE_STREAM    = 0x04,  // rate u16 Hz (0 = stop, max 1000)
+    TYPE_STATS     = 0x05,  // reply: rx, tx, crc errors, dropped, overruns (u32 each)
+    TYPE_MODE_TEXT = 0x06,  // return to the text CLI
+    TYPE_SNAPSHOT  = 0x07,  // reply: StateSnapshot record
+    TYPE_RESTORE   = 0x08,  // payload: StateSnapshot record; reply: restore time us u32
+    TYPE_SAMPLES   = 0x90,  // unsolicited: seq u32, n x (time us u32, co2 i16 0.01 mmHg)
+    TYPE_NAK       = 0xFF   // error u8
+  };
+  
+  enum Param : uint8_t {
+    PARAM_AMPLITUDE = 1,
+    PARAM_FREQUENCY,
+    PARAM_BASELINE,
+    PARAM_PHASE,            // degrees
+    PARAM_ETCO2_HIGH,
+    PARAM_ETCO2_LOW,
+    PARAM_ETCO2_HIGH_EN,
+    PARAM_ETCO2_LOW_EN,
+    PARAM_RR_HIGH,
+    PARAM_RR_LOW,
+    PARAM_RR_HIGH_EN,
+    PARAM_RR_LOW_EN,
+    PARAM_LATCHING,
+    PARAM_USE_I2C,
+    PARAM_COUNT
+  };
+  
+  enum Error : uint8_t {
+    ERR_CRC = 1,
+    ERR_LENGTH,
+    ERR_UNKNOWN_TYPE,
+    ERR_BAD_PARAM,
+    ERR_BAD_RATE,
+    ERR_BAD_SNAPSHOT
+  };
+  
+private:
+  enum RxState : uint8_t { RX_SOF, RX_TYPE, RX_LEN, RX_PAYLOAD, RX_CRC_LO, RX_CRC_HI };
+  
+  WaveformGenerator& waveform;
+  AlarmManager& alarms;
+  DeviceState& device;
+  ConfigStorage& storage;
+  Stream& serial;
+  StateSnapshot* snapshot;
+  
+  bool active;
+  RxState rxState;
+  uint8_t rxType;
+  uint8_t rxLen;
+  uint8_t rxPos;
+  uint16_t rxCrc;
+  uint32_t lastByteTime;
+  uint8_t rxPayload[MAX_PAYLOAD];
+  uint8_t txFrame[MAX_PAYLOAD + 5];
+  
+  // Streaming: samples are batched so one frame covers up to 10 ms
+  static const uint8_t SAMPLES_PER_FRAME = 20;
+  static const uint8_t SAMPLE_SIZE = 6;
+  static const uint32_t BATCH_TIMEOUT_US = 10000;
+  static const uint32_t RX_TIMEOUT_MS = 50;
+  uint32_t streamPeriodUs;
+  uint32_t nextSampleUs;
+  uint32_t batchStartUs;
+  uint32_t streamSeq;
+  uint8_t batchCount;
+  uint8_t batch[4 + SAMPLES_PER_FRAME * SAMPLE_SIZE];
+  
+  uint32_t rxFrames;
+  uint32_t txFrames;
+  uint32_t crcErrors;
+  uint32_t droppedFrames;
+  uint32_t overruns;
+  
+  void handleFrame();
+  void handleSet();
+  void sendFrame(uint8_t type, const uint8_t* payload, uint8_t len);
+  void sendNak(uint8_t error);
+  void pollStream();
+  void flushBatch();
+  ConfigStorage::Config currentConfig() const;
+  
+  static bool paramInRange(uint8_t id, float value);
+  static bool setParam(ConfigStorage::Config& cfg, uint8_t id, float value);
+  static float getParam(const ConfigStorage::Config& cfg, uint8_t id);
+  
+public:
+  BinaryChannel(WaveformGenerator& wave, AlarmManager& alarm, DeviceState& dev,
+                ConfigStorage& stor, Stream& ser);
+  
+  void setSnapshot(StateSnapshot* snap);
+  
+  void activate();
+  bool isActive() const { return active; }
+  void feed(uint8_t byte);
+  void update();
+  
+  static uint16_t crc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF);
+};
+
+#endif // BINARY_CHANNEL_H
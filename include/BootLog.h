@@ -0,0 +1,29 @@
+#ifndef BOOT_LOG_H
+#define BOOT_LOG_H
+
+#include <Arduino.h>
+
+// Timestamps of the boot phases (micros() at the end of each phase).
+// Phases may be marked from the loop and from the background boot task.
+class BootLog {
+private:
+  static const uint8_t MAX_PHASES = 12;
+  
+  struct Phase {
+    const char* name;
+    uint32_t time;
+  };
+  
+  Phase phases[MAX_PHASES];
+  uint8_t count;
+  portMUX_TYPE mux;
+  
+public:
+  BootLog();
+  
+  void mark(const char* name);
+  uint32_t getPhaseTime(const char* name) const;
+  void print(Print& out) const;
+};
+
+#endif // BOOT_LOG_H
@@ -0,0 +1,47 @@
+#ifndef BREATH_DETECTOR_H
+#define BREATH_DETECTOR_H
+
+#include <Arduino.h>
+
+// Splits the CO2 stream into breaths using an adaptive mid-level threshold
+// with hysteresis. A breath is reported at the end of its expiratory phase.
+class BreathDetector {
+public:
+  // Judged against the no-breath timeout: WAITING until the first breath,
+  // BREATHING while the last one is younger than the timeout, NO_BREATH
+  // once it is older (or no breath came within the timeout of the first
+  // sample)
+  enum Status : uint8_t {
+    WAITING = 0,
+    BREATHING,
+    NO_BREATH
+  };
+  
+private:
+  int32_t envelopeMin;      // 0.01 mmHg, like the samples
+  int32_t envelopeMax;
+  int32_t peak;
+  bool inExpiration;
+  uint32_t lastRiseTime;
+  uint16_t etco2;
+  uint16_t respRate;
+  uint32_t breathCount;
+  bool started;
+  uint32_t lastBreathTime;  // end of the last breath, or the first sample
+  
+  static const int32_t ENVELOPE_DECAY = 1;     // 0.01 mmHg per sample
+  static const int32_t MIN_SWING = 200;        // 2 mmHg
+  
+public:
+  BreathDetector();
+  
+  bool update(uint32_t now, int32_t co2);   // 0.01 mmHg
+  void reset();
+  
+  uint16_t getETCO2() const;    // 0.1 mmHg
+  uint16_t getRespRate() const;
+  uint32_t getBreathCount() const;
+  Status status(uint32_t now, uint32_t timeoutMs) const;
+};
+
+#endif // BREATH_DETECTOR_H
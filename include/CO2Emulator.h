@@ -2,38 +2,88 @@
 #define CO2_EMULATOR_H
 
 #include <Arduino.h>
+#include <atomic>
 #include "I2CSensorInterface.h"
 #include "ConfigStorage.h"
 #include "WaveformGenerator.h"
 #include "AlarmManager.h"
 #include "DeviceState.h"
 #include "ProtocolHandler.h"
+#include "FaultInjector.h"
 #include "ProtocolReceiver.h"
+#include "PassthroughBridge.h"
 #include "CommandLineInterface.h"
+#include "BinaryChannel.h"
+#include "Component.h"
+#include "LoopStats.h"
+#include "MetricsExporter.h"
+#include "StateSnapshot.h"
+#include "HeapMonitor.h"
+#include "BreathDetector.h"
+#include "TrendStore.h"
+#include "WaveformRecorder.h"
+#include "WaveformPlayer.h"
+#include "ProtocolTrace.h"
+#include "BootLog.h"
+#include "Clock.h"
+#include "Config.h"
+#if WEB_ENABLED
 #include "WebInterface.h"
+#endif
+#if TFT_ENABLED
 #include "TFTDisplay.h"
-#include "Config.h"
+#endif
 
 class CO2Emulator {
 private:
+  WireBus i2cBus;
   I2CSensorInterface i2cSensor;
   ConfigStorage storage;
   WaveformGenerator waveform;
   AlarmManager alarms;
   DeviceState device;
+  ProtocolTrace trace;
+  FaultInjector faults;
   ProtocolHandler protocol;
   ProtocolReceiver receiver;
+  PassthroughBridge bridge;
   CommandLineInterface cli;
+  BinaryChannel binary;
+#if WEB_ENABLED
   WebInterface web;
+#endif
+#if TFT_ENABLED
   TFTDisplay tftDisplay;
+#endif
+  HeapMonitor heapMonitor;
+  BreathDetector breathDetector;
+  TrendStore trends;
+  WaveformRecorder recorder;
+  WaveformPlayer player;
+  BootLog bootLog;
+  LoopStats loopStats;
+  MetricsExporter metrics;
+  StateSnapshot snapshot;
   
   uint32_t lastWaveformUpdate;
   uint32_t lastParamUpdate;
   uint8_t dpiCounter;
   
+  // Optional subsystems, started in order by the boot task. Only the
+  // first componentsStarted entries are updated from the loop.
+  static const uint8_t MAX_COMPONENTS = 4;
+  Component* components[MAX_COMPONENTS];
+  uint8_t componentCount;
+  std::atomic<uint8_t> componentsStarted;
+  
   static const uint32_t WAVEFORM_INTERVAL = 10;
   static const uint32_t PARAM_INTERVAL = 1000;
   
+  void addComponent(Component* component);
+  
+  static void backgroundBootTask(void* param);
+  void backgroundBoot();
+  
 public:
   CO2Emulator();
   void begin();
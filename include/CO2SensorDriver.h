@@ -0,0 +1,70 @@
+#ifndef CO2_SENSOR_DRIVER_H
+#define CO2_SENSOR_DRIVER_H
+
+#include <Arduino.h>
+#include "I2CBus.h"
+#include "Config.h"
+
+// One I2C CO2 sensor model. A reading is taken in two non-blocking steps:
+// startConversion() issues the command, and readResult() fetches the value
+// once getConversionMs() has elapsed. Values are returned in mmHg.
+class CO2SensorDriver {
+public:
+  virtual ~CO2SensorDriver() {}
+  
+  virtual const char* getName() const = 0;
+  virtual uint8_t getAddress() const = 0;
+  virtual uint32_t getMaxClockHz() const { return 400000; }
+  virtual uint32_t getIntervalMs() const = 0;     // native sample period
+  virtual uint32_t getConversionMs() const = 0;   // command to result delay
+  
+  virtual bool init(I2CBus& /*bus*/) { return true; }
+  virtual bool startConversion(I2CBus& bus) = 0;
+  virtual bool readResult(I2CBus& bus, float& co2Value) = 0;
+  
+  static float ppmToMmHg(float ppm) { return ppm * 760.0f / 1000000.0f; }
+  static uint8_t sensirionCRC(const uint8_t* data, size_t len);
+  static bool sensirionCommand(I2CBus& bus, uint8_t address, uint16_t cmd);
+  static bool sensirionCommand(I2CBus& bus, uint8_t address, uint16_t cmd, uint16_t arg);
+};
+
+// Template for a custom sensor: one-byte read command, 16-bit result in 0.01 mmHg
+class GenericCO2Driver : public CO2SensorDriver {
+public:
+  const char* getName() const override { return "generic"; }
+  uint8_t getAddress() const override { return I2C_SENSOR_ADDR; }
+  uint32_t getIntervalMs() const override { return 10; }
+  uint32_t getConversionMs() const override { return 10; }
+  
+  bool startConversion(I2CBus& bus) override;
+  bool readResult(I2CBus& bus, float& co2Value) override;
+};
+
+// Sensirion SCD30 (NDIR, 2 s interval, clock stretching limits it to 100 kHz)
+class SCD30Driver : public CO2SensorDriver {
+public:
+  const char* getName() const override { return "scd30"; }
+  uint8_t getAddress() const override { return 0x61; }
+  uint32_t getMaxClockHz() const override { return 100000; }
+  uint32_t getIntervalMs() const override { return 2000; }
+  uint32_t getConversionMs() const override { return 3; }
+  
+  bool init(I2CBus& bus) override;
+  bool startConversion(I2CBus& bus) override;
+  bool readResult(I2CBus& bus, float& co2Value) override;
+};
+
+// Sensirion SCD40/SCD41 (photoacoustic, 5 s periodic measurement)
+class SCD4xDriver : public CO2SensorDriver {
+public:
+  const char* getName() const override { return "scd4x"; }
+  uint8_t getAddress() const override { return 0x62; }
+  uint32_t getIntervalMs() const override { return 5000; }
+  uint32_t getConversionMs() const override { return 1; }
+  
+  bool init(I2CBus& bus) override;
+  bool startConversion(I2CBus& bus) override;
+  bool readResult(I2CBus& bus, float& co2Value) override;
+};
+
+#endif // CO2_SENSOR_DRIVER_H
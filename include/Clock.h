@@ -0,0 +1,25 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <Arduino.h>
+
+// Time source for everything that shapes the bytes the host sees: the
+// sample tick, the waveform, zeroing and receiver timeouts. On hardware it
+// follows millis(). A host harness can switch to virtual time and step it,
+// so a scripted session produces the same byte stream on every run, faster
+// than real time.
+class Clock {
+private:
+  static bool virtualTime;
+  static uint32_t virtualMs;
+  
+public:
+  static inline uint32_t nowMs() { return virtualTime ? virtualMs : millis(); }
+  static inline uint32_t nowUs() { return virtualTime ? virtualMs * 1000UL : micros(); }
+  
+  static void useVirtual(uint32_t startMs);
+  static void advance(uint32_t ms);
+  static bool isVirtual();
+};
+
+#endif // CLOCK_H
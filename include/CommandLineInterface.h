@@ -6,6 +6,19 @@
 #include "AlarmManager.h"
 #include "DeviceState.h"
 #include "ConfigStorage.h"
+#include "HeapMonitor.h"
+#include "BootLog.h"
+#include "I2CSensorInterface.h"
+#include "BinaryChannel.h"
+#include "ProtocolReceiver.h"
+#include "LoopStats.h"
+#include "MetricsExporter.h"
+#include "StateSnapshot.h"
+#include "WaveformRecorder.h"
+#include "WaveformPlayer.h"
+#include "PassthroughBridge.h"
+#include "FaultInjector.h"
+#include "SettingLimits.h"
 
 class CommandLineInterface {
 private:
@@ -14,16 +27,54 @@ private:
   DeviceState& device;
   ConfigStorage& storage;
   Stream& serial;
-  String lineBuffer;
+  HeapMonitor* heapMonitor;
+  BootLog* bootLog;
+  I2CSensorInterface* i2cSensor;
+  BinaryChannel* binary;
+  ProtocolReceiver* receiver;
+  LoopStats* loopStats;
+  WaveformRecorder* recorder;
+  WaveformPlayer* player;
+  MetricsExporter* metrics;
+  StateSnapshot* snapshot;
+  PassthroughBridge* bridge;
+  FaultInjector* faults;
+  ProtocolHandler* faultOwner;      // its lock guards the injector
+  
+  static const uint16_t LINE_BUFFER_SIZE = 2 * StateSnapshot::MAX_SIZE + 16;   // fits "snap <hex>"
+  char lineBuffer[LINE_BUFFER_SIZE];
+  uint16_t lineLength;
   
   void printHelp();
   void printStatus();
-  void processLine(String line);
+  void processLine(char* line);
+  ConfigStorage::Config currentConfig() const;
+  void settingChanged();
+  bool parseSetting(const char* arg, const SettingLimits::Range& range, float& value);
+  void handlePreset(char* arg);
+  void handleSensor(const char* name);
+  void handleRecorder(char* arg);
+  void handleSnapshot(char* arg);
+  void handleBridge(char* arg);
+  void handleFault(char* arg);
   
 public:
   CommandLineInterface(WaveformGenerator& wave, AlarmManager& alarm, 
                        DeviceState& dev, ConfigStorage& stor, Stream& ser);
   
+  void setHeapMonitor(HeapMonitor* monitor);
+  void setBootLog(BootLog* log);
+  void setI2CSensor(I2CSensorInterface* sensor);
+  void setBinaryChannel(BinaryChannel* channel);
+  void setProtocolReceiver(ProtocolReceiver* rx);
+  void setLoopStats(LoopStats* stats);
+  void setRecorder(WaveformRecorder* rec);
+  void setPlayer(WaveformPlayer* play);
+  void setMetrics(MetricsExporter* exporter);
+  void setSnapshot(StateSnapshot* snap);
+  void setBridge(PassthroughBridge* passthrough);
+  void setFaultInjector(FaultInjector* injector, ProtocolHandler* owner);
+  
   void update();
   void printWelcome();
 };
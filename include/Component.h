@@ -0,0 +1,15 @@
+#ifndef COMPONENT_H
+#define COMPONENT_H
+
+// Optional subsystem registered with CO2Emulator. begin() runs on the
+// background boot task; update() is called from the main loop once begin()
+// has returned. Builds that leave a component out never reference it.
+class Component {
+public:
+  virtual ~Component() {}
+  virtual const char* getName() const = 0;
+  virtual bool begin() = 0;
+  virtual void update() = 0;
+};
+
+#endif // COMPONENT_H
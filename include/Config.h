@@ -8,13 +8,26 @@
 #define BAUD_RATE_HOST 19200
 #define BAUD_RATE_CMD 115200
 
+// Passthrough bridge: a real sensor on a second UART, started on demand
+#define SENSOR_SERIAL Serial2
+#define SENSOR_RX_PIN 2
+#define SENSOR_TX_PIN 1
+
 // I2C Configuration (using default I2C pins for T-Display S3)
 #define I2C_SDA 43
 #define I2C_SCL 44
 #define I2C_SENSOR_ADDR 0x48
+#define I2C_CLOCK_HZ 400000
 
 // TFT Display pins (configured in platformio.ini build_flags)
+// Headless builds (-DHEADLESS_BUILD) leave out the display, WiFi and web server
+#ifdef HEADLESS_BUILD
+#define TFT_ENABLED false
+#define WEB_ENABLED false
+#else
 #define TFT_ENABLED true
+#define WEB_ENABLED true
+#endif
 
 // WiFi Configuration - CHANGE THESE!
 #define WIFI_AP_MODE true           // true = Access Point, false = Station
@@ -25,6 +38,18 @@
 #define WIFI_STA_SSID "YourSSID"
 #define WIFI_STA_PASSWORD "YourPassword"
 
+// Trend storage (ring buffers in PSRAM)
+#define TREND_RAW_SECONDS 300                        // 100 Hz samples
+#define TREND_RAW_CAPACITY (TREND_RAW_SECONDS * 100)
+#define TREND_BREATH_CAPACITY 14400                  // 4 h at 60 br/min
+#define TREND_MINUTE_CAPACITY 10080                  // 7 days
+
+// Waveform recorder (LittleFS). Records are staged in RAM and written one
+// flash block at a time; the oldest file is deleted past RECORDER_MAX_FILES.
+#define RECORDER_BUFFER_BYTES 4096
+#define RECORDER_MAX_FILE_BYTES (512UL * 1024)       // about 11 min at 100 Hz
+#define RECORDER_MAX_FILES 8
+
 // Protocol Constants
 namespace Protocol {
   const uint8_t CMD_CO2_WAVEFORM = 0x80;
@@ -45,6 +70,8 @@ namespace Protocol {
   const uint8_t NACK_INVALID_CMD = 1;
   const uint8_t NACK_CHECKSUM = 2;
   const uint8_t NACK_TIMEOUT = 3;
+  const uint8_t NACK_BYTE_COUNT = 4;
+  const uint8_t NACK_INVALID_DATA = 5;
 }
 
 #endif // CONFIG_H
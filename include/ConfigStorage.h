@@ -3,9 +3,17 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
+// Settings record and presets in NVS. The web server, the console and the
+// loop all save and load, so every NVS access and every use of the preset
+// table holds one recursive lock; autosaves are still written by update().
 class ConfigStorage {
 public:
+  // Fields are only ever appended; older records are migrated by keeping
+  // the fields their schema had and filling the rest with defaults (see
+  // schemaSize()).
   struct Config {
     float amplitude;
     float frequency;
@@ -16,16 +24,103 @@ public:
     bool alarmHighEnabled;
     bool alarmLowEnabled;
     bool useI2CSensor;
+    // v2
+    float rrHigh;
+    float rrLow;
+    bool rrHighEnabled;
+    bool rrLowEnabled;
+    bool alarmLatching;
+    // v3
+    uint8_t etco2TimePeriod;
+    uint8_t noBreathTimeout;
+    uint8_t co2Units;
+    uint8_t zeroGasType;
   };
   
+  static const uint16_t SCHEMA_VERSION = 3;
+  static const uint8_t MAX_PRESETS = 16;
+  static const uint8_t PRESET_NAME_LEN = 16;
+  
 private:
+  // On-flash layout of the single "config" blob
+  struct Record {
+    uint16_t magic;
+    uint16_t version;
+    uint16_t size;          // sizeof(Config) of the writer
+    uint16_t reserved;
+    uint32_t writeCount;
+    Config config;
+    uint32_t crc;           // CRC-32 of everything above
+  };
+  
+  // "presets" blob: header, then count x (name, Config of configSize
+  // bytes), then a CRC-32 of everything before it
+  struct PresetHeader {
+    uint16_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint16_t configSize;
+  };
+  
+  struct Preset {
+    char name[PRESET_NAME_LEN];
+    Config config;
+  };
+  
+  static const uint16_t RECORD_MAGIC = 0xC02E;
+  static const uint16_t PRESET_MAGIC = 0xC02F;
+  static const uint32_t AUTOSAVE_DELAY_MS = 2000;
+  
   Preferences prefs;
+  SemaphoreHandle_t lock;
+  uint32_t writeCount;
+  bool autosave;
+  volatile bool savePending;
+  uint32_t lastChangeTime;
+  Config pending;
+  portMUX_TYPE pendingMux;
+  
+  Preset presets[MAX_PRESETS];
+  uint8_t presetCount;
+  Config staged;
+  volatile bool stagedReady;
+  
+  static size_t schemaSize(uint16_t version);
+  bool readRecord(Config& cfg);
+  bool migrateLegacyKeys(Config& cfg);
+  void writeRecord(const Config& cfg);
+  void loadPresets();
+  void writePresets();
+  int findPreset(const char* name) const;
   
 public:
+  ConfigStorage();
+  
   bool begin();
   void saveConfig(const Config& cfg);
   Config loadConfig();
   void clearConfig();
+  
+  void setAutosave(bool enable);
+  bool isAutosaveEnabled() const;
+  void requestSave(const Config& cfg);
+  void update();
+  
+  // Names are case-insensitive and stored in lower case, as the console
+  // types them; one that does not fit PRESET_NAME_LEN is rejected
+  static bool isValidPresetName(const char* name);
+  bool savePreset(const char* name, const Config& cfg);
+  bool getPreset(const char* name, Config& cfg) const;
+  bool deletePreset(const char* name);
+  uint8_t getPresetCount() const;
+  uint8_t getPresetNames(char names[][PRESET_NAME_LEN]) const;   // MAX_PRESETS rows
+  
+  void stageConfig(const Config& cfg);
+  bool takeStagedConfig(Config& cfg);
+  
+  uint32_t getWriteCount() const;
+  static Config defaults();
+  static uint32_t crc32(const uint8_t* data, size_t len, uint32_t crc = 0);
 };
 
 #endif // CONFIG_STORAGE_H
@@ -0,0 +1,26 @@
+#ifndef COUNTER_H
+#define COUNTER_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Monotonic event counter for /metrics. Each counter has a single writer
+// at a time (its owning task, or the protocol lock), so an increment is a
+// relaxed load, add and store: no lock and no compare-and-swap loop on the
+// hot path. Readers on other tasks always see a whole 32-bit value. The
+// value wraps at 2^32, which a scraper treats as a counter reset.
+class Counter {
+private:
+  std::atomic<uint32_t> value;
+
+public:
+  Counter() : value(0) {}
+
+  inline void inc() { add(1); }
+  inline void add(uint32_t n) {
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+  inline uint32_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+#endif // COUNTER_H
@@ -2,6 +2,9 @@
 #define DEVICE_STATE_H
 
 #include <Arduino.h>
+#include "ConfigStorage.h"
+#include "FixedPoint.h"
+#include "StateRecord.h"
 
 class DeviceState {
 private:
@@ -17,6 +20,9 @@ private:
   uint8_t etco2TimePeriod;
   uint8_t noBreathTimeout;
   uint8_t co2Units;
+  uint8_t sleepMode;
+  uint8_t zeroGasType;
+  uint32_t co2Scale;        // Q16 factor from mmHg to co2Units
   
   bool zeroInProgress;
   uint32_t zeroStartTime;
@@ -29,7 +35,11 @@ private:
   uint16_t respRate;
   uint16_t inspCO2;
   
+  void updateCO2Scale();
+  
 public:
+  enum CO2Unit : uint8_t { UNITS_MMHG = 0, UNITS_PERCENT = 1, UNITS_KPA = 2 };
+  
   DeviceState();
   
   void startContinuousMode();
@@ -38,6 +48,7 @@ public:
   bool isInitialized() const;
   
   uint8_t getAndIncrementSync();
+  uint8_t skipSync(uint8_t count);    // returns the wraps past 127 it made
   
   void setBarometricPressure(uint16_t value);
   uint16_t getBarometricPressure() const;
@@ -53,6 +64,14 @@ public:
   
   void setCO2Units(uint8_t value);
   uint8_t getCO2Units() const;
+  // mmHg value (any fixed-point resolution) in the host's selected unit
+  uint32_t toCO2Units(uint32_t mmHg) const { return FixedPoint::scaleQ16(mmHg, co2Scale); }
+  
+  void setSleepMode(uint8_t value);
+  uint8_t getSleepMode() const;
+  
+  void setZeroGasType(uint8_t value);
+  uint8_t getZeroGasType() const;
   
   void setGasCompensations(uint8_t o2, uint8_t balance, uint16_t anesthetic);
   uint8_t getO2Compensation() const;
@@ -76,6 +95,14 @@ public:
   uint16_t getETCO2() const;
   uint16_t getRespRate() const;
   uint16_t getInspCO2() const;
+  
+  // Host settings the sensor keeps across power cycles
+  void loadFromConfig(const ConfigStorage::Config& cfg);
+  void saveToConfig(ConfigStorage::Config& cfg) const;
+  
+  // Everything, including zero and sync progress, for StateSnapshot
+  void captureState(DeviceSnapshot& s, uint32_t now) const;
+  void restoreState(const DeviceSnapshot& s, uint32_t now);
 };
 
 #endif // DEVICE_STATE_H
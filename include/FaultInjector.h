@@ -0,0 +1,90 @@
+#ifndef FAULT_INJECTOR_H
+#define FAULT_INJECTOR_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "Counter.h"
+
+// Damages outgoing protocol traffic on purpose: bad checksums, dropped
+// packets, sync counter jumps, delayed packets, truncated frames and
+// unsolicited NACKs. Each fault fires with a probability, on every Nth
+// packet, or both. The xorshift32 generator is seeded explicitly, so a
+// seed and a schedule give the same faults on every run. While no fault
+// is configured ProtocolHandler only tests isArmed() and the packet goes
+// out untouched.
+class FaultInjector {
+public:
+  enum Fault : uint8_t {
+    FAULT_CHECKSUM = 0, FAULT_DROP, FAULT_SYNC_JUMP, FAULT_DELAY, FAULT_TRUNCATE, FAULT_NACK, FAULT_COUNT
+  };
+  static const uint16_t PROBABILITY_SCALE = 10000;   // probabilities in units of 0.01 %
+  static const uint8_t MAX_FRAME = 64;
+  static const uint32_t DEFAULT_SEED = 0x2545F491;
+  static const uint16_t DEFAULT_DELAY_MS = 250;
+  
+  struct Rule {
+    uint16_t probability;           // per PROBABILITY_SCALE packets
+    uint16_t every;                 // every Nth packet; 0 = no schedule
+  };
+  
+  // What happens to one packet beyond the bytes changed in place
+  struct Action {
+    bool drop;
+    bool delay;
+    uint8_t syncJump;               // extra packets skipped by the sync counter
+    uint8_t nackCode;               // unsolicited NACK after the packet; 0 = none
+  };
+  
+private:
+  enum SlotState : uint8_t { SLOT_EMPTY = 0, SLOT_FULL };
+  
+  Rule rules[FAULT_COUNT];
+  uint32_t eligible[FAULT_COUNT];   // packets a schedule has counted
+  Counter injected[FAULT_COUNT];
+  std::atomic<bool> armed;
+  uint32_t seed;
+  uint32_t state;
+  uint16_t delayMs;
+  
+  // One packet held back by FAULT_DELAY; filled under the protocol lock,
+  // sent by the loop
+  uint8_t delayed[MAX_FRAME];
+  uint8_t delayedLen;
+  uint32_t delayedDue;
+  std::atomic<uint8_t> delayedState;
+  
+  uint32_t next();
+  bool fires(uint8_t fault, bool applicable);
+  void rearm();
+  
+public:
+  FaultInjector();
+  
+  inline bool isArmed() const { return armed.load(std::memory_order_relaxed); }
+  
+  // Called by the protocol with a copy of the packet; may change the bytes
+  // and shorten len
+  void inject(uint8_t* frame, uint8_t& len, Action& action);
+  
+  bool defer(const uint8_t* frame, uint8_t len, uint32_t now);
+  bool takeDue(uint32_t now, uint8_t* frame, uint8_t& len);
+  
+  void setRule(uint8_t fault, uint16_t probability, uint16_t every);
+  const Rule& getRule(uint8_t fault) const { return rules[fault]; }
+  void clear();
+  void setSeed(uint32_t value);     // also restarts the schedules
+  uint32_t getSeed() const { return seed; }
+  void setDelayMs(uint16_t ms) { delayMs = ms; }
+  uint16_t getDelayMs() const { return delayMs; }
+  uint32_t getInjected(uint8_t fault) const { return injected[fault].get(); }
+  
+  static const char* faultName(uint8_t fault);
+  static int8_t findFault(const char* name);
+  // Text from the console or the web: a percentage from 0 to 100, and a
+  // whole schedule count that fits Rule::every
+  static bool parsePercent(const char* text, uint16_t& probability);
+  static bool parseEvery(const char* text, uint16_t& every);
+  void printStatus(Print& out) const;
+};
+
+#endif // FAULT_INJECTOR_H
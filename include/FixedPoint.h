@@ -0,0 +1,25 @@
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include <Arduino.h>
+
+// Integer helpers for the sample path. CO2 travels from the generator to
+// the packet encoder as centi-units (0.01 mmHg, or 0.01 of the host's unit
+// after scaling), so host and target produce identical bytes.
+namespace FixedPoint {
+  const uint32_t SCALE_ONE = 1UL << 16;          // Q16 1.0
+
+  // Q15 sine of a 32-bit phase (2^32 = one cycle), from a quarter-wave
+  // table with linear interpolation
+  int16_t sinQ15(uint32_t phase);
+
+  // Converts once at the float boundary (UI, config, I2C sensor)
+  inline int32_t toCenti(float value) { return lroundf(value * 100.0f); }
+
+  // value * scale in Q16, rounded; value must not be negative
+  inline uint32_t scaleQ16(uint32_t value, uint32_t scale) {
+    return (uint32_t)(((uint64_t)value * scale + (SCALE_ONE >> 1)) >> 16);
+  }
+}
+
+#endif // FIXED_POINT_H
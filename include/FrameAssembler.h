@@ -0,0 +1,41 @@
+#ifndef FRAME_ASSEMBLER_H
+#define FRAME_ASSEMBLER_H
+
+#include <Arduino.h>
+
+// Capnostat framing, shared by the host receiver and the passthrough
+// bridge: a command byte (bit 7 set), NBF, NBF - 1 data bytes and a
+// checksum. feed() only reassembles; what a frame or an error means is
+// up to the caller.
+class FrameAssembler {
+public:
+  static const uint8_t FRAME_SIZE = 64;
+  static const uint32_t BYTE_TIMEOUT_MS = 500;
+  
+  enum Result : uint8_t {
+    FRAME_NONE,           // byte consumed, no frame yet
+    FRAME_COMPLETE,       // frame()/frameLength() hold a whole frame
+    FRAME_TIMEOUT,        // gap inside a frame; the partial frame and this byte are dropped
+    FRAME_BAD_LENGTH      // NBF out of range; the partial frame is dropped
+  };
+  
+private:
+  uint8_t buffer[FRAME_SIZE];
+  uint8_t index;
+  uint8_t completeLength;
+  uint32_t lastByteTime;
+  
+public:
+  FrameAssembler() : index(0), completeLength(0), lastByteTime(0) {}
+  
+  Result feed(uint8_t b, uint32_t now);
+  
+  // Bytes of the frame in progress. After an error they are still in
+  // frame() until the next byte is fed.
+  uint8_t pending() const { return index; }
+  
+  uint8_t* frame() { return buffer; }
+  uint8_t frameLength() const { return completeLength; }
+};
+
+#endif // FRAME_ASSEMBLER_H
@@ -0,0 +1,31 @@
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include <Arduino.h>
+
+// Heap telemetry plus a per-tick allocation check. The check is only armed
+// in builds with HEAP_ALLOC_TRACKING (see the alloccheck env), where
+// malloc/calloc/realloc are wrapped at link time.
+class HeapMonitor {
+private:
+  uint32_t tickAllocBase;
+  uint32_t tickViolations;
+  uint32_t lastViolationAllocs;
+  
+public:
+  HeapMonitor();
+  
+  void beginTick();
+  void endTick();
+  
+  uint32_t getFreeHeap() const;
+  uint32_t getMinFreeHeap() const;
+  uint32_t getLargestFreeBlock() const;
+  uint8_t getFragmentation() const;
+  uint32_t getAllocationCount() const;
+  uint32_t getTickViolations() const;
+  
+  void printReport(Print& out) const;
+};
+
+#endif // HEAP_MONITOR_H
@@ -0,0 +1,35 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <Arduino.h>
+#include <Wire.h>
+
+// Minimal I2C transaction interface so sensor code can run against a
+// mock bus in a host build. Each call is one complete bus transaction.
+class I2CBus {
+public:
+  virtual ~I2CBus() {}
+  virtual bool begin(uint32_t clockHz) = 0;
+  virtual void setClock(uint32_t clockHz) = 0;
+  virtual bool probe(uint8_t address) = 0;
+  virtual bool write(uint8_t address, const uint8_t* data, size_t len) = 0;
+  virtual bool read(uint8_t address, uint8_t* data, size_t len) = 0;
+};
+
+class WireBus : public I2CBus {
+private:
+  TwoWire& wire;
+  int sda;
+  int scl;
+  
+public:
+  WireBus(TwoWire& w, int sdaPin, int sclPin);
+  
+  bool begin(uint32_t clockHz) override;
+  void setClock(uint32_t clockHz) override;
+  bool probe(uint8_t address) override;
+  bool write(uint8_t address, const uint8_t* data, size_t len) override;
+  bool read(uint8_t address, uint8_t* data, size_t len) override;
+};
+
+#endif // I2C_BUS_H
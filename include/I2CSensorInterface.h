@@ -2,26 +2,82 @@
 #define I2C_SENSOR_INTERFACE_H
 
 #include <Arduino.h>
-#include <Wire.h>
+#include <atomic>
+#include "I2CBus.h"
+#include "CO2SensorDriver.h"
+#include "Resampler.h"
+#include "Counter.h"
 #include "Config.h"
 
+// Polls the selected sensor driver with a non-blocking state machine:
+// update() performs at most one short bus transaction per call and never
+// waits for the conversion. The driver, resampler and reading state belong
+// to the task calling update(); it publishes the resampled 100 Hz value as
+// a single atomic word, which getSample() reads from any task. While the
+// selected sensor is absent it is probed again every REPROBE_MS, so one
+// plugged in after boot is picked up without a restart.
 class I2CSensorInterface {
+public:
+  static const uint8_t DRIVER_COUNT = 3;
+  static const int8_t DRIVER_AUTO = -1;
+  
 private:
-  uint8_t address;
-  bool available;
-  float lastReading;
+  enum State : uint8_t { STATE_IDLE, STATE_CONVERTING };
+  
+  I2CBus& bus;
+  GenericCO2Driver genericDriver;
+  SCD30Driver scd30Driver;
+  SCD4xDriver scd4xDriver;
+  CO2SensorDriver* drivers[DRIVER_COUNT];
+  CO2SensorDriver* driver;
+  Resampler resampler;
+  std::atomic<int8_t> requestedDriver;
+  int8_t selection;         // DRIVER_AUTO or the forced driver
+  
+  std::atomic<bool> available;
+  State state;
+  uint32_t requestTime;
+  uint32_t probeTime;
+  uint32_t lastUpdateTime;
   uint32_t lastReadTime;
+  bool hasReading;
+  bool staleCounted;        // the current reading has been counted stale
+  std::atomic<float> lastReading;
+  std::atomic<int32_t> sampleCenti;   // NO_SAMPLE when absent or stale
   
-  bool readSensorData(float& co2Value);
+  Counter readCount;
+  Counter failedCount;
+  Counter staleCount;
+  
+  static const uint32_t STALE_MS = 100;
+  static const uint32_t REPROBE_MS = 1000;
+  static const int8_t NO_REQUEST = -2;
+  static const int32_t NO_SAMPLE = INT32_MIN;
+  
+  bool selectDriver(int8_t index, uint32_t now);
+  void printFound() const;
+  void poll(uint32_t now);
+  void publish(uint32_t now);
   
 public:
-  I2CSensorInterface(uint8_t addr = I2C_SENSOR_ADDR);
+  I2CSensorInterface(I2CBus& i2cBus);
   
   bool begin();
+  void update(uint32_t now);
   bool isAvailable() const;
-  bool getSample(float& co2Value);
+  bool getSample(int32_t& co2Centi) const;    // 0.01 mmHg
   float getLastReading() const;
-  uint32_t getLastReadTime() const;
+  
+  // Driver selection; safe to call from any task, applied by update()
+  void requestDriver(int8_t index);
+  int8_t findDriver(const char* name) const;
+  const char* getDriverName(uint8_t index) const;
+  const char* getActiveDriverName() const;
+  
+  uint32_t getReadCount() const;
+  uint32_t getFailedCount() const;
+  uint32_t getStaleCount() const;
+  void printStats(Print& out) const;
 };
 
 #endif // I2C_SENSOR_INTERFACE_H
@@ -0,0 +1,43 @@
+#ifndef ISB_REGISTRY_H
+#define ISB_REGISTRY_H
+
+#include <Arduino.h>
+#include "DeviceState.h"
+#include "PacketBuilder.h"
+
+// Capnostat 5 Get/Set Settings (0x84) described as data. The table in
+// IsbRegistry.cpp has one entry per ISB and is indexed directly by the ISB
+// number; decode, range checks, encode and the trace decoder all read it.
+namespace IsbRegistry {
+  const uint8_t COUNT = 20;          // ISBs 0..19
+  const uint8_t MAX_FIELDS = 3;
+
+  struct Field {
+    const char* name;
+    uint8_t width;                   // data bytes: 1, or 2 for a 14-bit value
+    uint16_t min;
+    uint16_t max;
+  };
+
+  struct Entry {
+    uint8_t fieldCount;              // 0 with no text: ISB not supported
+    Field fields[MAX_FIELDS];
+    bool persistent;                 // saved with the configuration on write
+    void (*set)(DeviceState&, const uint16_t* values);   // nullptr: read-only
+    void (*get)(const DeviceState&, uint16_t* values);
+    const char* text;                // fixed ASCII reply in place of fields
+  };
+
+  const Entry* find(uint8_t isb);    // nullptr if the ISB is not supported
+  uint8_t dataLength(const Entry& entry);
+
+  // Decodes a write into one value per field. False if a byte has the
+  // high bit set or a value is out of range.
+  bool decode(const Entry& entry, const uint8_t* data, uint16_t* values);
+  // Limits a value from another source (stored config, snapshot) to the
+  // range of field `field` of the ISB; unchanged if there is no such field
+  uint16_t clamp(uint8_t isb, uint16_t value, uint8_t field = 0);
+  void encode(const Entry& entry, const DeviceState& device, PacketBuilder& packet);
+}
+
+#endif // ISB_REGISTRY_H
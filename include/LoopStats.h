@@ -0,0 +1,31 @@
+#ifndef LOOP_STATS_H
+#define LOOP_STATS_H
+
+#include <Arduino.h>
+
+// Duration of each main-loop pass, for comparing build variants
+class LoopStats {
+private:
+  uint32_t startUs;
+  uint32_t count;
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint64_t totalUs;
+  uint32_t over1ms;
+  uint32_t lastUs;
+  
+public:
+  LoopStats();
+  
+  void beginPass() { startUs = micros(); }
+  void endPass();
+  void reset();
+  uint32_t getCount() const { return count; }
+  uint32_t getMaxUs() const { return maxUs; }
+  uint32_t getMeanUs() const { return count ? (uint32_t)(totalUs / count) : 0; }
+  uint32_t getOver1ms() const { return over1ms; }
+  uint32_t getLastUs() const { return lastUs; }
+  void print(Print& out) const;
+};
+
+#endif // LOOP_STATS_H
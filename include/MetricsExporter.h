@@ -0,0 +1,38 @@
+#ifndef METRICS_EXPORTER_H
+#define METRICS_EXPORTER_H
+
+#include <Arduino.h>
+#include "ProtocolHandler.h"
+#include "ProtocolReceiver.h"
+#include "AlarmManager.h"
+#include "LoopStats.h"
+#include "HeapMonitor.h"
+
+// Prometheus text exposition (format 0.0.4) of the emulator's counters.
+// The counters stay with the modules that own them; this only reads them,
+// so a scrape costs the hot path nothing. Output goes to any Print, so the
+// same text serves /metrics and the serial console.
+class MetricsExporter {
+private:
+  const ProtocolHandler& protocol;
+  const ProtocolReceiver& receiver;
+  const AlarmManager& alarms;
+  const LoopStats& loopStats;
+  const HeapMonitor& heap;
+
+  static void header(Print& out, const char* name, const char* type, const char* help);
+  static void counter(Print& out, const char* name, const char* help, uint32_t value);
+
+public:
+  static const char* const CONTENT_TYPE;
+
+  MetricsExporter(const ProtocolHandler& proto, const ProtocolReceiver& rx, const AlarmManager& alarm,
+                  const LoopStats& loop, const HeapMonitor& heapMonitor);
+
+  void write(Print& out) const;
+
+  // For metrics owned by callers (e.g. the web server's client count)
+  static void gauge(Print& out, const char* name, const char* help, uint32_t value);
+};
+
+#endif // METRICS_EXPORTER_H
@@ -15,10 +15,14 @@ public:
   void addByte(uint8_t b);
   void addCommand(uint8_t cmd);
   void add2ByteValue(uint16_t value);
-  void addCO2Waveform(float co2Value);
+  void addCO2Waveform(int32_t co2Centi);   // 0.01 units, saturated to the 14-bit field
   void finalize();
   void send(Stream& serial);
   
+  const uint8_t* getBuffer() const;
+  uint8_t getLength() const;
+  
+  static uint16_t encodeCO2Waveform(int32_t co2Centi);
   static uint8_t calculateChecksum(const uint8_t* buf, uint8_t len);
   static uint16_t decode2Bytes(uint8_t b1, uint8_t b2);
 };
@@ -0,0 +1,92 @@
+#ifndef PASSTHROUGH_BRIDGE_H
+#define PASSTHROUGH_BRIDGE_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "FrameAssembler.h"
+#include "ProtocolReceiver.h"
+#include "ProtocolTrace.h"
+#include "Counter.h"
+
+// Sits between a real sensor and the host. Each direction is serviced
+// on the receive event task of its input UART, raised for every byte,
+// and written straight to the other UART before it is parsed, so the
+// loop never sees the traffic. Both directions are framed with the
+// receiver's FrameAssembler and recorded in the protocol trace.
+// Optionally the sensor's waveform frames are rewritten (CO2 value
+// replaced, status bits set) and their checksum recomputed; only those
+// frames are then held until complete.
+class PassthroughBridge {
+public:
+  static const uint8_t CHUNK_SIZE = 32;
+  static const uint8_t DRIVER_RX_FIFO_FULL = 120;   // UART driver default
+  
+private:
+  enum Request : uint8_t { REQUEST_NONE = 0, REQUEST_START, REQUEST_STOP };
+  
+  // One direction, touched only by the event task of its input UART
+  struct Link {
+    HardwareSerial& in;
+    HardwareSerial& out;
+    ProtocolTrace::Direction dir;
+    FrameAssembler frames;
+    bool holding;                   // current frame held back for rewriting
+    Counter bytes;
+    Counter frameCount;
+    Counter badChecksums;
+    uint32_t maxServiceUs;
+    
+    Link(HardwareSerial& i, HardwareSerial& o, ProtocolTrace::Direction d)
+      : in(i), out(o), dir(d), holding(false), maxServiceUs(0) {}
+  };
+  
+  Link toSensor;                    // host commands
+  Link toHost;                      // sensor replies and waveform
+  ProtocolTrace& trace;
+  ProtocolReceiver& receiver;
+  bool sensorStarted;
+  std::atomic<bool> active;
+  std::atomic<uint8_t> requested;
+  
+  std::atomic<bool> replaceWave;
+  std::atomic<int32_t> replacement;  // device units, published by the loop
+  std::atomic<uint32_t> statusMask;  // ORed into status bytes 1..3
+  Counter rewritten;
+  
+  void start();
+  void stop();
+  void pump(Link& link, bool rewriting);
+  void hold(Link& link, uint8_t b, uint32_t now);
+  void frameDone(Link& link, const uint8_t* frame, uint8_t len);
+  bool rewrite(uint8_t* frame, uint8_t len);
+  bool isRewriting() const;
+  static void printLink(Print& out, const char* name, const Link& link);
+  
+public:
+  PassthroughBridge(HardwareSerial& host, HardwareSerial& sensor, ProtocolTrace& protocolTrace,
+                    ProtocolReceiver& rx);
+  
+  // Any task; applied by update() on the loop
+  void requestStart() { requested = REQUEST_START; }
+  void requestStop() { requested = REQUEST_STOP; }
+  void update();
+  bool isActive() const { return active; }
+  
+  void setReplaceWaveform(bool on) { replaceWave = on; }
+  bool isReplacingWaveform() const { return replaceWave; }
+  void setStatusMask(uint8_t byte1, uint8_t byte2, uint8_t byte3);
+  uint8_t getStatusMask(uint8_t byte) const { return (statusMask >> (8 * byte)) & 0x7F; }
+  void publishSample(int32_t co2Units) { replacement.store(co2Units, std::memory_order_relaxed); }
+  
+  uint32_t getBytesToSensor() const { return toSensor.bytes.get(); }
+  uint32_t getBytesToHost() const { return toHost.bytes.get(); }
+  uint32_t getFramesToSensor() const { return toSensor.frameCount.get(); }
+  uint32_t getFramesToHost() const { return toHost.frameCount.get(); }
+  uint32_t getBadChecksums() const { return toSensor.badChecksums.get() + toHost.badChecksums.get(); }
+  uint32_t getRewritten() const { return rewritten.get(); }
+  uint32_t getMaxServiceUs() const;
+  
+  void printStatus(Print& out) const;
+};
+
+#endif // PASSTHROUGH_BRIDGE_H
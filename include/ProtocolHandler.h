@@ -2,32 +2,88 @@
 #define PROTOCOL_HANDLER_H
 
 #include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include "DeviceState.h"
 #include "WaveformGenerator.h"
 #include "AlarmManager.h"
 #include "PacketBuilder.h"
+#include "ProtocolTrace.h"
+#include "ConfigStorage.h"
+#include "IsbRegistry.h"
+#include "Counter.h"
+#include "FaultInjector.h"
 #include "Config.h"
 
 class ProtocolHandler {
+public:
+  // Transmitted packets are counted per command
+  enum PacketKind : uint8_t {
+    PK_WAVEFORM = 0, PK_ZERO, PK_SETTINGS, PK_STOP, PK_REVISION,
+    PK_CAPS, PK_RESET_NO_BREATH, PK_NACK, PK_OTHER, PK_COUNT
+  };
+  static const uint8_t NACK_REASONS = 6;   // indexed by NACK code; 0 = unknown
+  
+  // Every writer holds the protocol lock, so each counter has one writer
+  struct Stats {
+    Counter packetsTx[PK_COUNT];
+    Counter nacks[NACK_REASONS];
+    Counter bytesTx;
+    Counter commandsRx;
+    Counter syncWraps;
+    Counter zeroStarted;
+    Counter zeroRejected;
+  };
+  
 private:
   DeviceState& device;
   WaveformGenerator& waveform;
   AlarmManager& alarms;
   Stream& serial;
+  ProtocolTrace& trace;
+  ConfigStorage* storage;   // optional; persistent ISB writes are saved here
+  std::atomic<bool> saveRequested;   // by a persistent ISB write, for update()
+  SemaphoreHandle_t lock;   // recursive; commands arrive on the UART event task
+  FaultInjector* faults;    // optional; tested once per packet
+  Stats stats;
+  bool awaitingReply;       // set while a host command is dispatched
+  uint32_t replyUs;         // micros() when its reply was queued to the UART
   
-  void sendNACK(uint8_t errorCode);
+  void transmit(const PacketBuilder& packet);
+  void transmitFaulted(const PacketBuilder& packet);
+  void write(const uint8_t* data, uint8_t len);
   void sendSimpleResponse(uint8_t cmd);
   void handleGetRevision(uint8_t format);
   void handleSensorCapabilities(uint8_t sci, uint8_t scb);
   void handleGetSetSettings(uint8_t isb, const uint8_t* data, uint8_t dataLen);
   void handleZero();
+  void dispatchCommand(const uint8_t* buf, uint8_t len);
+  ConfigStorage::Config currentConfig() const;
   
 public:
   ProtocolHandler(DeviceState& dev, WaveformGenerator& wave, 
-                  AlarmManager& alarm, Stream& ser);
+                  AlarmManager& alarm, Stream& ser, ProtocolTrace& tr);
   
+  void begin();
+  void setConfigStorage(ConfigStorage* stor);
+  void setFaultInjector(FaultInjector* injector);
+  void update(uint32_t now);         // loop: delayed fault packets, ISB saves
+  void sendNACK(uint8_t errorCode);  
   void sendWaveformPacket(bool includeDPI, uint8_t dpiType);
-  void processCommand(uint8_t* buf, uint8_t len);
+  void sendWaveformPacket(int32_t co2Centi, bool includeDPI, uint8_t dpiType);   // 0.01 mmHg
+  // True if a reply was queued for the UART; getReplyUs() says when
+  bool processCommand(const uint8_t* buf, uint8_t len);
+  uint32_t getReplyUs() const { return replyUs; }
+  
+  // Keeps host commands and packets out while state is captured or replaced
+  void beginExclusive();
+  void endExclusive();
+  
+  const Stats& getStats() const { return stats; }
+  const FaultInjector* getFaultInjector() const { return faults; }
+  static PacketKind packetKind(uint8_t cmd);
+  static const char* packetKindName(uint8_t kind);
 };
 
 #endif // PROTOCOL_HANDLER_H
@@ -3,18 +3,46 @@
 
 #include <Arduino.h>
 #include "ProtocolHandler.h"
+#include "FrameAssembler.h"
+#include "Counter.h"
 
+// Reassembles host frames byte by byte. feed() is the whole parser, so it
+// can be driven from any byte source (serial, a replay file, a fuzzer).
+// On hardware, begin() hooks the UART receive event, so frames are handled
+// on the high-priority event task instead of waiting for the next loop.
 class ProtocolReceiver {
+public:
+  static const uint8_t LATENCY_BUCKETS = 8;
+  
 private:
-  uint8_t buffer[64];
-  uint8_t index;
-  uint32_t lastByteTime;
+  FrameAssembler frames;
   ProtocolHandler& handler;
-  Stream& serial;
+  HardwareSerial& serial;
+  bool eventDriven;
+  uint32_t byteUs;          // one character time on the wire (10 bits)
+  Counter bytesRx;
+  
+  // Latency from the last byte of a command arriving to its reply being
+  // queued for the UART, in microseconds
+  static const uint32_t LATENCY_BOUNDS[LATENCY_BUCKETS - 1];
+  uint32_t latencyCounts[LATENCY_BUCKETS];
+  uint32_t latencyMax;
+  uint32_t latencyTotal;
+  uint32_t latencySamples;
+  
+  void drain();
+  void recordLatency(uint32_t us);
   
 public:
-  ProtocolReceiver(ProtocolHandler& h, Stream& ser);
+  ProtocolReceiver(ProtocolHandler& h, HardwareSerial& ser);
+  void begin();
   void update();
+  bool feed(uint8_t b, uint32_t now);
+  void feed(const uint8_t* data, size_t len, uint32_t now);
+  
+  uint32_t getBytesReceived() const { return bytesRx.get(); }
+  void printLatency(Print& out) const;
+  void resetLatency();
 };
 
 #endif // PROTOCOL_RECEIVER_H
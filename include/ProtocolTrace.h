@@ -0,0 +1,60 @@
+#ifndef PROTOCOL_TRACE_H
+#define PROTOCOL_TRACE_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "Clock.h"
+
+// Lock-free ring of raw protocol frames. Writers claim a slot with one
+// atomic increment and copy the frame; decoding happens on the reader
+// side (web task), so the protocol path only pays for the copy.
+class ProtocolTrace {
+public:
+  static const uint8_t MAX_FRAME = 24;     // longer frames are truncated
+  static const uint16_t CAPACITY = 256;    // power of two
+  
+  enum Direction : uint8_t { DIR_RX, DIR_TX };
+  
+  struct Entry {
+    uint32_t time;                         // Clock::nowUs()
+    uint8_t dir;
+    uint8_t len;                           // original frame length
+    bool truncated;                        // only MAX_FRAME bytes were kept
+    uint8_t data[MAX_FRAME];
+  };
+  
+private:
+  struct Slot {
+    std::atomic<uint32_t> seq;
+    Entry entry;
+  };
+  
+  Slot slots[CAPACITY];
+  std::atomic<uint32_t> head;
+  
+public:
+  ProtocolTrace();
+  
+  inline void record(Direction dir, const uint8_t* frame, uint8_t len) {
+    uint32_t seq = head.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots[seq & (CAPACITY - 1)];
+    slot.seq.store(UINT32_MAX, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.entry.time = Clock::nowUs();
+    slot.entry.dir = dir;
+    slot.entry.len = len;
+    slot.entry.truncated = len > MAX_FRAME;
+    memcpy(slot.entry.data, frame, len < MAX_FRAME ? len : MAX_FRAME);
+    slot.seq.store(seq, std::memory_order_release);
+  }
+  
+  uint32_t getHead() const;
+  uint32_t getOldest() const;
+  bool read(uint32_t seq, Entry& out) const;
+  
+  static bool isWaveform(const Entry& e);
+  static bool checksumOk(const Entry& e);   // not meaningful for truncated entries
+  static size_t describe(const Entry& e, char* out, size_t len);
+};
+
+#endif // PROTOCOL_TRACE_H
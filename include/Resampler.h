@@ -0,0 +1,27 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <Arduino.h>
+
+// Turns slow, irregular sensor readings into a smooth 100 Hz stream with
+// Catmull-Rom interpolation over the last three readings. Output lags the
+// sensor by one reading interval so the curve always runs between two
+// known points; the tangent at the newest point uses a mirrored ghost.
+class Resampler {
+private:
+  float points[3];
+  uint32_t times[3];
+  uint8_t count;
+  uint32_t nativeInterval;
+  
+  static const uint32_t PASSTHROUGH_MS = 10;  // At or above the output rate
+  
+public:
+  Resampler();
+  
+  void reset(uint32_t nativeIntervalMs);
+  void push(uint32_t time, float value);
+  bool sample(uint32_t now, float& out) const;
+};
+
+#endif // RESAMPLER_H
@@ -0,0 +1,27 @@
+#ifndef SETTING_LIMITS_H
+#define SETTING_LIMITS_H
+
+#include <Arduino.h>
+
+// Accepted ranges of the waveform and alarm settings. The CLI, web API,
+// binary channel and snapshot restore all check against these, so a value
+// refused on one path is refused on every path. CO2 is in mmHg.
+namespace SettingLimits {
+  struct Range {
+    float min;
+    float max;
+  };
+
+  constexpr Range AMPLITUDE = { 0, 150 };      // the waveform encodes up to ~153 mmHg
+  constexpr Range FREQUENCY = { 0, 2.5 };      // Hz; 150 breaths/min
+  constexpr Range BASELINE = { -150, 150 };
+  constexpr Range PHASE = { -360, 360 };       // degrees
+  constexpr Range ETCO2_ALARM = { 0, 150 };
+  constexpr Range RR_ALARM = { 0, 150 };       // breaths/min
+
+  // False for NaN and infinities as well
+  inline bool inRange(const Range& r, float value) { return value >= r.min && value <= r.max; }
+  inline bool phaseRadiansInRange(float radians) { return inRange(PHASE, radians * 180.0f / PI); }
+}
+
+#endif // SETTING_LIMITS_H
@@ -0,0 +1,82 @@
+#ifndef STATE_RECORD_H
+#define STATE_RECORD_H
+
+#include <Arduino.h>
+
+// On-wire layout of a state snapshot (see StateSnapshot). Fixed-width
+// fields with natural alignment, so the layout is the same on the ESP32
+// and on a little-endian host. Fields are only ever appended to
+// SnapshotState; a shorter record from an older build restores what it
+// has. Durations are relative to the capture, not absolute times.
+
+struct DeviceSnapshot {
+  bool continuousMode;
+  bool initialized;
+  bool zeroInProgress;
+  bool compensationsSet;
+  uint8_t syncCounter;
+  uint8_t o2Compensation;
+  uint8_t balanceGas;
+  uint8_t etco2TimePeriod;
+  uint8_t noBreathTimeout;
+  uint8_t co2Units;
+  uint8_t sleepMode;
+  uint8_t zeroGasType;
+  uint8_t statusByte1;
+  uint8_t statusByte2;
+  uint8_t statusByte3;
+  uint8_t reserved;
+  uint16_t barometricPressure;
+  uint16_t anestheticAgent;
+  uint16_t gasTemp;
+  uint16_t etco2;
+  uint16_t respRate;
+  uint16_t inspCO2;
+  uint32_t zeroElapsedMs;
+};
+
+struct WaveformSnapshot {
+  float amplitude;
+  float frequency;
+  float baseline;
+  float phase;
+  bool useI2CSensor;
+  uint8_t reserved[3];
+};
+
+struct AlarmConditionSnapshot {
+  bool enabled;
+  bool active;
+  bool latched;
+  bool pending;
+  uint32_t pendingMs;       // how long the pending transition has run
+};
+
+struct AlarmSnapshot {
+  static const uint8_t CONDITIONS = 4;
+
+  float highThreshold;
+  float lowThreshold;
+  float rrHighThreshold;
+  float rrLowThreshold;
+  bool latching;
+  uint8_t reserved[3];
+  AlarmConditionSnapshot conditions[CONDITIONS];
+};
+
+struct SnapshotState {
+  DeviceSnapshot device;
+  WaveformSnapshot waveform;
+  AlarmSnapshot alarms;
+};
+
+struct SnapshotRecord {
+  char magic[4];            // "CO2S"
+  uint16_t version;
+  uint16_t size;            // sizeof(SnapshotState) of the writer
+  uint32_t capturedMs;      // Clock::nowMs() at capture, for reference
+  SnapshotState state;
+  uint32_t crc;             // CRC-32 of everything above
+};
+
+#endif // STATE_RECORD_H
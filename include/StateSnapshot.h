@@ -0,0 +1,54 @@
+#ifndef STATE_SNAPSHOT_H
+#define STATE_SNAPSHOT_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "StateRecord.h"
+#include "DeviceState.h"
+#include "WaveformGenerator.h"
+#include "AlarmManager.h"
+#include "ProtocolHandler.h"
+
+// Captures and restores the whole emulator state (host-visible device
+// state including zero and sync counter, waveform, alarm engine) as one
+// SnapshotRecord. Both directions hold the protocol lock, so no host
+// command lands halfway through. Restores from tasks other than the loop
+// are staged and applied by update(), between two samples.
+class StateSnapshot {
+public:
+  static const uint16_t VERSION = 1;
+  static const size_t MAX_SIZE = sizeof(SnapshotRecord);
+
+private:
+  DeviceState& device;
+  WaveformGenerator& waveform;
+  AlarmManager& alarms;
+  ProtocolHandler& protocol;
+
+  uint8_t staged[MAX_SIZE];
+  size_t stagedLen;
+  std::atomic<bool> stagedReady;
+
+  uint32_t lastCaptureUs;
+  uint32_t lastRestoreUs;
+
+public:
+  StateSnapshot(DeviceState& dev, WaveformGenerator& wave, AlarmManager& alarm, ProtocolHandler& proto);
+
+  // Writes the record to out; returns its length, or 0 if len is too small
+  size_t capture(uint8_t* out, size_t len);
+
+  // Loop task only. Returns nullptr on success, otherwise the reason.
+  const char* restore(const uint8_t* data, size_t len);
+
+  // Any task: checked now, applied by the next update()
+  const char* stage(const uint8_t* data, size_t len);
+  void update();
+
+  static const char* validate(const uint8_t* data, size_t len);
+
+  uint32_t getLastCaptureUs() const { return lastCaptureUs; }
+  uint32_t getLastRestoreUs() const { return lastRestoreUs; }
+};
+
+#endif // STATE_SNAPSHOT_H
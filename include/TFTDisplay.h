@@ -6,8 +6,9 @@
 #include "WaveformGenerator.h"
 #include "AlarmManager.h"
 #include "DeviceState.h"
+#include "Component.h"
 
-class TFTDisplay {
+class TFTDisplay : public Component {
 private:
   TFT_eSPI tft;
   WaveformGenerator& waveform;
@@ -17,6 +18,7 @@ private:
   float waveformData[170];  // Screen width
   uint8_t dataIndex;
   uint32_t lastUpdate;
+  bool needsClear;
   
   void drawWaveform();
   void drawStatus();
@@ -25,8 +27,9 @@ private:
 public:
   TFTDisplay(WaveformGenerator& wave, AlarmManager& alarm, DeviceState& dev);
   
-  void begin();
-  void update();
+  const char* getName() const override { return "display"; }
+  bool begin() override;
+  void update() override;
   void clear();
   void showMessage(const char* msg);
 };
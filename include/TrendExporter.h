@@ -0,0 +1,57 @@
+#ifndef TREND_EXPORTER_H
+#define TREND_EXPORTER_H
+
+#include <Arduino.h>
+#include "TrendStore.h"
+
+// Encodes a time range of a TrendStore ring on the fly. State is a
+// sequence cursor, so memory use does not depend on the export length.
+//
+// Binary layout (little-endian): 16-byte header
+//   "CO2T", version, resolution, record size (u16), 8 reserved bytes
+// followed by fixed-size records:
+//   raw:    u32 time_ms, i16 co2 [0.01 mmHg]
+//   breath: u32 time_ms, u16 etco2 [0.1 mmHg], u16 resp rate
+//   minute: u32 time_ms, i16 min, i16 max, i16 mean, u16 etco2, u16 rate, u16 breaths
+class TrendExporter {
+public:
+  enum Format : uint8_t { FORMAT_JSON, FORMAT_CSV, FORMAT_BINARY };
+  
+  static const uint8_t BINARY_VERSION = 1;
+  
+private:
+  const TrendStore& store;
+  TrendStore::Resolution res;
+  Format format;
+  uint32_t seq;
+  uint32_t end;
+  uint32_t stride;
+  uint8_t stage;  // 0 header, 1 records, 2 trailer, 3 done
+  bool first;
+  
+  uint32_t records;
+  uint32_t bytes;
+  uint32_t startTime;
+  uint32_t elapsed;
+  
+  size_t writeHeader(uint8_t* out, size_t len) const;
+  size_t writeRecord(uint32_t recordSeq, uint8_t* out, size_t len) const;
+  uint8_t recordSize() const;
+  
+public:
+  TrendExporter(const TrendStore& trendStore, TrendStore::Resolution resolution, 
+                Format fmt, uint32_t from, uint32_t to, uint32_t maxRecords);
+  
+  size_t read(uint8_t* buffer, size_t maxLen);
+  bool isFinished() const;
+  
+  uint32_t getRecordCount() const;
+  uint32_t getByteCount() const;
+  uint32_t getElapsedMs() const;
+  
+  static const char* contentType(Format fmt);
+  static const char* fileExtension(Format fmt);
+  static bool parseFormat(const char* name, Format& fmt);
+};
+
+#endif // TREND_EXPORTER_H
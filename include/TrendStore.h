@@ -0,0 +1,131 @@
+#ifndef TREND_STORE_H
+#define TREND_STORE_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "Config.h"
+
+// Fixed-size ring addressed by absolute sequence number. Readers on other
+// tasks keep a sequence cursor while the writer overwrites the oldest
+// entries; get() rejects an entry that was recycled during the copy.
+template <typename T>
+class TrendRing {
+private:
+  T* entries;
+  uint32_t capacity;
+  std::atomic<uint32_t> total;
+  std::atomic<uint32_t> writing;
+  
+public:
+  TrendRing() : entries(nullptr), capacity(0), total(0), writing(0) {}
+  
+  void attach(T* storage, uint32_t count) {
+    entries = storage;
+    capacity = storage ? count : 0;
+  }
+  
+  T* detach() {
+    T* storage = entries;
+    entries = nullptr;
+    capacity = 0;
+    return storage;
+  }
+  
+  void push(const T& entry) {
+    if (capacity == 0) return;
+    uint32_t seq = total.load();
+    writing.store(seq + 1);
+    entries[seq % capacity] = entry;
+    total.store(seq + 1);
+  }
+  
+  uint32_t getCapacity() const { return capacity; }
+  uint32_t endSeq() const { return total.load(); }
+  uint32_t firstSeq() const {
+    uint32_t end = total.load();
+    return end > capacity ? end - capacity : 0;
+  }
+  
+  bool get(uint32_t seq, T& out) const {
+    if (seq >= total.load()) return false;
+    out = entries[seq % capacity];
+    uint32_t w = writing.load();
+    return w <= capacity || seq >= w - capacity;
+  }
+  
+  // First sequence whose timestamp is >= time (entries are time ordered)
+  uint32_t lowerBound(uint32_t time) const {
+    uint32_t lo = firstSeq();
+    uint32_t hi = endSeq();
+    while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if (entries[mid % capacity].time < time) lo = mid + 1;
+      else hi = mid;
+    }
+    return lo;
+  }
+};
+
+class TrendStore {
+public:
+  enum Resolution : uint8_t { RES_RAW, RES_BREATH, RES_MINUTE };
+  
+  struct RawSample {
+    uint32_t time;
+    int16_t co2;          // 0.01 mmHg
+  };
+  
+  struct BreathRecord {
+    uint32_t time;
+    uint16_t etco2;       // 0.1 mmHg
+    uint16_t respRate;    // breaths/min
+  };
+  
+  struct MinuteRecord {
+    uint32_t time;        // start of the minute
+    int16_t co2Min;       // 0.01 mmHg
+    int16_t co2Max;
+    int16_t co2Mean;
+    uint16_t etco2;       // mean over the minute, 0.1 mmHg
+    uint16_t respRate;    // mean over the minute
+    uint16_t breaths;
+  };
+  
+  TrendRing<RawSample> raw;
+  TrendRing<BreathRecord> breaths;
+  TrendRing<MinuteRecord> minutes;
+  
+private:
+  bool inPSRAM;
+  uint32_t minuteStart;
+  int32_t co2Sum;
+  uint32_t co2Count;
+  int16_t co2Min;
+  int16_t co2Max;
+  uint32_t etco2Sum;
+  uint32_t rateSum;
+  uint16_t breathCount;
+  
+  void resetMinute(uint32_t now);
+  
+  template <typename T>
+  T* allocate(uint32_t count);
+  
+public:
+  TrendStore();
+  ~TrendStore();
+  
+  bool begin();
+  void addSample(uint32_t now, float co2);
+  void addBreath(uint32_t now, uint16_t etco2, uint16_t respRate);
+  
+  uint32_t firstSeq(Resolution res) const;
+  uint32_t endSeq(Resolution res) const;
+  uint32_t lowerBound(Resolution res, uint32_t time) const;
+  
+  bool isInPSRAM() const;
+  static const char* resolutionName(Resolution res);
+  static bool parseResolution(const char* name, Resolution& res);
+};
+
+#endif // TREND_STORE_H
@@ -2,8 +2,12 @@
 #define WAVEFORM_GENERATOR_H
 
 #include <Arduino.h>
+#include <atomic>
 #include "I2CSensorInterface.h"
 #include "ConfigStorage.h"
+#include "Clock.h"
+#include "FixedPoint.h"
+#include "StateRecord.h"
 
 class WaveformGenerator {
 private:
@@ -11,9 +15,21 @@ private:
   float frequency;
   float baseline;
   float phase;
+  
+  // Integer forms of the above, refreshed by every setter
+  int32_t amplitudeCenti;
+  int32_t baselineCenti;
+  uint32_t frequencyMicroHz;
+  uint32_t phaseOffset;           // 2^32 = one cycle
+  
   I2CSensorInterface* i2cSensor;
   bool useI2CSensor;
   
+  // Replayed sample that replaces the generator; NO_EXTERNAL when unused
+  std::atomic<int32_t> externalCenti;
+  
+  void updateFixed();
+  
 public:
   WaveformGenerator();
   
@@ -31,11 +47,26 @@ public:
   float getBaseline() const;
   float getPhase() const;
   
-  float getSample();
+  int32_t getAmplitudeCenti() const { return amplitudeCenti; }
+  int32_t getBaselineCenti() const { return baselineCenti; }
+  uint32_t getFrequencyMicroHz() const { return frequencyMicroHz; }
+  uint32_t getPhaseOffset() const { return phaseOffset; }
+  
+  static const int32_t NO_EXTERNAL = INT32_MIN;
+  void setExternalSample(int32_t centi) { externalCenti = centi; }
+  void clearExternalSample() { externalCenti = NO_EXTERNAL; }
+  bool hasExternalSample() const { return externalCenti != NO_EXTERNAL; }
+  
+  int32_t getSampleCenti();     // 0.01 mmHg, never negative
+  float getSample();            // mmHg, for display
   uint16_t getRespiratoryRate() const;
   uint16_t getETCO2() const;
   
   void loadFromConfig(const ConfigStorage::Config& cfg);
+  void saveToConfig(ConfigStorage::Config& cfg) const;
+  
+  void captureState(WaveformSnapshot& s) const;
+  void restoreState(const WaveformSnapshot& s);
 };
 
 #endif // WAVEFORM_GENERATOR_H
@@ -0,0 +1,85 @@
+#ifndef WAVEFORM_IMPORTER_H
+#define WAVEFORM_IMPORTER_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "WaveformRecorder.h"
+
+// Converts an uploaded waveform into the recorder's replay format while
+// the body is still arriving. Chunks are parsed as they come in and
+// written one flash block at a time, so RAM use does not depend on the
+// file size.
+//
+// Accepted input, detected from the first bytes:
+//   CSV        "time_ms,co2_mmHg" lines (as /api/export writes them), or a
+//              single co2_mmHg column taken at the 10 ms sample tick.
+//              Lines that do not start with a number are skipped.
+//   CO2R       a recorder file; records are validated and copied
+//   CO2T       a raw-resolution /api/export binary file
+class WaveformImporter {
+public:
+  enum Format : uint8_t { FORMAT_NONE = 0, FORMAT_CSV, FORMAT_RECORDING, FORMAT_TREND };
+
+  struct Result {
+    uint32_t sequence;        // recording the upload became
+    uint32_t bytesIn;
+    uint32_t samples;
+    uint32_t skipped;         // unparsable lines or invalid records
+    uint32_t durationMs;
+    uint32_t peakHeapUsed;    // lowest free heap seen, relative to the start
+    Format format;
+    bool ok;
+    const char* error;
+  };
+
+  static const uint8_t HEADER_SIZE = 16;
+  static const uint8_t LINE_MAX = 48;
+
+private:
+  WaveformRecorder& recorder;
+  bool active;
+  File file;
+  Result result;
+  uint32_t startMs;
+  uint32_t startFreeHeap;
+  uint32_t minFreeHeap;
+
+  uint8_t header[HEADER_SIZE];
+  uint8_t headerLen;
+  uint8_t recordSize;         // input record size for binary formats
+  uint8_t partial[8];         // binary record straddling two chunks
+  uint8_t partialLen;
+
+  char line[LINE_MAX];
+  uint8_t lineLen;
+  bool lineOverflow;
+  bool haveFirstTime;
+  uint32_t firstTime;
+  uint32_t lastTime;
+
+  WaveformRecorder::Record out[WaveformRecorder::BUFFER_RECORDS];
+  uint16_t outCount;
+
+  bool detectFormat();
+  void feedCsv(const uint8_t* data, size_t len);
+  void parseLine();
+  void feedBinary(const uint8_t* data, size_t len);
+  void convertRecord(const uint8_t* rec);
+  void emit(uint32_t timeMs, uint8_t type, int16_t value);
+  bool flush();
+  void fail(const char* error);
+
+public:
+  WaveformImporter(WaveformRecorder& rec);
+
+  bool begin();
+  bool feed(const uint8_t* data, size_t len);
+  bool finish();
+  void abort();
+
+  bool isActive() const { return active; }
+  const Result& getResult() const { return result; }
+  static const char* formatName(Format fmt);
+};
+
+#endif // WAVEFORM_IMPORTER_H
@@ -0,0 +1,86 @@
+#ifndef WAVEFORM_PLAYER_H
+#define WAVEFORM_PLAYER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <LittleFS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "WaveformGenerator.h"
+#include "WaveformRecorder.h"
+#include "ConfigStorage.h"
+
+// Replays a recording (recorded or uploaded) in place of the generator.
+// A reader task keeps two record buffers filled ahead of the loop, which
+// only walks through RAM. Parameter records are applied to the waveform
+// generator so the DPIs follow the recording; the previous parameters are
+// restored when replay ends. The file stays marked in use with the
+// recorder while it plays, so it cannot be deleted or evicted under the
+// reader.
+class WaveformPlayer {
+private:
+  enum BufferState : uint8_t { BUF_EMPTY = 0, BUF_FULL };
+
+  WaveformGenerator& waveform;
+  WaveformRecorder& recorder;
+  TaskHandle_t readerTask;
+  bool mounted;
+
+  // Loop side
+  std::atomic<uint32_t> requested;    // sequence to play; STOP_REQUEST to stop
+  bool playing;
+  bool started;                       // first buffer arrived, clock running
+  uint32_t sequence;
+  uint32_t generation;
+  uint32_t startMs;
+  uint8_t readBuffer;
+  uint16_t readPos;
+  int32_t current;
+  uint32_t samples;
+  uint32_t underruns;
+  ConfigStorage::Config saved;
+
+  // Shared with the reader task
+  WaveformRecorder::Record buffers[2][WaveformRecorder::BUFFER_RECORDS];
+  uint16_t counts[2];
+  std::atomic<uint8_t> state[2];
+  std::atomic<bool> endOfFile;
+  std::atomic<uint32_t> openGeneration;   // set by the loop to (re)open
+  std::atomic<uint32_t> readyGeneration;  // set by the reader once reset
+  std::atomic<uint32_t> openSequence;
+  std::atomic<bool> readError;
+
+  // Reader side
+  File file;
+  uint8_t fillBuffer;
+
+  static const uint32_t STOP_REQUEST = 0xFFFFFFFF;
+
+  void start(uint32_t seq);
+  void stop(const char* reason);
+  void apply(const WaveformRecorder::Record& r);
+  bool advanceBuffer();
+
+  static void readerTaskEntry(void* param);
+  void readerLoop();
+  void fillBuffers();
+
+public:
+  WaveformPlayer(WaveformGenerator& wave, WaveformRecorder& rec);
+
+  void begin(bool filesystemMounted);
+  void update();
+
+  // Latest replayed value for this tick; false while not replaying
+  bool getSample(uint32_t now, int32_t& co2Centi);
+
+  // Safe from any task; applied by update()
+  void requestPlay(uint32_t seq);
+  void requestStop();
+
+  bool isPlaying() const { return playing; }
+  uint32_t getSequence() const { return sequence; }
+  void printStatus(Print& out) const;
+};
+
+#endif // WAVEFORM_PLAYER_H
@@ -0,0 +1,145 @@
+#ifndef WAVEFORM_RECORDER_H
+#define WAVEFORM_RECORDER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <LittleFS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "WaveformGenerator.h"
+#include "Config.h"
+
+// Records the produced CO2 stream and waveform parameter changes to
+// LittleFS for later replay. The loop only appends fixed-size records to
+// a RAM buffer; a full buffer is handed to a writer task that appends it
+// to the current file, so flash latency never reaches the 100 Hz path.
+//
+// Files are /rec/NNNNN.bin: a FileHeader, then Records. Each file starts
+// with a snapshot of every parameter so it replays on its own. Past
+// RECORDER_MAX_FILE_BYTES a new file is started; past RECORDER_MAX_FILES
+// (or when the filesystem is full) the oldest file is deleted. Files the
+// importer is writing or the player is reading are marked in use and are
+// neither deleted nor evicted until released.
+class WaveformRecorder {
+public:
+  enum RecordType : uint8_t {
+    REC_SAMPLE = 0,       // 0.01 mmHg
+    REC_AMPLITUDE,        // 0.01 mmHg
+    REC_FREQUENCY,        // mHz
+    REC_BASELINE,         // 0.01 mmHg
+    REC_PHASE,            // mrad
+    REC_SOURCE,           // 0 generator, 1 I2C sensor
+    REC_TYPE_COUNT
+  };
+
+  struct Record {         // little-endian, 8 bytes
+    uint32_t timeMs;      // since the recording started
+    uint8_t type;
+    uint8_t reserved;
+    int16_t value;
+  };
+
+  struct FileHeader {
+    char magic[4];        // "CO2R"
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t intervalMs;  // nominal sample spacing
+    uint32_t sequence;    // file number
+  };
+
+  static const uint16_t FILE_VERSION = 1;
+  static const uint16_t BUFFER_RECORDS = RECORDER_BUFFER_BYTES / sizeof(Record);
+  static const uint8_t MAX_PATH = 24;
+  static const uint32_t SAMPLE_INTERVAL_MS = 10;   // the emulator's sample tick
+  static const uint8_t IN_USE_SLOTS = 4;
+
+private:
+  enum Request : uint8_t { REQ_NONE = 0, REQ_START, REQ_STOP };
+
+  // Hand-off flags for the writer task
+  static const uint8_t FLAG_OPEN = 0x01;
+  static const uint8_t FLAG_CLOSE = 0x02;
+
+  WaveformGenerator& waveform;
+  bool mounted;
+  bool recording;
+  bool stopPending;
+  bool openPending;
+  std::atomic<uint8_t> request;
+  uint32_t startMs;
+  bool paramsPending;             // emit every parameter with the next sample
+  int16_t lastParams[REC_TYPE_COUNT];
+
+  Record buffers[2][BUFFER_RECORDS];
+  uint8_t fillBuffer;
+  uint16_t fillCount;
+
+  // Owned by the writer task while writerBusy is set
+  TaskHandle_t writerTask;
+  std::atomic<bool> writerBusy;
+  uint8_t handoffBuffer;
+  uint16_t handoffCount;
+  uint8_t handoffFlags;
+  File file;
+  uint32_t fileBytes;
+  std::atomic<uint32_t> nextSequence;
+  std::atomic<uint32_t> openSequence;   // file being written, 0 if none
+  
+  // Guards the in-use set, deletions and the writer opening a file
+  SemaphoreHandle_t lock;
+  uint32_t inUse[IN_USE_SLOTS];         // 0 = free slot
+  int16_t startParams[2][REC_TYPE_COUNT];   // parameters as each buffer began
+
+  uint32_t samples;
+  uint32_t droppedBuffers;
+  uint32_t writeErrors;
+  uint32_t bytesWritten;
+
+  void append(uint32_t now, uint8_t type, int16_t value);
+  void recordParam(uint32_t now, uint8_t type, int32_t value);
+  bool handOff(uint8_t flags);
+
+  static void writerTaskEntry(void* param);
+  void writerLoop();
+  bool openNextFile();
+  void writeSnapshot(uint8_t buffer, uint32_t timeMs);
+  bool isInUse(uint32_t sequence) const;
+
+public:
+  WaveformRecorder(WaveformGenerator& wave);
+
+  bool begin();
+  void addSample(uint32_t now, int32_t co2Centi);   // once per produced sample
+  void update();
+
+  // Safe from any task; applied by update()
+  void requestStart();
+  void requestStop();
+
+  bool isMounted() const { return mounted; }
+  bool isRecording() const { return recording; }
+  uint32_t getSampleCount() const { return samples; }
+  uint32_t getDroppedBuffers() const { return droppedBuffers; }
+  uint32_t getWriteErrors() const { return writeErrors; }
+  uint32_t getBytesWritten() const { return bytesWritten; }
+
+  static void filePath(uint32_t sequence, char* out, size_t len);
+  static uint32_t parseSequence(const char* name);
+  uint32_t allocateSequence() { return nextSequence++; }   // for imported files
+  bool deleteFile(uint32_t sequence);
+  
+  // Deletes the oldest recordings not in use until there is room for one
+  // more full file; the writer calls it before starting each file
+  void enforceLimits();
+  
+  // Safe from any task; false if every slot is taken
+  bool markInUse(uint32_t sequence);
+  void releaseInUse(uint32_t sequence);
+
+  // Calls fn(sequence, bytes, ctx) for each recording, oldest first
+  void listFiles(void (*fn)(uint32_t sequence, uint32_t bytes, void* ctx), void* ctx);
+  void printStatus(Print& out);
+};
+
+#endif // WAVEFORM_RECORDER_H
@@ -2,16 +2,58 @@
 #define WEB_INTERFACE_H
 
 #include <Arduino.h>
+#include <memory>
 #include <WiFi.h>
 #include <ESPAsyncWebServer.h>
 #include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include "WaveformGenerator.h"
 #include "AlarmManager.h"
 #include "DeviceState.h"
 #include "ConfigStorage.h"
+#include "TrendStore.h"
+#include "TrendExporter.h"
+#include "ProtocolTrace.h"
+#include "I2CSensorInterface.h"
+#include "WaveformRecorder.h"
+#include "WaveformImporter.h"
+#include "WaveformPlayer.h"
+#include "MetricsExporter.h"
+#include "StateSnapshot.h"
+#include "PassthroughBridge.h"
+#include "FaultInjector.h"
+#include "ProtocolHandler.h"
+#include "Component.h"
 #include "Config.h"
 
-class WebInterface {
+class WebInterface : public Component {
+public:
+  struct ExportStats {
+    uint32_t bytes;
+    uint32_t records;
+    uint32_t durationMs;
+    bool completed;
+  };
+  
+  static const uint8_t MAX_STREAM_CLIENTS = 4;
+  static const uint8_t STREAM_QUEUE_DEPTH = 16;   // samples held per client
+  static const uint8_t STREAM_MAX_IN_FLIGHT = 2;  // messages queued in the server
+  
+  // Live-stream state of one SSE client. Samples wait here (drop-oldest)
+  // while the client's server-side queue is backed up.
+  struct StreamClient {
+    AsyncEventSourceClient* client;
+    uint32_t connectedAt;
+    uint32_t sent;
+    uint32_t dropped;
+    uint16_t lag;
+    uint16_t maxLag;
+    uint8_t head;
+    uint8_t count;
+    float pending[STREAM_QUEUE_DEPTH];
+  };
+  
 private:
   AsyncWebServer server;
   AsyncEventSource events;
@@ -19,19 +61,61 @@ private:
   AlarmManager& alarms;
   DeviceState& device;
   ConfigStorage& storage;
+  TrendStore* trends;
+  ProtocolTrace* trace;
+  I2CSensorInterface* i2cSensor;
+  WaveformRecorder* recorder;
+  WaveformPlayer* player;
+  MetricsExporter* metrics;
+  StateSnapshot* snapshot;
+  PassthroughBridge* bridge;
+  FaultInjector* faults;
+  ProtocolHandler* faultOwner;      // its lock guards the injector
+  uint8_t snapshotUpload[StateSnapshot::MAX_SIZE];
+  size_t snapshotUploadLen;                     // > MAX_SIZE once the body overflows
+  std::unique_ptr<WaveformImporter> importer;   // created with the recorder
+  AsyncWebServerRequest* uploadOwner;           // request feeding the importer
   
   float currentCO2Value;
   uint32_t lastDataUpdate;
+  bool staConnected;
+  ExportStats lastExport;
+  char eventBuffer[512];
+  StreamClient streamClients[MAX_STREAM_CLIENTS];
+  uint8_t activeStreamClients;
+  SemaphoreHandle_t streamLock;
   
   void setupRoutes();
-  String getIndexHTML();
+  void checkConnection();
+  ConfigStorage::Config currentConfig() const;
+  void handleTraceRequest(AsyncWebServerRequest* request);
+  void handleRecorderRequest(AsyncWebServerRequest* request);
+  void handleUploadBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index);
+  void handleUploadDone(AsyncWebServerRequest* request);
+  void addStreamClient(AsyncEventSourceClient* client);
+  void removeStreamClient(AsyncEventSourceClient* client);
+  bool flushStreamClient(StreamClient& slot, uint16_t rate, uint16_t alarmWord);
+  void handleTrendRequest(AsyncWebServerRequest* request, TrendExporter::Format defaultFormat, 
+                          uint32_t defaultMax, bool download);
+  const char* getIndexHTML() const;
   
 public:
   WebInterface(WaveformGenerator& wave, AlarmManager& alarm, 
                DeviceState& dev, ConfigStorage& stor);
   
-  bool begin();
-  void update();
+  void setTrendStore(TrendStore* store);
+  void setI2CSensor(I2CSensorInterface* sensor);
+  void setProtocolTrace(ProtocolTrace* protocolTrace);
+  void setRecorder(WaveformRecorder* rec);
+  void setPlayer(WaveformPlayer* play);
+  void setMetrics(MetricsExporter* exporter);
+  void setSnapshot(StateSnapshot* snap);
+  void setBridge(PassthroughBridge* passthrough);
+  void setFaultInjector(FaultInjector* injector, ProtocolHandler* owner);
+  
+  const char* getName() const override { return "web"; }
+  bool begin() override;
+  void update() override;
 };
 
 #endif // WEB_INTERFACE_H
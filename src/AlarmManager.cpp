@@ -1,38 +1,204 @@
 #include "AlarmManager.h"
 
+const AlarmManager::Priority AlarmManager::PRIORITIES[CONDITION_COUNT] = {
+  PRIORITY_MEDIUM,  // ETCO2_HIGH
+  PRIORITY_HIGH,    // ETCO2_LOW
+  PRIORITY_MEDIUM,  // RR_HIGH
+  PRIORITY_HIGH     // RR_LOW
+};
+
+const char* const AlarmManager::NAMES[CONDITION_COUNT] = {
+  "etco2-high", "etco2-low", "rr-high", "rr-low"
+};
+
 AlarmManager::AlarmManager() 
-  : highThreshold(50.0), lowThreshold(30.0), 
-    highEnabled(false), lowEnabled(false) {}
+  : highThreshold(50.0), lowThreshold(30.0), rrHighThreshold(30.0), rrLowThreshold(8.0),
+    latching(false), statusWord(0) {
+  memset(conditions, 0, sizeof(conditions));
+  updateThresholds();
+}
+
+void AlarmManager::updateThresholds() {
+  highTenths = lroundf(highThreshold * 10.0f);
+  lowTenths = lroundf(lowThreshold * 10.0f);
+  rrHighTenths = lroundf(rrHighThreshold * 10.0f);
+  rrLowTenths = lroundf(rrLowThreshold * 10.0f);
+}
 
-void AlarmManager::setHighThreshold(float value) { highThreshold = value; }
-void AlarmManager::setLowThreshold(float value) { lowThreshold = value; }
-void AlarmManager::enableHigh(bool enable) { highEnabled = enable; }
-void AlarmManager::enableLow(bool enable) { lowEnabled = enable; }
+void AlarmManager::setHighThreshold(float value) { highThreshold = value; updateThresholds(); }
+void AlarmManager::setLowThreshold(float value) { lowThreshold = value; updateThresholds(); }
+void AlarmManager::enableHigh(bool enable) { conditions[ETCO2_HIGH].enabled = enable; }
+void AlarmManager::enableLow(bool enable) { conditions[ETCO2_LOW].enabled = enable; }
+void AlarmManager::setRRHighThreshold(float value) { rrHighThreshold = value; updateThresholds(); }
+void AlarmManager::setRRLowThreshold(float value) { rrLowThreshold = value; updateThresholds(); }
+void AlarmManager::enableRRHigh(bool enable) { conditions[RR_HIGH].enabled = enable; }
+void AlarmManager::enableRRLow(bool enable) { conditions[RR_LOW].enabled = enable; }
+void AlarmManager::setLatching(bool enable) { latching = enable; }
 
 float AlarmManager::getHighThreshold() const { return highThreshold; }
 float AlarmManager::getLowThreshold() const { return lowThreshold; }
-bool AlarmManager::isHighEnabled() const { return highEnabled; }
-bool AlarmManager::isLowEnabled() const { return lowEnabled; }
+bool AlarmManager::isHighEnabled() const { return conditions[ETCO2_HIGH].enabled; }
+bool AlarmManager::isLowEnabled() const { return conditions[ETCO2_LOW].enabled; }
+float AlarmManager::getRRHighThreshold() const { return rrHighThreshold; }
+float AlarmManager::getRRLowThreshold() const { return rrLowThreshold; }
+bool AlarmManager::isRRHighEnabled() const { return conditions[RR_HIGH].enabled; }
+bool AlarmManager::isRRLowEnabled() const { return conditions[RR_LOW].enabled; }
+bool AlarmManager::isLatching() const { return latching; }
 
-bool AlarmManager::checkAlarms(float value, uint8_t& statusByte) const {
-  bool alarm = false;
+void AlarmManager::step(Condition id, bool violated, bool cleared, uint32_t now) {
+  ConditionState& c = conditions[id];
+  
+  if (!c.enabled) {
+    if (c.active) clearedCount[id].inc();
+    c.active = c.latched = c.pending = false;
+    return;
+  }
+  
+  // Between the two hysteresis edges the current state simply holds
+  bool wantChange = c.active ? cleared : violated;
+  if (!wantChange) {
+    c.pending = false;
+    return;
+  }
   
-  if (highEnabled && value > highThreshold) {
-    statusByte |= 0x08;
-    alarm = true;
+  if (!c.pending) {
+    c.pending = true;
+    c.since = now;
   }
   
-  if (lowEnabled && value < lowThreshold) {
-    statusByte |= 0x08;
-    alarm = true;
+  if (now - c.since < (c.active ? OFF_DELAY_MS : ON_DELAY_MS)) return;
+  
+  c.pending = false;
+  if (c.active) {
+    if (c.latched) return;
+    c.active = false;
+    clearedCount[id].inc();
+  } else {
+    c.active = true;
+    c.latched = latching;
+    raisedCount[id].inc();
+  }
+}
+
+void AlarmManager::evaluate(uint32_t now, uint16_t etco2, uint16_t respRate, BreathDetector::Status breath) {
+  // Before the first breath there is nothing to compare; hold each state.
+  // With no breath for the timeout there is no exhaled CO2 and no rate, so
+  // both read as zero: ETCO2_LOW and RR_LOW raise (unless set to 0), and
+  // ETCO2_HIGH and RR_HIGH clear through their normal off delay.
+  if (breath != BreathDetector::WAITING) {
+    int32_t co2 = breath == BreathDetector::BREATHING ? etco2 : 0;
+    int32_t rr = breath == BreathDetector::BREATHING ? respRate * 10 : 0;
+    step(ETCO2_HIGH, co2 > highTenths, co2 <= highTenths - ETCO2_HYSTERESIS, now);
+    step(ETCO2_LOW, co2 < lowTenths, co2 >= lowTenths + ETCO2_HYSTERESIS, now);
+    step(RR_HIGH, rr > rrHighTenths, rr <= rrHighTenths - RR_HYSTERESIS, now);
+    step(RR_LOW, rr < rrLowTenths, rr >= rrLowTenths + RR_HYSTERESIS, now);
+  } else {
+    for (uint8_t i = 0; i < CONDITION_COUNT; i++) step((Condition)i, false, false, now);
+  }
+  
+  publish();
+}
+
+void AlarmManager::acknowledge() {
+  for (uint8_t i = 0; i < CONDITION_COUNT; i++) conditions[i].latched = false;
+}
+
+void AlarmManager::publish() {
+  uint16_t word = 0;
+  uint8_t priority = PRIORITY_NONE;
+  
+  for (uint8_t i = 0; i < CONDITION_COUNT; i++) {
+    if (!conditions[i].active) continue;
+    word |= 1 << i;
+    if (PRIORITIES[i] > priority) priority = PRIORITIES[i];
   }
   
-  return alarm;
+  statusWord.store(word | (priority << STATUS_PRIORITY_SHIFT), std::memory_order_relaxed);
+}
+
+uint8_t AlarmManager::applyStatusByte1(uint8_t statusByte) const {
+  return isAlarmActive() ? (statusByte | STATUS_BYTE1_ALARM) : (statusByte & ~STATUS_BYTE1_ALARM);
+}
+
+const char* AlarmManager::conditionName(uint8_t id) {
+  return id < CONDITION_COUNT ? NAMES[id] : "";
+}
+
+void AlarmManager::printStatus(Print& out) const {
+  static const char* const PRIORITY_NAMES[] = {"none", "low", "medium", "high"};
+  uint16_t word = getStatusWord();
+  
+  out.print("Alarm status: 0x"); out.print(word, HEX);
+  out.print(" priority="); out.print(PRIORITY_NAMES[word >> STATUS_PRIORITY_SHIFT]);
+  out.print(" latching="); out.println(latching ? "ON" : "OFF");
+  for (uint8_t i = 0; i < CONDITION_COUNT; i++) {
+    const ConditionState& c = conditions[i];
+    out.print("  "); out.print(NAMES[i]);
+    out.print(c.enabled ? " enabled" : " disabled");
+    if (c.active) out.print(c.latched ? " ACTIVE (latched)" : " ACTIVE");
+    else if (c.pending) out.print(" pending");
+    out.println();
+  }
 }
 
 void AlarmManager::loadFromConfig(const ConfigStorage::Config& cfg) {
   highThreshold = cfg.alarmHigh;
   lowThreshold = cfg.alarmLow;
-  highEnabled = cfg.alarmHighEnabled;
-  lowEnabled = cfg.alarmLowEnabled;
+  conditions[ETCO2_HIGH].enabled = cfg.alarmHighEnabled;
+  conditions[ETCO2_LOW].enabled = cfg.alarmLowEnabled;
+  rrHighThreshold = cfg.rrHigh;
+  rrLowThreshold = cfg.rrLow;
+  conditions[RR_HIGH].enabled = cfg.rrHighEnabled;
+  conditions[RR_LOW].enabled = cfg.rrLowEnabled;
+  latching = cfg.alarmLatching;
+  updateThresholds();
+}
+
+void AlarmManager::saveToConfig(ConfigStorage::Config& cfg) const {
+  cfg.alarmHigh = highThreshold;
+  cfg.alarmLow = lowThreshold;
+  cfg.alarmHighEnabled = conditions[ETCO2_HIGH].enabled;
+  cfg.alarmLowEnabled = conditions[ETCO2_LOW].enabled;
+  cfg.rrHigh = rrHighThreshold;
+  cfg.rrLow = rrLowThreshold;
+  cfg.rrHighEnabled = conditions[RR_HIGH].enabled;
+  cfg.rrLowEnabled = conditions[RR_LOW].enabled;
+  cfg.alarmLatching = latching;
+}
+
+void AlarmManager::captureState(AlarmSnapshot& s, uint32_t now) const {
+  s.highThreshold = highThreshold;
+  s.lowThreshold = lowThreshold;
+  s.rrHighThreshold = rrHighThreshold;
+  s.rrLowThreshold = rrLowThreshold;
+  s.latching = latching;
+  memset(s.reserved, 0, sizeof(s.reserved));
+  for (uint8_t i = 0; i < CONDITION_COUNT; i++) {
+    const ConditionState& c = conditions[i];
+    AlarmConditionSnapshot& out = s.conditions[i];
+    out.enabled = c.enabled;
+    out.active = c.active;
+    out.latched = c.latched;
+    out.pending = c.pending;
+    out.pendingMs = c.pending ? now - c.since : 0;
+  }
+}
+
+void AlarmManager::restoreState(const AlarmSnapshot& s, uint32_t now) {
+  highThreshold = s.highThreshold;
+  lowThreshold = s.lowThreshold;
+  rrHighThreshold = s.rrHighThreshold;
+  rrLowThreshold = s.rrLowThreshold;
+  latching = s.latching;
+  for (uint8_t i = 0; i < CONDITION_COUNT; i++) {
+    const AlarmConditionSnapshot& in = s.conditions[i];
+    ConditionState& c = conditions[i];
+    c.enabled = in.enabled;
+    c.active = in.active;
+    c.latched = in.latched;
+    c.pending = in.pending;
+    c.since = now - in.pendingMs;
+  }
+  updateThresholds();
+  publish();
 }
@@ -0,0 +1,323 @@
+#include "BinaryChannel.h"
+
+static void put16(uint8_t* p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static void put32(uint8_t* p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+
+BinaryChannel::BinaryChannel(WaveformGenerator& wave, AlarmManager& alarm, DeviceState& dev,
+                             ConfigStorage& stor, Stream& ser)
+  : waveform(wave), alarms(alarm), device(dev), storage(stor), serial(ser), snapshot(nullptr),
+    active(false), rxState(RX_SOF), rxType(0), rxLen(0), rxPos(0), rxCrc(0), lastByteTime(0),
+    streamPeriodUs(0), nextSampleUs(0), batchStartUs(0), streamSeq(0), batchCount(0),
+    rxFrames(0), txFrames(0), crcErrors(0), droppedFrames(0), overruns(0) {}
+
+static_assert(StateSnapshot::MAX_SIZE <= BinaryChannel::MAX_PAYLOAD, "a snapshot must fit in one frame");
+
+void BinaryChannel::setSnapshot(StateSnapshot* snap) {
+  snapshot = snap;
+}
+
+uint16_t BinaryChannel::crc16(const uint8_t* data, size_t len, uint16_t crc) {
+  while (len--) {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+ConfigStorage::Config BinaryChannel::currentConfig() const {
+  ConfigStorage::Config cfg = ConfigStorage::defaults();
+  waveform.saveToConfig(cfg);
+  alarms.saveToConfig(cfg);
+  device.saveToConfig(cfg);
+  return cfg;
+}
+
+void BinaryChannel::activate() {
+  active = true;
+  rxState = RX_SOF;
+  streamPeriodUs = 0;
+  batchCount = 0;
+}
+
+void BinaryChannel::update() {
+  while (active && serial.available()) {
+    feed(serial.read());
+  }
+  if (active) pollStream();
+}
+
+void BinaryChannel::feed(uint8_t byte) {
+  uint32_t now = millis();
+  if (rxState != RX_SOF && now - lastByteTime > RX_TIMEOUT_MS) rxState = RX_SOF;
+  lastByteTime = now;
+  
+  switch (rxState) {
+    case RX_SOF:
+      if (byte == SOF) rxState = RX_TYPE;
+      break;
+      
+    case RX_TYPE:
+      rxType = byte;
+      rxState = RX_LEN;
+      break;
+      
+    case RX_LEN:
+      if (byte > MAX_PAYLOAD) {
+        sendNak(ERR_LENGTH);
+        rxState = RX_SOF;
+        break;
+      }
+      rxLen = byte;
+      rxPos = 0;
+      rxState = rxLen ? RX_PAYLOAD : RX_CRC_LO;
+      break;
+      
+    case RX_PAYLOAD:
+      rxPayload[rxPos++] = byte;
+      if (rxPos == rxLen) rxState = RX_CRC_LO;
+      break;
+      
+    case RX_CRC_LO:
+      rxCrc = byte;
+      rxState = RX_CRC_HI;
+      break;
+      
+    case RX_CRC_HI: {
+      rxCrc |= (uint16_t)byte << 8;
+      rxState = RX_SOF;
+      
+      const uint8_t header[2] = {rxType, rxLen};
+      uint16_t crc = crc16(rxPayload, rxLen, crc16(header, 2));
+      if (crc != rxCrc) {
+        crcErrors++;
+        sendNak(ERR_CRC);
+      } else {
+        rxFrames++;
+        handleFrame();
+      }
+      break;
+    }
+  }
+}
+
+void BinaryChannel::handleFrame() {
+  uint8_t reply[PARAM_COUNT * 5];
+  
+  switch (rxType) {
+    case TYPE_PING:
+      sendFrame(TYPE_PING | 0x80, rxPayload, rxLen);
+      break;
+      
+    case TYPE_SET:
+      handleSet();
+      break;
+      
+    case TYPE_GET: {
+      ConfigStorage::Config cfg = currentConfig();
+      uint8_t len = 0;
+      for (uint8_t id = 1; id < PARAM_COUNT; id++) {
+        float value = getParam(cfg, id);
+        reply[len] = id;
+        memcpy(&reply[len + 1], &value, 4);
+        len += 5;
+      }
+      sendFrame(TYPE_GET | 0x80, reply, len);
+      break;
+    }
+      
+    case TYPE_STREAM: {
+      if (rxLen != 2) { sendNak(ERR_LENGTH); break; }
+      uint16_t rate = rxPayload[0] | (rxPayload[1] << 8);
+      if (rate > 1000) { sendNak(ERR_BAD_RATE); break; }
+      
+      flushBatch();
+      streamPeriodUs = rate ? 1000000UL / rate : 0;
+      nextSampleUs = micros();
+      sendFrame(TYPE_STREAM | 0x80, rxPayload, 2);
+      break;
+    }
+      
+    case TYPE_STATS:
+      put32(&reply[0], rxFrames);
+      put32(&reply[4], txFrames);
+      put32(&reply[8], crcErrors);
+      put32(&reply[12], droppedFrames);
+      put32(&reply[16], overruns);
+      sendFrame(TYPE_STATS | 0x80, reply, 20);
+      break;
+      
+    case TYPE_SNAPSHOT: {
+      if (!snapshot) { sendNak(ERR_UNKNOWN_TYPE); break; }
+      uint8_t record[StateSnapshot::MAX_SIZE];
+      size_t len = snapshot->capture(record, sizeof(record));
+      sendFrame(TYPE_SNAPSHOT | 0x80, record, len);
+      break;
+    }
+      
+    // Runs on the loop task, so the state is replaced between two samples
+    case TYPE_RESTORE:
+      if (!snapshot) { sendNak(ERR_UNKNOWN_TYPE); break; }
+      if (snapshot->restore(rxPayload, rxLen)) { sendNak(ERR_BAD_SNAPSHOT); break; }
+      put32(&reply[0], snapshot->getLastRestoreUs());
+      sendFrame(TYPE_RESTORE | 0x80, reply, 4);
+      break;
+      
+    case TYPE_MODE_TEXT:
+      flushBatch();
+      streamPeriodUs = 0;
+      sendFrame(TYPE_MODE_TEXT | 0x80, nullptr, 0);
+      active = false;
+      break;
+      
+    default:
+      sendNak(ERR_UNKNOWN_TYPE);
+      break;
+  }
+}
+
+// All parameters of one frame take effect together, between two samples.
+// Every value is checked into a copy first, so one bad parameter NAKs the
+// frame with nothing applied or saved.
+void BinaryChannel::handleSet() {
+  if (rxLen % 5 != 0) {
+    sendNak(ERR_LENGTH);
+    return;
+  }
+  
+  ConfigStorage::Config cfg = currentConfig();
+  for (uint8_t i = 0; i < rxLen; i += 5) {
+    float value;
+    memcpy(&value, &rxPayload[i + 1], 4);
+    if (!setParam(cfg, rxPayload[i], value)) {
+      sendNak(ERR_BAD_PARAM);
+      return;
+    }
+  }
+  
+  waveform.loadFromConfig(cfg);
+  waveform.setUseI2CSensor(cfg.useI2CSensor);
+  alarms.loadFromConfig(cfg);
+  storage.requestSave(cfg);
+  
+  uint8_t count = rxLen / 5;
+  sendFrame(TYPE_SET | 0x80, &count, 1);
+}
+
+// Same limits as the CLI and web API; flags must be exactly 0 or 1
+bool BinaryChannel::paramInRange(uint8_t id, float value) {
+  using namespace SettingLimits;
+  switch (id) {
+    case PARAM_AMPLITUDE: return inRange(AMPLITUDE, value);
+    case PARAM_FREQUENCY: return inRange(FREQUENCY, value);
+    case PARAM_BASELINE: return inRange(BASELINE, value);
+    case PARAM_PHASE: return inRange(PHASE, value);
+    case PARAM_ETCO2_HIGH:
+    case PARAM_ETCO2_LOW: return inRange(ETCO2_ALARM, value);
+    case PARAM_RR_HIGH:
+    case PARAM_RR_LOW: return inRange(RR_ALARM, value);
+    default: return value == 0 || value == 1;
+  }
+}
+
+bool BinaryChannel::setParam(ConfigStorage::Config& cfg, uint8_t id, float value) {
+  if (!paramInRange(id, value)) return false;
+  switch (id) {
+    case PARAM_AMPLITUDE: cfg.amplitude = value; break;
+    case PARAM_FREQUENCY: cfg.frequency = value; break;
+    case PARAM_BASELINE: cfg.baseline = value; break;
+    case PARAM_PHASE: cfg.phase = value * PI / 180.0; break;
+    case PARAM_ETCO2_HIGH: cfg.alarmHigh = value; break;
+    case PARAM_ETCO2_LOW: cfg.alarmLow = value; break;
+    case PARAM_ETCO2_HIGH_EN: cfg.alarmHighEnabled = value != 0; break;
+    case PARAM_ETCO2_LOW_EN: cfg.alarmLowEnabled = value != 0; break;
+    case PARAM_RR_HIGH: cfg.rrHigh = value; break;
+    case PARAM_RR_LOW: cfg.rrLow = value; break;
+    case PARAM_RR_HIGH_EN: cfg.rrHighEnabled = value != 0; break;
+    case PARAM_RR_LOW_EN: cfg.rrLowEnabled = value != 0; break;
+    case PARAM_LATCHING: cfg.alarmLatching = value != 0; break;
+    case PARAM_USE_I2C: cfg.useI2CSensor = value != 0; break;
+    default: return false;
+  }
+  return true;
+}
+
+float BinaryChannel::getParam(const ConfigStorage::Config& cfg, uint8_t id) {
+  switch (id) {
+    case PARAM_AMPLITUDE: return cfg.amplitude;
+    case PARAM_FREQUENCY: return cfg.frequency;
+    case PARAM_BASELINE: return cfg.baseline;
+    case PARAM_PHASE: return cfg.phase * 180.0 / PI;
+    case PARAM_ETCO2_HIGH: return cfg.alarmHigh;
+    case PARAM_ETCO2_LOW: return cfg.alarmLow;
+    case PARAM_ETCO2_HIGH_EN: return cfg.alarmHighEnabled;
+    case PARAM_ETCO2_LOW_EN: return cfg.alarmLowEnabled;
+    case PARAM_RR_HIGH: return cfg.rrHigh;
+    case PARAM_RR_LOW: return cfg.rrLow;
+    case PARAM_RR_HIGH_EN: return cfg.rrHighEnabled;
+    case PARAM_RR_LOW_EN: return cfg.rrLowEnabled;
+    case PARAM_LATCHING: return cfg.alarmLatching;
+    case PARAM_USE_I2C: return cfg.useI2CSensor;
+    default: return 0;
+  }
+}
+
+void BinaryChannel::pollStream() {
+  if (!streamPeriodUs) return;
+  uint32_t now = micros();
+  
+  if ((int32_t)(now - nextSampleUs) < 0) {
+    if (batchCount && now - batchStartUs >= BATCH_TIMEOUT_US) flushBatch();
+    return;
+  }
+  
+  // The loop stalled for more than ten periods: skip ahead instead of bursting
+  if (now - nextSampleUs > streamPeriodUs * 10) {
+    overruns++;
+    nextSampleUs = now;
+  }
+  nextSampleUs += streamPeriodUs;
+  
+  if (batchCount == 0) {
+    batchStartUs = now;
+    put32(batch, streamSeq);
+  }
+  
+  int32_t co2 = waveform.getSampleCenti();
+  int16_t centi = co2 > INT16_MAX ? INT16_MAX : (co2 < INT16_MIN ? INT16_MIN : co2);
+  uint8_t* record = &batch[4 + batchCount * SAMPLE_SIZE];
+  put32(record, now);
+  put16(record + 4, (uint16_t)centi);
+  batchCount++;
+  streamSeq++;
+  
+  if (batchCount == SAMPLES_PER_FRAME || now - batchStartUs >= BATCH_TIMEOUT_US) flushBatch();
+}
+
+void BinaryChannel::flushBatch() {
+  if (batchCount == 0) return;
+  
+  // Never block the loop on a slow host; the sequence number shows the gap
+  size_t len = 4 + batchCount * SAMPLE_SIZE;
+  if ((size_t)serial.availableForWrite() < len + 5) {
+    droppedFrames++;
+  } else {
+    sendFrame(TYPE_SAMPLES, batch, len);
+  }
+  batchCount = 0;
+}
+
+void BinaryChannel::sendFrame(uint8_t type, const uint8_t* payload, uint8_t len) {
+  txFrame[0] = SOF;
+  txFrame[1] = type;
+  txFrame[2] = len;
+  if (len) memcpy(&txFrame[3], payload, len);
+  put16(&txFrame[3 + len], crc16(&txFrame[1], len + 2));
+  serial.write(txFrame, len + 5);
+  txFrames++;
+}
+
+void BinaryChannel::sendNak(uint8_t error) {
+  sendFrame(TYPE_NAK, &error, 1);
+}
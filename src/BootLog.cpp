@@ -0,0 +1,31 @@
+#include "BootLog.h"
+
+BootLog::BootLog() : count(0), mux(portMUX_INITIALIZER_UNLOCKED) {}
+
+void BootLog::mark(const char* name) {
+  uint32_t now = micros();
+  portENTER_CRITICAL(&mux);
+  if (count < MAX_PHASES) {
+    phases[count].name = name;
+    phases[count].time = now;
+    count++;
+  }
+  portEXIT_CRITICAL(&mux);
+}
+
+uint32_t BootLog::getPhaseTime(const char* name) const {
+  for (uint8_t i = 0; i < count; i++) {
+    if (strcmp(phases[i].name, name) == 0) return phases[i].time;
+  }
+  return 0;
+}
+
+void BootLog::print(Print& out) const {
+  out.println("\n=== Boot Phases (ms since timer start) ===");
+  uint32_t prev = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    out.printf("%-10s %8.2f  (+%.2f)\n", phases[i].name, 
+               phases[i].time / 1000.0, (phases[i].time - prev) / 1000.0);
+    prev = phases[i].time;
+  }
+}
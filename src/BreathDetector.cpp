@@ -0,0 +1,67 @@
+#include "BreathDetector.h"
+
+BreathDetector::BreathDetector() { 
+  reset(); 
+}
+
+void BreathDetector::reset() {
+  envelopeMin = 0;
+  envelopeMax = 0;
+  peak = 0;
+  inExpiration = false;
+  lastRiseTime = 0;
+  etco2 = 0;
+  respRate = 0;
+  breathCount = 0;
+  started = false;
+  lastBreathTime = 0;
+}
+
+bool BreathDetector::update(uint32_t now, int32_t co2) {
+  if (!started) {
+    started = true;
+    lastBreathTime = now;
+  }
+  
+  envelopeMax = (co2 > envelopeMax - ENVELOPE_DECAY) ? co2 : envelopeMax - ENVELOPE_DECAY;
+  envelopeMin = (co2 < envelopeMin + ENVELOPE_DECAY) ? co2 : envelopeMin + ENVELOPE_DECAY;
+  
+  int32_t swing = envelopeMax - envelopeMin;
+  if (swing < MIN_SWING) return false;
+  
+  int32_t mid = envelopeMin + swing / 2;
+  int32_t hyst = swing / 10;
+  
+  if (!inExpiration && co2 > mid + hyst) {
+    inExpiration = true;
+    peak = co2;
+    if (lastRiseTime != 0 && now > lastRiseTime) {
+      respRate = (uint16_t)((60000UL + (now - lastRiseTime) / 2) / (now - lastRiseTime));
+    }
+    lastRiseTime = now;
+    return false;
+  }
+  
+  if (inExpiration) {
+    if (co2 > peak) peak = co2;
+    if (co2 < mid - hyst) {
+      inExpiration = false;
+      etco2 = (uint16_t)((peak + 5) / 10);
+      breathCount++;
+      lastBreathTime = now;
+      return true;
+    }
+  }
+  
+  return false;
+}
+
+uint16_t BreathDetector::getETCO2() const { return etco2; }
+uint16_t BreathDetector::getRespRate() const { return respRate; }
+uint32_t BreathDetector::getBreathCount() const { return breathCount; }
+
+BreathDetector::Status BreathDetector::status(uint32_t now, uint32_t timeoutMs) const {
+  if (!started) return WAITING;
+  if (now - lastBreathTime >= timeoutMs) return NO_BREATH;
+  return breathCount > 0 ? BREATHING : WAITING;
+}
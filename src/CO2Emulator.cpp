@@ -1,24 +1,49 @@
 #include "CO2Emulator.h"
 
 CO2Emulator::CO2Emulator()
-  : protocol(device, waveform, alarms, HOST_SERIAL),
+  : i2cBus(Wire, I2C_SDA, I2C_SCL),
+    i2cSensor(i2cBus),
+    protocol(device, waveform, alarms, HOST_SERIAL, trace),
     receiver(protocol, HOST_SERIAL),
+    bridge(HOST_SERIAL, SENSOR_SERIAL, trace, receiver),
     cli(waveform, alarms, device, storage, CMD_SERIAL),
+    binary(waveform, alarms, device, storage, CMD_SERIAL),
+#if WEB_ENABLED
     web(waveform, alarms, device, storage),
+#endif
+#if TFT_ENABLED
     tftDisplay(waveform, alarms, device),
-    lastWaveformUpdate(0), lastParamUpdate(0), dpiCounter(0) {}
+#endif
+    recorder(waveform),
+    player(waveform, recorder),
+    metrics(protocol, receiver, alarms, loopStats, heapMonitor),
+    snapshot(device, waveform, alarms, protocol),
+    lastWaveformUpdate(0), lastParamUpdate(0), dpiCounter(0),
+    componentCount(0), componentsStarted(0) {
+  #if TFT_ENABLED
+  addComponent(&tftDisplay);
+  #endif
+  #if WEB_ENABLED
+  addComponent(&web);
+  #endif
+}
 
+void CO2Emulator::addComponent(Component* component) {
+  if (componentCount < MAX_COMPONENTS) components[componentCount++] = component;
+}
+
+// Only what the host protocol needs runs here; registered components
+// (display, WiFi and web server) come up in backgroundBoot() while the
+// loop is already serving.
 void CO2Emulator::begin() {
+  bootLog.mark("start");
   CMD_SERIAL.begin(BAUD_RATE_CMD);
   HOST_SERIAL.begin(BAUD_RATE_HOST, SERIAL_8N1, 44, 43);  // RX=44, TX=43 for T-Display S3
-  
-  delay(1000);
-  
-  // Initialize TFT first
-  #if TFT_ENABLED
-  tftDisplay.begin();
-  tftDisplay.showMessage("Starting...");
-  #endif
+  protocol.begin();
+  protocol.setConfigStorage(&storage);
+  protocol.setFaultInjector(&faults);
+  receiver.begin();
+  bootLog.mark("serial");
   
   storage.begin();
   waveform.setI2CSensor(&i2cSensor);
@@ -27,55 +52,132 @@ void CO2Emulator::begin() {
   ConfigStorage::Config cfg = storage.loadConfig();
   waveform.loadFromConfig(cfg);
   alarms.loadFromConfig(cfg);
+  device.loadFromConfig(cfg);
+  bootLog.mark("config");
   
-  #if TFT_ENABLED
-  tftDisplay.showMessage("WiFi...");
+  trends.begin();
+  recorder.begin();
+  player.begin(recorder.isMounted());
+  bootLog.mark("recorder");
+  cli.setHeapMonitor(&heapMonitor);
+  cli.setBootLog(&bootLog);
+  cli.setI2CSensor(&i2cSensor);
+  cli.setBinaryChannel(&binary);
+  cli.setProtocolReceiver(&receiver);
+  cli.setLoopStats(&loopStats);
+  cli.setRecorder(&recorder);
+  cli.setPlayer(&player);
+  cli.setMetrics(&metrics);
+  cli.setSnapshot(&snapshot);
+  cli.setBridge(&bridge);
+  cli.setFaultInjector(&faults, &protocol);
+  binary.setSnapshot(&snapshot);
+  #if WEB_ENABLED
+  web.setTrendStore(&trends);
+  web.setProtocolTrace(&trace);
+  web.setI2CSensor(&i2cSensor);
+  web.setRecorder(&recorder);
+  web.setPlayer(&player);
+  web.setMetrics(&metrics);
+  web.setSnapshot(&snapshot);
+  web.setBridge(&bridge);
+  web.setFaultInjector(&faults, &protocol);
   #endif
+  bootLog.mark("protocol");
   
-  web.begin();
-  
-  #if TFT_ENABLED
-  tftDisplay.showMessage("Ready!");
-  delay(1000);
-  tftDisplay.clear();
-  #endif
+  if (componentCount) xTaskCreatePinnedToCore(backgroundBootTask, "boot", 8192, this, 1, NULL, 0);
   
   cli.printWelcome();
 }
 
+void CO2Emulator::backgroundBootTask(void* param) {
+  static_cast<CO2Emulator*>(param)->backgroundBoot();
+  vTaskDelete(NULL);
+}
+
+void CO2Emulator::backgroundBoot() {
+  for (uint8_t i = 0; i < componentCount; i++) {
+    components[i]->begin();
+    bootLog.mark(components[i]->getName());
+    componentsStarted = i + 1;
+  }
+}
+
 void CO2Emulator::update() {
-  uint32_t now = millis();
+  loopStats.beginPass();
+  uint32_t now = Clock::nowMs();
   
   cli.update();
+  i2cSensor.update(now);
+  
+  // Protocol tick: must not touch the heap (checked in alloccheck builds)
+  heapMonitor.beginTick();
   receiver.update();
+  protocol.update(now);
   device.updateZero();
-  web.update();
   
-  #if TFT_ENABLED
-  tftDisplay.update();
-  #endif
-  
-  if (device.isContinuousMode() && (now - lastWaveformUpdate >= WAVEFORM_INTERVAL)) {
+  if (now - lastWaveformUpdate >= WAVEFORM_INTERVAL) {
     lastWaveformUpdate = now;
     
-    bool includeDPI = false;
-    uint8_t dpiType = 0;
+    // Presets switch as a whole between two samples
+    ConfigStorage::Config staged;
+    if (storage.takeStagedConfig(staged)) {
+      waveform.loadFromConfig(staged);
+      alarms.loadFromConfig(staged);
+      device.loadFromConfig(staged);
+    }
+    
+    // A replay stands in for the generator everywhere the sample goes
+    int32_t replayed;
+    if (player.getSample(now, replayed)) waveform.setExternalSample(replayed);
+    else if (waveform.hasExternalSample()) waveform.clearExternalSample();
+    
+    int32_t co2 = waveform.getSampleCenti();
+    trends.addSample(now, co2 / 100.0f);
+    recorder.addSample(now, co2);
+    if (breathDetector.update(now, co2)) {
+      trends.addBreath(now, breathDetector.getETCO2(), breathDetector.getRespRate());
+    }
+    alarms.evaluate(now, breathDetector.getETCO2(), breathDetector.getRespRate(),
+                    breathDetector.status(now, device.getNoBreathTimeout() * 1000UL));
     
-    if (now - lastParamUpdate >= PARAM_INTERVAL) {
-      lastParamUpdate = now;
-      includeDPI = true;
+    // While bridging the real sensor talks to the host; the sample is
+    // only offered as a replacement waveform
+    if (bridge.isActive()) {
+      bridge.publishSample(device.toCO2Units(co2 > 0 ? co2 : 0));
+    } else if (device.isContinuousMode()) {
+      bool includeDPI = false;
+      uint8_t dpiType = 0;
       
-      switch (dpiCounter % 4) {
-        case 0: dpiType = Protocol::DPI_CO2_STATUS; break;
-        case 1: dpiType = Protocol::DPI_ETCO2; break;
-        case 2: dpiType = Protocol::DPI_RESP_RATE; break;
-        case 3: dpiType = Protocol::DPI_INSP_CO2; break;
+      if (now - lastParamUpdate >= PARAM_INTERVAL) {
+        lastParamUpdate = now;
+        includeDPI = true;
+        
+        switch (dpiCounter % 4) {
+          case 0: dpiType = Protocol::DPI_CO2_STATUS; break;
+          case 1: dpiType = Protocol::DPI_ETCO2; break;
+          case 2: dpiType = Protocol::DPI_RESP_RATE; break;
+          case 3: dpiType = Protocol::DPI_INSP_CO2; break;
+        }
+        dpiCounter++;
+        
+        device.updateParameters(waveform.getETCO2(), waveform.getRespiratoryRate());
       }
-      dpiCounter++;
       
-      device.updateParameters(waveform.getETCO2(), waveform.getRespiratoryRate());
+      protocol.sendWaveformPacket(co2, includeDPI, dpiType);
     }
-    
-    protocol.sendWaveformPacket(includeDPI, dpiType);
   }
+  
+  heapMonitor.endTick();
+  
+  storage.update();
+  recorder.update();
+  player.update();
+  snapshot.update();
+  bridge.update();
+  
+  uint8_t started = componentsStarted;
+  for (uint8_t i = 0; i < started; i++) components[i]->update();
+  
+  loopStats.endPass();
 }
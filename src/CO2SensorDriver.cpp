@@ -0,0 +1,95 @@
+#include "CO2SensorDriver.h"
+
+uint8_t CO2SensorDriver::sensirionCRC(const uint8_t* data, size_t len) {
+  uint8_t crc = 0xFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+bool CO2SensorDriver::sensirionCommand(I2CBus& bus, uint8_t address, uint16_t cmd) {
+  const uint8_t buf[2] = {(uint8_t)(cmd >> 8), (uint8_t)cmd};
+  return bus.write(address, buf, 2);
+}
+
+bool CO2SensorDriver::sensirionCommand(I2CBus& bus, uint8_t address, uint16_t cmd, uint16_t arg) {
+  uint8_t buf[5] = {(uint8_t)(cmd >> 8), (uint8_t)cmd, (uint8_t)(arg >> 8), (uint8_t)arg, 0};
+  buf[4] = sensirionCRC(&buf[2], 2);
+  return bus.write(address, buf, 5);
+}
+
+// ============================================================================
+// Generic template sensor
+// ============================================================================
+
+bool GenericCO2Driver::startConversion(I2CBus& bus) {
+  const uint8_t cmd = 0x00;  // Read command
+  return bus.write(getAddress(), &cmd, 1);
+}
+
+bool GenericCO2Driver::readResult(I2CBus& bus, float& co2Value) {
+  uint8_t raw[2];
+  if (!bus.read(getAddress(), raw, 2)) return false;
+  
+  uint16_t rawValue = (raw[0] << 8) | raw[1];
+  co2Value = rawValue * 0.01;
+  
+  return true;
+}
+
+// ============================================================================
+// SCD30
+// ============================================================================
+
+bool SCD30Driver::init(I2CBus& bus) {
+  if (!sensirionCommand(bus, getAddress(), 0x4600, getIntervalMs() / 1000)) return false;  // Set interval
+  return sensirionCommand(bus, getAddress(), 0x0010, 0);  // Continuous, no pressure compensation
+}
+
+bool SCD30Driver::startConversion(I2CBus& bus) {
+  return sensirionCommand(bus, getAddress(), 0x0300);  // Read measurement
+}
+
+bool SCD30Driver::readResult(I2CBus& bus, float& co2Value) {
+  uint8_t raw[18];
+  if (!bus.read(getAddress(), raw, sizeof(raw))) return false;
+  if (sensirionCRC(&raw[0], 2) != raw[2] || sensirionCRC(&raw[3], 2) != raw[5]) return false;
+  
+  uint32_t bits = ((uint32_t)raw[0] << 24) | ((uint32_t)raw[1] << 16) | 
+                  ((uint32_t)raw[3] << 8) | raw[4];
+  float ppm;
+  memcpy(&ppm, &bits, sizeof(ppm));
+  co2Value = ppmToMmHg(ppm);
+  
+  return true;
+}
+
+// ============================================================================
+// SCD4x
+// ============================================================================
+
+bool SCD4xDriver::init(I2CBus& bus) {
+  // Fails harmlessly if the sensor is already measuring after an MCU reset
+  sensirionCommand(bus, getAddress(), 0x21B1);  // Start periodic measurement
+  return true;
+}
+
+bool SCD4xDriver::startConversion(I2CBus& bus) {
+  return sensirionCommand(bus, getAddress(), 0xEC05);  // Read measurement
+}
+
+bool SCD4xDriver::readResult(I2CBus& bus, float& co2Value) {
+  uint8_t raw[9];
+  if (!bus.read(getAddress(), raw, sizeof(raw))) return false;
+  if (sensirionCRC(&raw[0], 2) != raw[2]) return false;
+  
+  uint16_t ppm = (raw[0] << 8) | raw[1];
+  if (ppm == 0) return false;  // No new data yet
+  co2Value = ppmToMmHg(ppm);
+  
+  return true;
+}
@@ -0,0 +1,17 @@
+#include "Clock.h"
+
+bool Clock::virtualTime = false;
+uint32_t Clock::virtualMs = 0;
+
+void Clock::useVirtual(uint32_t startMs) {
+  virtualMs = startMs;
+  virtualTime = true;
+}
+
+void Clock::advance(uint32_t ms) {
+  virtualMs += ms;
+}
+
+bool Clock::isVirtual() {
+  return virtualTime;
+}
@@ -1,17 +1,270 @@
 #include "CommandLineInterface.h"
+#if WEB_ENABLED
 #include <WiFi.h>
+#endif
 
 CommandLineInterface::CommandLineInterface(WaveformGenerator& wave, AlarmManager& alarm, 
                                            DeviceState& dev, ConfigStorage& stor, Stream& ser)
-  : waveform(wave), alarms(alarm), device(dev), storage(stor), serial(ser) {}
+  : waveform(wave), alarms(alarm), device(dev), storage(stor), serial(ser),
+    heapMonitor(nullptr), bootLog(nullptr), i2cSensor(nullptr), binary(nullptr), receiver(nullptr), loopStats(nullptr), recorder(nullptr), player(nullptr), metrics(nullptr), snapshot(nullptr), bridge(nullptr), faults(nullptr), faultOwner(nullptr), lineLength(0) {
+  lineBuffer[0] = '\0';
+}
+
+void CommandLineInterface::setHeapMonitor(HeapMonitor* monitor) {
+  heapMonitor = monitor;
+}
+
+void CommandLineInterface::setBootLog(BootLog* log) {
+  bootLog = log;
+}
+
+void CommandLineInterface::setI2CSensor(I2CSensorInterface* sensor) {
+  i2cSensor = sensor;
+}
+
+void CommandLineInterface::setBinaryChannel(BinaryChannel* channel) {
+  binary = channel;
+}
+
+void CommandLineInterface::setProtocolReceiver(ProtocolReceiver* rx) {
+  receiver = rx;
+}
+
+void CommandLineInterface::setLoopStats(LoopStats* stats) {
+  loopStats = stats;
+}
+
+void CommandLineInterface::setRecorder(WaveformRecorder* rec) {
+  recorder = rec;
+}
+
+void CommandLineInterface::setPlayer(WaveformPlayer* play) {
+  player = play;
+}
+
+void CommandLineInterface::setMetrics(MetricsExporter* exporter) {
+  metrics = exporter;
+}
+
+void CommandLineInterface::setSnapshot(StateSnapshot* snap) {
+  snapshot = snap;
+}
+
+void CommandLineInterface::setBridge(PassthroughBridge* passthrough) {
+  bridge = passthrough;
+}
+
+void CommandLineInterface::setFaultInjector(FaultInjector* injector, ProtocolHandler* owner) {
+  faults = injector;
+  faultOwner = owner;
+}
 
 void CommandLineInterface::printHelp() {
   serial.println("\n=== CO2 Emulator Commands ===");
   serial.println("Wave: amp/freq/base/phase <value>");
   serial.println("Alarm: high/low/highen/lowen <value>");
-  serial.println("I2C: usei2c <0/1>");
-  serial.println("Config: save/load/clear");
-  serial.println("Info: status/help/ip");
+  serial.println("       rrhigh/rrlow/rrhighen/rrlowen/latch <value>, alarms, ack");
+  serial.println("I2C: usei2c <0/1>, sensor [auto/scd30/scd4x/generic]");
+  serial.println("Config: save/load/clear/autosave <0/1>");
+  serial.println("Preset: preset save/load/del <name>, preset list");
+  serial.println("Record: rec [start/stop/del <n>], rec play <n>/halt");
+  serial.println("State: snap (capture as hex), snap <hex> (restore)");
+  serial.println("Bridge: bridge [on/off], bridge wave <0/1>, bridge status <b1> <b2> <b3>");
+  serial.println("Faults: fault <name> <percent> [every], fault seed/delayms <n>, fault off");
+  serial.println("Info: status/help/ip/heap/boot/latency [reset]/loop [reset]/metrics");
+  serial.println("Rig: binary (framed binary mode, see README)");
+}
+
+ConfigStorage::Config CommandLineInterface::currentConfig() const {
+  ConfigStorage::Config cfg = ConfigStorage::defaults();
+  waveform.saveToConfig(cfg);
+  alarms.saveToConfig(cfg);
+  device.saveToConfig(cfg);
+  return cfg;
+}
+
+void CommandLineInterface::settingChanged() {
+  storage.requestSave(currentConfig());
+}
+
+// Numeric setting argument, checked against the limits every path shares
+bool CommandLineInterface::parseSetting(const char* arg, const SettingLimits::Range& range, float& value) {
+  char* end;
+  value = strtof(arg, &end);
+  if (end == arg || *end != '\0' || !SettingLimits::inRange(range, value)) {
+    serial.print("Out of range ("); serial.print(range.min); serial.print(" to ");
+    serial.print(range.max); serial.println(")");
+    return false;
+  }
+  return true;
+}
+
+void CommandLineInterface::handlePreset(char* arg) {
+  char* name = strchr(arg, ' ');
+  if (name) {
+    *name++ = '\0';
+    while (*name == ' ') name++;
+  } else {
+    name = arg + strlen(arg);
+  }
+  
+  if (strcmp(arg, "list") == 0) {
+    char names[ConfigStorage::MAX_PRESETS][ConfigStorage::PRESET_NAME_LEN];
+    uint8_t count = storage.getPresetNames(names);
+    serial.print("Presets ("); serial.print(count);
+    serial.print("/"); serial.print(ConfigStorage::MAX_PRESETS); serial.println("):");
+    for (uint8_t i = 0; i < count; i++) {
+      serial.print("  "); serial.println(names[i]);
+    }
+  }
+  else if (strcmp(arg, "save") == 0 && *name) {
+    if (!ConfigStorage::isValidPresetName(name)) {
+      serial.print("Preset name too long (max ");
+      serial.print(ConfigStorage::PRESET_NAME_LEN - 1); serial.println(" characters)");
+    } else {
+      serial.println(storage.savePreset(name, currentConfig()) ? "Preset saved" : "Preset table full");
+    }
+  }
+  else if (strcmp(arg, "load") == 0 && *name) {
+    ConfigStorage::Config cfg;
+    if (storage.getPreset(name, cfg)) {
+      storage.stageConfig(cfg);
+      serial.print("Preset applied: "); serial.println(name);
+    } else {
+      serial.println("No such preset");
+    }
+  }
+  else if (strcmp(arg, "del") == 0 && *name) {
+    serial.println(storage.deletePreset(name) ? "Preset deleted" : "No such preset");
+  }
+  else {
+    serial.println("Usage: preset save/load/del <name>, preset list");
+  }
+}
+
+void CommandLineInterface::handleSensor(const char* name) {
+  if (!i2cSensor) return;
+  
+  if (!name) {
+    serial.print("Sensor drivers (active: "); serial.print(i2cSensor->getActiveDriverName());
+    serial.println(i2cSensor->isAvailable() ? ")" : ", absent)");
+    serial.println("  auto");
+    for (uint8_t i = 0; i < I2CSensorInterface::DRIVER_COUNT; i++) {
+      serial.print("  "); serial.println(i2cSensor->getDriverName(i));
+    }
+    return;
+  }
+  
+  int8_t index = i2cSensor->findDriver(name);
+  if (index < I2CSensorInterface::DRIVER_AUTO) {
+    serial.println("Unknown sensor driver");
+    return;
+  }
+  i2cSensor->requestDriver(index);
+  serial.print("Sensor driver: "); serial.println(name);
+}
+
+void CommandLineInterface::handleRecorder(char* arg) {
+  if (strcmp(arg, "start") == 0) recorder->requestStart();
+  else if (strcmp(arg, "stop") == 0) recorder->requestStop();
+  else if (strncmp(arg, "del ", 4) == 0) {
+    serial.println(recorder->deleteFile(strtoul(arg + 4, nullptr, 10)) ? "Recording deleted" : "Cannot delete recording");
+  }
+  else if (strncmp(arg, "play ", 5) == 0 && player) {
+    uint32_t seq = strtoul(arg + 5, nullptr, 10);
+    if (seq) player->requestPlay(seq);
+    else serial.println("Usage: rec play <n>");
+  }
+  else if (strcmp(arg, "halt") == 0 && player) player->requestStop();
+  else {
+    recorder->printStatus(serial);
+    if (player) player->printStatus(serial);
+  }
+}
+
+// "snap" prints the state as one hex line; "snap <hex>" restores it
+void CommandLineInterface::handleSnapshot(char* arg) {
+  uint8_t record[StateSnapshot::MAX_SIZE];
+  
+  if (*arg == '\0') {
+    size_t len = snapshot->capture(record, sizeof(record));
+    serial.print("Snapshot: "); serial.print(len);
+    serial.print(" bytes, captured in "); serial.print(snapshot->getLastCaptureUs()); serial.println(" us");
+    for (size_t i = 0; i < len; i++) serial.printf("%02X", record[i]);
+    serial.println();
+    return;
+  }
+  
+  size_t len = 0;
+  for (char* p = arg; p[0] && p[1]; p += 2) {
+    char hex[3] = { p[0], p[1], '\0' };
+    char* end;
+    uint8_t b = (uint8_t)strtoul(hex, &end, 16);
+    if (*end || len == sizeof(record)) {
+      serial.println("Invalid snapshot hex");
+      return;
+    }
+    record[len++] = b;
+  }
+  
+  const char* error = snapshot->restore(record, len);
+  if (error) {
+    serial.print("Snapshot not restored: "); serial.println(error);
+  } else {
+    serial.print("Snapshot restored in "); serial.print(snapshot->getLastRestoreUs()); serial.println(" us");
+  }
+}
+
+void CommandLineInterface::handleBridge(char* arg) {
+  if (strcmp(arg, "on") == 0) bridge->requestStart();
+  else if (strcmp(arg, "off") == 0) bridge->requestStop();
+  else if (strncmp(arg, "wave ", 5) == 0) {
+    bridge->setReplaceWaveform(atoi(arg + 5) != 0);
+    serial.print("Bridge waveform ");
+    serial.println(bridge->isReplacingWaveform() ? "replaced" : "passed through");
+  }
+  else if (strncmp(arg, "status ", 7) == 0) {
+    char* p = arg + 7;
+    uint8_t b1 = strtoul(p, &p, 0);
+    uint8_t b2 = strtoul(p, &p, 0);
+    uint8_t b3 = strtoul(p, &p, 0);
+    bridge->setStatusMask(b1, b2, b3);
+    serial.printf("Bridge status mask: %02X %02X %02X\n",
+                  bridge->getStatusMask(0), bridge->getStatusMask(1), bridge->getStatusMask(2));
+  }
+  else bridge->printStatus(serial);
+}
+
+// "fault drop 2.5" drops 2.5 % of packets, "fault sync 0 50" jumps every 50th
+// The injector runs on the UART task under the protocol lock, so every
+// change is made holding it
+void CommandLineInterface::handleFault(char* arg) {
+  char* value = strchr(arg, ' ');
+  if (value) *value++ = '\0';
+  
+  int8_t fault = -1;
+  uint16_t probability = 0, every = 0;
+  if (*arg && strcmp(arg, "off") != 0 && strcmp(arg, "seed") != 0 && strcmp(arg, "delayms") != 0) {
+    fault = FaultInjector::findFault(arg);
+    if (fault < 0 || !value) {
+      serial.println("Usage: fault <checksum/drop/sync/delay/truncate/nack> <percent> [every]");
+      return;
+    }
+    char* count = strchr(value, ' ');
+    if (count) *count++ = '\0';
+    if (!FaultInjector::parsePercent(value, probability) || (count && !FaultInjector::parseEvery(count, every))) {
+      serial.print("Out of range (percent 0 to 100, every 0 to "); serial.print(UINT16_MAX); serial.println(")");
+      return;
+    }
+  }
+  
+  if (faultOwner) faultOwner->beginExclusive();
+  if (fault >= 0) faults->setRule(fault, probability, every);
+  else if (strcmp(arg, "off") == 0) faults->clear();
+  else if (strcmp(arg, "seed") == 0 && value) faults->setSeed(strtoul(value, nullptr, 0));
+  else if (strcmp(arg, "delayms") == 0 && value) faults->setDelayMs(atoi(value));
+  if (faultOwner) faultOwner->endExclusive();
+  faults->printStatus(serial);
 }
 
 void CommandLineInterface::printStatus() {
@@ -23,110 +276,226 @@ void CommandLineInterface::printStatus() {
   
   serial.print("Source: "); 
   serial.println(waveform.isUsingI2CSensor() ? "I2C Sensor" : "Simulation");
+  if (i2cSensor) i2cSensor->printStats(serial);
   
   serial.print("Alarms: high="); serial.print(alarms.getHighThreshold());
   serial.print(alarms.isHighEnabled() ? " (ON)" : " (OFF)");
   serial.print(" low="); serial.print(alarms.getLowThreshold());
   serial.println(alarms.isLowEnabled() ? " (ON)" : " (OFF)");
+  serial.print("RR alarms: high="); serial.print(alarms.getRRHighThreshold());
+  serial.print(alarms.isRRHighEnabled() ? " (ON)" : " (OFF)");
+  serial.print(" low="); serial.print(alarms.getRRLowThreshold());
+  serial.print(alarms.isRRLowEnabled() ? " (ON)" : " (OFF)");
+  serial.print(" latching="); serial.println(alarms.isLatching() ? "ON" : "OFF");
   
   serial.print("Device: ");
   serial.print(device.isContinuousMode() ? "CONTINUOUS" : "IDLE");
   serial.print(" init=");
   serial.println(device.isInitialized() ? "YES" : "NO");
+  
+  serial.print("Storage: writes="); serial.print(storage.getWriteCount());
+  serial.print(" autosave="); 
+  serial.println(storage.isAutosaveEnabled() ? "ON" : "OFF");
 }
 
-void CommandLineInterface::processLine(String line) {
-  line.trim();
-  line.toLowerCase();
+void CommandLineInterface::processLine(char* line) {
+  // Trim and lowercase in place; the line never leaves lineBuffer
+  while (*line == ' ' || *line == '\t') line++;
+  char* end = line + strlen(line);
+  while (end > line && (end[-1] == ' ' || end[-1] == '\t')) *--end = '\0';
+  for (char* p = line; *p; p++) *p = tolower(*p);
   
-  int spaceIdx = line.indexOf(' ');
-  String cmd = spaceIdx > 0 ? line.substring(0, spaceIdx) : line;
-  String arg = spaceIdx > 0 ? line.substring(spaceIdx + 1) : "";
+  char* arg = strchr(line, ' ');
+  if (arg) {
+    *arg++ = '\0';
+    while (*arg == ' ') arg++;
+  } else {
+    arg = end;
+  }
+  const char* cmd = line;
+  bool hasArg = *arg != '\0';
+  float value;
   
-  if (cmd == "help") printHelp();
-  else if (cmd == "status") printStatus();
-  else if (cmd == "amp" && arg.length() > 0) {
-    waveform.setAmplitude(arg.toFloat());
+  if (strcmp(cmd, "help") == 0) printHelp();
+  else if (strcmp(cmd, "status") == 0) printStatus();
+  else if (strcmp(cmd, "amp") == 0 && hasArg) {
+    if (!parseSetting(arg, SettingLimits::AMPLITUDE, value)) return;
+    waveform.setAmplitude(value);
     serial.print("Amplitude: "); serial.println(waveform.getAmplitude());
+    settingChanged();
   }
-  else if (cmd == "freq" && arg.length() > 0) {
-    waveform.setFrequency(arg.toFloat());
+  else if (strcmp(cmd, "freq") == 0 && hasArg) {
+    if (!parseSetting(arg, SettingLimits::FREQUENCY, value)) return;
+    waveform.setFrequency(value);
     serial.print("Frequency: "); serial.println(waveform.getFrequency());
+    settingChanged();
   }
-  else if (cmd == "base" && arg.length() > 0) {
-    waveform.setBaseline(arg.toFloat());
+  else if (strcmp(cmd, "base") == 0 && hasArg) {
+    if (!parseSetting(arg, SettingLimits::BASELINE, value)) return;
+    waveform.setBaseline(value);
     serial.print("Baseline: "); serial.println(waveform.getBaseline());
+    settingChanged();
   }
-  else if (cmd == "phase" && arg.length() > 0) {
-    waveform.setPhase(arg.toFloat() * PI / 180.0);
-    serial.print("Phase: "); serial.println(arg.toFloat());
+  else if (strcmp(cmd, "phase") == 0 && hasArg) {
+    if (!parseSetting(arg, SettingLimits::PHASE, value)) return;
+    waveform.setPhase(value * PI / 180.0);
+    serial.print("Phase: "); serial.println(value);
+    settingChanged();
   }
-  else if (cmd == "high" && arg.length() > 0) {
-    alarms.setHighThreshold(arg.toFloat());
+  else if (strcmp(cmd, "high") == 0 && hasArg) {
+    if (!parseSetting(arg, SettingLimits::ETCO2_ALARM, value)) return;
+    alarms.setHighThreshold(value);
     serial.print("High alarm: "); serial.println(alarms.getHighThreshold());
+    settingChanged();
   }
-  else if (cmd == "low" && arg.length() > 0) {
-    alarms.setLowThreshold(arg.toFloat());
+  else if (strcmp(cmd, "low") == 0 && hasArg) {
+    if (!parseSetting(arg, SettingLimits::ETCO2_ALARM, value)) return;
+    alarms.setLowThreshold(value);
     serial.print("Low alarm: "); serial.println(alarms.getLowThreshold());
+    settingChanged();
   }
-  else if (cmd == "highen" && arg.length() > 0) {
-    alarms.enableHigh(arg.toInt() != 0);
+  else if (strcmp(cmd, "highen") == 0 && hasArg) {
+    alarms.enableHigh(atoi(arg) != 0);
     serial.print("High alarm "); 
     serial.println(alarms.isHighEnabled() ? "enabled" : "disabled");
+    settingChanged();
   }
-  else if (cmd == "lowen" && arg.length() > 0) {
-    alarms.enableLow(arg.toInt() != 0);
+  else if (strcmp(cmd, "lowen") == 0 && hasArg) {
+    alarms.enableLow(atoi(arg) != 0);
     serial.print("Low alarm "); 
     serial.println(alarms.isLowEnabled() ? "enabled" : "disabled");
+    settingChanged();
+  }
+  else if (strcmp(cmd, "rrhigh") == 0 && hasArg) {
+    if (!parseSetting(arg, SettingLimits::RR_ALARM, value)) return;
+    alarms.setRRHighThreshold(value);
+    serial.print("High RR alarm: "); serial.println(alarms.getRRHighThreshold());
+    settingChanged();
+  }
+  else if (strcmp(cmd, "rrlow") == 0 && hasArg) {
+    if (!parseSetting(arg, SettingLimits::RR_ALARM, value)) return;
+    alarms.setRRLowThreshold(value);
+    serial.print("Low RR alarm: "); serial.println(alarms.getRRLowThreshold());
+    settingChanged();
+  }
+  else if (strcmp(cmd, "rrhighen") == 0 && hasArg) {
+    alarms.enableRRHigh(atoi(arg) != 0);
+    serial.print("High RR alarm "); 
+    serial.println(alarms.isRRHighEnabled() ? "enabled" : "disabled");
+    settingChanged();
+  }
+  else if (strcmp(cmd, "rrlowen") == 0 && hasArg) {
+    alarms.enableRRLow(atoi(arg) != 0);
+    serial.print("Low RR alarm "); 
+    serial.println(alarms.isRRLowEnabled() ? "enabled" : "disabled");
+    settingChanged();
+  }
+  else if (strcmp(cmd, "latch") == 0 && hasArg) {
+    alarms.setLatching(atoi(arg) != 0);
+    serial.print("Alarm latching "); 
+    serial.println(alarms.isLatching() ? "enabled" : "disabled");
+    settingChanged();
   }
-  else if (cmd == "usei2c" && arg.length() > 0) {
-    waveform.setUseI2CSensor(arg.toInt() != 0);
+  else if (strcmp(cmd, "alarms") == 0) {
+    alarms.printStatus(serial);
+  }
+  else if (strcmp(cmd, "ack") == 0) {
+    alarms.acknowledge();
+    serial.println("Alarms acknowledged");
+  }
+  else if (strcmp(cmd, "usei2c") == 0 && hasArg) {
+    waveform.setUseI2CSensor(atoi(arg) != 0);
     serial.print("I2C sensor "); 
     serial.println(waveform.isUsingI2CSensor() ? "enabled" : "disabled");
+    settingChanged();
   }
-  else if (cmd == "save") {
-    ConfigStorage::Config cfg;
-    cfg.amplitude = waveform.getAmplitude();
-    cfg.frequency = waveform.getFrequency();
-    cfg.baseline = waveform.getBaseline();
-    cfg.phase = waveform.getPhase();
-    cfg.alarmHigh = alarms.getHighThreshold();
-    cfg.alarmLow = alarms.getLowThreshold();
-    cfg.alarmHighEnabled = alarms.isHighEnabled();
-    cfg.alarmLowEnabled = alarms.isLowEnabled();
-    cfg.useI2CSensor = waveform.isUsingI2CSensor();
-    storage.saveConfig(cfg);
-  }
-  else if (cmd == "load") {
+  else if (strcmp(cmd, "sensor") == 0) {
+    handleSensor(hasArg ? arg : nullptr);
+  }
+  else if (strcmp(cmd, "save") == 0) {
+    storage.saveConfig(currentConfig());
+  }
+  else if (strcmp(cmd, "load") == 0) {
     ConfigStorage::Config cfg = storage.loadConfig();
     waveform.loadFromConfig(cfg);
     alarms.loadFromConfig(cfg);
+    device.loadFromConfig(cfg);
     printStatus();
   }
-  else if (cmd == "clear") {
+  else if (strcmp(cmd, "clear") == 0) {
     storage.clearConfig();
   }
-  else if (cmd == "ip") {
+  else if (strcmp(cmd, "autosave") == 0 && hasArg) {
+    storage.setAutosave(atoi(arg) != 0);
+    serial.print("Autosave ");
+    serial.println(storage.isAutosaveEnabled() ? "enabled" : "disabled");
+  }
+  else if (strcmp(cmd, "preset") == 0 && hasArg) {
+    handlePreset(arg);
+  }
+  else if (strcmp(cmd, "rec") == 0 && recorder) {
+    handleRecorder(arg);
+  }
+  else if (strcmp(cmd, "heap") == 0) {
+    if (heapMonitor) heapMonitor->printReport(serial);
+  }
+  else if (strcmp(cmd, "latency") == 0 && receiver) {
+    if (hasArg && strcmp(arg, "reset") == 0) receiver->resetLatency();
+    receiver->printLatency(serial);
+  }
+  else if (strcmp(cmd, "loop") == 0 && loopStats) {
+    loopStats->print(serial);
+    if (hasArg && strcmp(arg, "reset") == 0) loopStats->reset();
+  }
+  else if (strcmp(cmd, "snap") == 0 && snapshot) {
+    handleSnapshot(arg);
+  }
+  else if (strcmp(cmd, "bridge") == 0 && bridge) {
+    handleBridge(arg);
+  }
+  else if (strcmp(cmd, "fault") == 0 && faults) {
+    handleFault(arg);
+  }
+  else if (strcmp(cmd, "metrics") == 0 && metrics) {
+    metrics->write(serial);
+  }
+  else if (strcmp(cmd, "boot") == 0) {
+    if (bootLog) bootLog->print(serial);
+  }
+  else if (strcmp(cmd, "binary") == 0 && binary) {
+    serial.println("Binary mode");
+    binary->activate();
+  }
+#if WEB_ENABLED
+  else if (strcmp(cmd, "ip") == 0) {
     serial.print("IP Address: ");
     serial.println(WiFi.localIP());
   }
+#endif
   else {
     serial.println("Unknown command. Type 'help'");
   }
 }
 
 void CommandLineInterface::update() {
-  while (serial.available()) {
+  while (serial.available() && !(binary && binary->isActive())) {
     char c = serial.read();
-    if (c == '\n' || c == '\r') {
-      if (lineBuffer.length() > 0) {
+    if ((uint8_t)c == BinaryChannel::SOF && lineLength == 0 && binary) {
+      // Rigs can start framing without sending 'binary' first
+      binary->activate();
+      binary->feed(c);
+    } else if (c == '\n' || c == '\r') {
+      if (lineLength > 0) {
+        lineBuffer[lineLength] = '\0';
         processLine(lineBuffer);
-        lineBuffer = "";
+        lineLength = 0;
       }
-    } else {
-      lineBuffer += c;
+    } else if (lineLength < LINE_BUFFER_SIZE - 1) {
+      lineBuffer[lineLength++] = c;
     }
   }
+  
+  if (binary && binary->isActive()) binary->update();
 }
 
 void CommandLineInterface::printWelcome() {
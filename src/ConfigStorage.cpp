@@ -1,41 +1,338 @@
 #include "ConfigStorage.h"
 #include "Config.h"
 
+static const char* const LEGACY_KEYS[] = { "amplitude", "frequency", "baseline", "phase", "alarmHigh",
+                                           "alarmLow", "alarmHighEn", "alarmLowEn", "useI2C" };
+
+ConfigStorage::ConfigStorage() 
+  : lock(nullptr), writeCount(0), autosave(false), savePending(false), lastChangeTime(0),
+    pendingMux(portMUX_INITIALIZER_UNLOCKED), presetCount(0), stagedReady(false) {}
+
 bool ConfigStorage::begin() {
-  return prefs.begin("co2-emulator", false);
+  lock = xSemaphoreCreateRecursiveMutex();
+  if (!prefs.begin("co2-emulator", false)) return false;
+  loadPresets();
+  return true;
 }
 
-void ConfigStorage::saveConfig(const Config& cfg) {
-  prefs.putFloat("amplitude", cfg.amplitude);
-  prefs.putFloat("frequency", cfg.frequency);
-  prefs.putFloat("baseline", cfg.baseline);
-  prefs.putFloat("phase", cfg.phase);
-  prefs.putFloat("alarmHigh", cfg.alarmHigh);
-  prefs.putFloat("alarmLow", cfg.alarmLow);
-  prefs.putBool("alarmHighEn", cfg.alarmHighEnabled);
-  prefs.putBool("alarmLowEn", cfg.alarmLowEnabled);
-  prefs.putBool("useI2C", cfg.useI2CSensor);
+ConfigStorage::Config ConfigStorage::defaults() {
+  Config cfg;
+  cfg.amplitude = 38.0;
+  cfg.frequency = 0.25;
+  cfg.baseline = 0.0;
+  cfg.phase = 0.0;
+  cfg.alarmHigh = 50.0;
+  cfg.alarmLow = 30.0;
+  cfg.alarmHighEnabled = false;
+  cfg.alarmLowEnabled = false;
+  cfg.useI2CSensor = false;
+  cfg.rrHigh = 30.0;
+  cfg.rrLow = 8.0;
+  cfg.rrHighEnabled = false;
+  cfg.rrLowEnabled = false;
+  cfg.alarmLatching = false;
+  cfg.etco2TimePeriod = 10;
+  cfg.noBreathTimeout = 20;
+  cfg.co2Units = 0;
+  cfg.zeroGasType = 0;
+  return cfg;
+}
+
+uint32_t ConfigStorage::crc32(const uint8_t* data, size_t len, uint32_t crc) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *data++;
+    for (uint8_t i = 0; i < 8; i++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+// Bytes of Config that hold fields of the given schema. A writer's size
+// also counts its trailing padding, and a later schema may place its first
+// field there (v3's etco2TimePeriod sits in v2's padding), so an older
+// blob is only trusted up to the first field its schema did not have.
+size_t ConfigStorage::schemaSize(uint16_t version) {
+  switch (version) {
+    case 1: return offsetof(Config, rrHigh);
+    case 2: return offsetof(Config, etco2TimePeriod);
+    case SCHEMA_VERSION: return sizeof(Config);
+    default: return 0;
+  }
+}
+
+bool ConfigStorage::readRecord(Config& cfg) {
+  Record rec;
+  size_t len = prefs.getBytesLength("config");
+  if (len < offsetof(Record, config) + sizeof(uint32_t) || len > sizeof(Record)) return false;
+  
+  memset(&rec, 0, sizeof(rec));
+  prefs.getBytes("config", &rec, len);
+  
+  // The CRC sits right after the config of the writer's schema
+  size_t crcOffset = len - sizeof(uint32_t);
+  uint32_t storedCrc;
+  memcpy(&storedCrc, (uint8_t*)&rec + crcOffset, sizeof(storedCrc));
+  
+  if (rec.magic != RECORD_MAGIC || rec.version == 0 || rec.version > SCHEMA_VERSION ||
+      offsetof(Record, config) + rec.size != crcOffset ||
+      crc32((const uint8_t*)&rec, crcOffset) != storedCrc) {
+    CMD_SERIAL.println("Stored configuration invalid, using defaults");
+    return false;
+  }
+  
+  cfg = defaults();
+  memcpy(&cfg, &rec.config, min((size_t)rec.size, schemaSize(rec.version)));
+  writeCount = rec.writeCount;
+  
+  if (rec.version < SCHEMA_VERSION) {
+    CMD_SERIAL.print("Migrating configuration from schema v");
+    CMD_SERIAL.println(rec.version);
+    writeRecord(cfg);
+  }
+  return true;
+}
+
+// Schema v0 kept each field under its own key
+bool ConfigStorage::migrateLegacyKeys(Config& cfg) {
+  if (!prefs.isKey("amplitude")) return false;
+  
+  Config def = defaults();
+  cfg.amplitude = prefs.getFloat("amplitude", def.amplitude);
+  cfg.frequency = prefs.getFloat("frequency", def.frequency);
+  cfg.baseline = prefs.getFloat("baseline", def.baseline);
+  cfg.phase = prefs.getFloat("phase", def.phase);
+  cfg.alarmHigh = prefs.getFloat("alarmHigh", def.alarmHigh);
+  cfg.alarmLow = prefs.getFloat("alarmLow", def.alarmLow);
+  cfg.alarmHighEnabled = prefs.getBool("alarmHighEn", def.alarmHighEnabled);
+  cfg.alarmLowEnabled = prefs.getBool("alarmLowEn", def.alarmLowEnabled);
+  cfg.useI2CSensor = prefs.getBool("useI2C", def.useI2CSensor);
+  
+  CMD_SERIAL.println("Migrating configuration from schema v0");
+  writeRecord(cfg);
   
+  for (const char* key : LEGACY_KEYS) prefs.remove(key);
+  return true;
+}
+
+// One putBytes() is one NVS entry, so a power cut leaves either the old
+// or the new record, never a mix.
+void ConfigStorage::writeRecord(const Config& cfg) {
+  Record rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.magic = RECORD_MAGIC;
+  rec.version = SCHEMA_VERSION;
+  rec.size = sizeof(Config);
+  rec.writeCount = ++writeCount;
+  rec.config = cfg;
+  rec.crc = crc32((const uint8_t*)&rec, offsetof(Record, crc));
+  prefs.putBytes("config", &rec, sizeof(rec));
+}
+
+void ConfigStorage::saveConfig(const Config& cfg) {
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  writeRecord(cfg);
+  savePending = false;
+  if (lock) xSemaphoreGiveRecursive(lock);
   CMD_SERIAL.println("Configuration saved to EEPROM");
 }
 
 ConfigStorage::Config ConfigStorage::loadConfig() {
   Config cfg;
-  cfg.amplitude = prefs.getFloat("amplitude", 38.0);
-  cfg.frequency = prefs.getFloat("frequency", 0.25);
-  cfg.baseline = prefs.getFloat("baseline", 0.0);
-  cfg.phase = prefs.getFloat("phase", 0.0);
-  cfg.alarmHigh = prefs.getFloat("alarmHigh", 50.0);
-  cfg.alarmLow = prefs.getFloat("alarmLow", 30.0);
-  cfg.alarmHighEnabled = prefs.getBool("alarmHighEn", false);
-  cfg.alarmLowEnabled = prefs.getBool("alarmLowEn", false);
-  cfg.useI2CSensor = prefs.getBool("useI2C", false);
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  if (!readRecord(cfg) && !migrateLegacyKeys(cfg)) {
+    cfg = defaults();
+  }
+  if (lock) xSemaphoreGiveRecursive(lock);
   
   CMD_SERIAL.println("Configuration loaded from EEPROM");
   return cfg;
 }
 
+// Only the settings record goes; presets and the write count stay
 void ConfigStorage::clearConfig() {
-  prefs.clear();
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  prefs.remove("config");
+  for (const char* key : LEGACY_KEYS) prefs.remove(key);
+  savePending = false;
+  if (lock) xSemaphoreGiveRecursive(lock);
   CMD_SERIAL.println("Configuration cleared");
 }
+
+void ConfigStorage::setAutosave(bool enable) { 
+  autosave = enable; 
+  if (!enable) savePending = false;
+}
+
+bool ConfigStorage::isAutosaveEnabled() const { 
+  return autosave; 
+}
+
+// Coalesces bursts of changes (e.g. slider drags) into one write once
+// the settings have been quiet for AUTOSAVE_DELAY_MS
+void ConfigStorage::requestSave(const Config& cfg) {
+  if (!autosave) return;
+  portENTER_CRITICAL(&pendingMux);
+  pending = cfg;
+  lastChangeTime = millis();
+  savePending = true;
+  portEXIT_CRITICAL(&pendingMux);
+}
+
+void ConfigStorage::update() {
+  if (!savePending || millis() - lastChangeTime < AUTOSAVE_DELAY_MS) return;
+  
+  portENTER_CRITICAL(&pendingMux);
+  Config cfg = pending;
+  savePending = false;
+  portEXIT_CRITICAL(&pendingMux);
+  
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  writeRecord(cfg);
+  if (lock) xSemaphoreGiveRecursive(lock);
+  CMD_SERIAL.println("Configuration autosaved");
+}
+
+void ConfigStorage::loadPresets() {
+  static const size_t MAX_BLOB = sizeof(PresetHeader) + MAX_PRESETS * sizeof(Preset) + sizeof(uint32_t);
+  uint8_t blob[MAX_BLOB];
+  size_t len = prefs.getBytesLength("presets");
+  presetCount = 0;
+  if (len < sizeof(PresetHeader) + sizeof(uint32_t) || len > MAX_BLOB) return;
+  
+  prefs.getBytes("presets", blob, len);
+  PresetHeader header;
+  memcpy(&header, blob, sizeof(header));
+  
+  // Entries written by an older schema have a shorter Config; fields it
+  // did not have take the defaults
+  size_t stride = PRESET_NAME_LEN + header.configSize;
+  size_t crcOffset = sizeof(header) + header.count * stride;
+  uint32_t storedCrc;
+  if (header.magic != PRESET_MAGIC || header.count > MAX_PRESETS || 
+      header.version == 0 || header.version > SCHEMA_VERSION ||
+      header.configSize > sizeof(Config) || crcOffset + sizeof(uint32_t) != len) {
+    CMD_SERIAL.println("Stored presets invalid, ignoring");
+    return;
+  }
+  memcpy(&storedCrc, blob + crcOffset, sizeof(storedCrc));
+  if (crc32(blob, crcOffset) != storedCrc) {
+    CMD_SERIAL.println("Stored presets invalid, ignoring");
+    return;
+  }
+  
+  size_t configBytes = min((size_t)header.configSize, schemaSize(header.version));
+  for (uint16_t i = 0; i < header.count; i++) {
+    const uint8_t* entry = blob + sizeof(header) + i * stride;
+    Preset& p = presets[i];
+    memcpy(p.name, entry, PRESET_NAME_LEN);
+    p.name[PRESET_NAME_LEN - 1] = '\0';
+    p.config = defaults();
+    memcpy(&p.config, entry + PRESET_NAME_LEN, configBytes);
+  }
+  presetCount = header.count;
+}
+
+void ConfigStorage::writePresets() {
+  static const size_t MAX_BLOB = sizeof(PresetHeader) + MAX_PRESETS * sizeof(Preset) + sizeof(uint32_t);
+  uint8_t blob[MAX_BLOB];
+  
+  PresetHeader header = { PRESET_MAGIC, SCHEMA_VERSION, presetCount, sizeof(Config) };
+  size_t len = sizeof(header);
+  memcpy(blob, &header, sizeof(header));
+  for (uint8_t i = 0; i < presetCount; i++) {
+    memcpy(blob + len, presets[i].name, PRESET_NAME_LEN);
+    memcpy(blob + len + PRESET_NAME_LEN, &presets[i].config, sizeof(Config));
+    len += PRESET_NAME_LEN + sizeof(Config);
+  }
+  uint32_t crc = crc32(blob, len);
+  memcpy(blob + len, &crc, sizeof(crc));
+  len += sizeof(crc);
+  
+  prefs.putBytes("presets", blob, len);
+  writeCount++;
+}
+
+int ConfigStorage::findPreset(const char* name) const {
+  for (uint8_t i = 0; i < presetCount; i++) {
+    if (strcasecmp(presets[i].name, name) == 0) return i;
+  }
+  return -1;
+}
+
+bool ConfigStorage::isValidPresetName(const char* name) {
+  return name[0] && strlen(name) < PRESET_NAME_LEN;
+}
+
+bool ConfigStorage::savePreset(const char* name, const Config& cfg) {
+  if (!isValidPresetName(name)) return false;
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  int idx = findPreset(name);
+  bool ok = idx >= 0 || presetCount < MAX_PRESETS;
+  if (ok) {
+    if (idx < 0) {
+      idx = presetCount++;
+      memset(presets[idx].name, 0, PRESET_NAME_LEN);
+      for (uint8_t i = 0; name[i]; i++) presets[idx].name[i] = tolower(name[i]);
+    }
+    presets[idx].config = cfg;
+    writePresets();
+  }
+  if (lock) xSemaphoreGiveRecursive(lock);
+  return ok;
+}
+
+bool ConfigStorage::getPreset(const char* name, Config& cfg) const {
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  int idx = findPreset(name);
+  if (idx >= 0) cfg = presets[idx].config;
+  if (lock) xSemaphoreGiveRecursive(lock);
+  return idx >= 0;
+}
+
+bool ConfigStorage::deletePreset(const char* name) {
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  int idx = findPreset(name);
+  if (idx >= 0) {
+    for (uint8_t i = idx; i + 1 < presetCount; i++) presets[i] = presets[i + 1];
+    presetCount--;
+    writePresets();
+  }
+  if (lock) xSemaphoreGiveRecursive(lock);
+  return idx >= 0;
+}
+
+uint8_t ConfigStorage::getPresetCount() const { 
+  return presetCount; 
+}
+
+// Copies the names out under the lock, so a list is never torn by a
+// concurrent save or delete
+uint8_t ConfigStorage::getPresetNames(char names[][PRESET_NAME_LEN]) const {
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  uint8_t count = presetCount;
+  for (uint8_t i = 0; i < count; i++) memcpy(names[i], presets[i].name, PRESET_NAME_LEN);
+  if (lock) xSemaphoreGiveRecursive(lock);
+  return count;
+}
+
+// Hands a complete parameter set to the sample loop, which applies it
+// between two samples (see takeStagedConfig)
+void ConfigStorage::stageConfig(const Config& cfg) {
+  portENTER_CRITICAL(&pendingMux);
+  staged = cfg;
+  stagedReady = true;
+  portEXIT_CRITICAL(&pendingMux);
+}
+
+bool ConfigStorage::takeStagedConfig(Config& cfg) {
+  if (!stagedReady) return false;
+  portENTER_CRITICAL(&pendingMux);
+  cfg = staged;
+  stagedReady = false;
+  portEXIT_CRITICAL(&pendingMux);
+  return true;
+}
+
+uint32_t ConfigStorage::getWriteCount() const { 
+  return writeCount; 
+}
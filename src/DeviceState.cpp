@@ -1,13 +1,27 @@
 #include "DeviceState.h"
+#include "Clock.h"
+#include "IsbRegistry.h"
 
 DeviceState::DeviceState() 
   : continuousMode(false), initialized(false), syncCounter(0),
     barometricPressure(760), o2Compensation(16), balanceGas(0),
     anestheticAgent(0), gasTemp(350), etco2TimePeriod(10),
-    noBreathTimeout(20), co2Units(0),
+    noBreathTimeout(20), co2Units(0), sleepMode(0), zeroGasType(0), co2Scale(0),
     zeroInProgress(false), zeroStartTime(0), compensationsSet(false),
     statusByte1(0), statusByte2(0x10), statusByte3(0),
-    etco2(380), respRate(15), inspCO2(0) {}
+    etco2(380), respRate(15), inspCO2(0) {
+  updateCO2Scale();
+}
+
+// kPa is a fixed factor; % is relative to the host's barometric pressure
+void DeviceState::updateCO2Scale() {
+  static const uint32_t KPA_PER_MMHG_Q16 = 8737;   // 0.133322 * 65536
+  switch (co2Units) {
+    case UNITS_PERCENT: co2Scale = (100 * FixedPoint::SCALE_ONE + barometricPressure / 2) / barometricPressure; break;
+    case UNITS_KPA: co2Scale = KPA_PER_MMHG_Q16; break;
+    default: co2Scale = FixedPoint::SCALE_ONE; break;
+  }
+}
 
 void DeviceState::startContinuousMode() { 
   continuousMode = true; 
@@ -25,8 +39,15 @@ uint8_t DeviceState::getAndIncrementSync() {
   return val;
 }
 
+uint8_t DeviceState::skipSync(uint8_t count) {
+  uint16_t next = syncCounter + count;
+  syncCounter = next & 0x7F;
+  return next >> 7;
+}
+
 void DeviceState::setBarometricPressure(uint16_t value) { 
   barometricPressure = value;
+  updateCO2Scale();
   compensationsSet = true;
   statusByte2 &= ~0x10;
 }
@@ -42,9 +63,18 @@ uint8_t DeviceState::getETCO2TimePeriod() const { return etco2TimePeriod; }
 void DeviceState::setNoBreathTimeout(uint8_t value) { noBreathTimeout = value; }
 uint8_t DeviceState::getNoBreathTimeout() const { return noBreathTimeout; }
 
-void DeviceState::setCO2Units(uint8_t value) { co2Units = value; }
+void DeviceState::setCO2Units(uint8_t value) { 
+  co2Units = value; 
+  updateCO2Scale();
+}
 uint8_t DeviceState::getCO2Units() const { return co2Units; }
 
+void DeviceState::setSleepMode(uint8_t value) { sleepMode = value; }
+uint8_t DeviceState::getSleepMode() const { return sleepMode; }
+
+void DeviceState::setZeroGasType(uint8_t value) { zeroGasType = value; }
+uint8_t DeviceState::getZeroGasType() const { return zeroGasType; }
+
 void DeviceState::setGasCompensations(uint8_t o2, uint8_t balance, uint16_t anesthetic) {
   o2Compensation = o2;
   balanceGas = balance;
@@ -61,11 +91,11 @@ bool DeviceState::canStartZero() const { return compensationsSet && !zeroInProgr
 
 void DeviceState::startZero() {
   zeroInProgress = true;
-  zeroStartTime = millis();
+  zeroStartTime = Clock::nowMs();
 }
 
 void DeviceState::updateZero() {
-  if (zeroInProgress && (millis() - zeroStartTime > 2000)) {
+  if (zeroInProgress && (Clock::nowMs() - zeroStartTime > 2000)) {
     zeroInProgress = false;
     statusByte2 &= ~0x0C;
   }
@@ -89,3 +119,71 @@ void DeviceState::updateParameters(uint16_t etco2Val, uint16_t respRateVal) {
 uint16_t DeviceState::getETCO2() const { return etco2; }
 uint16_t DeviceState::getRespRate() const { return respRate; }
 uint16_t DeviceState::getInspCO2() const { return inspCO2; }
+
+// Stored values never passed an ISB decode, so they get the same limits
+void DeviceState::loadFromConfig(const ConfigStorage::Config& cfg) {
+  etco2TimePeriod = IsbRegistry::clamp(5, cfg.etco2TimePeriod);
+  noBreathTimeout = IsbRegistry::clamp(6, cfg.noBreathTimeout);
+  co2Units = IsbRegistry::clamp(7, cfg.co2Units);
+  zeroGasType = IsbRegistry::clamp(9, cfg.zeroGasType);
+  updateCO2Scale();
+}
+
+void DeviceState::saveToConfig(ConfigStorage::Config& cfg) const {
+  cfg.etco2TimePeriod = etco2TimePeriod;
+  cfg.noBreathTimeout = noBreathTimeout;
+  cfg.co2Units = co2Units;
+  cfg.zeroGasType = zeroGasType;
+}
+
+void DeviceState::captureState(DeviceSnapshot& s, uint32_t now) const {
+  s.continuousMode = continuousMode;
+  s.initialized = initialized;
+  s.zeroInProgress = zeroInProgress;
+  s.compensationsSet = compensationsSet;
+  s.syncCounter = syncCounter;
+  s.o2Compensation = o2Compensation;
+  s.balanceGas = balanceGas;
+  s.etco2TimePeriod = etco2TimePeriod;
+  s.noBreathTimeout = noBreathTimeout;
+  s.co2Units = co2Units;
+  s.sleepMode = sleepMode;
+  s.zeroGasType = zeroGasType;
+  s.statusByte1 = statusByte1;
+  s.statusByte2 = statusByte2;
+  s.statusByte3 = statusByte3;
+  s.reserved = 0;
+  s.barometricPressure = barometricPressure;
+  s.anestheticAgent = anestheticAgent;
+  s.gasTemp = gasTemp;
+  s.etco2 = etco2;
+  s.respRate = respRate;
+  s.inspCO2 = inspCO2;
+  s.zeroElapsedMs = zeroInProgress ? now - zeroStartTime : 0;
+}
+
+void DeviceState::restoreState(const DeviceSnapshot& s, uint32_t now) {
+  continuousMode = s.continuousMode;
+  initialized = s.initialized;
+  zeroInProgress = s.zeroInProgress;
+  compensationsSet = s.compensationsSet;
+  syncCounter = s.syncCounter & 0x7F;
+  o2Compensation = s.o2Compensation;
+  balanceGas = s.balanceGas;
+  etco2TimePeriod = s.etco2TimePeriod;
+  noBreathTimeout = s.noBreathTimeout;
+  co2Units = s.co2Units;
+  sleepMode = s.sleepMode;
+  zeroGasType = s.zeroGasType;
+  statusByte1 = s.statusByte1;
+  statusByte2 = s.statusByte2;
+  statusByte3 = s.statusByte3;
+  barometricPressure = s.barometricPressure;
+  anestheticAgent = s.anestheticAgent;
+  gasTemp = s.gasTemp;
+  etco2 = s.etco2;
+  respRate = s.respRate;
+  inspCO2 = s.inspCO2;
+  zeroStartTime = now - s.zeroElapsedMs;
+  updateCO2Scale();
+}
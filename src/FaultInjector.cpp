@@ -0,0 +1,138 @@
+#include "FaultInjector.h"
+#include "PacketBuilder.h"
+#include "Config.h"
+
+FaultInjector::FaultInjector()
+  : armed(false), seed(DEFAULT_SEED), state(DEFAULT_SEED), delayMs(DEFAULT_DELAY_MS),
+    delayedLen(0), delayedDue(0), delayedState(SLOT_EMPTY) {
+  memset(rules, 0, sizeof(rules));
+  memset(eligible, 0, sizeof(eligible));
+}
+
+const char* FaultInjector::faultName(uint8_t fault) {
+  static const char* const NAMES[FAULT_COUNT] = {
+    "checksum", "drop", "sync", "delay", "truncate", "nack"
+  };
+  return fault < FAULT_COUNT ? NAMES[fault] : "";
+}
+
+int8_t FaultInjector::findFault(const char* name) {
+  for (uint8_t i = 0; i < FAULT_COUNT; i++) {
+    if (strcmp(name, faultName(i)) == 0) return i;
+  }
+  return -1;
+}
+
+bool FaultInjector::parsePercent(const char* text, uint16_t& probability) {
+  char* end;
+  float percent = strtof(text, &end);
+  if (end == text || *end != '\0' || !(percent >= 0 && percent <= 100)) return false;
+  probability = (uint16_t)(percent * (PROBABILITY_SCALE / 100) + 0.5f);
+  return true;
+}
+
+bool FaultInjector::parseEvery(const char* text, uint16_t& every) {
+  char* end;
+  unsigned long value = strtoul(text, &end, 10);
+  if (!isdigit((unsigned char)text[0]) || *end != '\0' || value > UINT16_MAX) return false;
+  every = value;
+  return true;
+}
+
+// xorshift32; never zero as long as the seed is not
+uint32_t FaultInjector::next() {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+// A fault that cannot apply to this packet neither counts it for its
+// schedule nor draws a number, so it does not shift the other faults
+bool FaultInjector::fires(uint8_t fault, bool applicable) {
+  const Rule& rule = rules[fault];
+  if (!applicable || (!rule.probability && !rule.every)) return false;
+  
+  bool hit = rule.every && ++eligible[fault] % rule.every == 0;
+  if (rule.probability && next() % PROBABILITY_SCALE < rule.probability) hit = true;
+  if (hit) injected[fault].inc();
+  return hit;
+}
+
+// Waveform frames: 0x80 NBF sync CO2(2) ... checksum
+void FaultInjector::inject(uint8_t* frame, uint8_t& len, Action& action) {
+  memset(&action, 0, sizeof(action));
+  bool waveform = frame[0] == Protocol::CMD_CO2_WAVEFORM && len >= 4;
+  
+  if (fires(FAULT_SYNC_JUMP, waveform)) {
+    action.syncJump = 1 + next() % 0x7E;
+    frame[2] = (frame[2] + action.syncJump) & 0x7F;
+    frame[len - 1] = PacketBuilder::calculateChecksum(frame, len - 1);
+  }
+  if (fires(FAULT_CHECKSUM, true)) {
+    frame[len - 1] ^= 1 + next() % 0x7F;
+  }
+  if (fires(FAULT_TRUNCATE, len > 1)) {
+    len = 1 + next() % (len - 1);
+  }
+  action.drop = fires(FAULT_DROP, true);
+  action.delay = fires(FAULT_DELAY, !action.drop && delayedState.load(std::memory_order_acquire) == SLOT_EMPTY);
+  if (fires(FAULT_NACK, true)) {
+    action.nackCode = Protocol::NACK_INVALID_CMD + next() % Protocol::NACK_INVALID_DATA;
+  }
+}
+
+// Only one packet is held at a time; inject() only asks for a delay when
+// the slot is free. Returns false if it is taken.
+bool FaultInjector::defer(const uint8_t* frame, uint8_t len, uint32_t now) {
+  if (delayedState.load(std::memory_order_acquire) != SLOT_EMPTY) return false;
+  memcpy(delayed, frame, len);
+  delayedLen = len;
+  delayedDue = now + delayMs;
+  delayedState.store(SLOT_FULL, std::memory_order_release);
+  return true;
+}
+
+bool FaultInjector::takeDue(uint32_t now, uint8_t* frame, uint8_t& len) {
+  if (delayedState.load(std::memory_order_acquire) != SLOT_FULL) return false;
+  if ((int32_t)(now - delayedDue) < 0) return false;
+  memcpy(frame, delayed, delayedLen);
+  len = delayedLen;
+  delayedState.store(SLOT_EMPTY, std::memory_order_release);
+  return true;
+}
+
+void FaultInjector::rearm() {
+  bool any = false;
+  for (uint8_t i = 0; i < FAULT_COUNT; i++) any |= rules[i].probability || rules[i].every;
+  armed = any;
+}
+
+void FaultInjector::setRule(uint8_t fault, uint16_t probability, uint16_t every) {
+  if (fault >= FAULT_COUNT) return;
+  rules[fault].probability = probability < PROBABILITY_SCALE ? probability : PROBABILITY_SCALE;
+  rules[fault].every = every;
+  eligible[fault] = 0;
+  rearm();
+}
+
+void FaultInjector::clear() {
+  memset(rules, 0, sizeof(rules));
+  rearm();
+}
+
+void FaultInjector::setSeed(uint32_t value) {
+  seed = value ? value : DEFAULT_SEED;
+  state = seed;
+  memset(eligible, 0, sizeof(eligible));
+}
+
+void FaultInjector::printStatus(Print& out) const {
+  out.print("Fault injection: "); out.print(isArmed() ? "armed" : "off");
+  out.printf(", seed %lu, delay %u ms\n", (unsigned long)seed, delayMs);
+  for (uint8_t i = 0; i < FAULT_COUNT; i++) {
+    out.printf("  %-8s %3u.%02u%%  every %-5u injected %lu\n", faultName(i),
+               rules[i].probability / 100, rules[i].probability % 100, rules[i].every,
+               (unsigned long)injected[i].get());
+  }
+}
@@ -0,0 +1,32 @@
+#include "FixedPoint.h"
+
+namespace FixedPoint {
+
+// round(32767 * sin(i/64 * pi/2)), i = 0..64
+static const int16_t QUARTER_SINE[65] = {
+      0,   804,  1608,  2410,  3212,  4011,  4808,  5602,
+   6393,  7179,  7962,  8739,  9512, 10278, 11039, 11793,
+  12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+  18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+  23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+  27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+  30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+  32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+  32767,
+};
+
+int16_t sinQ15(uint32_t phase) {
+  // Position within the quadrant: 6 bits of table index, 16 of fraction
+  uint32_t pos = (phase >> 8) & 0x3FFFFF;
+  uint8_t quadrant = phase >> 30;
+  if (quadrant & 1) pos = 0x400000 - pos;   // falling quadrants mirror
+
+  uint32_t idx = pos >> 16;
+  uint32_t frac = pos & 0xFFFF;
+  int32_t value = QUARTER_SINE[idx];
+  if (frac) value += ((uint32_t)(QUARTER_SINE[idx + 1] - QUARTER_SINE[idx]) * frac) >> 16;
+
+  return (quadrant & 2) ? -value : value;
+}
+
+} // namespace FixedPoint
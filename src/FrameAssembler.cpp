@@ -0,0 +1,32 @@
+#include "FrameAssembler.h"
+
+FrameAssembler::Result FrameAssembler::feed(uint8_t b, uint32_t now) {
+  if (b >= 0x80) {
+    index = 0;
+    buffer[index++] = b;
+    lastByteTime = now;
+    return FRAME_NONE;
+  }
+  if (index == 0) return FRAME_NONE;
+  
+  if (now - lastByteTime > BYTE_TIMEOUT_MS) {
+    index = 0;
+    return FRAME_TIMEOUT;
+  }
+  
+  buffer[index++] = b;
+  lastByteTime = now;
+  
+  // NBF counts the data bytes plus the checksum, so a frame is NBF + 2 long
+  uint8_t nbf = buffer[1];
+  if (nbf == 0 || nbf + 2 > FRAME_SIZE) {
+    index = 0;
+    return FRAME_BAD_LENGTH;
+  }
+  if (index == nbf + 2) {
+    completeLength = index;
+    index = 0;
+    return FRAME_COMPLETE;
+  }
+  return FRAME_NONE;
+}
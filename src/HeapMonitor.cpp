@@ -0,0 +1,99 @@
+#include "HeapMonitor.h"
+#include <esp_heap_caps.h>
+
+#ifdef HEAP_ALLOC_TRACKING
+#include <assert.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Only allocations made by the task that opened the tick are counted, so
+// the async web server and WiFi tasks do not trip the check.
+static volatile TaskHandle_t trackedTask = nullptr;
+static volatile uint32_t allocationCount = 0;
+
+extern "C" {
+  void* __real_malloc(size_t size);
+  void* __real_calloc(size_t n, size_t size);
+  void* __real_realloc(void* ptr, size_t size);
+  
+  void* __wrap_malloc(size_t size) {
+    if (trackedTask && xTaskGetCurrentTaskHandle() == trackedTask) allocationCount++;
+    return __real_malloc(size);
+  }
+  
+  void* __wrap_calloc(size_t n, size_t size) {
+    if (trackedTask && xTaskGetCurrentTaskHandle() == trackedTask) allocationCount++;
+    return __real_calloc(n, size);
+  }
+  
+  void* __wrap_realloc(void* ptr, size_t size) {
+    if (trackedTask && xTaskGetCurrentTaskHandle() == trackedTask) allocationCount++;
+    return __real_realloc(ptr, size);
+  }
+}
+#endif
+
+HeapMonitor::HeapMonitor() 
+  : tickAllocBase(0), tickViolations(0), lastViolationAllocs(0) {}
+
+void HeapMonitor::beginTick() {
+  #ifdef HEAP_ALLOC_TRACKING
+  trackedTask = xTaskGetCurrentTaskHandle();
+  tickAllocBase = allocationCount;
+  #endif
+}
+
+void HeapMonitor::endTick() {
+  #ifdef HEAP_ALLOC_TRACKING
+  uint32_t allocs = allocationCount - tickAllocBase;
+  trackedTask = nullptr;
+  if (allocs != 0) {
+    tickViolations++;
+    lastViolationAllocs = allocs;
+  }
+  assert(allocs == 0 && "heap allocation in steady-state tick");
+  #endif
+}
+
+uint32_t HeapMonitor::getFreeHeap() const { 
+  return heap_caps_get_free_size(MALLOC_CAP_8BIT); 
+}
+
+uint32_t HeapMonitor::getMinFreeHeap() const { 
+  return heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT); 
+}
+
+uint32_t HeapMonitor::getLargestFreeBlock() const { 
+  return heap_caps_get_largest_free_block(MALLOC_CAP_8BIT); 
+}
+
+uint8_t HeapMonitor::getFragmentation() const {
+  uint32_t freeBytes = getFreeHeap();
+  if (freeBytes == 0) return 0;
+  return 100 - (uint8_t)((uint64_t)getLargestFreeBlock() * 100 / freeBytes);
+}
+
+uint32_t HeapMonitor::getAllocationCount() const {
+  #ifdef HEAP_ALLOC_TRACKING
+  return allocationCount;
+  #else
+  return 0;
+  #endif
+}
+
+uint32_t HeapMonitor::getTickViolations() const { 
+  return tickViolations; 
+}
+
+void HeapMonitor::printReport(Print& out) const {
+  out.println("\n=== Heap ===");
+  out.print("Free: "); out.print(getFreeHeap());
+  out.print(" Min: "); out.print(getMinFreeHeap());
+  out.print(" Largest: "); out.println(getLargestFreeBlock());
+  out.print("Fragmentation: "); out.print(getFragmentation()); out.println("%");
+  #ifdef HEAP_ALLOC_TRACKING
+  out.print("Tracked allocs: "); out.print(getAllocationCount());
+  out.print(" Tick violations: "); out.print(tickViolations);
+  out.print(" (last "); out.print(lastViolationAllocs); out.println(")");
+  #endif
+}
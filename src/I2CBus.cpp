@@ -0,0 +1,31 @@
+#include "I2CBus.h"
+
+WireBus::WireBus(TwoWire& w, int sdaPin, int sclPin) 
+  : wire(w), sda(sdaPin), scl(sclPin) {}
+
+bool WireBus::begin(uint32_t clockHz) {
+  if (!wire.begin(sda, scl)) return false;
+  wire.setClock(clockHz);
+  return true;
+}
+
+void WireBus::setClock(uint32_t clockHz) {
+  wire.setClock(clockHz);
+}
+
+bool WireBus::probe(uint8_t address) {
+  wire.beginTransmission(address);
+  return wire.endTransmission() == 0;
+}
+
+bool WireBus::write(uint8_t address, const uint8_t* data, size_t len) {
+  wire.beginTransmission(address);
+  wire.write(data, len);
+  return wire.endTransmission() == 0;
+}
+
+bool WireBus::read(uint8_t address, uint8_t* data, size_t len) {
+  if (wire.requestFrom(address, len) != len) return false;
+  for (size_t i = 0; i < len; i++) data[i] = wire.read();
+  return true;
+}
@@ -1,64 +1,169 @@
 #include "I2CSensorInterface.h"
+#include "FixedPoint.h"
 
-I2CSensorInterface::I2CSensorInterface(uint8_t addr) 
-  : address(addr), available(false), lastReading(0), lastReadTime(0) {}
+I2CSensorInterface::I2CSensorInterface(I2CBus& i2cBus) 
+  : bus(i2cBus), drivers{&scd30Driver, &scd4xDriver, &genericDriver}, driver(nullptr),
+    requestedDriver(NO_REQUEST), selection(DRIVER_AUTO), available(false), state(STATE_IDLE),
+    requestTime(0), probeTime(0),
+    lastUpdateTime(0), lastReadTime(0), hasReading(false), staleCounted(false),
+    lastReading(0), sampleCenti(NO_SAMPLE) {}
 
 bool I2CSensorInterface::begin() {
-  Wire.begin(I2C_SDA, I2C_SCL);
-  Wire.setClock(100000);
+  bus.begin(I2C_CLOCK_HZ);
+  selectDriver(DRIVER_AUTO, 0);
   
-  Wire.beginTransmission(address);
-  available = (Wire.endTransmission() == 0);
+  if (available) printFound();
+  else CMD_SERIAL.println("I2C sensor not found, using simulation");
   
-  if (available) {
-    CMD_SERIAL.print("I2C sensor found at 0x");
-    CMD_SERIAL.println(address, HEX);
-  } else {
-    CMD_SERIAL.println("I2C sensor not found, using simulation");
+  return available;
+}
+
+void I2CSensorInterface::printFound() const {
+  CMD_SERIAL.print("I2C sensor found: ");
+  CMD_SERIAL.print(driver->getName());
+  CMD_SERIAL.print(" at 0x");
+  CMD_SERIAL.println(driver->getAddress(), HEX);
+}
+
+// The first conversion starts one interval after the sensor is found
+bool I2CSensorInterface::selectDriver(int8_t index, uint32_t now) {
+  selection = index;
+  driver = nullptr;
+  available = false;
+  state = STATE_IDLE;
+  hasReading = false;
+  requestTime = now;
+  probeTime = now;
+  
+  for (uint8_t i = 0; i < DRIVER_COUNT; i++) {
+    if (index != DRIVER_AUTO && index != i) continue;
+    
+    CO2SensorDriver* candidate = drivers[i];
+    bus.setClock(min((uint32_t)I2C_CLOCK_HZ, candidate->getMaxClockHz()));
+    if (bus.probe(candidate->getAddress()) && candidate->init(bus)) {
+      driver = candidate;
+      available = true;
+      break;
+    }
   }
   
+  // A forced driver stays selected even if absent; update() keeps probing it
+  if (!driver && index >= 0 && index < DRIVER_COUNT) driver = drivers[index];
+  if (driver) resampler.reset(driver->getIntervalMs());
   return available;
 }
 
+void I2CSensorInterface::requestDriver(int8_t index) {
+  requestedDriver = index;
+}
+
+int8_t I2CSensorInterface::findDriver(const char* name) const {
+  if (strcmp(name, "auto") == 0) return DRIVER_AUTO;
+  for (uint8_t i = 0; i < DRIVER_COUNT; i++) {
+    if (strcmp(name, drivers[i]->getName()) == 0) return i;
+  }
+  return NO_REQUEST;
+}
+
+const char* I2CSensorInterface::getDriverName(uint8_t index) const {
+  return index < DRIVER_COUNT ? drivers[index]->getName() : "";
+}
+
+const char* I2CSensorInterface::getActiveDriverName() const {
+  return driver ? driver->getName() : "none";
+}
+
 bool I2CSensorInterface::isAvailable() const { 
   return available; 
 }
 
-bool I2CSensorInterface::readSensorData(float& co2Value) {
-  // Template implementation - customize for your sensor
-  // Example for generic I2C sensor:
-  Wire.beginTransmission(address);
-  Wire.write(0x00);  // Read command
-  if (Wire.endTransmission() != 0) return false;
-  
-  delay(10);
-  
-  if (Wire.requestFrom(address, (uint8_t)2) != 2) return false;
-  
-  uint16_t rawValue = Wire.read() << 8;
-  rawValue |= Wire.read();
+void I2CSensorInterface::update(uint32_t now) {
+  lastUpdateTime = now;
   
-  co2Value = rawValue * 0.01;  // Example conversion
-  
-  return true;
+  int8_t request = requestedDriver.exchange(NO_REQUEST);
+  if (request != NO_REQUEST) {
+    selectDriver(request, now);
+  } else if (available) {
+    poll(now);
+  } else if (now - probeTime >= REPROBE_MS && selectDriver(selection, now)) {
+    printFound();
+  }
+  publish(now);
 }
 
-bool I2CSensorInterface::getSample(float& co2Value) {
-  if (!available) return false;
+void I2CSensorInterface::poll(uint32_t now) {
+  switch (state) {
+    case STATE_IDLE:
+      if (now - requestTime < driver->getIntervalMs()) break;
+      requestTime = now;
+      if (driver->startConversion(bus)) {
+        state = STATE_CONVERTING;
+      } else {
+        failedCount.inc();
+      }
+      break;
+      
+    case STATE_CONVERTING: {
+      if (now - requestTime < driver->getConversionMs()) break;
+      float value;
+      if (driver->readResult(bus, value)) {
+        lastReading.store(value, std::memory_order_relaxed);
+        lastReadTime = now;
+        hasReading = true;
+        staleCounted = false;
+        readCount.inc();
+        resampler.push(now, value);
+      } else {
+        failedCount.inc();
+      }
+      state = STATE_IDLE;
+      break;
+    }
+  }
+}
+
+// A reading that goes stale is counted once, however long it stays stale
+void I2CSensorInterface::publish(uint32_t now) {
+  int32_t centi = NO_SAMPLE;
   
-  if (readSensorData(co2Value)) {
-    lastReading = co2Value;
-    lastReadTime = millis();
-    return true;
+  if (available && hasReading) {
+    uint32_t staleLimit = 3 * driver->getIntervalMs();
+    if (staleLimit < STALE_MS) staleLimit = STALE_MS;
+    float value;
+    if (now - lastReadTime > staleLimit) {
+      if (!staleCounted) staleCount.inc();
+      staleCounted = true;
+    } else if (resampler.sample(now, value)) {
+      centi = FixedPoint::toCenti(value);
+    }
   }
   
-  return false;
+  sampleCenti.store(centi, std::memory_order_relaxed);
+}
+
+bool I2CSensorInterface::getSample(int32_t& co2Centi) const {
+  int32_t centi = sampleCenti.load(std::memory_order_relaxed);
+  if (centi == NO_SAMPLE) return false;
+  co2Centi = centi;
+  return true;
 }
 
 float I2CSensorInterface::getLastReading() const { 
-  return lastReading; 
+  return lastReading.load(std::memory_order_relaxed); 
 }
 
-uint32_t I2CSensorInterface::getLastReadTime() const { 
-  return lastReadTime; 
+uint32_t I2CSensorInterface::getReadCount() const { return readCount.get(); }
+uint32_t I2CSensorInterface::getFailedCount() const { return failedCount.get(); }
+uint32_t I2CSensorInterface::getStaleCount() const { return staleCount.get(); }
+
+void I2CSensorInterface::printStats(Print& out) const {
+  out.print("I2C: ");
+  out.print(getActiveDriverName());
+  out.print(available ? " present" : " absent");
+  out.print(" reads="); out.print(getReadCount());
+  out.print(" failed="); out.print(getFailedCount());
+  out.print(" stale="); out.print(getStaleCount());
+  out.print(" age="); 
+  if (hasReading) { out.print(lastUpdateTime - lastReadTime); out.println("ms"); }
+  else out.println("-");
 }
@@ -0,0 +1,122 @@
+#include "IsbRegistry.h"
+
+namespace IsbRegistry {
+
+static void setBaro(DeviceState& d, const uint16_t* v) { d.setBarometricPressure(v[0]); }
+static void getBaro(const DeviceState& d, uint16_t* v) { v[0] = d.getBarometricPressure(); }
+static void setGasTemp(DeviceState& d, const uint16_t* v) { d.setGasTemp(v[0]); }
+static void getGasTemp(const DeviceState& d, uint16_t* v) { v[0] = d.getGasTemp(); }
+static void setPeriod(DeviceState& d, const uint16_t* v) { d.setETCO2TimePeriod(v[0]); }
+static void getPeriod(const DeviceState& d, uint16_t* v) { v[0] = d.getETCO2TimePeriod(); }
+static void setNoBreath(DeviceState& d, const uint16_t* v) { d.setNoBreathTimeout(v[0]); }
+static void getNoBreath(const DeviceState& d, uint16_t* v) { v[0] = d.getNoBreathTimeout(); }
+static void setUnits(DeviceState& d, const uint16_t* v) { d.setCO2Units(v[0]); }
+static void getUnits(const DeviceState& d, uint16_t* v) { v[0] = d.getCO2Units(); }
+static void setSleep(DeviceState& d, const uint16_t* v) { d.setSleepMode(v[0]); }
+static void getSleep(const DeviceState& d, uint16_t* v) { v[0] = d.getSleepMode(); }
+static void setZeroGas(DeviceState& d, const uint16_t* v) { d.setZeroGasType(v[0]); }
+static void getZeroGas(const DeviceState& d, uint16_t* v) { v[0] = d.getZeroGasType(); }
+static void setComp(DeviceState& d, const uint16_t* v) { d.setGasCompensations(v[0], v[1], v[2]); }
+static void getComp(const DeviceState& d, uint16_t* v) {
+  v[0] = d.getO2Compensation();
+  v[1] = d.getBalanceGas();
+  v[2] = d.getAnestheticAgent();
+}
+static void getHwRev(const DeviceState&, uint16_t* v) { v[0] = 0x01; }
+
+static constexpr Entry TABLE[COUNT] = {
+  /*  0 */ {},
+  /*  1 */ { 1, { { "baro", 2, 400, 850 } }, false, setBaro, getBaro, nullptr },
+  /*  2 */ {},
+  /*  3 */ {},
+  /*  4 */ { 1, { { "temp", 2, 0, 500 } }, false, setGasTemp, getGasTemp, nullptr },
+  /*  5 */ { 1, { { "etco2Period", 1, 1, 20 } }, true, setPeriod, getPeriod, nullptr },
+  /*  6 */ { 1, { { "noBreath", 1, 10, 60 } }, true, setNoBreath, getNoBreath, nullptr },
+  /*  7 */ { 1, { { "units", 1, 0, 2 } }, true, setUnits, getUnits, nullptr },
+  /*  8 */ { 1, { { "sleep", 1, 0, 2 } }, false, setSleep, getSleep, nullptr },
+  /*  9 */ { 1, { { "zeroGas", 1, 0, 1 } }, true, setZeroGas, getZeroGas, nullptr },
+  /* 10 */ {},
+  /* 11 */ { 3, { { "o2", 1, 0, 100 }, { "bal", 1, 0, 2 }, { "agent", 2, 0, 200 } },
+             false, setComp, getComp, nullptr },
+  /* 12 */ {},
+  /* 13 */ {},
+  /* 14 */ {},
+  /* 15 */ {},
+  /* 16 */ {},
+  /* 17 */ {},
+  /* 18 */ { 0, {}, false, nullptr, nullptr, "1028494TL " },
+  /* 19 */ { 1, { { "hwRev", 1, 0, 0x7F } }, false, nullptr, getHwRev, nullptr },
+};
+
+// Every field must fit its 7-bit wire encoding and every writable ISB must
+// also be readable; checked here so a bad row fails the build.
+static constexpr bool fieldOk(const Field& f) {
+  return (f.width == 1 || f.width == 2) && f.min <= f.max &&
+         f.max <= (f.width == 1 ? 0x7F : 0x3FFF);
+}
+
+static constexpr bool entryOk(const Entry& e, uint8_t i) {
+  return i >= e.fieldCount || (fieldOk(e.fields[i]) && entryOk(e, i + 1));
+}
+
+static constexpr bool tableOk(uint8_t isb) {
+  return isb >= COUNT ||
+         (entryOk(TABLE[isb], 0) && TABLE[isb].fieldCount <= MAX_FIELDS &&
+          (TABLE[isb].fieldCount == 0 || TABLE[isb].get != nullptr) &&
+          (TABLE[isb].set == nullptr || TABLE[isb].fieldCount > 0) &&
+          tableOk(isb + 1));
+}
+
+static_assert(tableOk(0), "ISB table row violates its wire encoding");
+
+const Entry* find(uint8_t isb) {
+  if (isb >= COUNT) return nullptr;
+  const Entry& e = TABLE[isb];
+  return (e.fieldCount || e.text) ? &e : nullptr;
+}
+
+uint8_t dataLength(const Entry& entry) {
+  if (entry.text) return strlen(entry.text);
+  uint8_t len = 0;
+  for (uint8_t i = 0; i < entry.fieldCount; i++) len += entry.fields[i].width;
+  return len;
+}
+
+bool decode(const Entry& entry, const uint8_t* data, uint16_t* values) {
+  for (uint8_t i = 0; i < entry.fieldCount; i++) {
+    const Field& f = entry.fields[i];
+    if (data[0] & 0x80) return false;
+    if (f.width == 2) {
+      if (data[1] & 0x80) return false;
+      values[i] = PacketBuilder::decode2Bytes(data[0], data[1]);
+    } else {
+      values[i] = data[0];
+    }
+    if (values[i] < f.min || values[i] > f.max) return false;
+    data += f.width;
+  }
+  return true;
+}
+
+uint16_t clamp(uint8_t isb, uint16_t value, uint8_t field) {
+  const Entry* entry = find(isb);
+  if (!entry || field >= entry->fieldCount) return value;
+  const Field& f = entry->fields[field];
+  return value < f.min ? f.min : (value > f.max ? f.max : value);
+}
+
+void encode(const Entry& entry, const DeviceState& device, PacketBuilder& packet) {
+  if (entry.text) {
+    for (const char* p = entry.text; *p; p++) packet.addByte(*p);
+    return;
+  }
+
+  uint16_t values[MAX_FIELDS];
+  entry.get(device, values);
+  for (uint8_t i = 0; i < entry.fieldCount; i++) {
+    if (entry.fields[i].width == 2) packet.add2ByteValue(values[i]);
+    else packet.addByte(values[i]);
+  }
+}
+
+} // namespace IsbRegistry
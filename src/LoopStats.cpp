@@ -0,0 +1,34 @@
+#include "LoopStats.h"
+
+LoopStats::LoopStats() : startUs(0), lastUs(0) {
+  reset();
+}
+
+void LoopStats::endPass() {
+  uint32_t us = micros() - startUs;
+  lastUs = us;
+  count++;
+  totalUs += us;
+  if (us < minUs) minUs = us;
+  if (us > maxUs) maxUs = us;
+  if (us >= 1000) over1ms++;
+}
+
+void LoopStats::reset() {
+  count = 0;
+  minUs = UINT32_MAX;
+  maxUs = 0;
+  totalUs = 0;
+  over1ms = 0;
+}
+
+void LoopStats::print(Print& out) const {
+  out.print("Loop: passes="); out.print(count);
+  if (count) {
+    out.print(" min="); out.print(minUs);
+    out.print("us mean="); out.print((uint32_t)(totalUs / count));
+    out.print("us max="); out.print(maxUs);
+    out.print("us >=1ms="); out.print(over1ms);
+  }
+  out.println();
+}
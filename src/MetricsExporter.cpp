@@ -0,0 +1,83 @@
+#include "MetricsExporter.h"
+
+const char* const MetricsExporter::CONTENT_TYPE = "text/plain; version=0.0.4";
+
+MetricsExporter::MetricsExporter(const ProtocolHandler& proto, const ProtocolReceiver& rx,
+                                 const AlarmManager& alarm, const LoopStats& loop,
+                                 const HeapMonitor& heapMonitor)
+  : protocol(proto), receiver(rx), alarms(alarm), loopStats(loop), heap(heapMonitor) {}
+
+void MetricsExporter::header(Print& out, const char* name, const char* type, const char* help) {
+  out.printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void MetricsExporter::gauge(Print& out, const char* name, const char* help, uint32_t value) {
+  header(out, name, "gauge", help);
+  out.printf("%s %lu\n", name, (unsigned long)value);
+}
+
+void MetricsExporter::counter(Print& out, const char* name, const char* help, uint32_t value) {
+  header(out, name, "counter", help);
+  out.printf("%s %lu\n", name, (unsigned long)value);
+}
+
+void MetricsExporter::write(Print& out) const {
+  static const char* const NACK_NAMES[ProtocolHandler::NACK_REASONS] = {
+    "unknown", "invalid_cmd", "checksum", "timeout", "byte_count", "invalid_data"
+  };
+  const ProtocolHandler::Stats& stats = protocol.getStats();
+
+  header(out, "co2emu_packets_tx_total", "counter", "Packets sent to the host, by command.");
+  for (uint8_t i = 0; i < ProtocolHandler::PK_COUNT; i++) {
+    out.printf("co2emu_packets_tx_total{type=\"%s\"} %lu\n",
+               ProtocolHandler::packetKindName(i), (unsigned long)stats.packetsTx[i].get());
+  }
+
+  header(out, "co2emu_nacks_total", "counter", "NACKs sent to the host, by reason.");
+  for (uint8_t i = 0; i < ProtocolHandler::NACK_REASONS; i++) {
+    out.printf("co2emu_nacks_total{reason=\"%s\"} %lu\n", NACK_NAMES[i], (unsigned long)stats.nacks[i].get());
+  }
+
+  counter(out, "co2emu_commands_rx_total", "Complete command frames received from the host.", stats.commandsRx.get());
+  counter(out, "co2emu_bytes_tx_total", "Bytes written to the host port.", stats.bytesTx.get());
+  counter(out, "co2emu_bytes_rx_total", "Bytes read from the host port.", receiver.getBytesReceived());
+  counter(out, "co2emu_sync_wraps_total", "Waveform sync counter wraps from 127 to 0.", stats.syncWraps.get());
+
+  const FaultInjector* faults = protocol.getFaultInjector();
+  if (faults) {
+    header(out, "co2emu_faults_injected_total", "counter", "Faults injected into host traffic, by fault.");
+    for (uint8_t i = 0; i < FaultInjector::FAULT_COUNT; i++) {
+      out.printf("co2emu_faults_injected_total{fault=\"%s\"} %lu\n",
+                 FaultInjector::faultName(i), (unsigned long)faults->getInjected(i));
+    }
+  }
+
+  header(out, "co2emu_zero_total", "counter", "Zero commands, by result.");
+  out.printf("co2emu_zero_total{result=\"started\"} %lu\n", (unsigned long)stats.zeroStarted.get());
+  out.printf("co2emu_zero_total{result=\"rejected\"} %lu\n", (unsigned long)stats.zeroRejected.get());
+
+  header(out, "co2emu_alarm_transitions_total", "counter", "Alarm condition changes, by condition and direction.");
+  for (uint8_t i = 0; i < AlarmManager::CONDITION_COUNT; i++) {
+    const char* name = AlarmManager::conditionName(i);
+    out.printf("co2emu_alarm_transitions_total{condition=\"%s\",to=\"active\"} %lu\n",
+               name, (unsigned long)alarms.getRaisedCount(i));
+    out.printf("co2emu_alarm_transitions_total{condition=\"%s\",to=\"clear\"} %lu\n",
+               name, (unsigned long)alarms.getClearedCount(i));
+  }
+  gauge(out, "co2emu_alarm_status_word", "Alarm status word (bit n = condition n active).", alarms.getStatusWord());
+
+  counter(out, "co2emu_loop_passes_total", "Main-loop passes since the last loop reset.", loopStats.getCount());
+  counter(out, "co2emu_loop_passes_over_1ms_total", "Main-loop passes that took 1 ms or longer.", loopStats.getOver1ms());
+  gauge(out, "co2emu_loop_last_us", "Duration of the most recent main-loop pass.", loopStats.getLastUs());
+  gauge(out, "co2emu_loop_mean_us", "Mean main-loop pass duration.", loopStats.getMeanUs());
+  gauge(out, "co2emu_loop_max_us", "Longest main-loop pass.", loopStats.getMaxUs());
+
+  gauge(out, "co2emu_heap_free_bytes", "Free heap.", heap.getFreeHeap());
+  gauge(out, "co2emu_heap_min_free_bytes", "Lowest free heap since boot.", heap.getMinFreeHeap());
+  gauge(out, "co2emu_heap_largest_block_bytes", "Largest allocatable heap block.", heap.getLargestFreeBlock());
+  gauge(out, "co2emu_heap_fragmentation_percent", "Heap fragmentation.", heap.getFragmentation());
+  counter(out, "co2emu_heap_tick_violations_total", "Protocol ticks that allocated (alloccheck builds).",
+          heap.getTickViolations());
+
+  gauge(out, "co2emu_uptime_seconds", "Time since boot.", millis() / 1000);
+}
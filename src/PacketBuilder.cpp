@@ -21,10 +21,8 @@ void PacketBuilder::add2ByteValue(uint16_t value) {
   addByte(value & 0x7F);
 }
 
-void PacketBuilder::addCO2Waveform(float co2Value) {
-  int16_t encoded = (int16_t)(co2Value * 100.0) + 1000;
-  if (encoded < 0) encoded = 0;
-  add2ByteValue(encoded);
+void PacketBuilder::addCO2Waveform(int32_t co2Centi) {
+  add2ByteValue(encodeCO2Waveform(co2Centi));
 }
 
 void PacketBuilder::finalize() {
@@ -38,6 +36,21 @@ void PacketBuilder::send(Stream& serial) {
   serial.write(buffer, index); 
 }
 
+const uint8_t* PacketBuilder::getBuffer() const { 
+  return buffer; 
+}
+
+uint8_t PacketBuilder::getLength() const { 
+  return index; 
+}
+
+uint16_t PacketBuilder::encodeCO2Waveform(int32_t co2Centi) {
+  int32_t encoded = co2Centi + 1000;
+  if (encoded > 0x3FFF) encoded = 0x3FFF;
+  else if (encoded < 0) encoded = 0;
+  return encoded;
+}
+
 uint8_t PacketBuilder::calculateChecksum(const uint8_t* buf, uint8_t len) {
   uint8_t sum = 0;
   for (uint8_t i = 0; i < len; i++) sum += buf[i];
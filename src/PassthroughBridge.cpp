@@ -0,0 +1,177 @@
+#include "PassthroughBridge.h"
+#include "PacketBuilder.h"
+#include "Clock.h"
+#include "Config.h"
+
+PassthroughBridge::PassthroughBridge(HardwareSerial& host, HardwareSerial& sensor,
+                                     ProtocolTrace& protocolTrace, ProtocolReceiver& rx)
+  : toSensor(host, sensor, ProtocolTrace::DIR_RX), toHost(sensor, host, ProtocolTrace::DIR_TX),
+    trace(protocolTrace), receiver(rx), sensorStarted(false), active(false), requested(REQUEST_NONE),
+    replaceWave(false), replacement(0), statusMask(0) {}
+
+void PassthroughBridge::update() {
+  uint8_t request = requested.exchange(REQUEST_NONE);
+  if (request == REQUEST_START && !active) start();
+  else if (request == REQUEST_STOP && active) stop();
+}
+
+// A receive event per byte (FIFO threshold 1) bounds the added latency to
+// the event task's wake-up, well under one byte time at 19200 baud
+void PassthroughBridge::start() {
+  if (!sensorStarted) {
+    toHost.in.begin(BAUD_RATE_HOST, SERIAL_8N1, SENSOR_RX_PIN, SENSOR_TX_PIN);
+    sensorStarted = true;
+  }
+  toSensor.holding = false;
+  toHost.holding = false;
+  
+  toHost.in.setRxTimeout(1);
+  toHost.in.setRxFIFOFull(1);
+  toHost.in.onReceive([this]() { pump(toHost, isRewriting()); }, false);
+  
+  // Replaces the receiver's callback: the emulator stops answering the host
+  toSensor.in.setRxFIFOFull(1);
+  toSensor.in.onReceive([this]() { pump(toSensor, false); }, false);
+  
+  active = true;
+  CMD_SERIAL.println("Bridge started");
+}
+
+void PassthroughBridge::stop() {
+  toHost.in.onReceive(nullptr);
+  toSensor.in.setRxFIFOFull(DRIVER_RX_FIFO_FULL);
+  receiver.begin();
+  
+  active = false;
+  CMD_SERIAL.println("Bridge stopped");
+}
+
+bool PassthroughBridge::isRewriting() const {
+  return replaceWave.load(std::memory_order_relaxed) || statusMask.load(std::memory_order_relaxed);
+}
+
+void PassthroughBridge::setStatusMask(uint8_t byte1, uint8_t byte2, uint8_t byte3) {
+  statusMask = (uint32_t)(byte1 & 0x7F) | (uint32_t)(byte2 & 0x7F) << 8 | (uint32_t)(byte3 & 0x7F) << 16;
+}
+
+// Cut-through: a chunk is written out before it is parsed, straight from
+// the buffer it was read into
+void PassthroughBridge::pump(Link& link, bool rewriting) {
+  uint32_t start = micros();
+  uint32_t now = Clock::nowMs();
+  uint8_t chunk[CHUNK_SIZE];
+  
+  int avail;
+  while ((avail = link.in.available()) > 0) {
+    size_t n = link.in.readBytes(chunk, avail < CHUNK_SIZE ? avail : CHUNK_SIZE);
+    link.bytes.add(n);
+    
+    if (rewriting) {
+      for (size_t i = 0; i < n; i++) hold(link, chunk[i], now);
+      continue;
+    }
+    
+    // Rewriting was switched off halfway through a held frame
+    if (link.holding) {
+      link.out.write(link.frames.frame(), link.frames.pending());
+      link.holding = false;
+    }
+    link.out.write(chunk, n);
+    for (size_t i = 0; i < n; i++) {
+      if (link.frames.feed(chunk[i], now) == FrameAssembler::FRAME_COMPLETE) {
+        frameDone(link, link.frames.frame(), link.frames.frameLength());
+      }
+    }
+  }
+  
+  uint32_t us = micros() - start;
+  if (us > link.maxServiceUs) link.maxServiceUs = us;
+}
+
+// Store-and-forward for waveform frames only; every other byte still goes
+// through as it arrives. Framing errors pass the held bytes on unchanged.
+void PassthroughBridge::hold(Link& link, uint8_t b, uint32_t now) {
+  uint8_t held = link.holding ? link.frames.pending() : 0;
+  if (b >= 0x80 && held) {
+    link.out.write(link.frames.frame(), held);
+    held = 0;
+  }
+  
+  switch (link.frames.feed(b, now)) {
+    case FrameAssembler::FRAME_COMPLETE: {
+      uint8_t* frame = link.frames.frame();
+      uint8_t len = link.frames.frameLength();
+      if (link.holding) {
+        if (rewrite(frame, len)) rewritten.inc();
+        link.out.write(frame, len);
+      } else {
+        link.out.write(b);
+      }
+      link.holding = false;
+      frameDone(link, frame, len);
+      break;
+    }
+    case FrameAssembler::FRAME_NONE:
+      if (b >= 0x80) link.holding = (b == Protocol::CMD_CO2_WAVEFORM);
+      if (!link.holding) link.out.write(b);
+      break;
+    default:
+      if (held) link.out.write(link.frames.frame(), held);
+      link.out.write(b);
+      link.holding = false;
+      break;
+  }
+}
+
+void PassthroughBridge::frameDone(Link& link, const uint8_t* frame, uint8_t len) {
+  link.frameCount.inc();
+  if (PacketBuilder::calculateChecksum(frame, len) != 0) link.badChecksums.inc();
+  trace.record(link.dir, frame, len);
+}
+
+// 0x80 NBF sync CO2(2) [DPI data...] checksum. A frame that arrived with a
+// bad checksum is left alone rather than given a valid one.
+bool PassthroughBridge::rewrite(uint8_t* frame, uint8_t len) {
+  if (len < 6 || PacketBuilder::calculateChecksum(frame, len) != 0) return false;
+  bool changed = false;
+  
+  if (replaceWave.load(std::memory_order_relaxed)) {
+    uint16_t encoded = PacketBuilder::encodeCO2Waveform(replacement.load(std::memory_order_relaxed));
+    frame[3] = (encoded >> 7) & 0x7F;
+    frame[4] = encoded & 0x7F;
+    changed = true;
+  }
+  
+  uint32_t mask = statusMask.load(std::memory_order_relaxed);
+  if (mask && len >= 10 && frame[5] == Protocol::DPI_CO2_STATUS) {
+    frame[6] |= mask & 0x7F;
+    frame[7] |= (mask >> 8) & 0x7F;
+    frame[8] |= (mask >> 16) & 0x7F;
+    changed = true;
+  }
+  
+  if (changed) frame[len - 1] = PacketBuilder::calculateChecksum(frame, len - 1);
+  return changed;
+}
+
+uint32_t PassthroughBridge::getMaxServiceUs() const {
+  return toSensor.maxServiceUs > toHost.maxServiceUs ? toSensor.maxServiceUs : toHost.maxServiceUs;
+}
+
+void PassthroughBridge::printLink(Print& out, const char* name, const Link& link) {
+  out.print(name);
+  out.print(link.bytes.get()); out.print(" bytes, ");
+  out.print(link.frameCount.get()); out.print(" frames, ");
+  out.print(link.badChecksums.get()); out.print(" bad checksums, max service ");
+  out.print(link.maxServiceUs); out.println(" us");
+}
+
+void PassthroughBridge::printStatus(Print& out) const {
+  out.print("Bridge: "); out.print(active ? "active" : "off");
+  out.printf(" (sensor UART RX=%d TX=%d)\n", SENSOR_RX_PIN, SENSOR_TX_PIN);
+  printLink(out, "  host->sensor: ", toSensor);
+  printLink(out, "  sensor->host: ", toHost);
+  out.print("  Rewrite: waveform "); out.print(replaceWave ? "replaced" : "passed");
+  out.printf(", status mask %02X %02X %02X, ", getStatusMask(0), getStatusMask(1), getStatusMask(2));
+  out.print(rewritten.get()); out.println(" frames rewritten");
+}
@@ -1,22 +1,124 @@
 #include "ProtocolHandler.h"
+#include "Clock.h"
 
 ProtocolHandler::ProtocolHandler(DeviceState& dev, WaveformGenerator& wave, 
-                                 AlarmManager& alarm, Stream& ser)
-  : device(dev), waveform(wave), alarms(alarm), serial(ser) {}
+                                 AlarmManager& alarm, Stream& ser, ProtocolTrace& tr)
+  : device(dev), waveform(wave), alarms(alarm), serial(ser), trace(tr), storage(nullptr), saveRequested(false),
+    lock(nullptr), faults(nullptr), awaitingReply(false), replyUs(0) {}
+
+// Commands are handled on the UART event task while waveform packets go out
+// from the loop; each public entry point holds the lock so whole packets
+// never interleave on the wire.
+void ProtocolHandler::begin() {
+  lock = xSemaphoreCreateRecursiveMutex();
+}
+
+void ProtocolHandler::setConfigStorage(ConfigStorage* stor) {
+  storage = stor;
+}
+
+void ProtocolHandler::setFaultInjector(FaultInjector* injector) {
+  faults = injector;
+}
+
+ConfigStorage::Config ProtocolHandler::currentConfig() const {
+  ConfigStorage::Config cfg = ConfigStorage::defaults();
+  waveform.saveToConfig(cfg);
+  alarms.saveToConfig(cfg);
+  device.saveToConfig(cfg);
+  return cfg;
+}
+
+ProtocolHandler::PacketKind ProtocolHandler::packetKind(uint8_t cmd) {
+  switch (cmd) {
+    case Protocol::CMD_CO2_WAVEFORM: return PK_WAVEFORM;
+    case Protocol::CMD_ZERO: return PK_ZERO;
+    case Protocol::CMD_GET_SET_SETTINGS: return PK_SETTINGS;
+    case Protocol::CMD_STOP_CONTINUOUS: return PK_STOP;
+    case Protocol::CMD_GET_REVISION: return PK_REVISION;
+    case Protocol::CMD_SENSOR_CAPS: return PK_CAPS;
+    case Protocol::CMD_RESET_NO_BREATH: return PK_RESET_NO_BREATH;
+    case Protocol::CMD_NACK: return PK_NACK;
+    default: return PK_OTHER;
+  }
+}
+
+const char* ProtocolHandler::packetKindName(uint8_t kind) {
+  static const char* const NAMES[PK_COUNT] = {
+    "waveform", "zero", "settings", "stop", "revision", "capabilities", "reset_no_breath", "nack", "other"
+  };
+  return kind < PK_COUNT ? NAMES[kind] : "";
+}
+
+// Packets are counted as built; bytes and the trace follow what reaches the wire
+void ProtocolHandler::transmit(const PacketBuilder& packet) {
+  stats.packetsTx[packetKind(packet.getBuffer()[0])].inc();
+  if (faults && faults->isArmed()) transmitFaulted(packet);
+  else write(packet.getBuffer(), packet.getLength());
+}
+
+void ProtocolHandler::write(const uint8_t* data, uint8_t len) {
+  stats.bytesTx.add(len);
+  trace.record(ProtocolTrace::DIR_TX, data, len);
+  serial.write(data, len);
+  if (awaitingReply) {
+    replyUs = micros();
+    awaitingReply = false;
+  }
+}
+
+// The injector works on a copy, so the packet as built stays intact
+void ProtocolHandler::transmitFaulted(const PacketBuilder& packet) {
+  uint8_t frame[FaultInjector::MAX_FRAME];
+  uint8_t len = packet.getLength();
+  memcpy(frame, packet.getBuffer(), len);
+  
+  FaultInjector::Action action;
+  faults->inject(frame, len, action);
+  if (action.syncJump) stats.syncWraps.add(device.skipSync(action.syncJump));
+  
+  if (action.delay) faults->defer(frame, len, Clock::nowMs());
+  else if (!action.drop) write(frame, len);
+  
+  if (action.nackCode) {
+    PacketBuilder nack;
+    nack.addCommand(Protocol::CMD_NACK);
+    nack.addByte(action.nackCode);
+    nack.finalize();
+    write(nack.getBuffer(), nack.getLength());
+  }
+}
+
+// The configuration is read here on the loop, like every other autosave,
+// rather than on the UART task while the web and console change it
+void ProtocolHandler::update(uint32_t now) {
+  if (saveRequested.exchange(false) && storage) storage->requestSave(currentConfig());
+  
+  uint8_t frame[FaultInjector::MAX_FRAME];
+  uint8_t len;
+  if (!faults || !faults->takeDue(now, frame, len)) return;
+  
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  write(frame, len);
+  if (lock) xSemaphoreGiveRecursive(lock);
+}
 
 void ProtocolHandler::sendNACK(uint8_t errorCode) {
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  stats.nacks[errorCode < NACK_REASONS ? errorCode : 0].inc();
   PacketBuilder packet;
   packet.addCommand(Protocol::CMD_NACK);
   packet.addByte(errorCode);
   packet.finalize();
-  packet.send(serial);
+  transmit(packet);
+  if (lock) xSemaphoreGiveRecursive(lock);
 }
 
 void ProtocolHandler::sendSimpleResponse(uint8_t cmd) {
   PacketBuilder packet;
   packet.addCommand(cmd);
   packet.finalize();
-  packet.send(serial);
+  transmit(packet);
 }
 
 void ProtocolHandler::handleGetRevision(uint8_t format) {
@@ -26,7 +128,7 @@ void ProtocolHandler::handleGetRevision(uint8_t format) {
   packet.addByte(format);
   for (const char* p = revStr; *p; p++) packet.addByte(*p);
   packet.finalize();
-  packet.send(serial);
+  transmit(packet);
 }
 
 void ProtocolHandler::handleSensorCapabilities(uint8_t sci, uint8_t scb) {
@@ -35,51 +137,42 @@ void ProtocolHandler::handleSensorCapabilities(uint8_t sci, uint8_t scb) {
   packet.addByte(sci);
   packet.addByte((sci == 0 || sci == 1) ? 0x01 : (scb & 0x01));
   packet.finalize();
-  packet.send(serial);
+  transmit(packet);
 }
 
+// Everything about an ISB (length, range, access, persistence) comes from
+// its IsbRegistry entry. A get is a request with no data bytes.
 void ProtocolHandler::handleGetSetSettings(uint8_t isb, const uint8_t* data, uint8_t dataLen) {
-  PacketBuilder packet;
-  packet.addCommand(Protocol::CMD_GET_SET_SETTINGS);
+  const IsbRegistry::Entry* entry = IsbRegistry::find(isb);
+  if (!entry) {
+    sendNACK(Protocol::NACK_INVALID_DATA);
+    return;
+  }
   
   if (dataLen > 0) {
-    switch (isb) {
-      case 1: device.setBarometricPressure(PacketBuilder::decode2Bytes(data[0], data[1])); break;
-      case 4: device.setGasTemp(PacketBuilder::decode2Bytes(data[0], data[1])); break;
-      case 5: device.setETCO2TimePeriod(data[0]); break;
-      case 6: device.setNoBreathTimeout(data[0]); break;
-      case 7: device.setCO2Units(data[0]); break;
-      case 11: device.setGasCompensations(data[0], data[1], 
-                                         PacketBuilder::decode2Bytes(data[2], data[3])); break;
+    if (!entry->set) {
+      sendNACK(Protocol::NACK_INVALID_DATA);
+      return;
     }
+    if (dataLen < IsbRegistry::dataLength(*entry)) {
+      sendNACK(Protocol::NACK_BYTE_COUNT);
+      return;
+    }
+    uint16_t values[IsbRegistry::MAX_FIELDS];
+    if (!IsbRegistry::decode(*entry, data, values)) {
+      sendNACK(Protocol::NACK_INVALID_DATA);
+      return;
+    }
+    entry->set(device, values);
+    if (entry->persistent) saveRequested = true;
   }
   
+  PacketBuilder packet;
+  packet.addCommand(Protocol::CMD_GET_SET_SETTINGS);
   packet.addByte(isb);
-  
-  switch (isb) {
-    case 1: packet.add2ByteValue(device.getBarometricPressure()); break;
-    case 4: packet.add2ByteValue(device.getGasTemp()); break;
-    case 5: packet.addByte(device.getETCO2TimePeriod()); break;
-    case 6: packet.addByte(device.getNoBreathTimeout()); break;
-    case 7: packet.addByte(device.getCO2Units()); break;
-    case 11:
-      packet.addByte(device.getO2Compensation());
-      packet.addByte(device.getBalanceGas());
-      packet.add2ByteValue(device.getAnestheticAgent());
-      break;
-    case 18:
-      for (const char* p = "1028494TL "; *p; p++) packet.addByte(*p);
-      break;
-    case 19: packet.addByte(0x01); break;
-    default:
-      packet.reset();
-      packet.addCommand(Protocol::CMD_GET_SET_SETTINGS);
-      packet.addByte(0);
-      break;
-  }
-  
+  IsbRegistry::encode(*entry, device, packet);
   packet.finalize();
-  packet.send(serial);
+  transmit(packet);
 }
 
 void ProtocolHandler::handleZero() {
@@ -87,58 +180,94 @@ void ProtocolHandler::handleZero() {
   packet.addCommand(Protocol::CMD_ZERO);
   
   if (!device.isCompensationsSet()) {
+    stats.zeroRejected.inc();
     packet.addByte(1);
   } else if (device.isZeroInProgress()) {
+    stats.zeroRejected.inc();
     packet.addByte(2);
   } else {
+    stats.zeroStarted.inc();
     device.startZero();
     packet.addByte(0);
   }
   
   packet.finalize();
-  packet.send(serial);
+  transmit(packet);
 }
 
 void ProtocolHandler::sendWaveformPacket(bool includeDPI, uint8_t dpiType) {
+  sendWaveformPacket(waveform.getSampleCenti(), includeDPI, dpiType);
+}
+
+// CO2 values leave in the unit selected with ISB 7
+void ProtocolHandler::sendWaveformPacket(int32_t co2Centi, bool includeDPI, uint8_t dpiType) {
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
   PacketBuilder packet;
   packet.addCommand(Protocol::CMD_CO2_WAVEFORM);
-  packet.addByte(device.getAndIncrementSync());
-  
-  float co2Value = waveform.getSample();
-  uint8_t status = device.getStatusByte1();
-  alarms.checkAlarms(co2Value, status);
-  device.setStatusByte1(status);
+  // One step wraps only from 127; fault jumps count their own wraps
+  uint8_t sync = device.getAndIncrementSync();
+  if (sync == 0x7F) stats.syncWraps.inc();
+  packet.addByte(sync);
   
-  packet.addCO2Waveform(co2Value);
+  packet.addCO2Waveform(device.toCO2Units(co2Centi > 0 ? co2Centi : 0));
   
   if (includeDPI) {
     packet.addByte(dpiType);
     
     switch (dpiType) {
       case Protocol::DPI_CO2_STATUS:
-        packet.addByte(device.getStatusByte1());
+        packet.addByte(alarms.applyStatusByte1(device.getStatusByte1()));
         packet.addByte(device.getStatusByte2());
         packet.addByte(device.getStatusByte3());
         packet.addByte(0);
         packet.addByte(0);
         break;
-      case Protocol::DPI_ETCO2: packet.add2ByteValue(device.getETCO2()); break;
+      case Protocol::DPI_ETCO2: packet.add2ByteValue(device.toCO2Units(device.getETCO2())); break;
       case Protocol::DPI_RESP_RATE: packet.add2ByteValue(device.getRespRate()); break;
-      case Protocol::DPI_INSP_CO2: packet.add2ByteValue(device.getInspCO2()); break;
+      case Protocol::DPI_INSP_CO2: packet.add2ByteValue(device.toCO2Units(device.getInspCO2())); break;
       case Protocol::DPI_BREATH_DETECTED: break;
     }
   }
   
   packet.finalize();
-  packet.send(serial);
+  transmit(packet);
+  if (lock) xSemaphoreGiveRecursive(lock);
+}
+
+void ProtocolHandler::beginExclusive() {
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+}
+
+void ProtocolHandler::endExclusive() {
+  if (lock) xSemaphoreGiveRecursive(lock);
+}
+
+// A reply held back or dropped by the fault injector counts as none
+bool ProtocolHandler::processCommand(const uint8_t* buf, uint8_t len) {
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  awaitingReply = true;
+  dispatchCommand(buf, len);
+  bool replied = !awaitingReply;
+  awaitingReply = false;
+  if (lock) xSemaphoreGiveRecursive(lock);
+  return replied;
 }
 
-void ProtocolHandler::processCommand(uint8_t* buf, uint8_t len) {
+void ProtocolHandler::dispatchCommand(const uint8_t* buf, uint8_t len) {
   if (len < 2) return;
   
+  trace.record(ProtocolTrace::DIR_RX, buf, len);
+  stats.commandsRx.inc();
+  
   uint8_t cmd = buf[0];
   uint8_t nbf = buf[1];
   
+  // Everything below indexes by NBF, so it must match what was received
+  if (nbf == 0 || len != nbf + 2) {
+    sendNACK(Protocol::NACK_BYTE_COUNT);
+    return;
+  }
+  
   if (PacketBuilder::calculateChecksum(buf, len) != 0) {
     sendNACK(Protocol::NACK_CHECKSUM);
     return;
@@ -1,39 +1,99 @@
 #include "ProtocolReceiver.h"
+#include "Clock.h"
 
-ProtocolReceiver::ProtocolReceiver(ProtocolHandler& h, Stream& ser)
-  : index(0), lastByteTime(0), handler(h), serial(ser) {}
+const uint32_t ProtocolReceiver::LATENCY_BOUNDS[LATENCY_BUCKETS - 1] = {
+  250, 500, 1000, 2000, 5000, 10000, 50000
+};
 
+ProtocolReceiver::ProtocolReceiver(ProtocolHandler& h, HardwareSerial& ser)
+  : handler(h), serial(ser), eventDriven(false), byteUs(0),
+    latencyMax(0), latencyTotal(0), latencySamples(0) {
+  memset(latencyCounts, 0, sizeof(latencyCounts));
+}
+
+// Call after the UART is started. The callback fires once the line has been
+// idle for one symbol time, i.e. right after the host finishes a frame.
+void ProtocolReceiver::begin() {
+  uint32_t baud = serial.baudRate();
+  byteUs = baud ? 10000000UL / baud : 0;
+  serial.setRxTimeout(1);
+  serial.onReceive([this]() { drain(); }, true);
+  eventDriven = true;
+}
+
+// Polled fallback; with the receive event installed the loop has nothing to do
 void ProtocolReceiver::update() {
-  uint32_t now = millis();
+  if (!eventDriven) drain();
+}
+
+// The receive event fires one idle character time after the last byte, so
+// a byte followed by n more in the buffer arrived about (n + 1) character
+// times before the event. Polled, arrival is only known to be before now.
+void ProtocolReceiver::drain() {
+  uint32_t eventUs = micros();
+  uint32_t now = Clock::nowMs();
   
   while (serial.available()) {
     uint8_t b = serial.read();
-    
-    if (b >= 0x80) {
-      index = 0;
-      buffer[index++] = b;
-      lastByteTime = now;
-    } else if (index > 0) {
-      if (now - lastByteTime > 500) {
-        index = 0;
-        PacketBuilder packet;
-        packet.addCommand(Protocol::CMD_NACK);
-        packet.addByte(Protocol::NACK_TIMEOUT);
-        packet.finalize();
-        packet.send(serial);
-      } else {
-        buffer[index++] = b;
-        
-        if (index >= 2) {
-          uint8_t nbf = buffer[1];
-          if (index >= nbf + 2) {
-            handler.processCommand(buffer, index);
-            index = 0;
-          }
-        }
-        
-        lastByteTime = now;
-      }
+    uint32_t arrivedUs = eventUs - (eventDriven ? (serial.available() + 1) * byteUs : 0);
+    if (feed(b, now)) recordLatency(handler.getReplyUs() - arrivedUs);
+  }
+}
+
+void ProtocolReceiver::feed(const uint8_t* data, size_t len, uint32_t now) {
+  while (len--) feed(*data++, now);
+}
+
+// Returns true when the byte completed a frame that was answered
+bool ProtocolReceiver::feed(uint8_t b, uint32_t now) {
+  bytesRx.inc();
+  switch (frames.feed(b, now)) {
+    case FrameAssembler::FRAME_COMPLETE:
+      return handler.processCommand(frames.frame(), frames.frameLength());
+    case FrameAssembler::FRAME_TIMEOUT:
+      handler.sendNACK(Protocol::NACK_TIMEOUT);
+      break;
+    case FrameAssembler::FRAME_BAD_LENGTH:
+      handler.sendNACK(Protocol::NACK_BYTE_COUNT);
+      break;
+    default:
+      break;
+  }
+  return false;
+}
+
+void ProtocolReceiver::recordLatency(uint32_t us) {
+  uint8_t bucket = 0;
+  while (bucket < LATENCY_BUCKETS - 1 && us >= LATENCY_BOUNDS[bucket]) bucket++;
+  latencyCounts[bucket]++;
+  latencyTotal += us;
+  latencySamples++;
+  if (us > latencyMax) latencyMax = us;
+}
+
+void ProtocolReceiver::resetLatency() {
+  memset(latencyCounts, 0, sizeof(latencyCounts));
+  latencyMax = 0;
+  latencyTotal = 0;
+  latencySamples = 0;
+}
+
+void ProtocolReceiver::printLatency(Print& out) const {
+  out.print("Command latency (");
+  out.print(eventDriven ? "UART event" : "polled");
+  out.print("), n="); out.print(latencySamples);
+  if (latencySamples) {
+    out.print(" mean="); out.print(latencyTotal / latencySamples);
+    out.print("us max="); out.print(latencyMax); out.print("us");
+  }
+  out.println();
+  
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+    if (i < LATENCY_BUCKETS - 1) {
+      out.printf("  < %5luus: ", (unsigned long)LATENCY_BOUNDS[i]);
+    } else {
+      out.printf("  >=%5luus: ", (unsigned long)LATENCY_BOUNDS[i - 1]);
     }
+    out.println(latencyCounts[i]);
   }
 }
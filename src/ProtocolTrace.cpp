@@ -0,0 +1,126 @@
+#include "ProtocolTrace.h"
+#include "PacketBuilder.h"
+#include "Config.h"
+#include "IsbRegistry.h"
+
+ProtocolTrace::ProtocolTrace() : head(0) {
+  for (uint16_t i = 0; i < CAPACITY; i++) slots[i].seq.store(UINT32_MAX);
+}
+
+uint32_t ProtocolTrace::getHead() const { 
+  return head.load(std::memory_order_acquire); 
+}
+
+uint32_t ProtocolTrace::getOldest() const {
+  uint32_t h = getHead();
+  return h > CAPACITY ? h - CAPACITY : 0;
+}
+
+// False if the entry is not written yet or was overwritten while copying
+bool ProtocolTrace::read(uint32_t seq, Entry& out) const {
+  const Slot& slot = slots[seq & (CAPACITY - 1)];
+  if (slot.seq.load(std::memory_order_acquire) != seq) return false;
+  out = slot.entry;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot.seq.load(std::memory_order_relaxed) == seq;
+}
+
+bool ProtocolTrace::isWaveform(const Entry& e) {
+  return e.dir == DIR_TX && e.len > 0 && e.data[0] == Protocol::CMD_CO2_WAVEFORM;
+}
+
+// The checksum byte of a truncated frame was not kept, so there is
+// nothing to check; callers show those as truncated instead
+bool ProtocolTrace::checksumOk(const Entry& e) {
+  if (e.truncated || e.len < 3) return false;
+  return PacketBuilder::calculateChecksum(e.data, e.len) == 0;
+}
+
+static const char* nackName(uint8_t code) {
+  switch (code) {
+    case Protocol::NACK_INVALID_CMD: return "invalid cmd";
+    case Protocol::NACK_CHECKSUM: return "checksum";
+    case Protocol::NACK_TIMEOUT: return "timeout";
+    case Protocol::NACK_BYTE_COUNT: return "byte count";
+    case Protocol::NACK_INVALID_DATA: return "invalid data";
+  }
+  return "?";
+}
+
+// Field names and widths come from the ISB table, e.g. " o2=16 bal=0 agent=0"
+static void describeSetting(uint8_t isb, const uint8_t* p, uint8_t nData, char* out, size_t len, int& n) {
+  const IsbRegistry::Entry* entry = IsbRegistry::find(isb);
+  if (!entry) {
+    if (n >= 0 && (size_t)n < len) n += snprintf(out + n, len - n, " +%u bytes", nData);
+    return;
+  }
+  if (entry->text) {
+    if (n >= 0 && (size_t)n < len) n += snprintf(out + n, len - n, " \"%.*s\"", nData, (const char*)p);
+    return;
+  }
+  for (uint8_t i = 0; i < entry->fieldCount; i++) {
+    const IsbRegistry::Field& f = entry->fields[i];
+    if (nData < f.width) return;
+    uint16_t value = (f.width == 2) ? PacketBuilder::decode2Bytes(p[0], p[1]) : p[0];
+    if (n >= 0 && (size_t)n < len) n += snprintf(out + n, len - n, " %s=%u", f.name, value);
+    p += f.width;
+    nData -= f.width;
+  }
+}
+
+// Human-readable decode, e.g. "0x84 ISB=1 baro=760"
+size_t ProtocolTrace::describe(const Entry& e, char* out, size_t len) {
+  if (e.len < 2 || len == 0) {
+    return snprintf(out, len, "short frame (%u bytes)", e.len);
+  }
+  
+  const uint8_t* d = e.data;
+  uint8_t avail = e.truncated ? MAX_FRAME : e.len;
+  uint8_t nData = avail > 3 ? avail - 3 : 0;   // bytes between NBF and checksum
+  const uint8_t* p = d + 2;
+  bool rx = e.dir == DIR_RX;
+  int n = snprintf(out, len, "0x%02X", d[0]);
+  
+  #define APPEND(...) do { if (n >= 0 && (size_t)n < len) n += snprintf(out + n, len - n, __VA_ARGS__); } while (0)
+  
+  switch (d[0]) {
+    case Protocol::CMD_CO2_WAVEFORM:
+      if (rx) { APPEND(" start continuous"); break; }
+      if (nData >= 3) {
+        int16_t co2 = (int16_t)PacketBuilder::decode2Bytes(p[1], p[2]) - 1000;
+        APPEND(" sync=%u co2=%d.%02d", p[0], co2 / 100, abs(co2 % 100));
+      }
+      if (nData >= 4) {
+        APPEND(" DPI=%u", p[3]);
+        if (p[3] != Protocol::DPI_CO2_STATUS && nData >= 6) {
+          APPEND(" val=%u", PacketBuilder::decode2Bytes(p[4], p[5]));
+        } else if (p[3] == Protocol::DPI_CO2_STATUS && nData >= 7) {
+          APPEND(" st=%02X/%02X/%02X", p[4], p[5], p[6]);
+        }
+      }
+      break;
+    case Protocol::CMD_ZERO:
+      if (rx) APPEND(" zero");
+      else if (nData >= 1) APPEND(" zero result=%u", p[0]);
+      break;
+    case Protocol::CMD_GET_SET_SETTINGS:
+      if (nData < 1) break;
+      APPEND(" ISB=%u", p[0]);
+      if (nData == 1) { APPEND(" get"); break; }
+      describeSetting(p[0], p + 1, nData - 1, out, len, n);
+      break;
+    case Protocol::CMD_NACK:
+      if (nData >= 1) APPEND(" NACK %u (%s)", p[0], nackName(p[0]));
+      break;
+    case Protocol::CMD_STOP_CONTINUOUS: APPEND(" stop continuous"); break;
+    case Protocol::CMD_GET_REVISION: APPEND(" revision"); break;
+    case Protocol::CMD_SENSOR_CAPS: if (nData >= 1) APPEND(" caps SCI=%u", p[0]); break;
+    case Protocol::CMD_RESET_NO_BREATH: APPEND(" reset no-breath"); break;
+    default: APPEND(" unknown"); break;
+  }
+  
+  if (e.truncated) APPEND(" [truncated %u]", e.len);
+  #undef APPEND
+  
+  return (n < 0) ? 0 : ((size_t)n < len ? n : len - 1);
+}
@@ -0,0 +1,42 @@
+#include "Resampler.h"
+
+Resampler::Resampler() : count(0), nativeInterval(0) {
+  memset(points, 0, sizeof(points));
+  memset(times, 0, sizeof(times));
+}
+
+void Resampler::reset(uint32_t nativeIntervalMs) {
+  count = 0;
+  nativeInterval = nativeIntervalMs;
+}
+
+void Resampler::push(uint32_t time, float value) {
+  points[0] = points[1]; times[0] = times[1];
+  points[1] = points[2]; times[1] = times[2];
+  points[2] = value;     times[2] = time;
+  if (count < 3) count++;
+}
+
+bool Resampler::sample(uint32_t now, float& out) const {
+  if (count == 0) return false;
+  
+  float c = points[2];
+  uint32_t span = times[2] - times[1];
+  if (nativeInterval <= PASSTHROUGH_MS || count < 2 || span == 0) {
+    out = c;
+    return true;
+  }
+  
+  float b = points[1];
+  float a = (count == 3) ? points[0] : b;
+  float d = 2 * c - b;
+  
+  int32_t offset = (int32_t)(now - span - times[1]);
+  float u = constrain((float)offset / span, 0.0f, 1.0f);
+  float u2 = u * u;
+  float u3 = u2 * u;
+  
+  out = 0.5f * (2 * b + (c - a) * u + (2 * a - 5 * b + 4 * c - d) * u2 + 
+                (3 * b - a - 3 * c + d) * u3);
+  return true;
+}
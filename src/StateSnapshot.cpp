@@ -0,0 +1,234 @@
+#include "StateSnapshot.h"
+#include "ConfigStorage.h"
+#include "IsbRegistry.h"
+#include "SettingLimits.h"
+#include "Clock.h"
+
+// Device and host builds must agree byte for byte; new fields go at the end
+static_assert(sizeof(SnapshotState) == 104, "snapshot layout changed: append fields and bump VERSION");
+static_assert(AlarmSnapshot::CONDITIONS == AlarmManager::CONDITION_COUNT,
+              "snapshot must hold every alarm condition");
+
+StateSnapshot::StateSnapshot(DeviceState& dev, WaveformGenerator& wave, AlarmManager& alarm,
+                             ProtocolHandler& proto)
+  : device(dev), waveform(wave), alarms(alarm), protocol(proto), stagedLen(0), stagedReady(false),
+    lastCaptureUs(0), lastRestoreUs(0) {}
+
+size_t StateSnapshot::capture(uint8_t* out, size_t len) {
+  if (len < sizeof(SnapshotRecord)) return 0;
+  uint32_t start = micros();
+
+  SnapshotRecord rec;
+  memset(&rec, 0, sizeof(rec));
+  memcpy(rec.magic, "CO2S", 4);
+  rec.version = VERSION;
+  rec.size = sizeof(SnapshotState);
+
+  protocol.beginExclusive();
+  uint32_t now = Clock::nowMs();
+  rec.capturedMs = now;
+  device.captureState(rec.state.device, now);
+  waveform.captureState(rec.state.waveform);
+  alarms.captureState(rec.state.alarms, now);
+  protocol.endExclusive();
+
+  rec.crc = ConfigStorage::crc32((const uint8_t*)&rec, offsetof(SnapshotRecord, crc));
+  memcpy(out, &rec, sizeof(rec));
+
+  lastCaptureUs = micros() - start;
+  return sizeof(rec);
+}
+
+// Every field of SnapshotState in layout order, with the check a restored
+// value must pass. A record has to end on one of these fields.
+namespace {
+
+enum FieldKind : uint8_t {
+  FIELD_ANY,      // any value is harmless
+  FIELD_BOOL,     // any byte; normalised to 0/1 on restore
+  FIELD_7BIT,     // goes on the wire as is
+  FIELD_ISB,      // range of an IsbRegistry field (baro >= 400 keeps the unit scale finite)
+  FIELD_RANGE,    // SettingLimits range, finite
+  FIELD_PHASE     // radians within SettingLimits::PHASE
+};
+
+struct FieldRule {
+  uint8_t offset;
+  uint8_t size;
+  FieldKind kind;
+  uint8_t isb;
+  uint8_t isbField;
+  const SettingLimits::Range* range;
+};
+
+#define DEV(f) offsetof(SnapshotState, device.f), sizeof(DeviceSnapshot::f)
+#define WAVE(f) offsetof(SnapshotState, waveform.f), sizeof(WaveformSnapshot::f)
+#define ALARM(f) offsetof(SnapshotState, alarms.f), sizeof(AlarmSnapshot::f)
+#define COND(i, f) offsetof(SnapshotState, alarms.conditions[i].f), sizeof(AlarmConditionSnapshot::f)
+#define CONDITION_RULES(i) \
+  { COND(i, enabled), FIELD_BOOL, 0, 0, nullptr }, \
+  { COND(i, active), FIELD_BOOL, 0, 0, nullptr }, \
+  { COND(i, latched), FIELD_BOOL, 0, 0, nullptr }, \
+  { COND(i, pending), FIELD_BOOL, 0, 0, nullptr }, \
+  { COND(i, pendingMs), FIELD_ANY, 0, 0, nullptr }
+
+constexpr FieldRule FIELD_RULES[] = {
+  { DEV(continuousMode), FIELD_BOOL, 0, 0, nullptr },
+  { DEV(initialized), FIELD_BOOL, 0, 0, nullptr },
+  { DEV(zeroInProgress), FIELD_BOOL, 0, 0, nullptr },
+  { DEV(compensationsSet), FIELD_BOOL, 0, 0, nullptr },
+  { DEV(syncCounter), FIELD_ANY, 0, 0, nullptr },
+  { DEV(o2Compensation), FIELD_ISB, 11, 0, nullptr },
+  { DEV(balanceGas), FIELD_ISB, 11, 1, nullptr },
+  { DEV(etco2TimePeriod), FIELD_ISB, 5, 0, nullptr },
+  { DEV(noBreathTimeout), FIELD_ISB, 6, 0, nullptr },
+  { DEV(co2Units), FIELD_ISB, 7, 0, nullptr },
+  { DEV(sleepMode), FIELD_ISB, 8, 0, nullptr },
+  { DEV(zeroGasType), FIELD_ISB, 9, 0, nullptr },
+  { DEV(statusByte1), FIELD_7BIT, 0, 0, nullptr },
+  { DEV(statusByte2), FIELD_7BIT, 0, 0, nullptr },
+  { DEV(statusByte3), FIELD_7BIT, 0, 0, nullptr },
+  { DEV(reserved), FIELD_ANY, 0, 0, nullptr },
+  { DEV(barometricPressure), FIELD_ISB, 1, 0, nullptr },
+  { DEV(anestheticAgent), FIELD_ISB, 11, 2, nullptr },
+  { DEV(gasTemp), FIELD_ISB, 4, 0, nullptr },
+  { DEV(etco2), FIELD_ANY, 0, 0, nullptr },
+  { DEV(respRate), FIELD_ANY, 0, 0, nullptr },
+  { DEV(inspCO2), FIELD_ANY, 0, 0, nullptr },
+  { DEV(zeroElapsedMs), FIELD_ANY, 0, 0, nullptr },
+  { WAVE(amplitude), FIELD_RANGE, 0, 0, &SettingLimits::AMPLITUDE },
+  { WAVE(frequency), FIELD_RANGE, 0, 0, &SettingLimits::FREQUENCY },
+  { WAVE(baseline), FIELD_RANGE, 0, 0, &SettingLimits::BASELINE },
+  { WAVE(phase), FIELD_PHASE, 0, 0, nullptr },
+  { WAVE(useI2CSensor), FIELD_BOOL, 0, 0, nullptr },
+  { WAVE(reserved), FIELD_ANY, 0, 0, nullptr },
+  { ALARM(highThreshold), FIELD_RANGE, 0, 0, &SettingLimits::ETCO2_ALARM },
+  { ALARM(lowThreshold), FIELD_RANGE, 0, 0, &SettingLimits::ETCO2_ALARM },
+  { ALARM(rrHighThreshold), FIELD_RANGE, 0, 0, &SettingLimits::RR_ALARM },
+  { ALARM(rrLowThreshold), FIELD_RANGE, 0, 0, &SettingLimits::RR_ALARM },
+  { ALARM(latching), FIELD_BOOL, 0, 0, nullptr },
+  { ALARM(reserved), FIELD_ANY, 0, 0, nullptr },
+  CONDITION_RULES(0),
+  CONDITION_RULES(1),
+  CONDITION_RULES(2),
+  CONDITION_RULES(3),
+};
+
+#undef DEV
+#undef WAVE
+#undef ALARM
+#undef COND
+#undef CONDITION_RULES
+
+constexpr size_t FIELD_COUNT = sizeof(FIELD_RULES) / sizeof(FIELD_RULES[0]);
+
+bool fieldValid(const FieldRule& rule, const uint8_t* state) {
+  const uint8_t* p = state + rule.offset;
+  uint16_t value = rule.size == 2 ? p[0] | (p[1] << 8) : p[0];
+  float f;
+  switch (rule.kind) {
+    case FIELD_7BIT: return value <= 0x7F;
+    case FIELD_ISB: return IsbRegistry::clamp(rule.isb, value, rule.isbField) == value;
+    case FIELD_RANGE: memcpy(&f, p, sizeof(f)); return SettingLimits::inRange(*rule.range, f);
+    case FIELD_PHASE: memcpy(&f, p, sizeof(f)); return SettingLimits::phaseRadiansInRange(f);
+    default: return true;
+  }
+}
+
+}  // namespace
+
+// The rules must cover SnapshotState field by field, or a field would go
+// unchecked (the layout has no padding)
+static constexpr bool rulesTile(size_t i, size_t end) {
+  return i == FIELD_COUNT ? end == sizeof(SnapshotState)
+                          : FIELD_RULES[i].offset == end &&
+                            rulesTile(i + 1, end + FIELD_RULES[i].size);
+}
+static_assert(rulesTile(0, 0), "snapshot field rules out of step with SnapshotState");
+
+// The CRC sits right after the state of the writer's version. Every field
+// the record carries is range-checked here, so a restore either applies a
+// state the emulator could have reached itself or changes nothing.
+const char* StateSnapshot::validate(const uint8_t* data, size_t len) {
+  size_t headerLen = offsetof(SnapshotRecord, state);
+  if (len < headerLen + sizeof(uint32_t)) return "too short";
+
+  SnapshotRecord rec;
+  memcpy(&rec, data, headerLen);
+  if (memcmp(rec.magic, "CO2S", 4) != 0) return "not a snapshot";
+  if (rec.version == 0) return "bad version";
+  if (rec.version > VERSION) return "snapshot from a newer firmware";
+  if (rec.size > sizeof(SnapshotState) || headerLen + rec.size + sizeof(uint32_t) != len) return "bad length";
+
+  uint32_t storedCrc;
+  memcpy(&storedCrc, data + len - sizeof(uint32_t), sizeof(storedCrc));
+  if (ConfigStorage::crc32(data, len - sizeof(uint32_t)) != storedCrc) return "checksum mismatch";
+
+  const uint8_t* state = data + headerLen;
+  bool boundary = false;
+  for (size_t i = 0; i < FIELD_COUNT && FIELD_RULES[i].offset + FIELD_RULES[i].size <= rec.size; i++) {
+    if (!fieldValid(FIELD_RULES[i], state)) return "value out of range";
+    boundary = FIELD_RULES[i].offset + FIELD_RULES[i].size == rec.size;
+  }
+  if (!boundary) return "size not on a field boundary";
+  return nullptr;
+}
+
+const char* StateSnapshot::restore(const uint8_t* data, size_t len) {
+  const char* error = validate(data, len);
+  if (error) return error;
+  uint32_t start = micros();
+
+  uint16_t size;
+  memcpy(&size, data + offsetof(SnapshotRecord, size), sizeof(size));
+
+  protocol.beginExclusive();
+  uint32_t now = Clock::nowMs();
+
+  // Fields an older writer did not have keep their current values
+  SnapshotState state;
+  device.captureState(state.device, now);
+  waveform.captureState(state.waveform);
+  alarms.captureState(state.alarms, now);
+  memcpy(&state, data + offsetof(SnapshotRecord, state), size);
+  
+  // A bool object may only hold 0 or 1; the wire byte may be anything
+  uint8_t* raw = (uint8_t*)&state;
+  for (size_t i = 0; i < FIELD_COUNT && FIELD_RULES[i].offset < size; i++) {
+    if (FIELD_RULES[i].kind == FIELD_BOOL) raw[FIELD_RULES[i].offset] = raw[FIELD_RULES[i].offset] != 0;
+  }
+
+  device.restoreState(state.device, now);
+  waveform.restoreState(state.waveform);
+  alarms.restoreState(state.alarms, now);
+  protocol.endExclusive();
+
+  lastRestoreUs = micros() - start;
+  return nullptr;
+}
+
+const char* StateSnapshot::stage(const uint8_t* data, size_t len) {
+  if (stagedReady) return "restore already pending";
+  const char* error = validate(data, len);
+  if (error) return error;
+
+  memcpy(staged, data, len);
+  stagedLen = len;
+  stagedReady.store(true, std::memory_order_release);
+  return nullptr;
+}
+
+void StateSnapshot::update() {
+  if (!stagedReady.load(std::memory_order_acquire)) return;
+  const char* error = restore(staged, stagedLen);
+  stagedReady = false;
+
+  if (error) {
+    CMD_SERIAL.print("Snapshot restore failed: ");
+    CMD_SERIAL.println(error);
+  } else {
+    CMD_SERIAL.print("Snapshot restored in ");
+    CMD_SERIAL.print(lastRestoreUs);
+    CMD_SERIAL.println(" us");
+  }
+}
@@ -1,11 +1,11 @@
 #include "TFTDisplay.h"
 
 TFTDisplay::TFTDisplay(WaveformGenerator& wave, AlarmManager& alarm, DeviceState& dev)
-  : waveform(wave), alarms(alarm), device(dev), dataIndex(0), lastUpdate(0) {
+  : waveform(wave), alarms(alarm), device(dev), dataIndex(0), lastUpdate(0), needsClear(false) {
   for (int i = 0; i < 170; i++) waveformData[i] = 0;
 }
 
-void TFTDisplay::begin() {
+bool TFTDisplay::begin() {
   tft.init();
   tft.setRotation(0);  // Portrait mode
   tft.fillScreen(TFT_BLACK);
@@ -23,12 +23,19 @@ void TFTDisplay::begin() {
   tft.setTextSize(1);
   tft.setCursor(10, 40);
   tft.println("Initializing...");
+  needsClear = true;
+  return true;
 }
 
 void TFTDisplay::update() {
   if (millis() - lastUpdate < 100) return;  // Update at 10Hz
   lastUpdate = millis();
   
+  if (needsClear) {
+    clear();
+    needsClear = false;
+  }
+  
   // Get current CO2 value
   float co2 = waveform.getSample();
   
@@ -69,9 +76,7 @@ void TFTDisplay::drawParameters() {
   float co2 = waveform.getSample();
   uint16_t rate = waveform.getRespiratoryRate();
   
-  // Check alarms
-  uint8_t status = 0;
-  bool alarm = alarms.checkAlarms(co2, status);
+  bool alarm = alarms.isAlarmActive();
   
   // Draw CO2 value
   tft.setTextSize(3);
@@ -0,0 +1,205 @@
+#include "TrendExporter.h"
+
+static void putU16(uint8_t* p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+static void putU32(uint8_t* p, uint32_t v) {
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  p[2] = (v >> 16) & 0xFF;
+  p[3] = v >> 24;
+}
+
+TrendExporter::TrendExporter(const TrendStore& trendStore, TrendStore::Resolution resolution, 
+                             Format fmt, uint32_t from, uint32_t to, uint32_t maxRecords)
+  : store(trendStore), res(resolution), format(fmt), stage(0), first(true),
+    records(0), bytes(0), startTime(millis()), elapsed(0) {
+  seq = store.lowerBound(res, from);
+  end = (to < UINT32_MAX) ? store.lowerBound(res, to + 1) : store.endSeq(res);
+  
+  uint32_t count = end > seq ? end - seq : 0;
+  stride = (maxRecords > 0) ? (count + maxRecords - 1) / maxRecords : 1;
+  if (stride == 0) stride = 1;
+}
+
+uint8_t TrendExporter::recordSize() const {
+  switch (res) {
+    case TrendStore::RES_RAW: return 6;
+    case TrendStore::RES_BREATH: return 8;
+    case TrendStore::RES_MINUTE: return 16;
+  }
+  return 0;
+}
+
+size_t TrendExporter::writeHeader(uint8_t* out, size_t len) const {
+  int n = 0;
+  
+  if (format == FORMAT_BINARY) {
+    if (len < 16) return 0;
+    memcpy(out, "CO2T", 4);
+    out[4] = BINARY_VERSION;
+    out[5] = res;
+    putU16(out + 6, recordSize());
+    memset(out + 8, 0, 8);
+    return 16;
+  }
+  
+  if (format == FORMAT_JSON) {
+    n = snprintf((char*)out, len, "{\"res\":\"%s\",\"stride\":%lu,\"points\":[",
+                 TrendStore::resolutionName(res), (unsigned long)stride);
+  } else {
+    switch (res) {
+      case TrendStore::RES_RAW: 
+        n = snprintf((char*)out, len, "time_ms,co2_mmHg\n"); 
+        break;
+      case TrendStore::RES_BREATH: 
+        n = snprintf((char*)out, len, "time_ms,etco2_mmHg,resp_rate\n"); 
+        break;
+      case TrendStore::RES_MINUTE: 
+        n = snprintf((char*)out, len, "time_ms,co2_min,co2_max,co2_mean,etco2_mmHg,resp_rate,breaths\n"); 
+        break;
+    }
+  }
+  return (n > 0 && (size_t)n < len) ? n : 0;
+}
+
+// Returns 0 if the entry is gone or does not fit in len
+size_t TrendExporter::writeRecord(uint32_t recordSeq, uint8_t* out, size_t len) const {
+  char* text = (char*)out;
+  const char* open = (format == FORMAT_JSON) ? "[" : "";
+  const char* close = (format == FORMAT_JSON) ? "]" : "\n";
+  int n = 0;
+  
+  switch (res) {
+    case TrendStore::RES_RAW: {
+      TrendStore::RawSample s;
+      if (!store.raw.get(recordSeq, s)) return 0;
+      if (format == FORMAT_BINARY) {
+        if (len < 6) return 0;
+        putU32(out, s.time);
+        putU16(out + 4, (uint16_t)s.co2);
+        return 6;
+      }
+      n = snprintf(text, len, "%s%lu,%.2f%s", open, (unsigned long)s.time, s.co2 / 100.0f, close);
+      break;
+    }
+    case TrendStore::RES_BREATH: {
+      TrendStore::BreathRecord b;
+      if (!store.breaths.get(recordSeq, b)) return 0;
+      if (format == FORMAT_BINARY) {
+        if (len < 8) return 0;
+        putU32(out, b.time);
+        putU16(out + 4, b.etco2);
+        putU16(out + 6, b.respRate);
+        return 8;
+      }
+      n = snprintf(text, len, "%s%lu,%.1f,%u%s", open, (unsigned long)b.time, 
+                   b.etco2 / 10.0f, b.respRate, close);
+      break;
+    }
+    case TrendStore::RES_MINUTE: {
+      TrendStore::MinuteRecord m;
+      if (!store.minutes.get(recordSeq, m)) return 0;
+      if (format == FORMAT_BINARY) {
+        if (len < 16) return 0;
+        putU32(out, m.time);
+        putU16(out + 4, (uint16_t)m.co2Min);
+        putU16(out + 6, (uint16_t)m.co2Max);
+        putU16(out + 8, (uint16_t)m.co2Mean);
+        putU16(out + 10, m.etco2);
+        putU16(out + 12, m.respRate);
+        putU16(out + 14, m.breaths);
+        return 16;
+      }
+      n = snprintf(text, len, "%s%lu,%.2f,%.2f,%.2f,%.1f,%u,%u%s", open, (unsigned long)m.time,
+                   m.co2Min / 100.0f, m.co2Max / 100.0f, m.co2Mean / 100.0f,
+                   m.etco2 / 10.0f, m.respRate, m.breaths, close);
+      break;
+    }
+  }
+  return (n > 0 && (size_t)n < len) ? n : 0;
+}
+
+size_t TrendExporter::read(uint8_t* buffer, size_t maxLen) {
+  size_t used = 0;
+  
+  if (stage == 0) {
+    used = writeHeader(buffer, maxLen);
+    if (used == 0) return 0;
+    stage = 1;
+  }
+  
+  while (stage == 1) {
+    // Entries overwritten since the export started are skipped
+    uint32_t oldest = store.firstSeq(res);
+    if (seq < oldest) seq = oldest;
+    if (seq >= end) {
+      stage = 2;
+      break;
+    }
+    
+    size_t sep = (format == FORMAT_JSON && !first) ? 1 : 0;
+    if (used + sep >= maxLen) break;
+    size_t n = writeRecord(seq, buffer + used + sep, maxLen - used - sep);
+    if (n == 0 && store.firstSeq(res) <= seq) break;  // out of space
+    if (n > 0) {
+      if (sep) buffer[used] = ',';
+      used += sep + n;
+      first = false;
+      records++;
+    }
+    seq += stride;
+  }
+  
+  if (stage == 2) {
+    if (format == FORMAT_JSON) {
+      if (used + 2 <= maxLen) {
+        buffer[used++] = ']';
+        buffer[used++] = '}';
+        stage = 3;
+      }
+    } else {
+      stage = 3;
+    }
+    if (stage == 3) elapsed = millis() - startTime;
+  }
+  
+  bytes += used;
+  return used;
+}
+
+bool TrendExporter::isFinished() const { return stage == 3; }
+uint32_t TrendExporter::getRecordCount() const { return records; }
+uint32_t TrendExporter::getByteCount() const { return bytes; }
+
+uint32_t TrendExporter::getElapsedMs() const { 
+  return isFinished() ? elapsed : millis() - startTime; 
+}
+
+const char* TrendExporter::contentType(Format fmt) {
+  switch (fmt) {
+    case FORMAT_JSON: return "application/json";
+    case FORMAT_CSV: return "text/csv";
+    case FORMAT_BINARY: return "application/octet-stream";
+  }
+  return "application/octet-stream";
+}
+
+const char* TrendExporter::fileExtension(Format fmt) {
+  switch (fmt) {
+    case FORMAT_JSON: return "json";
+    case FORMAT_CSV: return "csv";
+    case FORMAT_BINARY: return "bin";
+  }
+  return "bin";
+}
+
+bool TrendExporter::parseFormat(const char* name, Format& fmt) {
+  if (strcmp(name, "json") == 0) fmt = FORMAT_JSON;
+  else if (strcmp(name, "csv") == 0) fmt = FORMAT_CSV;
+  else if (strcmp(name, "bin") == 0) fmt = FORMAT_BINARY;
+  else return false;
+  return true;
+}
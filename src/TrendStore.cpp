@@ -0,0 +1,125 @@
+#include "TrendStore.h"
+#include <esp_heap_caps.h>
+
+TrendStore::TrendStore() : inPSRAM(false) {
+  resetMinute(0);
+}
+
+TrendStore::~TrendStore() {
+  heap_caps_free(raw.detach());
+  heap_caps_free(breaths.detach());
+  heap_caps_free(minutes.detach());
+}
+
+template <typename T>
+T* TrendStore::allocate(uint32_t count) {
+  void* mem = heap_caps_malloc(count * sizeof(T), MALLOC_CAP_SPIRAM);
+  if (!mem) {
+    inPSRAM = false;
+    return nullptr;
+  }
+  return static_cast<T*>(mem);
+}
+
+bool TrendStore::begin() {
+  inPSRAM = true;
+  raw.attach(allocate<RawSample>(TREND_RAW_CAPACITY), TREND_RAW_CAPACITY);
+  breaths.attach(allocate<BreathRecord>(TREND_BREATH_CAPACITY), TREND_BREATH_CAPACITY);
+  minutes.attach(allocate<MinuteRecord>(TREND_MINUTE_CAPACITY), TREND_MINUTE_CAPACITY);
+  
+  if (!inPSRAM) {
+    CMD_SERIAL.println("PSRAM unavailable, trend storage partly disabled");
+  }
+  
+  resetMinute(millis());
+  return inPSRAM;
+}
+
+void TrendStore::resetMinute(uint32_t now) {
+  minuteStart = now;
+  co2Sum = 0;
+  co2Count = 0;
+  co2Min = INT16_MAX;
+  co2Max = INT16_MIN;
+  etco2Sum = 0;
+  rateSum = 0;
+  breathCount = 0;
+}
+
+void TrendStore::addSample(uint32_t now, float co2) {
+  int16_t value = (int16_t)constrain(co2 * 100.0f, (float)INT16_MIN, (float)INT16_MAX);
+  raw.push({now, value});
+  
+  co2Sum += value;
+  co2Count++;
+  if (value < co2Min) co2Min = value;
+  if (value > co2Max) co2Max = value;
+  
+  if (now - minuteStart >= 60000UL) {
+    MinuteRecord rec;
+    rec.time = minuteStart;
+    rec.co2Min = co2Min;
+    rec.co2Max = co2Max;
+    rec.co2Mean = (int16_t)(co2Sum / (int32_t)co2Count);
+    rec.etco2 = breathCount ? etco2Sum / breathCount : 0;
+    rec.respRate = breathCount ? rateSum / breathCount : 0;
+    rec.breaths = breathCount;
+    minutes.push(rec);
+    resetMinute(minuteStart + 60000UL);
+  }
+}
+
+void TrendStore::addBreath(uint32_t now, uint16_t etco2, uint16_t respRate) {
+  breaths.push({now, etco2, respRate});
+  etco2Sum += etco2;
+  rateSum += respRate;
+  breathCount++;
+}
+
+uint32_t TrendStore::firstSeq(Resolution res) const {
+  switch (res) {
+    case RES_RAW: return raw.firstSeq();
+    case RES_BREATH: return breaths.firstSeq();
+    case RES_MINUTE: return minutes.firstSeq();
+  }
+  return 0;
+}
+
+uint32_t TrendStore::endSeq(Resolution res) const {
+  switch (res) {
+    case RES_RAW: return raw.endSeq();
+    case RES_BREATH: return breaths.endSeq();
+    case RES_MINUTE: return minutes.endSeq();
+  }
+  return 0;
+}
+
+uint32_t TrendStore::lowerBound(Resolution res, uint32_t time) const {
+  switch (res) {
+    case RES_RAW: return raw.lowerBound(time);
+    case RES_BREATH: return breaths.lowerBound(time);
+    case RES_MINUTE: return minutes.lowerBound(time);
+  }
+  return 0;
+}
+
+bool TrendStore::isInPSRAM() const { 
+  return inPSRAM; 
+}
+
+const char* TrendStore::resolutionName(Resolution res) {
+  switch (res) {
+    case RES_RAW: return "raw";
+    case RES_BREATH: return "breath";
+    case RES_MINUTE: return "minute";
+  }
+  return "?";
+}
+
+bool TrendStore::parseResolution(const char* name, Resolution& res) {
+  if (strcmp(name, "raw") == 0) res = RES_RAW;
+  else if (strcmp(name, "breath") == 0) res = RES_BREATH;
+  else if (strcmp(name, "minute") == 0) res = RES_MINUTE;
+  else return false;
+  return true;
+}
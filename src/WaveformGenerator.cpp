@@ -2,49 +2,69 @@
 
 WaveformGenerator::WaveformGenerator() 
   : amplitude(38.0), frequency(0.25), baseline(0.0), phase(0.0),
-    i2cSensor(nullptr), useI2CSensor(false) {}
+    i2cSensor(nullptr), useI2CSensor(false), externalCenti(NO_EXTERNAL) {
+  updateFixed();
+}
+
+// The sample path never touches float; parameters are converted here once
+void WaveformGenerator::updateFixed() {
+  amplitudeCenti = FixedPoint::toCenti(amplitude);
+  baselineCenti = FixedPoint::toCenti(baseline);
+  frequencyMicroHz = frequency > 0 ? (uint32_t)llround(frequency * 1e6) : 0;
+  phaseOffset = (uint32_t)(int64_t)llround(phase / (2.0 * PI) * 4294967296.0);
+}
 
 void WaveformGenerator::setI2CSensor(I2CSensorInterface* sensor) { 
   i2cSensor = sensor; 
 }
 
+// Kept even while the sensor is absent; the simulation fills in until it
+// delivers samples
 void WaveformGenerator::setUseI2CSensor(bool use) { 
-  useI2CSensor = use && i2cSensor && i2cSensor->isAvailable(); 
+  useI2CSensor = use && i2cSensor; 
 }
 
 bool WaveformGenerator::isUsingI2CSensor() const { 
   return useI2CSensor; 
 }
 
-void WaveformGenerator::setAmplitude(float amp) { amplitude = amp; }
-void WaveformGenerator::setFrequency(float freq) { frequency = freq; }
-void WaveformGenerator::setBaseline(float base) { baseline = base; }
-void WaveformGenerator::setPhase(float phaseRadians) { phase = phaseRadians; }
+void WaveformGenerator::setAmplitude(float amp) { amplitude = amp; updateFixed(); }
+void WaveformGenerator::setFrequency(float freq) { frequency = freq; updateFixed(); }
+void WaveformGenerator::setBaseline(float base) { baseline = base; updateFixed(); }
+void WaveformGenerator::setPhase(float phaseRadians) { phase = phaseRadians; updateFixed(); }
 
 float WaveformGenerator::getAmplitude() const { return amplitude; }
 float WaveformGenerator::getFrequency() const { return frequency; }
 float WaveformGenerator::getBaseline() const { return baseline; }
 float WaveformGenerator::getPhase() const { return phase; }
 
-float WaveformGenerator::getSample() {
+int32_t WaveformGenerator::getSampleCenti() {
+  int32_t external = externalCenti;
+  if (external != NO_EXTERNAL) return external > 0 ? external : 0;
+  
   if (useI2CSensor && i2cSensor) {
-    float sensorValue;
-    if (i2cSensor->getSample(sensorValue)) {
-      return max(0.0f, sensorValue);
-    }
+    int32_t centi;
+    if (i2cSensor->getSample(centi)) return centi > 0 ? centi : 0;
   }
   
-  float time = millis() / 1000.0;
-  float value = baseline + amplitude * sin(2.0 * PI * frequency * time + phase);
-  return max(0.0f, value);
+  // Cycles elapsed = f * t; uHz * ms counts nanocycles, and only the
+  // fractional cycle matters for the phase
+  uint64_t nanoCycles = ((uint64_t)frequencyMicroHz * Clock::nowMs()) % 1000000000ULL;
+  uint32_t phase32 = (uint32_t)((nanoCycles << 32) / 1000000000ULL) + phaseOffset;
+  int32_t value = baselineCenti + (int32_t)(((int64_t)amplitudeCenti * FixedPoint::sinQ15(phase32)) / 32768);
+  return value > 0 ? value : 0;
+}
+
+float WaveformGenerator::getSample() {
+  return getSampleCenti() / 100.0f;
 }
 
 uint16_t WaveformGenerator::getRespiratoryRate() const {
-  return (uint16_t)(frequency * 60.0);
+  return (uint16_t)((uint64_t)frequencyMicroHz * 60 / 1000000);
 }
 
 uint16_t WaveformGenerator::getETCO2() const {
-  return (uint16_t)(amplitude * 10.0);
+  return amplitudeCenti > 0 ? (uint16_t)((amplitudeCenti + 5) / 10) : 0;
 }
 
 void WaveformGenerator::loadFromConfig(const ConfigStorage::Config& cfg) {
@@ -53,4 +73,32 @@ void WaveformGenerator::loadFromConfig(const ConfigStorage::Config& cfg) {
   baseline = cfg.baseline;
   phase = cfg.phase;
   useI2CSensor = cfg.useI2CSensor;
+  updateFixed();
+}
+
+void WaveformGenerator::saveToConfig(ConfigStorage::Config& cfg) const {
+  cfg.amplitude = amplitude;
+  cfg.frequency = frequency;
+  cfg.baseline = baseline;
+  cfg.phase = phase;
+  cfg.useI2CSensor = useI2CSensor;
+}
+
+void WaveformGenerator::captureState(WaveformSnapshot& s) const {
+  s.amplitude = amplitude;
+  s.frequency = frequency;
+  s.baseline = baseline;
+  s.phase = phase;
+  s.useI2CSensor = useI2CSensor;
+  memset(s.reserved, 0, sizeof(s.reserved));
+}
+
+// The sensor flag only takes if a sensor is present on this unit
+void WaveformGenerator::restoreState(const WaveformSnapshot& s) {
+  amplitude = s.amplitude;
+  frequency = s.frequency;
+  baseline = s.baseline;
+  phase = s.phase;
+  setUseI2CSensor(s.useI2CSensor);
+  updateFixed();
 }
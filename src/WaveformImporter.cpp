@@ -0,0 +1,298 @@
+#include "WaveformImporter.h"
+#include "TrendExporter.h"
+
+WaveformImporter::WaveformImporter(WaveformRecorder& rec)
+  : recorder(rec), active(false), startMs(0), startFreeHeap(0), minFreeHeap(0),
+    headerLen(0), recordSize(0), partialLen(0), lineLen(0), lineOverflow(false),
+    haveFirstTime(false), firstTime(0), lastTime(0), outCount(0) {
+  memset(&result, 0, sizeof(result));
+}
+
+const char* WaveformImporter::formatName(Format fmt) {
+  switch (fmt) {
+    case FORMAT_CSV: return "csv";
+    case FORMAT_RECORDING: return "recording";
+    case FORMAT_TREND: return "trend";
+    default: return "none";
+  }
+}
+
+bool WaveformImporter::begin() {
+  if (active) return false;
+
+  memset(&result, 0, sizeof(result));
+  headerLen = partialLen = lineLen = 0;
+  recordSize = 0;
+  lineOverflow = haveFirstTime = false;
+  firstTime = lastTime = 0;
+  outCount = 0;
+  startMs = millis();
+  startFreeHeap = minFreeHeap = ESP.getFreeHeap();
+
+  if (!recorder.isMounted()) {
+    result.error = "filesystem not mounted";
+    return false;
+  }
+
+  // In use before it exists, so eviction never picks it while it grows
+  result.sequence = recorder.allocateSequence();
+  if (!recorder.markInUse(result.sequence)) {
+    result.error = "recorder busy";
+    return false;
+  }
+  char path[WaveformRecorder::MAX_PATH];
+  WaveformRecorder::filePath(result.sequence, path, sizeof(path));
+  file = LittleFS.open(path, FILE_WRITE);
+  if (!file) {
+    recorder.releaseInUse(result.sequence);
+    result.error = "cannot create file";
+    return false;
+  }
+
+  WaveformRecorder::FileHeader fh = { {'C', 'O', '2', 'R'}, WaveformRecorder::FILE_VERSION,
+                                      sizeof(WaveformRecorder::Record),
+                                      WaveformRecorder::SAMPLE_INTERVAL_MS, result.sequence };
+  file.write((const uint8_t*)&fh, sizeof(fh));
+  active = true;
+  return true;
+}
+
+void WaveformImporter::fail(const char* error) {
+  if (file) file.close();
+  char path[WaveformRecorder::MAX_PATH];
+  WaveformRecorder::filePath(result.sequence, path, sizeof(path));
+  LittleFS.remove(path);
+  recorder.releaseInUse(result.sequence);
+
+  result.ok = false;
+  result.error = error;
+  result.durationMs = millis() - startMs;
+  result.peakHeapUsed = startFreeHeap - minFreeHeap;
+  active = false;
+}
+
+void WaveformImporter::abort() {
+  if (active) fail("aborted");
+}
+
+bool WaveformImporter::feed(const uint8_t* data, size_t len) {
+  if (!active) return false;
+  result.bytesIn += len;
+  uint32_t freeHeap = ESP.getFreeHeap();
+  if (freeHeap < minFreeHeap) minFreeHeap = freeHeap;
+
+  // The first four bytes decide the format
+  while (len && result.format == FORMAT_NONE) {
+    header[headerLen++] = *data++;
+    len--;
+    if (headerLen == 4 && !detectFormat()) return false;
+  }
+
+  if (result.format == FORMAT_CSV) feedCsv(data, len);
+  else if (result.format != FORMAT_NONE) feedBinary(data, len);
+  return active;
+}
+
+bool WaveformImporter::detectFormat() {
+  if (memcmp(header, "CO2R", 4) == 0) {
+    result.format = FORMAT_RECORDING;
+  } else if (memcmp(header, "CO2T", 4) == 0) {
+    result.format = FORMAT_TREND;
+  } else {
+    result.format = FORMAT_CSV;
+    feedCsv(header, headerLen);
+  }
+  return active;
+}
+
+// ---- CSV ----
+
+void WaveformImporter::feedCsv(const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len && active; i++) {
+    char c = data[i];
+    if (c == '\n' || c == '\r') {
+      parseLine();
+      lineLen = 0;
+      lineOverflow = false;
+    } else if (lineLen < LINE_MAX - 1) {
+      line[lineLen++] = c;
+    } else {
+      lineOverflow = true;
+    }
+  }
+}
+
+void WaveformImporter::parseLine() {
+  line[lineLen] = '\0';
+  if (lineLen == 0) return;
+
+  char c = line[0];
+  if (lineOverflow || !(isdigit(c) || c == '-' || c == '.')) {
+    result.skipped++;
+    return;
+  }
+
+  char* end;
+  double first = strtod(line, &end);
+  while (*end == ' ') end++;
+
+  uint32_t timeMs;
+  double co2;
+  if (*end == ',' || *end == ';' || *end == '\t') {
+    char* valueEnd;
+    co2 = strtod(end + 1, &valueEnd);
+    if (valueEnd == end + 1 || first < 0) {
+      result.skipped++;
+      return;
+    }
+    timeMs = (uint32_t)first;
+  } else {
+    co2 = first;
+    timeMs = result.samples * WaveformRecorder::SAMPLE_INTERVAL_MS;
+  }
+
+  if (!haveFirstTime) {
+    haveFirstTime = true;
+    firstTime = timeMs;
+  }
+  if (timeMs < firstTime || timeMs - firstTime < lastTime) {
+    result.skipped++;
+    return;
+  }
+
+  long centi = lround(co2 * 100.0);
+  if (centi > INT16_MAX) centi = INT16_MAX;
+  else if (centi < INT16_MIN) centi = INT16_MIN;
+  emit(timeMs - firstTime, WaveformRecorder::REC_SAMPLE, centi);
+}
+
+// ---- binary ----
+
+void WaveformImporter::feedBinary(const uint8_t* data, size_t len) {
+  while (len && headerLen < HEADER_SIZE) {
+    header[headerLen++] = *data++;
+    len--;
+    if (headerLen < HEADER_SIZE) continue;
+
+    uint16_t size = header[6] | (header[7] << 8);
+    if (result.format == FORMAT_RECORDING) {
+      uint16_t version = header[4] | (header[5] << 8);
+      if (version != WaveformRecorder::FILE_VERSION || size != sizeof(WaveformRecorder::Record)) {
+        fail("unsupported recording version");
+        return;
+      }
+    } else if (header[4] != TrendExporter::BINARY_VERSION || header[5] != TrendStore::RES_RAW || size != 6) {
+      fail("only raw-resolution CO2T files can be replayed");
+      return;
+    }
+    recordSize = size;
+  }
+  if (!recordSize) return;
+
+  // Finish a record split across chunks, then convert whole records in place
+  if (partialLen && len) {
+    size_t take = recordSize - partialLen;
+    if (take > len) take = len;
+    memcpy(partial + partialLen, data, take);
+    partialLen += take;
+    data += take;
+    len -= take;
+    if (partialLen == recordSize) {
+      convertRecord(partial);
+      partialLen = 0;
+    }
+  }
+
+  while (len >= recordSize && active) {
+    convertRecord(data);
+    data += recordSize;
+    len -= recordSize;
+  }
+
+  if (len && active) {
+    memcpy(partial, data, len);
+    partialLen = len;
+  }
+}
+
+void WaveformImporter::convertRecord(const uint8_t* rec) {
+  uint32_t timeMs = rec[0] | (rec[1] << 8) | (rec[2] << 16) | ((uint32_t)rec[3] << 24);
+  uint8_t type;
+  int16_t value;
+
+  if (result.format == FORMAT_RECORDING) {
+    type = rec[4];
+    value = (int16_t)(rec[6] | (rec[7] << 8));
+    if (type >= WaveformRecorder::REC_TYPE_COUNT) {
+      result.skipped++;
+      return;
+    }
+  } else {
+    type = WaveformRecorder::REC_SAMPLE;
+    value = (int16_t)(rec[4] | (rec[5] << 8));
+  }
+
+  if (!haveFirstTime) {
+    haveFirstTime = true;
+    firstTime = timeMs;
+  }
+  // Replay walks forward in time; anything going backwards is dropped
+  if (timeMs < firstTime || timeMs - firstTime < lastTime) {
+    result.skipped++;
+    return;
+  }
+  emit(timeMs - firstTime, type, value);
+}
+
+// ---- output ----
+
+void WaveformImporter::emit(uint32_t timeMs, uint8_t type, int16_t value) {
+  WaveformRecorder::Record& r = out[outCount++];
+  r.timeMs = timeMs;
+  r.type = type;
+  r.reserved = 0;
+  r.value = value;
+  lastTime = timeMs;
+  if (type == WaveformRecorder::REC_SAMPLE) result.samples++;
+
+  if (outCount == WaveformRecorder::BUFFER_RECORDS) flush();
+}
+
+bool WaveformImporter::flush() {
+  size_t len = outCount * sizeof(WaveformRecorder::Record);
+  outCount = 0;
+  if (len && file.write((const uint8_t*)out, len) != len) {
+    fail("filesystem full");
+    return false;
+  }
+  return true;
+}
+
+bool WaveformImporter::finish() {
+  if (!active) return result.ok;
+
+  if (result.format == FORMAT_NONE && headerLen) {
+    result.format = FORMAT_CSV;
+    feedCsv(header, headerLen);
+  }
+  if (result.format == FORMAT_CSV && lineLen) parseLine();
+  if ((result.format == FORMAT_RECORDING || result.format == FORMAT_TREND) && headerLen < HEADER_SIZE) {
+    fail("truncated header");
+    return false;
+  }
+  if (partialLen) result.skipped++;
+
+  if (!active || !flush()) return false;
+  if (result.samples == 0) {
+    fail("no samples");
+    return false;
+  }
+
+  file.close();
+  recorder.releaseInUse(result.sequence);
+  result.ok = true;
+  result.durationMs = millis() - startMs;
+  result.peakHeapUsed = startFreeHeap - minFreeHeap;
+  active = false;
+  return true;
+}
@@ -0,0 +1,193 @@
+#include "WaveformPlayer.h"
+
+WaveformPlayer::WaveformPlayer(WaveformGenerator& wave, WaveformRecorder& rec)
+  : waveform(wave), recorder(rec), readerTask(nullptr), mounted(false), requested(0), playing(false), started(false),
+    sequence(0), generation(0), startMs(0), readBuffer(0), readPos(0), current(0),
+    samples(0), underruns(0), endOfFile(false), openGeneration(0), readyGeneration(0),
+    openSequence(0), readError(false), fillBuffer(0) {
+  counts[0] = counts[1] = 0;
+  state[0] = state[1] = BUF_EMPTY;
+  saved = ConfigStorage::defaults();
+}
+
+void WaveformPlayer::begin(bool filesystemMounted) {
+  mounted = filesystemMounted;
+  if (mounted) xTaskCreatePinnedToCore(readerTaskEntry, "player", 4096, this, 1, &readerTask, 0);
+}
+
+void WaveformPlayer::requestPlay(uint32_t seq) { requested = seq; }
+void WaveformPlayer::requestStop() { requested = STOP_REQUEST; }
+
+// ---- loop side ----
+
+void WaveformPlayer::update() {
+  uint32_t req = requested.exchange(0);
+  if (req == STOP_REQUEST) {
+    if (playing) stop("stopped");
+  } else if (req) {
+    start(req);
+  }
+
+  if (playing && readyGeneration == generation && readError) stop("failed: not a readable recording");
+}
+
+void WaveformPlayer::start(uint32_t seq) {
+  if (!mounted) return;
+  if (playing && seq != sequence) recorder.releaseInUse(sequence);
+  if ((!playing || seq != sequence) && !recorder.markInUse(seq)) {
+    if (playing) stop("failed: recorder busy");
+    else CMD_SERIAL.println("Replay failed: recorder busy");
+    return;
+  }
+
+  // Back-to-back replays keep the parameters from before the first one
+  if (!playing) waveform.saveToConfig(saved);
+  playing = true;
+  started = false;
+  sequence = seq;
+  readBuffer = 0;
+  readPos = 0;
+  current = 0;
+  samples = 0;
+  underruns = 0;
+
+  openSequence = seq;
+  openGeneration = ++generation;
+  xTaskNotifyGive(readerTask);
+
+  CMD_SERIAL.print("Replaying recording #"); CMD_SERIAL.println(seq);
+}
+
+void WaveformPlayer::stop(const char* reason) {
+  playing = false;
+  recorder.releaseInUse(sequence);
+  openSequence = 0;
+  openGeneration = ++generation;
+  xTaskNotifyGive(readerTask);
+  waveform.loadFromConfig(saved);
+
+  CMD_SERIAL.print("Replay "); CMD_SERIAL.println(reason);
+}
+
+bool WaveformPlayer::getSample(uint32_t now, int32_t& co2Centi) {
+  if (!playing) return false;
+
+  // The replay clock starts once the first buffer is in RAM
+  if (!started) {
+    if (readyGeneration != generation) return false;
+    if (state[0] != BUF_FULL) {
+      if (endOfFile) stop("finished: recording is empty");
+      return false;
+    }
+    started = true;
+    startMs = now;
+  }
+
+  uint32_t elapsed = now - startMs;
+  for (;;) {
+    if (state[readBuffer] != BUF_FULL || readPos >= counts[readBuffer]) {
+      if (!advanceBuffer()) break;
+      continue;
+    }
+    const WaveformRecorder::Record& r = buffers[readBuffer][readPos];
+    if (r.timeMs > elapsed) break;
+    apply(r);
+    readPos++;
+  }
+
+  if (!playing) return false;
+  co2Centi = current;
+  return true;
+}
+
+// Returns the consumed buffer to the reader and moves to the other one.
+// False if that is not loaded yet (the last sample is held) or the
+// recording has ended.
+bool WaveformPlayer::advanceBuffer() {
+  if (state[readBuffer] == BUF_FULL) {
+    state[readBuffer] = BUF_EMPTY;
+    xTaskNotifyGive(readerTask);
+    readBuffer ^= 1;
+    readPos = 0;
+  }
+  if (state[readBuffer] == BUF_FULL) return true;
+
+  if (endOfFile) stop("finished");
+  else underruns++;
+  return false;
+}
+
+void WaveformPlayer::apply(const WaveformRecorder::Record& r) {
+  switch (r.type) {
+    case WaveformRecorder::REC_SAMPLE: current = r.value; samples++; break;
+    case WaveformRecorder::REC_AMPLITUDE: waveform.setAmplitude(r.value / 100.0f); break;
+    case WaveformRecorder::REC_FREQUENCY: waveform.setFrequency(r.value / 1000.0f); break;
+    case WaveformRecorder::REC_BASELINE: waveform.setBaseline(r.value / 100.0f); break;
+    case WaveformRecorder::REC_PHASE: waveform.setPhase(r.value / 1000.0f); break;
+    default: break;
+  }
+}
+
+void WaveformPlayer::printStatus(Print& out) const {
+  if (!playing) {
+    out.println("Replay: idle");
+    return;
+  }
+  out.print("Replay: recording #"); out.print(sequence);
+  out.print(started ? " playing" : " loading");
+  out.print(" samples="); out.print(samples);
+  out.print(" underruns="); out.println(underruns);
+}
+
+// ---- reader task ----
+
+void WaveformPlayer::readerTaskEntry(void* param) {
+  static_cast<WaveformPlayer*>(param)->readerLoop();
+}
+
+void WaveformPlayer::readerLoop() {
+  uint32_t loaded = 0;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    uint32_t want = openGeneration;
+    if (want != loaded) {
+      loaded = want;
+      if (file) file.close();
+      state[0] = state[1] = BUF_EMPTY;
+      fillBuffer = 0;
+      endOfFile = false;
+      readError = false;
+
+      uint32_t seq = openSequence;
+      if (seq) {
+        char path[WaveformRecorder::MAX_PATH];
+        WaveformRecorder::filePath(seq, path, sizeof(path));
+        file = LittleFS.open(path, FILE_READ);
+        WaveformRecorder::FileHeader header;
+        if (!file || file.read((uint8_t*)&header, sizeof(header)) != sizeof(header) ||
+            memcmp(header.magic, "CO2R", 4) != 0 || header.recordSize != sizeof(WaveformRecorder::Record)) {
+          readError = true;
+          if (file) file.close();
+        }
+      }
+      readyGeneration = loaded;
+    }
+
+    if (file) fillBuffers();
+  }
+}
+
+void WaveformPlayer::fillBuffers() {
+  while (state[fillBuffer] == BUF_EMPTY) {
+    size_t got = file.read((uint8_t*)buffers[fillBuffer], sizeof(buffers[0]));
+    counts[fillBuffer] = got / sizeof(WaveformRecorder::Record);
+    if (counts[fillBuffer] == 0) {
+      endOfFile = true;
+      file.close();
+      return;
+    }
+    state[fillBuffer] = BUF_FULL;
+    fillBuffer ^= 1;
+  }
+}
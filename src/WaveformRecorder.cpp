@@ -0,0 +1,319 @@
+#include "WaveformRecorder.h"
+#include "Clock.h"
+
+static const char* const RECORD_DIR = "/rec";
+
+WaveformRecorder::WaveformRecorder(WaveformGenerator& wave)
+  : waveform(wave), mounted(false), recording(false), stopPending(false), openPending(false),
+    request(REQ_NONE), startMs(0), paramsPending(false), fillBuffer(0), fillCount(0),
+    writerTask(nullptr), writerBusy(false), handoffBuffer(0), handoffCount(0), handoffFlags(0),
+    fileBytes(0), nextSequence(1), openSequence(0), lock(nullptr), samples(0), droppedBuffers(0),
+    writeErrors(0), bytesWritten(0) {
+  memset(lastParams, 0, sizeof(lastParams));
+  memset(startParams, 0, sizeof(startParams));
+  memset(inUse, 0, sizeof(inUse));
+}
+
+bool WaveformRecorder::begin() {
+  lock = xSemaphoreCreateRecursiveMutex();
+  mounted = LittleFS.begin(true);
+  if (!mounted) {
+    CMD_SERIAL.println("LittleFS mount failed, recorder disabled");
+    return false;
+  }
+  if (!LittleFS.exists(RECORD_DIR)) LittleFS.mkdir(RECORD_DIR);
+  
+  File dir = LittleFS.open(RECORD_DIR);
+  for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+    uint32_t seq = parseSequence(f.name());
+    if (seq >= nextSequence) nextSequence = seq + 1;
+  }
+  
+  xTaskCreatePinnedToCore(writerTaskEntry, "recorder", 4096, this, 1, &writerTask, 0);
+  return true;
+}
+
+void WaveformRecorder::requestStart() { request = REQ_START; }
+void WaveformRecorder::requestStop() { request = REQ_STOP; }
+
+void WaveformRecorder::filePath(uint32_t sequence, char* out, size_t len) {
+  snprintf(out, len, "%s/%05lu.bin", RECORD_DIR, (unsigned long)sequence);
+}
+
+// "00042.bin" -> 42; 0 for anything that is not a recording
+uint32_t WaveformRecorder::parseSequence(const char* name) {
+  const char* base = strrchr(name, '/');
+  base = base ? base + 1 : name;
+  char* end;
+  uint32_t seq = strtoul(base, &end, 10);
+  return (end != base && strcmp(end, ".bin") == 0) ? seq : 0;
+}
+
+// ---- loop side ----
+
+void WaveformRecorder::update() {
+  uint8_t req = request.exchange(REQ_NONE);
+  
+  if (req == REQ_START && mounted && !recording && !stopPending) {
+    recording = true;
+    openPending = true;
+    paramsPending = true;
+    startMs = Clock::nowMs();
+    fillCount = 0;
+    samples = 0;
+    CMD_SERIAL.println("Recording started");
+  } else if (req == REQ_STOP && recording) {
+    recording = false;
+    stopPending = true;
+  }
+  
+  // The last partial buffer waits for the writer rather than being dropped
+  if (stopPending && handOff(FLAG_CLOSE)) {
+    stopPending = false;
+    CMD_SERIAL.println("Recording stopped");
+  }
+}
+
+void WaveformRecorder::addSample(uint32_t now, int32_t co2Centi) {
+  if (!recording) return;
+  
+  // Parameter changes go in ahead of the first sample they affect
+  recordParam(now, REC_AMPLITUDE, waveform.getAmplitudeCenti());
+  recordParam(now, REC_FREQUENCY, waveform.getFrequencyMicroHz() / 1000);
+  recordParam(now, REC_BASELINE, waveform.getBaselineCenti());
+  recordParam(now, REC_PHASE, (int64_t)(int32_t)waveform.getPhaseOffset() * 6283 / 4294967296LL);
+  recordParam(now, REC_SOURCE, waveform.isUsingI2CSensor() ? 1 : 0);
+  paramsPending = false;
+  
+  append(now, REC_SAMPLE, co2Centi);
+  samples++;
+}
+
+void WaveformRecorder::recordParam(uint32_t now, uint8_t type, int32_t value) {
+  int16_t v = value > INT16_MAX ? INT16_MAX : (value < INT16_MIN ? INT16_MIN : value);
+  if (!paramsPending && v == lastParams[type]) return;
+  lastParams[type] = v;
+  append(now, type, v);
+}
+
+void WaveformRecorder::append(uint32_t now, uint8_t type, int16_t value) {
+  if (fillCount == 0) memcpy(startParams[fillBuffer], lastParams, sizeof(lastParams));
+  
+  Record& r = buffers[fillBuffer][fillCount++];
+  r.timeMs = now - startMs;
+  r.type = type;
+  r.reserved = 0;
+  r.value = value;
+  
+  if (fillCount == BUFFER_RECORDS) handOff(0);
+}
+
+// Passes the fill buffer to the writer and switches to the other one.
+// If the writer is still busy the data is lost; the next buffer then
+// repeats every parameter so replay resynchronizes.
+bool WaveformRecorder::handOff(uint8_t flags) {
+  if (writerBusy.load(std::memory_order_acquire)) {
+    if (flags & FLAG_CLOSE) return false;
+    droppedBuffers++;
+    fillCount = 0;
+    paramsPending = true;
+    return false;
+  }
+  
+  handoffBuffer = fillBuffer;
+  handoffCount = fillCount;
+  handoffFlags = flags | (openPending ? FLAG_OPEN : 0);
+  openPending = false;
+  writerBusy.store(true, std::memory_order_release);
+  xTaskNotifyGive(writerTask);
+  
+  fillBuffer ^= 1;
+  fillCount = 0;
+  return true;
+}
+
+// ---- writer task ----
+
+void WaveformRecorder::writerTaskEntry(void* param) {
+  static_cast<WaveformRecorder*>(param)->writerLoop();
+}
+
+void WaveformRecorder::writerLoop() {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    
+    const Record* records = buffers[handoffBuffer];
+    size_t len = handoffCount * sizeof(Record);
+    uint32_t firstTime = handoffCount ? records[0].timeMs : 0;
+    
+    if (handoffFlags & FLAG_OPEN) {
+      if (openNextFile()) writeSnapshot(handoffBuffer, firstTime);
+    } else if (!file || fileBytes + len > RECORDER_MAX_FILE_BYTES) {
+      if (openNextFile()) writeSnapshot(handoffBuffer, firstTime);
+    }
+    
+    if (len) {
+      if (file && file.write((const uint8_t*)records, len) == len) {
+        fileBytes += len;
+        bytesWritten += len;
+      } else {
+        writeErrors++;
+      }
+    }
+    
+    if ((handoffFlags & FLAG_CLOSE) && file) {
+      file.close();
+      openSequence = 0;
+    }
+    writerBusy.store(false, std::memory_order_release);
+  }
+}
+
+bool WaveformRecorder::openNextFile() {
+  if (file) file.close();
+  openSequence = 0;
+  
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  enforceLimits();
+  char path[MAX_PATH];
+  uint32_t sequence = allocateSequence();
+  filePath(sequence, path, sizeof(path));
+  file = LittleFS.open(path, FILE_WRITE);
+  if (file) openSequence = sequence;
+  if (lock) xSemaphoreGiveRecursive(lock);
+  
+  if (!file) {
+    writeErrors++;
+    return false;
+  }
+  
+  FileHeader header = { {'C', 'O', '2', 'R'}, FILE_VERSION, sizeof(Record), SAMPLE_INTERVAL_MS, sequence };
+  file.write((const uint8_t*)&header, sizeof(header));
+  fileBytes = sizeof(header);
+  bytesWritten += sizeof(header);
+  return true;
+}
+
+// Every file starts with the full parameter set so it replays on its own
+void WaveformRecorder::writeSnapshot(uint8_t buffer, uint32_t timeMs) {
+  Record snapshot[REC_TYPE_COUNT - 1];
+  for (uint8_t type = REC_AMPLITUDE; type < REC_TYPE_COUNT; type++) {
+    Record& r = snapshot[type - 1];
+    r.timeMs = timeMs;
+    r.type = type;
+    r.reserved = 0;
+    r.value = startParams[buffer][type];
+  }
+  file.write((const uint8_t*)snapshot, sizeof(snapshot));
+  fileBytes += sizeof(snapshot);
+  bytesWritten += sizeof(snapshot);
+}
+
+// Files in use still count against the limits but are never the ones
+// deleted; if only those are left, there is no more room to make
+void WaveformRecorder::enforceLimits() {
+  if (!mounted) return;
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  for (;;) {
+    uint32_t oldest = 0;
+    uint8_t count = 0;
+    File dir = LittleFS.open(RECORD_DIR);
+    for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+      uint32_t seq = parseSequence(f.name());
+      if (!seq) continue;
+      count++;
+      if (seq != openSequence && !isInUse(seq) && (!oldest || seq < oldest)) oldest = seq;
+    }
+    dir.close();
+    
+    size_t freeBytes = LittleFS.totalBytes() - LittleFS.usedBytes();
+    if (!oldest || (count < RECORDER_MAX_FILES && freeBytes >= RECORDER_MAX_FILE_BYTES + RECORDER_BUFFER_BYTES)) {
+      break;
+    }
+    
+    char path[MAX_PATH];
+    filePath(oldest, path, sizeof(path));
+    if (!LittleFS.remove(path)) break;
+  }
+  if (lock) xSemaphoreGiveRecursive(lock);
+}
+
+// ---- index ----
+
+// The file being written belongs to the writer task; files in use belong
+// to the importer or the player
+bool WaveformRecorder::deleteFile(uint32_t sequence) {
+  if (!mounted || !sequence) return false;
+  char path[MAX_PATH];
+  filePath(sequence, path, sizeof(path));
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  bool removed = sequence != openSequence && !isInUse(sequence) && LittleFS.remove(path);
+  if (lock) xSemaphoreGiveRecursive(lock);
+  return removed;
+}
+
+bool WaveformRecorder::markInUse(uint32_t sequence) {
+  if (!sequence) return false;
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  bool marked = false;
+  for (uint8_t i = 0; i < IN_USE_SLOTS && !marked; i++) {
+    if (!inUse[i]) {
+      inUse[i] = sequence;
+      marked = true;
+    }
+  }
+  if (lock) xSemaphoreGiveRecursive(lock);
+  return marked;
+}
+
+void WaveformRecorder::releaseInUse(uint32_t sequence) {
+  if (!sequence) return;
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  for (uint8_t i = 0; i < IN_USE_SLOTS; i++) {
+    if (inUse[i] == sequence) {
+      inUse[i] = 0;
+      break;
+    }
+  }
+  if (lock) xSemaphoreGiveRecursive(lock);
+}
+
+// Callers hold the lock
+bool WaveformRecorder::isInUse(uint32_t sequence) const {
+  for (uint8_t i = 0; i < IN_USE_SLOTS; i++) {
+    if (inUse[i] == sequence) return true;
+  }
+  return false;
+}
+
+void WaveformRecorder::listFiles(void (*fn)(uint32_t sequence, uint32_t bytes, void* ctx), void* ctx) {
+  if (!mounted) return;
+  File dir = LittleFS.open(RECORD_DIR);
+  for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+    uint32_t seq = parseSequence(f.name());
+    if (seq) fn(seq, f.size(), ctx);
+  }
+}
+
+static void printFileEntry(uint32_t sequence, uint32_t bytes, void* ctx) {
+  Print& out = *static_cast<Print*>(ctx);
+  out.print("  #"); out.print(sequence);
+  out.print("  "); out.print(bytes / 1024); out.print(" KB  ~");
+  out.print(bytes / sizeof(WaveformRecorder::Record) / (1000 / WaveformRecorder::SAMPLE_INTERVAL_MS));
+  out.println(" s");
+}
+
+void WaveformRecorder::printStatus(Print& out) {
+  if (!mounted) {
+    out.println("Recorder: filesystem not mounted");
+    return;
+  }
+  out.print("Recorder: "); out.println(recording ? "RECORDING" : "idle");
+  out.print("  samples="); out.print(samples);
+  out.print(" written="); out.print(bytesWritten);
+  out.print(" dropped buffers="); out.print(droppedBuffers);
+  out.print(" write errors="); out.println(writeErrors);
+  out.print("  filesystem "); out.print(LittleFS.usedBytes() / 1024);
+  out.print("/"); out.print(LittleFS.totalBytes() / 1024); out.println(" KB");
+  listFiles(printFileEntry, &out);
+}
@@ -1,11 +1,80 @@
 #include "WebInterface.h"
+#include <memory>
+#include "SettingLimits.h"
+
+// First numeric setting in the request outside SettingLimits, or nullptr
+static const char* settingOutOfRange(const JsonDocument& doc) {
+  using namespace SettingLimits;
+  static const struct { const char* key; const Range* range; } checks[] = {
+    { "amplitude", &AMPLITUDE }, { "frequency", &FREQUENCY }, { "baseline", &BASELINE },
+    { "phase", &PHASE }, { "alarmHigh", &ETCO2_ALARM }, { "alarmLow", &ETCO2_ALARM },
+    { "rrHigh", &RR_ALARM }, { "rrLow", &RR_ALARM }
+  };
+  for (const auto& check : checks) {
+    JsonVariantConst value = doc[check.key];
+    if (value.isNull()) continue;
+    if (!value.is<float>() || !inRange(*check.range, value.as<float>())) return check.key;
+  }
+  return nullptr;
+}
 
 WebInterface::WebInterface(WaveformGenerator& wave, AlarmManager& alarm, 
                            DeviceState& dev, ConfigStorage& stor)
   : server(80), events("/events"), waveform(wave), alarms(alarm), 
-    device(dev), storage(stor), currentCO2Value(0), lastDataUpdate(0) {}
+    device(dev), storage(stor), trends(nullptr), trace(nullptr), i2cSensor(nullptr), recorder(nullptr), player(nullptr), metrics(nullptr), snapshot(nullptr), bridge(nullptr), faults(nullptr), faultOwner(nullptr), snapshotUploadLen(0), uploadOwner(nullptr), currentCO2Value(0), lastDataUpdate(0), staConnected(false),
+    lastExport{0, 0, 0, false}, activeStreamClients(0), streamLock(nullptr) {
+  memset(streamClients, 0, sizeof(streamClients));
+}
+
+void WebInterface::setTrendStore(TrendStore* store) {
+  trends = store;
+}
+
+ConfigStorage::Config WebInterface::currentConfig() const {
+  ConfigStorage::Config cfg = ConfigStorage::defaults();
+  waveform.saveToConfig(cfg);
+  alarms.saveToConfig(cfg);
+  device.saveToConfig(cfg);
+  return cfg;
+}
+
+void WebInterface::setProtocolTrace(ProtocolTrace* protocolTrace) {
+  trace = protocolTrace;
+}
+
+void WebInterface::setI2CSensor(I2CSensorInterface* sensor) {
+  i2cSensor = sensor;
+}
+
+void WebInterface::setRecorder(WaveformRecorder* rec) {
+  recorder = rec;
+  if (rec) importer.reset(new WaveformImporter(*rec));
+}
+
+void WebInterface::setPlayer(WaveformPlayer* play) {
+  player = play;
+}
+
+void WebInterface::setMetrics(MetricsExporter* exporter) {
+  metrics = exporter;
+}
+
+void WebInterface::setSnapshot(StateSnapshot* snap) {
+  snapshot = snap;
+}
+
+void WebInterface::setBridge(PassthroughBridge* passthrough) {
+  bridge = passthrough;
+}
+
+void WebInterface::setFaultInjector(FaultInjector* injector, ProtocolHandler* owner) {
+  faults = injector;
+  faultOwner = owner;
+}
 
 bool WebInterface::begin() {
+  streamLock = xSemaphoreCreateMutex();
+  
   #if WIFI_AP_MODE
     WiFi.mode(WIFI_AP);
     WiFi.softAP(WIFI_AP_SSID, WIFI_AP_PASSWORD);
@@ -18,25 +87,11 @@ bool WebInterface::begin() {
     CMD_SERIAL.print("IP address: ");
     CMD_SERIAL.println(WiFi.softAPIP());
   #else
+    // Connection completes in the background; see checkConnection()
     WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(true);
     WiFi.begin(WIFI_STA_SSID, WIFI_STA_PASSWORD);
-    
-    CMD_SERIAL.print("Connecting to WiFi");
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-      delay(500);
-      CMD_SERIAL.print(".");
-      attempts++;
-    }
-    
-    if (WiFi.status() != WL_CONNECTED) {
-      CMD_SERIAL.println("\nWiFi connection failed");
-      return false;
-    }
-    
-    CMD_SERIAL.println("\nWiFi connected!");
-    CMD_SERIAL.print("IP address: ");
-    CMD_SERIAL.println(WiFi.localIP());
+    CMD_SERIAL.println("Connecting to WiFi...");
   #endif
   
   setupRoutes();
@@ -46,7 +101,8 @@ bool WebInterface::begin() {
 
 void WebInterface::setupRoutes() {
   server.on("/", HTTP_GET, [this](AsyncWebServerRequest *request){
-    request->send(200, "text/html", getIndexHTML());
+    const char* html = getIndexHTML();
+    request->send(200, "text/html", (const uint8_t*)html, strlen(html));
   });
   
   server.on("/api/settings", HTTP_GET, [this](AsyncWebServerRequest *request){
@@ -59,18 +115,35 @@ void WebInterface::setupRoutes() {
     doc["alarmLow"] = alarms.getLowThreshold();
     doc["alarmHighEnabled"] = alarms.isHighEnabled();
     doc["alarmLowEnabled"] = alarms.isLowEnabled();
+    doc["rrHigh"] = alarms.getRRHighThreshold();
+    doc["rrLow"] = alarms.getRRLowThreshold();
+    doc["rrHighEnabled"] = alarms.isRRHighEnabled();
+    doc["rrLowEnabled"] = alarms.isRRLowEnabled();
+    doc["alarmLatching"] = alarms.isLatching();
     doc["useI2C"] = waveform.isUsingI2CSensor();
     doc["continuousMode"] = device.isContinuousMode();
     
-    String response;
-    serializeJson(doc, response);
+    char response[512];
+    serializeJson(doc, response, sizeof(response));
     request->send(200, "application/json", response);
   });
   
   server.on("/api/settings", HTTP_POST, [](AsyncWebServerRequest *request){}, 
     NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
     StaticJsonDocument<512> doc;
-    deserializeJson(doc, (const char*)data);
+    if (deserializeJson(doc, data, len)) {
+      request->send(400, "application/json", "{\"status\":\"invalid\"}");
+      return;
+    }
+    
+    // Checked before anything is applied, so a bad value changes nothing
+    const char* bad = settingOutOfRange(doc);
+    if (bad) {
+      char response[64];
+      snprintf(response, sizeof(response), "{\"status\":\"out of range\",\"field\":\"%s\"}", bad);
+      request->send(400, "application/json", response);
+      return;
+    }
     
     if (doc.containsKey("amplitude")) waveform.setAmplitude(doc["amplitude"]);
     if (doc.containsKey("frequency")) waveform.setFrequency(doc["frequency"]);
@@ -80,23 +153,19 @@ void WebInterface::setupRoutes() {
     if (doc.containsKey("alarmLow")) alarms.setLowThreshold(doc["alarmLow"]);
     if (doc.containsKey("alarmHighEnabled")) alarms.enableHigh(doc["alarmHighEnabled"]);
     if (doc.containsKey("alarmLowEnabled")) alarms.enableLow(doc["alarmLowEnabled"]);
+    if (doc.containsKey("rrHigh")) alarms.setRRHighThreshold(doc["rrHigh"]);
+    if (doc.containsKey("rrLow")) alarms.setRRLowThreshold(doc["rrLow"]);
+    if (doc.containsKey("rrHighEnabled")) alarms.enableRRHigh(doc["rrHighEnabled"]);
+    if (doc.containsKey("rrLowEnabled")) alarms.enableRRLow(doc["rrLowEnabled"]);
+    if (doc.containsKey("alarmLatching")) alarms.setLatching(doc["alarmLatching"]);
     if (doc.containsKey("useI2C")) waveform.setUseI2CSensor(doc["useI2C"]);
+    storage.requestSave(currentConfig());
     
     request->send(200, "application/json", "{\"status\":\"ok\"}");
   });
   
   server.on("/api/save", HTTP_POST, [this](AsyncWebServerRequest *request){
-    ConfigStorage::Config cfg;
-    cfg.amplitude = waveform.getAmplitude();
-    cfg.frequency = waveform.getFrequency();
-    cfg.baseline = waveform.getBaseline();
-    cfg.phase = waveform.getPhase();
-    cfg.alarmHigh = alarms.getHighThreshold();
-    cfg.alarmLow = alarms.getLowThreshold();
-    cfg.alarmHighEnabled = alarms.isHighEnabled();
-    cfg.alarmLowEnabled = alarms.isLowEnabled();
-    cfg.useI2CSensor = waveform.isUsingI2CSensor();
-    storage.saveConfig(cfg);
+    storage.saveConfig(currentConfig());
     
     request->send(200, "application/json", "{\"status\":\"saved\"}");
   });
@@ -105,39 +174,672 @@ void WebInterface::setupRoutes() {
     ConfigStorage::Config cfg = storage.loadConfig();
     waveform.loadFromConfig(cfg);
     alarms.loadFromConfig(cfg);
+    device.loadFromConfig(cfg);
     
     request->send(200, "application/json", "{\"status\":\"loaded\"}");
   });
   
-  events.onConnect([](AsyncEventSourceClient *client){
+  server.on("/api/presets", HTTP_GET, [this](AsyncWebServerRequest *request){
+    StaticJsonDocument<768> doc;
+    JsonArray names = doc.createNestedArray("presets");
+    char presetNames[ConfigStorage::MAX_PRESETS][ConfigStorage::PRESET_NAME_LEN];
+    uint8_t count = storage.getPresetNames(presetNames);
+    for (uint8_t i = 0; i < count; i++) names.add(presetNames[i]);
+    doc["max"] = ConfigStorage::MAX_PRESETS;
+    
+    char response[768];
+    serializeJson(doc, response, sizeof(response));
+    request->send(200, "application/json", response);
+  });
+  
+  // POST /api/presets?action=save|load|delete&name=<name>
+  server.on("/api/presets", HTTP_POST, [this](AsyncWebServerRequest *request){
+    if (!request->hasParam("action") || !request->hasParam("name")) {
+      request->send(400, "application/json", "{\"status\":\"action and name required\"}");
+      return;
+    }
+    const String& action = request->getParam("action")->value();
+    const char* name = request->getParam("name")->value().c_str();
+    bool ok = false;
+    
+    if (action == "save") {
+      if (!ConfigStorage::isValidPresetName(name)) {
+        request->send(400, "application/json", "{\"status\":\"invalid name\"}");
+        return;
+      }
+      ok = storage.savePreset(name, currentConfig());
+    } else if (action == "load") {
+      ConfigStorage::Config cfg;
+      ok = storage.getPreset(name, cfg);
+      if (ok) storage.stageConfig(cfg);
+    } else if (action == "delete") {
+      ok = storage.deletePreset(name);
+    }
+    
+    request->send(ok ? 200 : 404, "application/json", ok ? "{\"status\":\"ok\"}" : "{\"status\":\"failed\"}");
+  });
+  
+  server.on("/api/alarms", HTTP_GET, [this](AsyncWebServerRequest *request){
+    StaticJsonDocument<256> doc;
+    uint16_t word = alarms.getStatusWord();
+    doc["status"] = word;
+    doc["priority"] = word >> AlarmManager::STATUS_PRIORITY_SHIFT;
+    JsonArray active = doc.createNestedArray("active");
+    for (uint8_t i = 0; i < AlarmManager::CONDITION_COUNT; i++) {
+      if (word & (1 << i)) active.add(AlarmManager::conditionName(i));
+    }
+    
+    char response[256];
+    serializeJson(doc, response, sizeof(response));
+    request->send(200, "application/json", response);
+  });
+  
+  server.on("/api/alarms/ack", HTTP_POST, [this](AsyncWebServerRequest *request){
+    alarms.acknowledge();
+    request->send(200, "application/json", "{\"status\":\"ok\"}");
+  });
+  
+  server.on("/api/sensor", HTTP_GET, [this](AsyncWebServerRequest *request){
+    if (!i2cSensor) {
+      request->send(404, "application/json", "{\"status\":\"no sensor interface\"}");
+      return;
+    }
+    StaticJsonDocument<384> doc;
+    JsonArray names = doc.createNestedArray("drivers");
+    names.add("auto");
+    for (uint8_t i = 0; i < I2CSensorInterface::DRIVER_COUNT; i++) names.add(i2cSensor->getDriverName(i));
+    doc["active"] = i2cSensor->getActiveDriverName();
+    doc["available"] = i2cSensor->isAvailable();
+    doc["reads"] = i2cSensor->getReadCount();
+    doc["failed"] = i2cSensor->getFailedCount();
+    doc["stale"] = i2cSensor->getStaleCount();
+    doc["lastReading"] = i2cSensor->getLastReading();
+    
+    char response[384];
+    serializeJson(doc, response, sizeof(response));
+    request->send(200, "application/json", response);
+  });
+  
+  // POST /api/sensor?driver=auto|scd30|scd4x|generic
+  server.on("/api/sensor", HTTP_POST, [this](AsyncWebServerRequest *request){
+    int8_t index = -2;
+    if (i2cSensor && request->hasParam("driver")) {
+      index = i2cSensor->findDriver(request->getParam("driver")->value().c_str());
+    }
+    if (index < I2CSensorInterface::DRIVER_AUTO) {
+      request->send(400, "application/json", "{\"status\":\"unknown driver\"}");
+      return;
+    }
+    i2cSensor->requestDriver(index);
+    request->send(200, "application/json", "{\"status\":\"ok\"}");
+  });
+  
+  // GET /api/recorder/file?id=N streams the raw recording from flash.
+  // Registered before /api/recorder, whose handlers also match sub-paths.
+  server.on("/api/recorder/file", HTTP_GET, [this](AsyncWebServerRequest *request){
+    char path[WaveformRecorder::MAX_PATH];
+    uint32_t id = request->hasParam("id") ? strtoul(request->getParam("id")->value().c_str(), nullptr, 10) : 0;
+    WaveformRecorder::filePath(id, path, sizeof(path));
+    if (!recorder || !recorder->isMounted() || !id || !LittleFS.exists(path)) {
+      request->send(404, "application/json", "{\"status\":\"no such recording\"}");
+      return;
+    }
+    request->send(LittleFS, path, "application/octet-stream", true);
+  });
+  
+  // POST /api/recorder/upload with the raw file as the body (CSV, CO2R or
+  // CO2T). The body is converted chunk by chunk as it arrives.
+  server.on("/api/recorder/upload", HTTP_POST,
+    [this](AsyncWebServerRequest *request){ handleUploadDone(request); },
+    nullptr,
+    [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
+      handleUploadBody(request, data, len, index);
+    });
+  
+  server.on("/api/recorder", HTTP_GET, [this](AsyncWebServerRequest *request){
+    handleRecorderRequest(request);
+  });
+  
+  // POST /api/recorder?action=start|stop|delete|play|halt[&id=N]
+  server.on("/api/recorder", HTTP_POST, [this](AsyncWebServerRequest *request){
+    if (!recorder || !recorder->isMounted() || !request->hasParam("action")) {
+      request->send(400, "application/json", "{\"status\":\"unavailable\"}");
+      return;
+    }
+    String action = request->getParam("action")->value();
+    bool ok = true;
+    if (action == "start") recorder->requestStart();
+    else if (action == "stop") recorder->requestStop();
+    else if (action == "delete" && request->hasParam("id")) {
+      ok = recorder->deleteFile(strtoul(request->getParam("id")->value().c_str(), nullptr, 10));
+    }
+    else if (action == "play" && player && request->hasParam("id")) {
+      uint32_t id = strtoul(request->getParam("id")->value().c_str(), nullptr, 10);
+      ok = id != 0;
+      if (ok) player->requestPlay(id);
+    }
+    else if (action == "halt" && player) player->requestStop();
+    else ok = false;
+    request->send(ok ? 200 : 400, "application/json", ok ? "{\"status\":\"ok\"}" : "{\"status\":\"failed\"}");
+  });
+  
+  server.on("/api/trend", HTTP_GET, [this](AsyncWebServerRequest *request){
+    handleTrendRequest(request, TrendExporter::FORMAT_JSON, 2000, false);
+  });
+  
+  server.on("/api/export", HTTP_GET, [this](AsyncWebServerRequest *request){
+    handleTrendRequest(request, TrendExporter::FORMAT_CSV, 0, true);
+  });
+  
+  server.on("/api/trace", HTTP_GET, [this](AsyncWebServerRequest *request){
+    handleTraceRequest(request);
+  });
+  
+  server.on("/api/export/stats", HTTP_GET, [this](AsyncWebServerRequest *request){
+    char response[160];
+    uint32_t rate = lastExport.durationMs ? (uint64_t)lastExport.bytes * 1000 / lastExport.durationMs : 0;
+    snprintf(response, sizeof(response), 
+             "{\"bytes\":%lu,\"records\":%lu,\"durationMs\":%lu,\"bytesPerSec\":%lu,\"completed\":%s}",
+             (unsigned long)lastExport.bytes, (unsigned long)lastExport.records,
+             (unsigned long)lastExport.durationMs, (unsigned long)rate,
+             lastExport.completed ? "true" : "false");
+    request->send(200, "application/json", response);
+  });
+  
+  events.onConnect([this](AsyncEventSourceClient *client){
     client->send("connected", NULL, millis(), 1000);
+    addStreamClient(client);
+  });
+  events.onDisconnect([this](AsyncEventSourceClient *client){
+    removeStreamClient(client);
+  });
+  
+  // GET /api/snapshot downloads the full state; POST restores it (raw body)
+  server.on("/api/snapshot", HTTP_GET, [this](AsyncWebServerRequest *request){
+    if (!snapshot) {
+      request->send(404, "application/json", "{\"status\":\"unavailable\"}");
+      return;
+    }
+    uint8_t record[StateSnapshot::MAX_SIZE];
+    size_t len = snapshot->capture(record, sizeof(record));
+    // A stream copies the bytes; a byte-array response would keep the stack pointer
+    AsyncResponseStream* response = request->beginResponseStream("application/octet-stream", len);
+    response->write(record, len);
+    response->addHeader("Content-Disposition", "attachment; filename=\"co2-state.bin\"");
+    request->send(response);
+  });
+  
+  server.on("/api/snapshot", HTTP_POST,
+    [this](AsyncWebServerRequest *request){
+      const char* error = !snapshot ? "unavailable"
+                        : snapshotUploadLen > sizeof(snapshotUpload) ? "too long"
+                        : snapshot->stage(snapshotUpload, snapshotUploadLen);
+      snapshotUploadLen = 0;
+      char response[96];
+      if (error) snprintf(response, sizeof(response), "{\"status\":\"failed\",\"error\":\"%s\"}", error);
+      else snprintf(response, sizeof(response), "{\"status\":\"ok\"}");
+      request->send(error ? 400 : 200, "application/json", response);
+    },
+    nullptr,
+    [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
+      if (index == 0) snapshotUploadLen = 0;
+      if (index + len > sizeof(snapshotUpload)) {
+        snapshotUploadLen = sizeof(snapshotUpload) + 1;
+        return;
+      }
+      memcpy(snapshotUpload + index, data, len);
+      snapshotUploadLen = index + len;
+    });
+  
+  server.on("/api/bridge", HTTP_GET, [this](AsyncWebServerRequest *request){
+    if (!bridge) {
+      request->send(404, "application/json", "{\"status\":\"unavailable\"}");
+      return;
+    }
+    StaticJsonDocument<384> doc;
+    doc["active"] = bridge->isActive();
+    doc["replaceWaveform"] = bridge->isReplacingWaveform();
+    JsonArray mask = doc.createNestedArray("statusMask");
+    for (uint8_t i = 0; i < 3; i++) mask.add(bridge->getStatusMask(i));
+    doc["bytesToSensor"] = bridge->getBytesToSensor();
+    doc["bytesToHost"] = bridge->getBytesToHost();
+    doc["framesToSensor"] = bridge->getFramesToSensor();
+    doc["framesToHost"] = bridge->getFramesToHost();
+    doc["badChecksums"] = bridge->getBadChecksums();
+    doc["rewritten"] = bridge->getRewritten();
+    doc["maxServiceUs"] = bridge->getMaxServiceUs();
+    
+    char response[384];
+    serializeJson(doc, response, sizeof(response));
+    request->send(200, "application/json", response);
+  });
+  
+  // POST /api/bridge?action=on|off|wave|status[&value=0|1 or b1,b2,b3]
+  server.on("/api/bridge", HTTP_POST, [this](AsyncWebServerRequest *request){
+    if (!bridge || !request->hasParam("action")) {
+      request->send(400, "application/json", "{\"status\":\"action required\"}");
+      return;
+    }
+    String action = request->getParam("action")->value();
+    const char* value = request->hasParam("value") ? request->getParam("value")->value().c_str() : "";
+    
+    if (action == "on") bridge->requestStart();
+    else if (action == "off") bridge->requestStop();
+    else if (action == "wave") bridge->setReplaceWaveform(atoi(value) != 0);
+    else if (action == "status") {
+      int b1 = 0, b2 = 0, b3 = 0;
+      sscanf(value, "%i,%i,%i", &b1, &b2, &b3);
+      bridge->setStatusMask(b1, b2, b3);
+    }
+    else {
+      request->send(400, "application/json", "{\"status\":\"unknown action\"}");
+      return;
+    }
+    request->send(200, "application/json", "{\"status\":\"ok\"}");
+  });
+  
+  server.on("/api/faults", HTTP_GET, [this](AsyncWebServerRequest *request){
+    if (!faults) {
+      request->send(404, "application/json", "{\"status\":\"unavailable\"}");
+      return;
+    }
+    StaticJsonDocument<768> doc;
+    doc["armed"] = faults->isArmed();
+    doc["seed"] = faults->getSeed();
+    doc["delayMs"] = faults->getDelayMs();
+    JsonObject list = doc.createNestedObject("faults");
+    for (uint8_t i = 0; i < FaultInjector::FAULT_COUNT; i++) {
+      JsonObject fault = list.createNestedObject(FaultInjector::faultName(i));
+      fault["percent"] = faults->getRule(i).probability / 100.0f;
+      fault["every"] = faults->getRule(i).every;
+      fault["injected"] = faults->getInjected(i);
+    }
+    
+    char response[768];
+    serializeJson(doc, response, sizeof(response));
+    request->send(200, "application/json", response);
+  });
+  
+  // POST /api/faults?fault=<name>&percent=P[&every=N], ?seed=N, ?delayMs=N or ?action=clear
+  server.on("/api/faults", HTTP_POST, [this](AsyncWebServerRequest *request){
+    if (!faults) {
+      request->send(404, "application/json", "{\"status\":\"unavailable\"}");
+      return;
+    }
+    int8_t fault = -1;
+    uint16_t probability = 0, every = 0;
+    if (request->hasParam("fault")) {
+      fault = FaultInjector::findFault(request->getParam("fault")->value().c_str());
+      if (fault < 0) {
+        request->send(400, "application/json", "{\"status\":\"unknown fault\"}");
+        return;
+      }
+      if ((request->hasParam("percent") &&
+           !FaultInjector::parsePercent(request->getParam("percent")->value().c_str(), probability)) ||
+          (request->hasParam("every") &&
+           !FaultInjector::parseEvery(request->getParam("every")->value().c_str(), every))) {
+        request->send(400, "application/json", "{\"status\":\"out of range\"}");
+        return;
+      }
+    }
+    
+    // The UART task injects under the protocol lock
+    if (faultOwner) faultOwner->beginExclusive();
+    if (fault >= 0) faults->setRule(fault, probability, every);
+    if (request->hasParam("seed")) faults->setSeed(strtoul(request->getParam("seed")->value().c_str(), nullptr, 0));
+    if (request->hasParam("delayMs")) faults->setDelayMs(request->getParam("delayMs")->value().toInt());
+    if (request->hasParam("action") && request->getParam("action")->value() == "clear") faults->clear();
+    if (faultOwner) faultOwner->endExclusive();
+    request->send(200, "application/json", "{\"status\":\"ok\"}");
+  });
+  
+  // Prometheus scrape target; the counters are read, never reset
+  server.on("/metrics", HTTP_GET, [this](AsyncWebServerRequest *request){
+    if (!metrics) {
+      request->send(404, "text/plain", "no metrics");
+      return;
+    }
+    AsyncResponseStream* response = request->beginResponseStream(MetricsExporter::CONTENT_TYPE, 4096);
+    metrics->write(*response);
+    MetricsExporter::gauge(*response, "co2emu_sse_clients", "Connected /events clients.", events.count());
+    MetricsExporter::gauge(*response, "co2emu_stream_clients", "Clients holding a waveform stream slot.", activeStreamClients);
+    request->send(response);
+  });
+  
+  server.on("/api/status", HTTP_GET, [this](AsyncWebServerRequest *request){
+    StaticJsonDocument<768> doc;
+    uint32_t now = millis();
+    doc["uptime"] = now;
+    doc["continuousMode"] = device.isContinuousMode();
+    
+    JsonArray clients = doc.createNestedArray("streamClients");
+    xSemaphoreTake(streamLock, portMAX_DELAY);
+    for (uint8_t i = 0; i < MAX_STREAM_CLIENTS; i++) {
+      const StreamClient& slot = streamClients[i];
+      if (!slot.client) continue;
+      JsonObject c = clients.createNestedObject();
+      c["slot"] = i;
+      c["connectedMs"] = now - slot.connectedAt;
+      c["sent"] = slot.sent;
+      c["dropped"] = slot.dropped;
+      c["lag"] = slot.lag;
+      c["maxLag"] = slot.maxLag;
+      c["serverQueue"] = slot.client->packetsWaiting();
+    }
+    xSemaphoreGive(streamLock);
+    
+    char response[768];
+    serializeJson(doc, response, sizeof(response));
+    request->send(200, "application/json", response);
   });
   server.addHandler(&events);
 }
 
+// GET /api/trend and /api/export
+//   ?res=raw|breath|minute&from=<ms>&to=<ms>&max=<records>&format=json|csv|bin
+void WebInterface::handleTrendRequest(AsyncWebServerRequest* request, TrendExporter::Format defaultFormat,
+                                      uint32_t defaultMax, bool download) {
+  if (!trends) {
+    request->send(503, "application/json", "{\"error\":\"no trend store\"}");
+    return;
+  }
+  
+  TrendStore::Resolution res = download ? TrendStore::RES_RAW : TrendStore::RES_BREATH;
+  if (request->hasParam("res") && 
+      !TrendStore::parseResolution(request->getParam("res")->value().c_str(), res)) {
+    request->send(400, "application/json", "{\"error\":\"res must be raw, breath or minute\"}");
+    return;
+  }
+  
+  TrendExporter::Format format = defaultFormat;
+  if (request->hasParam("format") && 
+      !TrendExporter::parseFormat(request->getParam("format")->value().c_str(), format)) {
+    request->send(400, "application/json", "{\"error\":\"format must be json, csv or bin\"}");
+    return;
+  }
+  
+  uint32_t from = request->hasParam("from") ? strtoul(request->getParam("from")->value().c_str(), NULL, 10) : 0;
+  uint32_t to = request->hasParam("to") ? strtoul(request->getParam("to")->value().c_str(), NULL, 10) : UINT32_MAX;
+  uint32_t maxRecords = request->hasParam("max") ? strtoul(request->getParam("max")->value().c_str(), NULL, 10) : defaultMax;
+  
+  auto exporter = std::make_shared<TrendExporter>(*trends, res, format, from, to, maxRecords);
+  
+  AsyncWebServerResponse* response = request->beginChunkedResponse(TrendExporter::contentType(format),
+    [this, exporter, download](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+      size_t n = exporter->read(buffer, maxLen);
+      if (n == 0 && !exporter->isFinished()) return RESPONSE_TRY_AGAIN;
+      
+      if (download) {
+        lastExport.bytes = exporter->getByteCount();
+        lastExport.records = exporter->getRecordCount();
+        lastExport.durationMs = exporter->getElapsedMs();
+        lastExport.completed = exporter->isFinished();
+        if (n == 0) {
+          CMD_SERIAL.printf("Export: %lu records, %lu bytes in %lu ms\n",
+                            (unsigned long)lastExport.records, (unsigned long)lastExport.bytes,
+                            (unsigned long)lastExport.durationMs);
+        }
+      }
+      return n;
+    });
+  
+  if (download) {
+    char disposition[64];
+    snprintf(disposition, sizeof(disposition), "attachment; filename=\"co2-%s.%s\"",
+             TrendStore::resolutionName(res), TrendExporter::fileExtension(format));
+    response->addHeader("Content-Disposition", disposition);
+  }
+  request->send(response);
+}
+
+// GET /api/trace?since=<seq>&nowave=1
+// Decoded protocol frames newer than 'since'; 'next' is the cursor for the
+// following poll and 'lost' counts frames overwritten before they were read.
+static void addRecordingEntry(uint32_t sequence, uint32_t bytes, void* ctx) {
+  JsonObject entry = static_cast<JsonArray*>(ctx)->createNestedObject();
+  entry["id"] = sequence;
+  entry["bytes"] = bytes;
+}
+
+void WebInterface::handleRecorderRequest(AsyncWebServerRequest* request) {
+  if (!recorder) {
+    request->send(404, "application/json", "{\"status\":\"no recorder\"}");
+    return;
+  }
+  StaticJsonDocument<1024> doc;
+  doc["mounted"] = recorder->isMounted();
+  doc["recording"] = recorder->isRecording();
+  doc["samples"] = recorder->getSampleCount();
+  doc["bytesWritten"] = recorder->getBytesWritten();
+  doc["droppedBuffers"] = recorder->getDroppedBuffers();
+  doc["writeErrors"] = recorder->getWriteErrors();
+  if (player && player->isPlaying()) doc["playing"] = player->getSequence();
+  if (recorder->isMounted()) {
+    doc["fsUsed"] = LittleFS.usedBytes();
+    doc["fsTotal"] = LittleFS.totalBytes();
+  }
+  JsonArray files = doc.createNestedArray("files");
+  recorder->listFiles(addRecordingEntry, &files);
+  
+  char response[1024];
+  serializeJson(doc, response, sizeof(response));
+  request->send(200, "application/json", response);
+}
+
+void WebInterface::handleUploadBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index) {
+  if (!importer) return;
+  if (index == 0) {
+    // One upload at a time; later ones are refused in handleUploadDone()
+    if (importer->isActive()) return;
+    uploadOwner = request;
+    request->onDisconnect([this, request]() {
+      if (uploadOwner != request) return;
+      importer->abort();
+      uploadOwner = nullptr;
+    });
+    if (!importer->begin()) return;
+  }
+  if (request == uploadOwner) importer->feed(data, len);
+}
+
+void WebInterface::handleUploadDone(AsyncWebServerRequest* request) {
+  if (!importer || request != uploadOwner) {
+    request->send(409, "application/json", "{\"status\":\"failed\",\"error\":\"upload in progress\"}");
+    return;
+  }
+  importer->finish();
+  uploadOwner = nullptr;
+  
+  const WaveformImporter::Result& r = importer->getResult();
+  uint32_t bytesPerSec = r.durationMs ? (uint32_t)((uint64_t)r.bytesIn * 1000 / r.durationMs) : r.bytesIn;
+  
+  StaticJsonDocument<384> doc;
+  doc["status"] = r.ok ? "ok" : "failed";
+  if (r.ok) doc["id"] = r.sequence;
+  else doc["error"] = r.error;
+  doc["format"] = WaveformImporter::formatName(r.format);
+  doc["bytes"] = r.bytesIn;
+  doc["samples"] = r.samples;
+  doc["skipped"] = r.skipped;
+  doc["durationMs"] = r.durationMs;
+  doc["bytesPerSec"] = bytesPerSec;
+  doc["peakHeapUsed"] = r.peakHeapUsed;
+  
+  char response[384];
+  serializeJson(doc, response, sizeof(response));
+  request->send(r.ok ? 200 : 400, "application/json", response);
+  
+  CMD_SERIAL.print("Upload "); CMD_SERIAL.print(r.ok ? "stored as #" : "failed: ");
+  if (r.ok) CMD_SERIAL.print(r.sequence); else CMD_SERIAL.print(r.error);
+  CMD_SERIAL.print(" ("); CMD_SERIAL.print(WaveformImporter::formatName(r.format));
+  CMD_SERIAL.print(", "); CMD_SERIAL.print(r.bytesIn); CMD_SERIAL.print(" bytes, ");
+  CMD_SERIAL.print(r.samples); CMD_SERIAL.print(" samples, ");
+  CMD_SERIAL.print(bytesPerSec); CMD_SERIAL.print(" B/s, peak heap ");
+  CMD_SERIAL.print(r.peakHeapUsed); CMD_SERIAL.println(" bytes)");
+}
+
+void WebInterface::handleTraceRequest(AsyncWebServerRequest* request) {
+  if (!trace) {
+    request->send(503, "application/json", "{\"error\":\"no trace\"}");
+    return;
+  }
+  
+  static const uint8_t MAX_ENTRIES = 32;
+  uint32_t since = request->hasParam("since") ? strtoul(request->getParam("since")->value().c_str(), NULL, 10) : 0;
+  bool noWave = request->hasParam("nowave") && request->getParam("nowave")->value() == "1";
+  
+  uint32_t head = trace->getHead();
+  uint32_t oldest = trace->getOldest();
+  uint32_t lost = 0;
+  if (since < oldest) {
+    lost = oldest - since;
+    since = oldest;
+  }
+  if (since > head) since = head;
+  
+  // Decoded text is plain ASCII without quotes, so it is written directly
+  AsyncResponseStream* response = request->beginResponseStream("application/json");
+  response->print("{\"entries\":[");
+  uint8_t count = 0;
+  uint32_t seq = since;
+  
+  for (; seq < head && count < MAX_ENTRIES; seq++) {
+    ProtocolTrace::Entry e;
+    if (!trace->read(seq, e)) {
+      if (seq >= trace->getOldest()) break;  // still being written
+      lost++;
+      continue;
+    }
+    if (noWave && ProtocolTrace::isWaveform(e)) continue;
+    
+    char text[96];
+    char hex[ProtocolTrace::MAX_FRAME * 3 + 1];
+    ProtocolTrace::describe(e, text, sizeof(text));
+    uint8_t n = e.truncated ? ProtocolTrace::MAX_FRAME : e.len;
+    for (uint8_t i = 0; i < n; i++) snprintf(hex + i * 3, 4, "%02X ", e.data[i]);
+    hex[n ? n * 3 - 1 : 0] = '\0';
+    
+    // A truncated frame lost its checksum byte: "ok" is null, not false
+    response->printf("%s{\"seq\":%lu,\"t\":%lu,\"dir\":\"%s\",\"ok\":%s,\"truncated\":%s,\"text\":\"%s\",\"hex\":\"%s\"}",
+                     count ? "," : "", (unsigned long)seq, (unsigned long)e.time,
+                     e.dir == ProtocolTrace::DIR_RX ? "RX" : "TX",
+                     e.truncated ? "null" : (ProtocolTrace::checksumOk(e) ? "true" : "false"),
+                     e.truncated ? "true" : "false", text, hex);
+    count++;
+  }
+  
+  response->printf("],\"next\":%lu,\"lost\":%lu}", (unsigned long)seq, (unsigned long)lost);
+  request->send(response);
+}
+
+void WebInterface::addStreamClient(AsyncEventSourceClient* client) {
+  xSemaphoreTake(streamLock, portMAX_DELAY);
+  for (uint8_t i = 0; i < MAX_STREAM_CLIENTS; i++) {
+    StreamClient& slot = streamClients[i];
+    if (slot.client) continue;
+    memset(&slot, 0, sizeof(slot));
+    slot.client = client;
+    slot.connectedAt = millis();
+    activeStreamClients++;
+    xSemaphoreGive(streamLock);
+    return;
+  }
+  xSemaphoreGive(streamLock);
+  client->close();  // all slots taken
+}
+
+void WebInterface::removeStreamClient(AsyncEventSourceClient* client) {
+  xSemaphoreTake(streamLock, portMAX_DELAY);
+  for (uint8_t i = 0; i < MAX_STREAM_CLIENTS; i++) {
+    if (streamClients[i].client == client) {
+      streamClients[i].client = nullptr;
+      activeStreamClients--;
+      break;
+    }
+  }
+  xSemaphoreGive(streamLock);
+}
+
+// Sends everything queued for one client as a single event. Called with
+// streamLock held.
+bool WebInterface::flushStreamClient(StreamClient& slot, uint16_t rate, uint16_t alarmWord) {
+  StaticJsonDocument<512> doc;
+  JsonArray values = doc.createNestedArray("co2");
+  uint8_t idx = (slot.head + STREAM_QUEUE_DEPTH - slot.count) % STREAM_QUEUE_DEPTH;
+  for (uint8_t i = 0; i < slot.count; i++) {
+    values.add(slot.pending[idx]);
+    idx = (idx + 1) % STREAM_QUEUE_DEPTH;
+  }
+  doc["rate"] = rate;
+  doc["mode"] = device.isContinuousMode() ? "CONTINUOUS" : "IDLE";
+  doc["alarm"] = (alarmWord & 0xFF) != 0;
+  doc["alarmBits"] = alarmWord & 0xFF;
+  doc["priority"] = alarmWord >> AlarmManager::STATUS_PRIORITY_SHIFT;
+  doc["dropped"] = slot.dropped;
+  
+  serializeJson(doc, eventBuffer, sizeof(eventBuffer));
+  if (!slot.client->send(eventBuffer, "data", millis())) return false;
+  
+  slot.sent++;
+  slot.count = 0;
+  return true;
+}
+
+void WebInterface::checkConnection() {
+  #if !WIFI_AP_MODE
+  bool connected = WiFi.status() == WL_CONNECTED;
+  if (connected != staConnected) {
+    staConnected = connected;
+    if (connected) {
+      CMD_SERIAL.print("WiFi connected, IP address: ");
+      CMD_SERIAL.println(WiFi.localIP());
+    } else {
+      CMD_SERIAL.println("WiFi disconnected");
+    }
+  }
+  #endif
+}
+
 void WebInterface::update() {
-  if (millis() - lastDataUpdate >= 100) {
-    lastDataUpdate = millis();
-    currentCO2Value = waveform.getSample();
+  if (millis() - lastDataUpdate < 100) return;
+  lastDataUpdate = millis();
+  checkConnection();
+  
+  // Nothing is sampled or serialized while nobody is listening
+  if (activeStreamClients == 0 || !streamLock) return;
+  
+  currentCO2Value = waveform.getSample();
+  uint16_t rate = waveform.getRespiratoryRate();
+  uint16_t alarmWord = alarms.getStatusWord();
+  
+  xSemaphoreTake(streamLock, portMAX_DELAY);
+  for (uint8_t i = 0; i < MAX_STREAM_CLIENTS; i++) {
+    StreamClient& slot = streamClients[i];
+    if (!slot.client) continue;
     
-    StaticJsonDocument<256> doc;
-    doc["co2"] = currentCO2Value;
-    doc["rate"] = waveform.getRespiratoryRate();
-    doc["mode"] = device.isContinuousMode() ? "CONTINUOUS" : "IDLE";
+    if (slot.count == STREAM_QUEUE_DEPTH) {
+      slot.count--;
+      slot.dropped++;
+    }
+    slot.pending[slot.head] = currentCO2Value;
+    slot.head = (slot.head + 1) % STREAM_QUEUE_DEPTH;
+    slot.count++;
     
-    uint8_t status = 0;
-    doc["alarm"] = alarms.checkAlarms(currentCO2Value, status);
+    size_t waiting = slot.client->packetsWaiting();
+    if (waiting < STREAM_MAX_IN_FLIGHT) {
+      flushStreamClient(slot, rate, alarmWord);
+    }
     
-    String data;
-    serializeJson(doc, data);
-    events.send(data.c_str(), "data", millis());
+    slot.lag = slot.count + waiting;
+    if (slot.lag > slot.maxLag) slot.maxLag = slot.lag;
   }
+  xSemaphoreGive(streamLock);
 }
 
 // Continued in Part 2 with HTML...
 // Add this method to WebInterface.cpp after the update() method
 
-String WebInterface::getIndexHTML() {
+const char* WebInterface::getIndexHTML() const {
   return R"rawliteral(<!DOCTYPE html>
 <html><head><meta name="viewport" content="width=device-width,initial-scale=1"><title>CO2 Emulator</title>
 <style>
@@ -165,11 +867,12 @@ button.secondary{background:#5f6368}button.secondary:hover{background:#4d5156}
 <div class="container">
 <h1>🫁 CO2 Sensor Emulator</h1>
 <div class="card"><h2>Live Data</h2><canvas id="waveform"></canvas>
+<div id="frameStats" style="font-size:12px;color:#5f6368;margin-top:4px"></div>
 <div class="info-row">
 <div class="info-item"><div class="info-label">Current CO2</div><div class="info-value"><span id="currentCO2">--</span> <span style="font-size:14px">mmHg</span></div></div>
 <div class="info-item"><div class="info-label">Respiratory Rate</div><div class="info-value"><span id="respRate">--</span> <span style="font-size:14px">br/min</span></div></div>
 <div class="info-item"><div class="info-label">Mode</div><div class="info-value" style="font-size:18px"><span class="status-badge" id="modeBadge">IDLE</span></div></div>
-</div><div id="alarmStatus" class="alarm"><span class="alarm-icon">⚠️</span><strong>ALARM:</strong> CO2 out of range!</div></div>
+</div><div id="alarmStatus" class="alarm"><span class="alarm-icon">⚠️</span><strong>ALARM:</strong> <span id="alarmText"></span></div></div>
 <div class="card"><h2>Waveform Control</h2>
 <div class="control-group"><label>Amplitude (mmHg):</label>
 <input type="range" id="amp" min="0" max="100" step="1" value="38"><span class="value-display" id="ampVal">38</span></div>
@@ -180,35 +883,101 @@ button.secondary{background:#5f6368}button.secondary:hover{background:#4d5156}
 <div class="control-group"><label>Phase (degrees):</label>
 <input type="range" id="phase" min="0" max="360" step="10" value="0"><span class="value-display" id="phaseVal">0</span></div>
 <div class="control-group"><label>Use I2C Sensor:</label><input type="checkbox" id="useI2C"></div>
+<div class="control-group"><label>Sensor Driver:</label><select id="sensorDriver" style="padding:8px;min-width:120px" onchange="setSensor(this.value)"></select>
+<span id="sensorState" style="margin-left:10px;color:#5f6368"></span></div>
 <button onclick="updateSettings()">Apply Changes</button></div>
 <div class="card"><h2>Alarm Settings</h2>
 <div class="control-group"><label>High Alarm (mmHg):</label>
 <input type="number" id="alarmHigh" value="50" step="1" style="width:100px"><input type="checkbox" id="alarmHighEn" style="margin-left:10px"> Enable</div>
 <div class="control-group"><label>Low Alarm (mmHg):</label>
 <input type="number" id="alarmLow" value="30" step="1" style="width:100px"><input type="checkbox" id="alarmLowEn" style="margin-left:10px"> Enable</div>
+<div class="control-group"><label>High RR (br/min):</label>
+<input type="number" id="rrHigh" value="30" step="1" style="width:100px"><input type="checkbox" id="rrHighEn" style="margin-left:10px"> Enable</div>
+<div class="control-group"><label>Low RR (br/min):</label>
+<input type="number" id="rrLow" value="8" step="1" style="width:100px"><input type="checkbox" id="rrLowEn" style="margin-left:10px"> Enable</div>
+<div class="control-group"><label>Latching:</label><input type="checkbox" id="alarmLatch">
+<button class="secondary" onclick="fetch('/api/alarms/ack',{method:'POST'})">Acknowledge</button></div>
 <button onclick="updateSettings()">Apply Changes</button></div>
+<div class="card"><h2>Presets</h2>
+<div class="control-group"><label>Preset:</label><select id="presetList" style="padding:8px;min-width:160px"></select>
+<button onclick="presetAction('load',document.getElementById('presetList').value)">Apply</button>
+<button class="secondary" onclick="presetAction('delete',document.getElementById('presetList').value)">Delete</button></div>
+<div class="control-group"><label>Save current as:</label><input type="text" id="presetName" maxlength="15" style="padding:8px">
+<button onclick="presetAction('save',document.getElementById('presetName').value)">Save Preset</button></div></div>
+<div class="card"><h2>Recorder</h2>
+<div class="control-group"><button onclick="recAction('start')">⏺ Record</button>
+<button class="secondary" onclick="recAction('stop')">⏹ Stop</button>
+<span id="recState" style="margin-left:10px;color:#5f6368"></span></div>
+<div class="control-group"><label>Upload:</label><input type="file" id="recUpload" accept=".csv,.bin,.txt">
+<button onclick="recUpload()">⬆ Upload</button>
+<button class="secondary" onclick="recAction('halt')">⏹ Stop replay</button>
+<span id="upState" style="margin-left:10px;color:#5f6368"></span></div>
+<div id="recFiles" style="font-size:14px"></div></div>
+<div class="card"><h2>Protocol Monitor</h2>
+<div class="control-group"><label>Capture:</label><input type="checkbox" id="traceOn">
+<label style="min-width:0;margin-left:20px">Hide waveform packets:</label><input type="checkbox" id="traceNoWave" checked>
+<button class="secondary" onclick="document.getElementById('traceLog').textContent=''">Clear</button></div>
+<pre id="traceLog" style="height:200px;overflow-y:auto;background:#fafafa;border:1px solid #dadce0;border-radius:4px;padding:8px;font-size:12px"></pre></div>
 <div class="card"><h2>Configuration</h2>
 <button onclick="saveConfig()">💾 Save to EEPROM</button>
-<button onclick="loadConfig()" class="secondary">📂 Load from EEPROM</button></div></div>
+<button onclick="loadConfig()" class="secondary">📂 Load from EEPROM</button>
+<div class="control-group"><label>State snapshot:</label><a href="/api/snapshot"><button class="secondary">⬇ Capture</button></a>
+<input type="file" id="snapFile" accept=".bin"><button onclick="restoreSnapshot()">⬆ Restore</button>
+<span id="snapState" style="margin-left:10px;color:#5f6368"></span></div></div></div>
 <script>
 let canvas=document.getElementById('waveform');let ctx=canvas.getContext('2d');
-canvas.width=canvas.offsetWidth;canvas.height=300;let waveformData=[];let maxPoints=canvas.width;
+canvas.width=canvas.offsetWidth;canvas.height=300;
+let alarmNames=['EtCO2 high','EtCO2 low','RR high','RR low'];
+// Samples land in a typed-array ring; events only append, frames draw.
+// The trace is a sweep: each frame repaints just the columns of new
+// samples (plus a small gap ahead) from the cached grid layer.
+const RING=4096,GAP=8;let ring=new Float32Array(RING),ringHead=0,ringCount=0,pending=0,sweepX=0,lastY=-1,latest=null;
+let grid=document.createElement('canvas');
+function buildGrid(){grid.width=canvas.width;grid.height=canvas.height;let g=grid.getContext('2d');
+g.fillStyle='#fafafa';g.fillRect(0,0,grid.width,grid.height);g.strokeStyle='#e0e0e0';g.lineWidth=1;
+for(let i=0;i<=4;i++){let y=i*grid.height/4;g.beginPath();g.moveTo(0,y);g.lineTo(grid.width,y);g.stroke();}
+ctx.drawImage(grid,0,0);sweepX=0;lastY=-1;pending=Math.min(ringCount,canvas.width);}
+buildGrid();
+window.addEventListener('resize',()=>{if(canvas.offsetWidth!==canvas.width){canvas.width=canvas.offsetWidth;canvas.height=300;buildGrid();}});
 let eventSource=new EventSource('/events');
 eventSource.addEventListener('data',function(e){let data=JSON.parse(e.data);updateDisplay(data);});
-function updateDisplay(data){document.getElementById('currentCO2').textContent=data.co2.toFixed(2);
+let fm={frames:0,drawn:0,drawTotal:0,drawMax:0,samples:0,events:0,since:performance.now()};
+function updateDisplay(data){
+let values=Array.isArray(data.co2)?data.co2:[data.co2];
+for(let i=0;i<values.length;i++){ring[ringHead]=values[i];ringHead=(ringHead+1)%RING;}
+ringCount=Math.min(ringCount+values.length,RING);pending+=values.length;
+fm.samples+=values.length;fm.events++;latest=data;}
+function showLatest(data){
 document.getElementById('respRate').textContent=data.rate;
 let badge=document.getElementById('modeBadge');badge.textContent=data.mode;
 badge.className='status-badge '+(data.mode==='CONTINUOUS'?'active':'inactive');
-waveformData.push(data.co2);if(waveformData.length>maxPoints)waveformData.shift();drawWaveform();
+let values=Array.isArray(data.co2)?data.co2:[data.co2];
+document.getElementById('currentCO2').textContent=values[values.length-1].toFixed(2);
 let alarmDiv=document.getElementById('alarmStatus');
-if(data.alarm){alarmDiv.classList.add('show');}else{alarmDiv.classList.remove('show');}}
-function drawWaveform(){ctx.fillStyle='#fafafa';ctx.fillRect(0,0,canvas.width,canvas.height);
-ctx.strokeStyle='#e0e0e0';ctx.lineWidth=1;
-for(let i=0;i<=4;i++){let y=i*canvas.height/4;ctx.beginPath();ctx.moveTo(0,y);ctx.lineTo(canvas.width,y);ctx.stroke();}
-ctx.strokeStyle='#1a73e8';ctx.lineWidth=2;ctx.beginPath();let minVal=0;let maxVal=100;
-for(let i=0;i<waveformData.length;i++){let x=i;
-let y=canvas.height-(waveformData[i]-minVal)/(maxVal-minVal)*canvas.height;
-if(i===0)ctx.moveTo(x,y);else ctx.lineTo(x,y);}ctx.stroke();}
+if(data.alarm){document.getElementById('alarmText').textContent=alarmNames.filter((n,i)=>data.alarmBits&(1<<i)).join(', ');
+alarmDiv.classList.add('show');}else{alarmDiv.classList.remove('show');}}
+function toY(v){return canvas.height-v/100*canvas.height;}
+function drawSamples(n){const W=canvas.width,H=canvas.height;let idx=(ringHead-n+RING)%RING;
+ctx.strokeStyle='#1a73e8';ctx.lineWidth=2;
+while(n>0){let run=Math.min(n,W-sweepX);let clearW=Math.min(run+GAP,W-sweepX);
+ctx.drawImage(grid,sweepX,0,clearW,H,sweepX,0,clearW,H);
+let wrap=sweepX+run+GAP-W;if(wrap>0)ctx.drawImage(grid,0,0,wrap,H,0,0,wrap,H);
+ctx.beginPath();let x=sweepX;if(lastY>=0)ctx.moveTo(x-1,lastY);
+for(let i=0;i<run;i++){let y=toY(ring[idx]);idx=(idx+1)%RING;
+if(i===0&&lastY<0)ctx.moveTo(x,y);else ctx.lineTo(x,y);x++;lastY=y;}
+ctx.stroke();sweepX=x;if(sweepX>=W){sweepX=0;lastY=-1;}n-=run;}}
+function frame(t){requestAnimationFrame(frame);fm.frames++;
+if(pending){let start=performance.now();
+// More than one sweep behind (e.g. a hidden tab): only the newest sweep is visible
+let n=Math.min(pending,canvas.width,RING);pending=0;drawSamples(n);
+if(latest){showLatest(latest);latest=null;}
+let d=performance.now()-start;fm.drawn++;fm.drawTotal+=d;if(d>fm.drawMax)fm.drawMax=d;}
+if(t-fm.since>=1000){let s=(t-fm.since)/1000;
+document.getElementById('frameStats').textContent=(fm.frames/s).toFixed(0)+' fps, draw '+
+(fm.drawn?fm.drawTotal/fm.drawn:0).toFixed(2)+' ms avg / '+fm.drawMax.toFixed(2)+' ms max, '+
+(fm.samples/s).toFixed(0)+' samples/s in '+(fm.events/s).toFixed(0)+' events/s';
+fm={frames:0,drawn:0,drawTotal:0,drawMax:0,samples:0,events:0,since:t};}}
+requestAnimationFrame(frame);
 ['amp','freq','base','phase'].forEach(id=>{document.getElementById(id).addEventListener('input',function(){
 document.getElementById(id+'Val').textContent=this.value;});});
 function updateSettings(){let settings={amplitude:parseFloat(document.getElementById('amp').value),
@@ -216,9 +985,49 @@ frequency:parseFloat(document.getElementById('freq').value),baseline:parseFloat(
 phase:parseFloat(document.getElementById('phase').value),alarmHigh:parseFloat(document.getElementById('alarmHigh').value),
 alarmLow:parseFloat(document.getElementById('alarmLow').value),
 alarmHighEnabled:document.getElementById('alarmHighEn').checked,
-alarmLowEnabled:document.getElementById('alarmLowEn').checked,useI2C:document.getElementById('useI2C').checked};
+alarmLowEnabled:document.getElementById('alarmLowEn').checked,
+rrHigh:parseFloat(document.getElementById('rrHigh').value),rrLow:parseFloat(document.getElementById('rrLow').value),
+rrHighEnabled:document.getElementById('rrHighEn').checked,rrLowEnabled:document.getElementById('rrLowEn').checked,
+alarmLatching:document.getElementById('alarmLatch').checked,useI2C:document.getElementById('useI2C').checked};
 fetch('/api/settings',{method:'POST',headers:{'Content-Type':'application/json'},body:JSON.stringify(settings)})
 .then(r=>r.json()).then(data=>console.log('Settings updated'));}
+let traceSeq=0;
+function pollTrace(){if(!document.getElementById('traceOn').checked){setTimeout(pollTrace,500);return;}
+let nw=document.getElementById('traceNoWave').checked?1:0;
+fetch('/api/trace?since='+traceSeq+'&nowave='+nw).then(r=>r.json()).then(d=>{traceSeq=d.next;
+let log=document.getElementById('traceLog');let lines='';
+if(d.lost)lines+='... '+d.lost+' frames lost\n';
+d.entries.forEach(e=>{lines+=(e.t/1000).toFixed(3).padStart(12)+' '+e.dir+' '+e.text+(e.truncated||e.ok?'':' [BAD CHECKSUM]')+'  | '+e.hex+'\n';});
+if(lines){log.textContent=(log.textContent+lines).split('\n').slice(-300).join('\n');log.scrollTop=log.scrollHeight;}
+setTimeout(pollTrace,d.entries.length>=32?50:500);}).catch(()=>setTimeout(pollTrace,1000));}
+pollTrace();
+function loadPresets(){fetch('/api/presets').then(r=>r.json()).then(d=>{let sel=document.getElementById('presetList');
+sel.innerHTML='';d.presets.forEach(n=>{let o=document.createElement('option');o.value=n;o.textContent=n;sel.appendChild(o);});});}
+function presetAction(action,name){if(!name)return;
+fetch('/api/presets?action='+action+'&name='+encodeURIComponent(name),{method:'POST'}).then(r=>r.json())
+.then(d=>{if(action==='load')setTimeout(()=>location.reload(),100);else loadPresets();});}
+loadPresets();
+function loadSensor(){fetch('/api/sensor').then(r=>r.json()).then(d=>{let sel=document.getElementById('sensorDriver');
+sel.innerHTML='';d.drivers.forEach(n=>{let o=document.createElement('option');o.value=n;o.textContent=n;sel.appendChild(o);});
+sel.value=d.active;document.getElementById('sensorState').textContent=d.available?'detected':'not found';}).catch(()=>{});}
+function setSensor(name){fetch('/api/sensor?driver='+name,{method:'POST'}).then(()=>setTimeout(loadSensor,300));}
+loadSensor();
+function loadRecorder(){fetch('/api/recorder').then(r=>r.json()).then(d=>{
+document.getElementById('recState').textContent=!d.mounted?'no filesystem':(d.recording?'recording, '+d.samples+' samples':'idle')+
+(d.droppedBuffers?', '+d.droppedBuffers+' buffers dropped':'')+(d.playing?', replaying #'+d.playing:'');
+document.getElementById('recFiles').innerHTML=d.files.map(f=>'<div>#'+f.id+' ('+(f.bytes/1024).toFixed(0)+' KB) '+
+'<a href="/api/recorder/file?id='+f.id+'">download</a> <a href="#" onclick="recAction(\'play\','+f.id+');return false">replay</a> '+
+'<a href="#" onclick="recAction(\'delete\','+f.id+');return false">delete</a></div>').join('');
+}).catch(()=>{});}
+function recAction(a,id){fetch('/api/recorder?action='+a+(id?'&id='+id:''),{method:'POST'}).then(()=>setTimeout(loadRecorder,300));}
+function recUpload(){const f=document.getElementById('recUpload').files[0];if(!f)return;const st=document.getElementById('upState');
+st.textContent='uploading...';fetch('/api/recorder/upload',{method:'POST',body:f}).then(r=>r.json()).then(d=>{
+st.textContent=d.status=='ok'?'#'+d.id+': '+d.samples+' samples ('+d.format+'), '+(d.bytesPerSec/1024).toFixed(1)+' KB/s':'failed: '+d.error;
+loadRecorder();}).catch(()=>{st.textContent='upload failed';});}
+loadRecorder();setInterval(loadRecorder,5000);
+function restoreSnapshot(){const f=document.getElementById('snapFile').files[0];if(!f)return;
+fetch('/api/snapshot',{method:'POST',body:f}).then(r=>r.json()).then(d=>{
+document.getElementById('snapState').textContent=d.status=='ok'?'restored':'failed: '+d.error;}).catch(()=>{});}
 function saveConfig(){fetch('/api/save',{method:'POST'}).then(r=>r.json()).then(data=>alert('Configuration saved!'));}
 function loadConfig(){fetch('/api/load',{method:'POST'}).then(r=>r.json()).then(data=>location.reload());}
 fetch('/api/settings').then(r=>r.json()).then(data=>{document.getElementById('amp').value=data.amplitude;
@@ -227,6 +1036,9 @@ document.getElementById('freqVal').textContent=data.frequency;document.getElemen
 document.getElementById('baseVal').textContent=data.baseline;document.getElementById('phase').value=data.phase;
 document.getElementById('phaseVal').textContent=data.phase;document.getElementById('alarmHigh').value=data.alarmHigh;
 document.getElementById('alarmLow').value=data.alarmLow;document.getElementById('alarmHighEn').checked=data.alarmHighEnabled;
-document.getElementById('alarmLowEn').checked=data.alarmLowEnabled;document.getElementById('useI2C').checked=data.useI2C;});
+document.getElementById('alarmLowEn').checked=data.alarmLowEnabled;document.getElementById('useI2C').checked=data.useI2C;
+document.getElementById('rrHigh').value=data.rrHigh;document.getElementById('rrLow').value=data.rrLow;
+document.getElementById('rrHighEn').checked=data.rrHighEnabled;document.getElementById('rrLowEn').checked=data.rrLowEnabled;
+document.getElementById('alarmLatch').checked=data.alarmLatching;});
 </script></body></html>)rawliteral";
 }
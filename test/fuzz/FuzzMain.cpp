@@ -0,0 +1,60 @@
+// Stand-in for the libFuzzer driver where the compiler has none: runs each
+// file named on the command line, or each file in a named directory,
+// through LLVMFuzzerTestOneInput once. Options ("-runs=0" and the like)
+// are accepted and ignored, so ctest can call both drivers the same way.
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+static bool runFile(const std::string& path) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) {
+    fprintf(stderr, "cannot open %s\n", path.c_str());
+    return false;
+  }
+  std::vector<uint8_t> data;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) data.insert(data.end(), chunk, chunk + n);
+  fclose(f);
+  LLVMFuzzerTestOneInput(data.data(), data.size());
+  return true;
+}
+
+int main(int argc, char** argv) {
+  size_t runs = 0;
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] == '-') continue;
+    struct stat st;
+    if (stat(argv[i], &st) != 0) {
+      fprintf(stderr, "cannot open %s\n", argv[i]);
+      return 1;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+      if (!runFile(argv[i])) return 1;
+      runs++;
+      continue;
+    }
+
+    std::vector<std::string> files;
+    DIR* dir = opendir(argv[i]);
+    for (struct dirent* e = dir ? readdir(dir) : nullptr; e; e = readdir(dir)) {
+      if (e->d_name[0] != '.') files.push_back(std::string(argv[i]) + "/" + e->d_name);
+    }
+    if (dir) closedir(dir);
+    std::sort(files.begin(), files.end());
+    for (const std::string& path : files) {
+      if (!runFile(path)) return 1;
+      runs++;
+    }
+  }
+
+  printf("Executed %zu inputs\n", runs);
+  return runs ? 0 : 1;
+}
@@ -0,0 +1,37 @@
+// Bytes into BinaryChannel::feed() with the channel active: framing, CRC,
+// SET/GET, streaming and snapshot/restore payloads. update() runs after
+// every byte so a requested stream is sent while input still arrives.
+#include <Arduino.h>
+#include <Preferences.h>
+#include "BinaryChannel.h"
+#include "StateSnapshot.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  Preferences::eraseAll();
+
+  WaveformGenerator waveform;
+  AlarmManager alarms;
+  DeviceState device;
+  ProtocolTrace trace;
+  ConfigStorage storage;
+  HardwareSerial port;
+  ProtocolHandler protocol(device, waveform, alarms, port, trace);
+  StateSnapshot snapshot(device, waveform, alarms, protocol);
+  BinaryChannel binary(waveform, alarms, device, storage, port);
+  protocol.begin();
+  storage.begin();
+  storage.setAutosave(true);
+  binary.setSnapshot(&snapshot);
+  binary.activate();
+
+  for (size_t i = 0; i < size; i++) {
+    binary.feed(data[i]);
+    delay(1);
+    binary.update();
+    snapshot.update();
+  }
+
+  delay(5000);
+  storage.update();
+  return 0;
+}
@@ -0,0 +1,30 @@
+// Console input to the whole headless emulator: CommandLineInterface line
+// parsing and every command handler behind it, including "binary", which
+// hands the rest of the input to BinaryChannel. The loop runs for 50 ms of
+// virtual time so queued requests are applied.
+#include <Arduino.h>
+#include <Preferences.h>
+#include "CO2Emulator.h"
+#include "Clock.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  Preferences::eraseAll();
+  Clock::useVirtual(0);
+  CMD_SERIAL.tx.clear();
+  CMD_SERIAL.rx.clear();
+  HOST_SERIAL.tx.clear();
+  HOST_SERIAL.rx.clear();
+
+  CO2Emulator* emu = new CO2Emulator();
+  emu->begin();
+  CMD_SERIAL.rx.insert(CMD_SERIAL.rx.end(), data, data + size);
+  for (int ms = 0; ms < 50; ms++) {
+    Clock::advance(1);
+    delay(1);
+    emu->update();
+  }
+
+  HOST_SERIAL.onReceiveCb = nullptr;
+  delete emu;
+  return 0;
+}
@@ -0,0 +1,38 @@
+// Host protocol bytes through ProtocolReceiver::feed(): FrameAssembler,
+// then ProtocolHandler::processCommand() and dispatchCommand() for every
+// frame it completes. The first input byte sets the gap between bytes in
+// 4 ms steps, so the inter-byte timeout is reached as well.
+#include <Arduino.h>
+#include <Preferences.h>
+#include "ProtocolReceiver.h"
+#include "ConfigStorage.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  if (size == 0) return 0;
+  Preferences::eraseAll();
+
+  DeviceState device;
+  WaveformGenerator waveform;
+  AlarmManager alarms;
+  ProtocolTrace trace;
+  HardwareSerial port;
+  ConfigStorage storage;
+  ProtocolHandler protocol(device, waveform, alarms, port, trace);
+  ProtocolReceiver receiver(protocol, port);
+  protocol.begin();
+  storage.begin();
+  storage.setAutosave(true);
+  protocol.setConfigStorage(&storage);
+
+  uint32_t gap = data[0] * 4;
+  uint32_t now = 0;
+  for (size_t i = 1; i < size; i++) {
+    receiver.feed(data[i], now);
+    now += gap;
+  }
+
+  // Settings written on the way are saved as the loop would save them
+  delay(5000);
+  storage.update();
+  return 0;
+}
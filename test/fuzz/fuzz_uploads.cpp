@@ -0,0 +1,78 @@
+// Request bodies the web server passes to the firmware, chosen by the
+// first input byte:
+//   0  POST /api/snapshot as sent: StateSnapshot::stage() and update()
+//   1  the same, but the input edits a freshly captured record that is then
+//      re-signed, so mutations get past the CRC to the field checks. The
+//      next byte cuts the state size (0xFF keeps it whole); the rest is
+//      XORed over the state.
+//   2  POST /api/recorder/upload: WaveformImporter fed in chunks of
+//      (next byte + 1) bytes
+#include <Arduino.h>
+#include <stddef.h>
+#include <vector>
+#include "StateSnapshot.h"
+#include "WaveformImporter.h"
+#include "ConfigStorage.h"
+
+static void stageSnapshot(const uint8_t* data, size_t size, bool edit) {
+  DeviceState device;
+  WaveformGenerator waveform;
+  AlarmManager alarms;
+  ProtocolTrace trace;
+  HardwareSerial port;
+  ProtocolHandler protocol(device, waveform, alarms, port, trace);
+  StateSnapshot snapshot(device, waveform, alarms, protocol);
+  protocol.begin();
+
+  std::vector<uint8_t> body(data, data + size);
+  if (edit) {
+    std::vector<uint8_t> rec(StateSnapshot::MAX_SIZE);
+    rec.resize(snapshot.capture(rec.data(), rec.size()));
+    const size_t state = offsetof(SnapshotRecord, state);
+    size_t stateSize = rec.size() - state - sizeof(uint32_t);
+    if (size > 0 && data[0] < stateSize) stateSize = data[0];
+    for (size_t i = 1; i < size && i - 1 < stateSize; i++) rec[state + i - 1] ^= data[i];
+
+    rec.resize(state + stateSize);
+    uint16_t size16 = stateSize;
+    memcpy(&rec[offsetof(SnapshotRecord, size)], &size16, sizeof(size16));
+    uint32_t crc = ConfigStorage::crc32(rec.data(), rec.size());
+    const uint8_t* p = (const uint8_t*)&crc;
+    rec.insert(rec.end(), p, p + sizeof(crc));
+    body = rec;
+  }
+
+  if (!snapshot.stage(body.data(), body.size())) snapshot.update();
+}
+
+static void importWaveform(const uint8_t* data, size_t size) {
+  if (size == 0) return;
+  size_t chunk = data[0] + 1;
+  data++;
+  size--;
+
+  // Each input starts from an empty filesystem
+  FS::eraseAll();
+  WaveformGenerator waveform;
+  WaveformRecorder recorder(waveform);
+  recorder.begin();
+  WaveformImporter importer(recorder);
+  if (!importer.begin()) return;
+  while (size) {
+    size_t n = size < chunk ? size : chunk;
+    if (!importer.feed(data, n)) return;
+    data += n;
+    size -= n;
+  }
+  importer.finish();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  if (size == 0) return 0;
+  switch (data[0] % 3) {
+    case 0: stageSnapshot(data + 1, size - 1, false); break;
+    case 1: stageSnapshot(data + 1, size - 1, true); break;
+    case 2: importWaveform(data + 1, size - 1); break;
+  }
+  return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+#include <vector>
+
+// Minimal runner for the host suites. Each suite is one executable whose
+// main() returns HostTest::runAll(); CHECK failures are reported and
+// counted, and the case carries on so one run shows every mismatch.
+namespace HostTest {
+
+struct Case {
+  const char* name;
+  void (*fn)();
+};
+
+inline std::vector<Case>& cases() {
+  static std::vector<Case> all;
+  return all;
+}
+
+inline int& failures() {
+  static int count = 0;
+  return count;
+}
+
+struct Registrar {
+  Registrar(const char* name, void (*fn)()) { cases().push_back(Case{name, fn}); }
+};
+
+inline bool check(bool ok, const char* expr, const char* file, int line) {
+  if (!ok) {
+    printf("  %s:%d: CHECK(%s) failed\n", file, line, expr);
+    failures()++;
+  }
+  return ok;
+}
+
+inline bool checkEq(long long actual, long long expected, const char* expr, const char* file, int line) {
+  if (actual != expected) {
+    printf("  %s:%d: %s == %lld, expected %lld\n", file, line, expr, actual, expected);
+    failures()++;
+  }
+  return actual == expected;
+}
+
+inline int runAll() {
+  for (const Case& c : cases()) {
+    int before = failures();
+    c.fn();
+    printf("%s %s\n", failures() == before ? "PASS" : "FAIL", c.name);
+  }
+  printf("%d case(s), %d failure(s)\n", (int)cases().size(), failures());
+  return failures() ? 1 : 0;
+}
+
+}  // namespace HostTest
+
+#define TEST_CASE(name) \
+  static void name(); \
+  static HostTest::Registrar name##Registrar(#name, name); \
+  static void name()
+
+#define CHECK(cond) HostTest::check((cond), #cond, __FILE__, __LINE__)
+#define CHECK_EQ(actual, expected) \
+  HostTest::checkEq((long long)(actual), (long long)(expected), #actual, __FILE__, __LINE__)
+
+#endif // HOST_TEST_H
@@ -0,0 +1,95 @@
+// Breath validity against the no-breath timeout, and what each alarm
+// condition does once breaths stop.
+#include <Arduino.h>
+#include <math.h>
+#include "AlarmManager.h"
+#include "BreathDetector.h"
+#include "HostTest.h"
+
+static const uint32_t SAMPLE_MS = 10;
+static const uint32_t TIMEOUT_MS = 20000;
+
+// 0-40 mmHg at 12 br/min, in 0.01 mmHg
+static int32_t breathing(uint32_t t) {
+  return (int32_t)(2000.0f - 2000.0f * cosf(2.0f * (float)M_PI * t / 5000.0f));
+}
+
+class Rig {
+public:
+  BreathDetector detector;
+  AlarmManager alarms;
+  uint32_t now = 1000;
+
+  Rig() {
+    alarms.setLowThreshold(30);
+    alarms.setHighThreshold(35);
+    alarms.setRRLowThreshold(8);
+    alarms.setRRHighThreshold(10);
+    alarms.enableLow(true);
+    alarms.enableHigh(true);
+    alarms.enableRRLow(true);
+    alarms.enableRRHigh(true);
+  }
+
+  BreathDetector::Status run(uint32_t ms, bool breathe) {
+    for (uint32_t end = now + ms; now < end; now += SAMPLE_MS) {
+      detector.update(now, breathe ? breathing(now) : 0);
+      alarms.evaluate(now, detector.getETCO2(), detector.getRespRate(),
+                      detector.status(now, TIMEOUT_MS));
+    }
+    return detector.status(now, TIMEOUT_MS);
+  }
+
+  bool active(AlarmManager::Condition c) { return alarms.getStatusWord() & (1 << c); }
+};
+
+TEST_CASE(statusFollowsTheAgeOfTheLastBreath) {
+  Rig rig;
+  CHECK_EQ(rig.detector.status(rig.now, TIMEOUT_MS), BreathDetector::WAITING);
+  CHECK_EQ(rig.run(30000, true), BreathDetector::BREATHING);
+  CHECK_EQ(rig.run(TIMEOUT_MS - 3000, false), BreathDetector::BREATHING);
+  CHECK_EQ(rig.run(3000, false), BreathDetector::NO_BREATH);
+  CHECK_EQ(rig.run(30000, false), BreathDetector::NO_BREATH);
+  CHECK_EQ(rig.run(10000, true), BreathDetector::BREATHING);
+}
+
+TEST_CASE(noBreathFromBootTimesOut) {
+  Rig rig;
+  CHECK_EQ(rig.run(TIMEOUT_MS - 100, false), BreathDetector::WAITING);
+  CHECK_EQ(rig.alarms.getStatusWord(), 0);
+  CHECK_EQ(rig.run(200, false), BreathDetector::NO_BREATH);
+}
+
+// Breathing at 40 mmHg / 12 br/min raises both highs; apnoea must swap
+// them for both lows
+TEST_CASE(apnoeaRaisesLowsAndClearsHighs) {
+  Rig rig;
+  rig.run(30000, true);
+  CHECK(rig.active(AlarmManager::ETCO2_HIGH));
+  CHECK(rig.active(AlarmManager::RR_HIGH));
+  CHECK(!rig.active(AlarmManager::ETCO2_LOW));
+  CHECK(!rig.active(AlarmManager::RR_LOW));
+
+  rig.run(TIMEOUT_MS + 3000, false);
+  CHECK(!rig.active(AlarmManager::ETCO2_HIGH));
+  CHECK(!rig.active(AlarmManager::RR_HIGH));
+  CHECK(rig.active(AlarmManager::ETCO2_LOW));
+  CHECK(rig.active(AlarmManager::RR_LOW));
+  CHECK_EQ(rig.alarms.getHighestPriority(), AlarmManager::PRIORITY_HIGH);
+
+  rig.run(30000, true);
+  CHECK(!rig.active(AlarmManager::ETCO2_LOW));
+  CHECK(!rig.active(AlarmManager::RR_LOW));
+}
+
+TEST_CASE(lowAlarmsSetToZeroStayQuiet) {
+  Rig rig;
+  rig.alarms.setLowThreshold(0);
+  rig.alarms.setRRLowThreshold(0);
+  rig.run(TIMEOUT_MS + 5000, false);
+  CHECK_EQ(rig.alarms.getStatusWord(), 0);
+}
+
+int main() {
+  return HostTest::runAll();
+}
@@ -0,0 +1,245 @@
+// ConfigStorage records and presets written by older schemas, built byte
+// for byte as those firmware versions laid them out, and stored settings
+// outside their ISB ranges.
+#include <Arduino.h>
+#include <Preferences.h>
+#include <stddef.h>
+#include <vector>
+#include "ConfigStorage.h"
+#include "DeviceState.h"
+#include "HostTest.h"
+
+typedef ConfigStorage::Config Config;
+
+// sizeof(Config) of the v1 and v2 writers, including their tail padding
+static const size_t V1_SIZE = offsetof(Config, rrHigh);
+static const size_t V2_SIZE = offsetof(Config, alarmLatching) + sizeof(bool) + 1;
+
+template <typename T> static void put(std::vector<uint8_t>& blob, T value) {
+  const uint8_t* p = (const uint8_t*)&value;
+  blob.insert(blob.end(), p, p + sizeof(T));
+}
+
+static void putCrc(std::vector<uint8_t>& blob) {
+  put<uint32_t>(blob, ConfigStorage::crc32(blob.data(), blob.size()));
+}
+
+// The first `size` bytes of cfg, with whatever the writer left in padding
+// replaced by `fill`
+static std::vector<uint8_t> configBytes(const Config& cfg, size_t size, uint8_t fill) {
+  std::vector<uint8_t> bytes(size, fill);
+  Config c = cfg;
+  memcpy(bytes.data(), &c, offsetof(Config, useI2CSensor) + sizeof(bool));
+  if (size > V1_SIZE) {
+    memcpy(bytes.data() + offsetof(Config, rrHigh), &c.rrHigh,
+           offsetof(Config, alarmLatching) + sizeof(bool) - offsetof(Config, rrHigh));
+  }
+  return bytes;
+}
+
+static std::vector<uint8_t> record(uint16_t version, const std::vector<uint8_t>& config) {
+  std::vector<uint8_t> blob;
+  put<uint16_t>(blob, 0xC02E);
+  put<uint16_t>(blob, version);
+  put<uint16_t>(blob, config.size());
+  put<uint16_t>(blob, 0);
+  put<uint32_t>(blob, 7);
+  blob.insert(blob.end(), config.begin(), config.end());
+  putCrc(blob);
+  return blob;
+}
+
+static void store(const char* key, const std::vector<uint8_t>& blob) {
+  Preferences prefs;
+  prefs.begin("co2-emulator");
+  prefs.putBytes(key, blob.data(), blob.size());
+}
+
+static Config sample() {
+  Config cfg = ConfigStorage::defaults();
+  cfg.amplitude = 41.5;
+  cfg.frequency = 0.5;
+  cfg.alarmHigh = 55;
+  cfg.alarmHighEnabled = true;
+  cfg.rrHigh = 40;
+  cfg.rrLow = 6;
+  cfg.rrLowEnabled = true;
+  cfg.alarmLatching = true;
+  return cfg;
+}
+
+TEST_CASE(v2RecordPaddingDoesNotLeakIntoV3Fields) {
+  Preferences::eraseAll();
+  store("config", record(2, configBytes(sample(), V2_SIZE, 0xAA)));
+
+  ConfigStorage storage;
+  storage.begin();
+  Config cfg = storage.loadConfig();
+  Config def = ConfigStorage::defaults();
+  CHECK(cfg.amplitude == 41.5f);
+  CHECK(cfg.rrHigh == 40.0f);
+  CHECK(cfg.rrLowEnabled);
+  CHECK(cfg.alarmLatching);
+  CHECK_EQ(cfg.etco2TimePeriod, def.etco2TimePeriod);
+  CHECK_EQ(cfg.noBreathTimeout, def.noBreathTimeout);
+  CHECK_EQ(cfg.co2Units, def.co2Units);
+  CHECK_EQ(cfg.zeroGasType, def.zeroGasType);
+
+  // Rewritten in the current schema on load
+  Preferences prefs;
+  prefs.begin("co2-emulator");
+  CHECK_EQ(prefs.getBytesLength("config"), 12 + sizeof(Config) + 4);
+}
+
+TEST_CASE(v1RecordTakesV2AndV3Defaults) {
+  Preferences::eraseAll();
+  store("config", record(1, configBytes(sample(), V1_SIZE, 0xAA)));
+
+  ConfigStorage storage;
+  storage.begin();
+  Config cfg = storage.loadConfig();
+  Config def = ConfigStorage::defaults();
+  CHECK(cfg.amplitude == 41.5f);
+  CHECK(cfg.alarmHighEnabled);
+  CHECK(cfg.rrHigh == def.rrHigh);
+  CHECK(cfg.rrLowEnabled == def.rrLowEnabled);
+  CHECK(cfg.alarmLatching == def.alarmLatching);
+  CHECK_EQ(cfg.etco2TimePeriod, def.etco2TimePeriod);
+}
+
+TEST_CASE(v2PresetsTakeV3Defaults) {
+  Preferences::eraseAll();
+  std::vector<uint8_t> blob;
+  put<uint16_t>(blob, 0xC02F);
+  put<uint16_t>(blob, 2);
+  put<uint16_t>(blob, 1);
+  put<uint16_t>(blob, V2_SIZE);
+  char name[ConfigStorage::PRESET_NAME_LEN] = "old";
+  blob.insert(blob.end(), name, name + sizeof(name));
+  std::vector<uint8_t> config = configBytes(sample(), V2_SIZE, 0xAA);
+  blob.insert(blob.end(), config.begin(), config.end());
+  putCrc(blob);
+  store("presets", blob);
+
+  ConfigStorage storage;
+  storage.begin();
+  Config cfg;
+  CHECK(storage.getPreset("old", cfg));
+  CHECK(cfg.rrHigh == 40.0f);
+  CHECK_EQ(cfg.etco2TimePeriod, ConfigStorage::defaults().etco2TimePeriod);
+}
+
+TEST_CASE(unknownVersionsAreRejected) {
+  Preferences::eraseAll();
+  std::vector<uint8_t> config = configBytes(sample(), V2_SIZE, 0);
+  store("config", record(0, config));
+  ConfigStorage storage;
+  storage.begin();
+  CHECK(storage.loadConfig().amplitude == ConfigStorage::defaults().amplitude);
+}
+
+TEST_CASE(storedIsbSettingsAreClampedToTheirRanges) {
+  Config cfg = ConfigStorage::defaults();
+  cfg.etco2TimePeriod = 0;
+  cfg.noBreathTimeout = 200;
+  cfg.co2Units = 9;
+  cfg.zeroGasType = 0xAA;
+
+  DeviceState device;
+  device.loadFromConfig(cfg);
+  CHECK_EQ(device.getETCO2TimePeriod(), 1);
+  CHECK_EQ(device.getNoBreathTimeout(), 60);
+  CHECK_EQ(device.getCO2Units(), DeviceState::UNITS_KPA);
+  CHECK_EQ(device.getZeroGasType(), 1);
+
+  cfg = ConfigStorage::defaults();
+  device.loadFromConfig(cfg);
+  CHECK_EQ(device.getETCO2TimePeriod(), cfg.etco2TimePeriod);
+  CHECK_EQ(device.getNoBreathTimeout(), cfg.noBreathTimeout);
+}
+
+TEST_CASE(presetTableRoundTrips) {
+  Preferences::eraseAll();
+  char names[ConfigStorage::MAX_PRESETS][ConfigStorage::PRESET_NAME_LEN];
+  {
+    ConfigStorage storage;
+    storage.begin();
+    Config cfg = sample();
+    for (uint8_t i = 0; i < ConfigStorage::MAX_PRESETS; i++) {
+      char name[8];
+      snprintf(name, sizeof(name), "p%u", i);
+      cfg.amplitude = i;
+      CHECK(storage.savePreset(name, cfg));
+    }
+    CHECK(!storage.savePreset("extra", cfg));
+    CHECK(storage.savePreset("p3", sample()));
+    CHECK(storage.deletePreset("p0"));
+    CHECK(!storage.deletePreset("p0"));
+    CHECK_EQ(storage.getPresetNames(names), ConfigStorage::MAX_PRESETS - 1);
+    CHECK(strcmp(names[0], "p1") == 0);
+  }
+
+  ConfigStorage storage;
+  storage.begin();
+  CHECK_EQ(storage.getPresetNames(names), ConfigStorage::MAX_PRESETS - 1);
+  CHECK(strcmp(names[ConfigStorage::MAX_PRESETS - 2], "p15") == 0);
+  Config cfg;
+  CHECK(storage.getPreset("p3", cfg));
+  CHECK(cfg.amplitude == 41.5f);
+  CHECK(storage.getPreset("p9", cfg));
+  CHECK(cfg.amplitude == 9.0f);
+  CHECK(!storage.getPreset("p0", cfg));
+}
+
+// Names sharing their first 15 characters used to collide
+TEST_CASE(presetNamesMatchWholeAndIgnoreCase) {
+  Preferences::eraseAll();
+  ConfigStorage storage;
+  storage.begin();
+  Config cfg = sample();
+  CHECK(!storage.savePreset("", cfg));
+  CHECK(!storage.savePreset("sixteen-chars-xx", cfg));
+  CHECK(storage.savePreset("fifteen-chars-a", cfg));
+  cfg.amplitude = 20;
+  CHECK(storage.savePreset("fifteen-chars", cfg));
+  CHECK_EQ(storage.getPresetCount(), 2);
+  CHECK(!storage.getPreset("fifteen-chars-ab", cfg));
+  CHECK(storage.getPreset("fifteen-chars-a", cfg));
+  CHECK(cfg.amplitude == 41.5f);
+
+  cfg.amplitude = 30;
+  CHECK(storage.savePreset("Rest", cfg));
+  CHECK(storage.savePreset("REST", sample()));
+  CHECK_EQ(storage.getPresetCount(), 3);
+  char names[ConfigStorage::MAX_PRESETS][ConfigStorage::PRESET_NAME_LEN];
+  storage.getPresetNames(names);
+  CHECK(strcmp(names[2], "rest") == 0);
+  CHECK(storage.getPreset("rest", cfg));
+  CHECK(cfg.amplitude == 41.5f);
+  CHECK(storage.deletePreset("rESt"));
+}
+
+TEST_CASE(clearKeepsPresetsAndWriteCount) {
+  Preferences::eraseAll();
+  {
+    ConfigStorage storage;
+    storage.begin();
+    storage.saveConfig(sample());
+    CHECK(storage.savePreset("rest", sample()));
+    uint32_t writes = storage.getWriteCount();
+    storage.clearConfig();
+    CHECK_EQ(storage.getWriteCount(), writes);
+    CHECK_EQ(storage.getPresetCount(), 1);
+    CHECK(storage.loadConfig().amplitude == ConfigStorage::defaults().amplitude);
+  }
+
+  ConfigStorage storage;
+  storage.begin();
+  Config cfg;
+  CHECK(storage.getPreset("rest", cfg));
+  CHECK(cfg.amplitude == 41.5f);
+}
+
+int main() {
+  return HostTest::runAll();
+}
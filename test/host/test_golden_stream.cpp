@@ -0,0 +1,193 @@
+// Scripted host sessions run against the whole headless emulator on virtual
+// time. Every byte sent to the host is logged with the millisecond it left,
+// one frame per line, and compared with the file of the same name in
+// test/golden/. A protocol, waveform or timing change shows up as a diff of
+// that file; regenerate with UPDATE_GOLDEN=1 once the change is intended.
+#include <Arduino.h>
+#include <Preferences.h>
+#include <initializer_list>
+#include <string>
+#include "CO2Emulator.h"
+#include "PacketBuilder.h"
+#include "Clock.h"
+#include "HostTest.h"
+
+class Session {
+private:
+  CO2Emulator* emu;
+  std::string log;
+  size_t consumed;
+
+  void capture() {
+    std::vector<uint8_t>& tx = HOST_SERIAL.tx;
+    while (consumed + 2 <= tx.size()) {
+      size_t len = (tx[consumed] & 0x80) ? tx[consumed + 1] + 2 : tx.size() - consumed;
+      if (consumed + len > tx.size()) break;
+      char line[16];
+      snprintf(line, sizeof(line), "%7lu:", (unsigned long)Clock::nowMs());
+      log += line;
+      for (size_t i = 0; i < len; i++) {
+        snprintf(line, sizeof(line), " %02X", tx[consumed + i]);
+        log += line;
+      }
+      log += "\n";
+      consumed += len;
+    }
+  }
+
+public:
+  Session() : emu(nullptr), consumed(0) {
+    Preferences::eraseAll();
+    Clock::useVirtual(0);
+    HOST_SERIAL.tx.clear();
+    HOST_SERIAL.rx.clear();
+    emu = new CO2Emulator();
+    emu->begin();
+    capture();
+  }
+
+  ~Session() {
+    HOST_SERIAL.onReceiveCb = nullptr;
+    delete emu;
+  }
+
+  void note(const char* step) {
+    log += "# ";
+    log += step;
+    log += "\n";
+  }
+
+  // Frames a command the way the host does: cmd, NBF, data, checksum
+  void send(std::initializer_list<uint8_t> cmdAndData) {
+    std::vector<uint8_t> frame(cmdAndData.begin(), cmdAndData.end());
+    frame.insert(frame.begin() + 1, (uint8_t)frame.size());
+    frame.push_back(PacketBuilder::calculateChecksum(frame.data(), frame.size()));
+    sendRaw(frame);
+  }
+
+  void sendRaw(const std::vector<uint8_t>& bytes) {
+    HOST_SERIAL.inject(bytes.data(), bytes.size());
+    capture();
+  }
+
+  void run(uint32_t ms) {
+    while (ms--) {
+      Clock::advance(1);
+      emu->update();
+      capture();
+    }
+  }
+
+  void compare(const char* name) {
+    std::string path = std::string(GOLDEN_DIR) + "/" + name + ".txt";
+    if (getenv("UPDATE_GOLDEN")) {
+      FILE* f = fopen(path.c_str(), "wb");
+      if (!CHECK(f != nullptr)) return;
+      fwrite(log.data(), 1, log.size(), f);
+      fclose(f);
+      return;
+    }
+
+    std::string expected;
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!CHECK(f != nullptr)) return;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) expected.append(buf, n);
+    fclose(f);
+
+    if (log == expected) return;
+    size_t line = 1, i = 0;
+    while (i < log.size() && i < expected.size() && log[i] == expected[i]) {
+      if (log[i] == '\n') line++;
+      i++;
+    }
+    printf("  %s differs from golden at line %u\n", name, (unsigned)line);
+    CHECK(log == expected);
+  }
+};
+
+TEST_CASE(startContinuousAndStop) {
+  Session s;
+  s.note("get revision, sensor capabilities");
+  s.send({ 0xCA, 0x00 });
+  s.send({ 0xCB, 0x00 });
+  s.note("start continuous mode, run past the first DPI");
+  s.send({ 0x80 });
+  s.run(1050);
+  s.note("stop; nothing may follow");
+  s.send({ 0xC9 });
+  s.run(100);
+  s.compare("start_stop");
+}
+
+TEST_CASE(compensationsAndZero) {
+  Session s;
+  s.send({ 0x80 });
+  s.run(50);
+  s.note("zero before compensations are set: rejected");
+  s.send({ 0x82 });
+  s.run(20);
+  s.note("baro 760 mmHg, then O2 21 %, N2 balance, no agent");
+  s.send({ 0x84, 0x01, 0x05, 0x78 });
+  s.send({ 0x84, 0x0B, 0x15, 0x00, 0x00, 0x00 });
+  s.run(20);
+  s.note("zero accepted, second request while zeroing rejected");
+  s.send({ 0x82 });
+  s.run(500);
+  s.send({ 0x82 });
+  s.run(1700);
+  s.note("zero finished: accepted again");
+  s.send({ 0x82 });
+  s.run(20);
+  s.send({ 0xC9 });
+  s.compare("compensations_zero");
+}
+
+TEST_CASE(unitsAndSettings) {
+  Session s;
+  s.send({ 0x84, 0x01, 0x05, 0x78 });
+  s.send({ 0x80 });
+  s.run(40);
+  s.note("CO2 in percent");
+  s.send({ 0x84, 0x07, 0x01 });
+  s.run(40);
+  s.note("CO2 in kPa");
+  s.send({ 0x84, 0x07, 0x02 });
+  s.run(40);
+  s.note("back to mmHg; read back period, timeout, temperature, text ISB");
+  s.send({ 0x84, 0x07, 0x00 });
+  s.send({ 0x84, 0x05 });
+  s.send({ 0x84, 0x06 });
+  s.send({ 0x84, 0x04 });
+  s.send({ 0x84, 0x12 });
+  s.run(20);
+  s.send({ 0xC9 });
+  s.compare("units_settings");
+}
+
+TEST_CASE(malformedFrames) {
+  Session s;
+  s.note("bad checksum");
+  s.sendRaw({ 0x80, 0x01, 0x00 });
+  s.note("unknown command");
+  s.send({ 0xC0 });
+  s.note("unsupported ISB, out-of-range value, read-only ISB");
+  s.send({ 0x84, 0x02 });
+  s.send({ 0x84, 0x01, 0x00, 0x10 });
+  s.send({ 0x84, 0x13, 0x01 });
+  s.note("truncated ISB write");
+  s.send({ 0x84, 0x0B, 0x15 });
+  s.note("partial frame, next data byte after the byte timeout");
+  s.sendRaw({ 0x84, 0x03 });
+  s.run(600);
+  s.sendRaw({ 0x05 });
+  s.note("a command byte always starts a new frame");
+  s.sendRaw({ 0x84, 0x03 });
+  s.sendRaw({ 0xC9, 0x01, 0x36 });
+  s.compare("malformed_frames");
+}
+
+int main() {
+  return HostTest::runAll();
+}
@@ -0,0 +1,253 @@
+// I2CSensorInterface and the CO2SensorDriver models against a mock I2CBus:
+// conversion, CRC failures, NACKs, stale readings and the polling rate.
+#include <Arduino.h>
+#include <map>
+#include <vector>
+#include "I2CSensorInterface.h"
+#include "HostTest.h"
+
+// Devices answer with a fixed reply until changed; a NACKing device fails
+// every transaction, including the probe
+class MockBus : public I2CBus {
+public:
+  struct Device {
+    bool nack = false;
+    std::vector<uint8_t> reply;
+    std::vector<std::vector<uint8_t> > writes;
+    uint32_t reads = 0;
+  };
+
+  std::map<uint8_t, Device> devices;
+  uint32_t clockHz = 0;
+
+  bool begin(uint32_t hz) override { clockHz = hz; return true; }
+  void setClock(uint32_t hz) override { clockHz = hz; }
+
+  bool probe(uint8_t address) override {
+    return answering(address) != nullptr;
+  }
+
+  bool write(uint8_t address, const uint8_t* data, size_t len) override {
+    Device* d = answering(address);
+    if (!d) return false;
+    d->writes.push_back(std::vector<uint8_t>(data, data + len));
+    return true;
+  }
+
+  bool read(uint8_t address, uint8_t* data, size_t len) override {
+    Device* d = answering(address);
+    if (!d || d->reply.size() < len) return false;
+    memcpy(data, d->reply.data(), len);
+    d->reads++;
+    return true;
+  }
+
+private:
+  Device* answering(uint8_t address) {
+    auto it = devices.find(address);
+    return (it == devices.end() || it->second.nack) ? nullptr : &it->second;
+  }
+};
+
+static const uint8_t SCD30 = 0x61;
+static const uint8_t SCD4X = 0x62;
+
+// Sensirion word with its CRC byte appended
+static void putWord(std::vector<uint8_t>& out, uint16_t word) {
+  uint8_t b[2] = { (uint8_t)(word >> 8), (uint8_t)word };
+  out.insert(out.end(), b, b + 2);
+  out.push_back(CO2SensorDriver::sensirionCRC(b, 2));
+}
+
+static std::vector<uint8_t> scd30Reply(float ppm) {
+  uint32_t bits;
+  memcpy(&bits, &ppm, sizeof(bits));
+  std::vector<uint8_t> out;
+  putWord(out, bits >> 16);
+  putWord(out, bits & 0xFFFF);
+  for (int i = 0; i < 4; i++) putWord(out, 0);
+  return out;
+}
+
+static std::vector<uint8_t> scd4xReply(uint16_t ppm) {
+  std::vector<uint8_t> out;
+  putWord(out, ppm);
+  putWord(out, 0);
+  putWord(out, 0);
+  return out;
+}
+
+static const float PPM_40_MMHG = 40.0f * 1000000.0f / 760.0f;
+
+class Rig {
+public:
+  MockBus bus;
+  I2CSensorInterface sensor;
+  uint32_t now = 0;
+
+  Rig() : sensor(bus) {}
+
+  // Polls once per millisecond, like the main loop
+  void run(uint32_t ms) {
+    for (uint32_t end = now + ms; now < end; now++) sensor.update(now);
+  }
+
+  bool sample(int32_t& centi) { return sensor.getSample(centi); }
+};
+
+TEST_CASE(absentSensorGivesNoSample) {
+  Rig rig;
+  CHECK(!rig.sensor.begin());
+  rig.run(100);
+  int32_t centi;
+  CHECK(!rig.sample(centi));
+  CHECK_EQ(rig.sensor.getReadCount(), 0u);
+}
+
+TEST_CASE(scd30InitConvertAndResample) {
+  Rig rig;
+  rig.bus.devices[SCD30].reply = scd30Reply(PPM_40_MMHG);
+  CHECK(rig.sensor.begin());
+  CHECK(strcmp(rig.sensor.getActiveDriverName(), "scd30") == 0);
+  CHECK_EQ(rig.bus.clockHz, 100000u);
+
+  // Measurement interval 2 s, then continuous measurement
+  const std::vector<std::vector<uint8_t> >& init = rig.bus.devices[SCD30].writes;
+  const uint8_t seconds[] = { 0x00, 0x02 };
+  CHECK_EQ(init.size(), 2u);
+  CHECK(init[0] == std::vector<uint8_t>({ 0x46, 0x00, 0x00, 0x02, CO2SensorDriver::sensirionCRC(seconds, 2) }));
+  CHECK(init[1].size() == 5 && init[1][0] == 0x00 && init[1][1] == 0x10);
+
+  rig.run(5000);
+  int32_t centi = 0;
+  CHECK(rig.sample(centi));
+  CHECK_EQ(centi, 4000);
+  CHECK(rig.sensor.getLastReading() > 39.99f && rig.sensor.getLastReading() < 40.01f);
+  CHECK_EQ(rig.sensor.getFailedCount(), 0u);
+}
+
+TEST_CASE(crcFailuresAreCountedAndNotUsed) {
+  Rig rig;
+  rig.bus.devices[SCD30].reply = scd30Reply(PPM_40_MMHG);
+  rig.bus.devices[SCD30].reply[5] ^= 0x01;
+  rig.sensor.begin();
+  rig.run(6500);
+  int32_t centi;
+  CHECK(!rig.sample(centi));
+  CHECK_EQ(rig.sensor.getReadCount(), 0u);
+  CHECK_EQ(rig.sensor.getFailedCount(), 3u);
+
+  Rig scd4x;
+  scd4x.bus.devices[SCD4X].reply = scd4xReply(5263);
+  scd4x.bus.devices[SCD4X].reply[2] ^= 0x80;
+  scd4x.sensor.begin();
+  scd4x.run(5500);
+  CHECK_EQ(scd4x.sensor.getReadCount(), 0u);
+  CHECK_EQ(scd4x.sensor.getFailedCount(), 1u);
+}
+
+// SCD4x reports 0 ppm until its first measurement is ready
+TEST_CASE(scd4xZeroMeansNoDataYet) {
+  Rig rig;
+  rig.bus.devices[SCD4X].reply = scd4xReply(0);
+  CHECK(rig.sensor.begin());
+  rig.run(5100);
+  CHECK_EQ(rig.sensor.getFailedCount(), 1u);
+  int32_t centi;
+  CHECK(!rig.sample(centi));
+
+  rig.bus.devices[SCD4X].reply = scd4xReply(5263);
+  rig.run(10000);
+  CHECK(rig.sample(centi));
+  CHECK(centi >= 399 && centi <= 400);
+}
+
+TEST_CASE(nackFailsThenGoesStaleOnce) {
+  Rig rig;
+  rig.bus.devices[SCD30].reply = scd30Reply(PPM_40_MMHG);
+  rig.sensor.begin();
+  rig.run(4500);
+  int32_t centi;
+  CHECK(rig.sample(centi));
+  uint32_t reads = rig.sensor.getReadCount();
+
+  rig.bus.devices[SCD30].nack = true;
+  rig.run(5000);
+  CHECK(rig.sample(centi));            // within three intervals of the last reading
+  CHECK(rig.sensor.getFailedCount() > 0);
+  CHECK_EQ(rig.sensor.getStaleCount(), 0u);
+
+  // Stale for many polls and reads, but one stale reading
+  rig.run(10000);
+  for (int i = 0; i < 100; i++) CHECK(!rig.sample(centi));
+  CHECK_EQ(rig.sensor.getStaleCount(), 1u);
+  CHECK_EQ(rig.sensor.getReadCount(), reads);
+
+  rig.bus.devices[SCD30].nack = false;
+  rig.run(4000);
+  CHECK(rig.sample(centi));
+  CHECK_EQ(centi, 4000);
+
+  rig.bus.devices[SCD30].nack = true;
+  rig.run(10000);
+  CHECK_EQ(rig.sensor.getStaleCount(), 2u);
+}
+
+// Plugged in after boot, both auto-detected and forced
+TEST_CASE(absentSensorIsPickedUpWhenPluggedIn) {
+  Rig rig;
+  CHECK(!rig.sensor.begin());
+  rig.run(3000);
+  rig.bus.devices[SCD30].reply = scd30Reply(PPM_40_MMHG);
+  rig.run(1000);
+  CHECK(rig.sensor.isAvailable());
+  CHECK(strcmp(rig.sensor.getActiveDriverName(), "scd30") == 0);
+  CHECK_EQ(rig.bus.devices[SCD30].writes.size(), 2u);
+  rig.run(5000);
+  int32_t centi = 0;
+  CHECK(rig.sample(centi));
+  CHECK_EQ(centi, 4000);
+
+  Rig forced;
+  forced.sensor.begin();
+  forced.sensor.requestDriver(forced.sensor.findDriver("scd4x"));
+  forced.run(2000);
+  CHECK(!forced.sensor.isAvailable());
+  CHECK(strcmp(forced.sensor.getActiveDriverName(), "scd4x") == 0);
+  forced.bus.devices[SCD4X].reply = scd4xReply(5263);
+  forced.run(16000);
+  CHECK(forced.sensor.isAvailable());
+  CHECK(forced.sample(centi));
+  CHECK(centi >= 399 && centi <= 400);
+}
+
+TEST_CASE(commandsFollowTheNativeInterval) {
+  Rig rig;
+  rig.bus.devices[SCD30].reply = scd30Reply(PPM_40_MMHG);
+  rig.sensor.begin();
+  rig.run(20000);
+  // One interval after start, then one every 2 s
+  CHECK_EQ(rig.sensor.getReadCount(), 9u);
+  CHECK_EQ(rig.bus.devices[SCD30].writes.size(), 2u + 9u);
+
+  Rig scd4x;
+  scd4x.bus.devices[SCD4X].reply = scd4xReply(5263);
+  scd4x.sensor.begin();
+  scd4x.run(20000);
+  CHECK_EQ(scd4x.sensor.getReadCount(), 3u);
+
+  // The generic 100 Hz template: never faster than its interval
+  Rig generic;
+  generic.bus.devices[I2C_SENSOR_ADDR].reply = { 0x0F, 0xA0 };
+  generic.sensor.begin();
+  generic.run(1000);
+  uint32_t n = generic.sensor.getReadCount();
+  CHECK(n >= 45 && n <= 100);
+  int32_t centi;
+  CHECK(generic.sample(centi));
+  CHECK_EQ(centi, 4000);
+}
+
+int main() {
+  return HostTest::runAll();
+}
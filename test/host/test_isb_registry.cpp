@@ -0,0 +1,208 @@
+// Every ISB in IsbRegistry, driven through Get/Set Settings (0x84) on a
+// ProtocolHandler: reply shape, both range boundaries, values just outside
+// them, read-only and unsupported ISBs, and whether a write survives a
+// reboot through ConfigStorage.
+#include <Arduino.h>
+#include <Preferences.h>
+#include <vector>
+#include "ProtocolHandler.h"
+#include "IsbRegistry.h"
+#include "HostTest.h"
+
+class Rig {
+public:
+  DeviceState device;
+  WaveformGenerator waveform;
+  AlarmManager alarms;
+  ProtocolTrace trace;
+  HardwareSerial port;
+  ConfigStorage storage;
+  ProtocolHandler protocol;
+
+  Rig() : protocol(device, waveform, alarms, port, trace) {
+    protocol.begin();
+    storage.begin();
+    storage.setAutosave(true);
+    protocol.setConfigStorage(&storage);
+    device.loadFromConfig(storage.loadConfig());
+  }
+
+  // Sends 0x84 for the ISB with the given data bytes; returns the reply frame
+  std::vector<uint8_t> command(uint8_t isb, const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> frame = { Protocol::CMD_GET_SET_SETTINGS, 0, isb };
+    frame.insert(frame.end(), data.begin(), data.end());
+    frame[1] = frame.size() - 1;
+    frame.push_back(PacketBuilder::calculateChecksum(frame.data(), frame.size()));
+    port.tx.clear();
+    protocol.processCommand(frame.data(), frame.size());
+    return port.tx;
+  }
+
+  // Field values of a get reply; empty if the reply is not one
+  std::vector<uint16_t> get(uint8_t isb) {
+    return values(*IsbRegistry::find(isb), command(isb, {}));
+  }
+
+  static std::vector<uint16_t> values(const IsbRegistry::Entry& entry,
+                                      const std::vector<uint8_t>& reply) {
+    std::vector<uint16_t> out;
+    if (reply.size() != IsbRegistry::dataLength(entry) + 4u ||
+        reply[0] != Protocol::CMD_GET_SET_SETTINGS) return out;
+    size_t pos = 3;
+    for (uint8_t i = 0; i < entry.fieldCount; i++) {
+      if (entry.fields[i].width == 2) {
+        out.push_back(PacketBuilder::decode2Bytes(reply[pos], reply[pos + 1]));
+      } else {
+        out.push_back(reply[pos]);
+      }
+      pos += entry.fields[i].width;
+    }
+    return out;
+  }
+};
+
+static std::vector<uint8_t> encodeValues(const IsbRegistry::Entry& entry,
+                                         const std::vector<uint16_t>& values) {
+  std::vector<uint8_t> data;
+  for (uint8_t i = 0; i < entry.fieldCount; i++) {
+    if (entry.fields[i].width == 2) {
+      data.push_back((values[i] >> 7) & 0x7F);
+      data.push_back(values[i] & 0x7F);
+    } else {
+      data.push_back(values[i] & 0x7F);
+    }
+  }
+  return data;
+}
+
+static bool isNack(const std::vector<uint8_t>& reply, uint8_t code) {
+  return reply.size() == 4 && reply[0] == Protocol::CMD_NACK && reply[2] == code;
+}
+
+static uint16_t widthMax(const IsbRegistry::Field& f) {
+  return f.width == 2 ? 0x3FFF : 0x7F;
+}
+
+TEST_CASE(unsupportedIsbsAreRejected) {
+  Preferences::eraseAll();
+  Rig rig;
+  for (uint16_t isb = 0; isb <= 0x7F; isb++) {
+    if (IsbRegistry::find(isb)) continue;
+    CHECK(isNack(rig.command(isb, {}), Protocol::NACK_INVALID_DATA));
+    CHECK(isNack(rig.command(isb, { 0x01, 0x01 }), Protocol::NACK_INVALID_DATA));
+  }
+}
+
+TEST_CASE(getRepliesMatchTheTable) {
+  Preferences::eraseAll();
+  Rig rig;
+  for (uint8_t isb = 0; isb < IsbRegistry::COUNT; isb++) {
+    const IsbRegistry::Entry* entry = IsbRegistry::find(isb);
+    if (!entry) continue;
+    std::vector<uint8_t> reply = rig.command(isb, {});
+    CHECK_EQ(reply.size(), IsbRegistry::dataLength(*entry) + 4u);
+    CHECK_EQ(reply[2], isb);
+    if (entry->text) {
+      CHECK(std::string(reply.begin() + 3, reply.end() - 1) == entry->text);
+      continue;
+    }
+    std::vector<uint16_t> current = Rig::values(*entry, reply);
+    for (uint8_t i = 0; i < entry->fieldCount; i++) {
+      CHECK(current[i] >= entry->fields[i].min && current[i] <= entry->fields[i].max);
+    }
+  }
+}
+
+TEST_CASE(readOnlyIsbsRefuseWrites) {
+  Preferences::eraseAll();
+  Rig rig;
+  for (uint8_t isb = 0; isb < IsbRegistry::COUNT; isb++) {
+    const IsbRegistry::Entry* entry = IsbRegistry::find(isb);
+    if (!entry || entry->set) continue;
+    std::vector<uint8_t> before = rig.command(isb, {});
+    CHECK(isNack(rig.command(isb, std::vector<uint8_t>(IsbRegistry::dataLength(*entry), 0x01)),
+                 Protocol::NACK_INVALID_DATA));
+    CHECK(rig.command(isb, {}) == before);
+  }
+}
+
+TEST_CASE(writesAcceptBoundariesAndRejectOutside) {
+  Preferences::eraseAll();
+  Rig rig;
+  for (uint8_t isb = 0; isb < IsbRegistry::COUNT; isb++) {
+    const IsbRegistry::Entry* entry = IsbRegistry::find(isb);
+    if (!entry || !entry->set) continue;
+
+    for (uint8_t i = 0; i < entry->fieldCount; i++) {
+      const IsbRegistry::Field& f = entry->fields[i];
+      for (uint16_t bound : { f.min, f.max }) {
+        std::vector<uint16_t> want = rig.get(isb);
+        want[i] = bound;
+        std::vector<uint8_t> reply = rig.command(isb, encodeValues(*entry, want));
+        if (!CHECK(Rig::values(*entry, reply) == want)) {
+          printf("  ISB %u field %s = %u\n", isb, f.name, bound);
+        }
+        CHECK(rig.get(isb) == want);
+      }
+
+      std::vector<uint16_t> outside;
+      if (f.min > 0) outside.push_back(f.min - 1);
+      if (f.max < widthMax(f)) outside.push_back(f.max + 1);
+      for (uint16_t value : outside) {
+        std::vector<uint16_t> before = rig.get(isb);
+        std::vector<uint16_t> bad = before;
+        bad[i] = value;
+        if (!CHECK(isNack(rig.command(isb, encodeValues(*entry, bad)), Protocol::NACK_INVALID_DATA))) {
+          printf("  ISB %u field %s = %u accepted\n", isb, f.name, value);
+        }
+        CHECK(rig.get(isb) == before);
+      }
+    }
+
+    // One byte short of the field data
+    std::vector<uint8_t> shortData(IsbRegistry::dataLength(*entry) - 1, 0x00);
+    if (!shortData.empty()) {
+      CHECK(isNack(rig.command(isb, shortData), Protocol::NACK_BYTE_COUNT));
+    }
+  }
+}
+
+// Persistent ISBs come back after a reboot; the rest return to power-on values
+TEST_CASE(persistentWritesSurviveReboot) {
+  for (uint8_t isb = 0; isb < IsbRegistry::COUNT; isb++) {
+    const IsbRegistry::Entry* entry = IsbRegistry::find(isb);
+    if (!entry || !entry->set) continue;
+
+    for (bool useMax : { false, true }) {
+      Preferences::eraseAll();
+      std::vector<uint16_t> written;
+      {
+        Rig rig;
+        written = rig.get(isb);
+        for (uint8_t i = 0; i < entry->fieldCount; i++) {
+          written[i] = useMax ? entry->fields[i].max : entry->fields[i].min;
+        }
+        rig.command(isb, encodeValues(*entry, written));
+        rig.protocol.update(millis());
+        delay(5000);
+        rig.storage.update();
+      }
+
+      Rig fresh;
+      std::vector<uint16_t> expected = written;
+      if (!entry->persistent) {
+        DeviceState powerOn;
+        uint16_t v[IsbRegistry::MAX_FIELDS];
+        entry->get(powerOn, v);
+        expected.assign(v, v + entry->fieldCount);
+      }
+      if (!CHECK(fresh.get(isb) == expected)) {
+        printf("  ISB %u (%s) after reboot\n", isb, entry->persistent ? "persistent" : "volatile");
+      }
+    }
+  }
+}
+
+int main() {
+  return HostTest::runAll();
+}
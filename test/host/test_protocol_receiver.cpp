@@ -0,0 +1,65 @@
+// Command latency as ProtocolReceiver records it: from the estimated arrival
+// of a frame's last byte (derived from the receive event and the bytes still
+// buffered behind it) to the reply being queued for the UART.
+#include <Arduino.h>
+#include <string>
+#include "ProtocolReceiver.h"
+#include "HostTest.h"
+
+class Rig {
+public:
+  DeviceState device;
+  WaveformGenerator waveform;
+  AlarmManager alarms;
+  ProtocolTrace trace;
+  HardwareSerial port;
+  ProtocolHandler protocol;
+  ProtocolReceiver receiver;
+
+  Rig() : protocol(device, waveform, alarms, port, trace), receiver(protocol, port) {
+    port.begin(19200);
+    protocol.begin();
+    receiver.begin();
+  }
+
+  std::string latency() {
+    HardwareSerial out;
+    receiver.printLatency(out);
+    return std::string(out.tx.begin(), out.tx.end());
+  }
+};
+
+static const uint8_t STOP[] = { 0xC9, 0x01, 0x36 };
+static const uint32_t BYTE_US = 10000000UL / 19200;
+
+TEST_CASE(singleFrameCountsTheIdleCharacter) {
+  Rig rig;
+  rig.port.inject(STOP, sizeof(STOP));
+  std::string out = rig.latency();
+  CHECK(out.find("n=1 ") != std::string::npos);
+  CHECK(out.find("max=" + std::to_string(BYTE_US) + "us") != std::string::npos);
+}
+
+// The first frame's last byte was followed by three more on the wire
+TEST_CASE(framesBatchedInOneEventAreBackdated) {
+  Rig rig;
+  uint8_t two[sizeof(STOP) * 2];
+  memcpy(two, STOP, sizeof(STOP));
+  memcpy(two + sizeof(STOP), STOP, sizeof(STOP));
+  rig.port.inject(two, sizeof(two));
+  std::string out = rig.latency();
+  CHECK(out.find("n=2 ") != std::string::npos);
+  CHECK(out.find("max=" + std::to_string(4 * BYTE_US) + "us") != std::string::npos);
+}
+
+TEST_CASE(unansweredFramesAreNotCounted) {
+  Rig rig;
+  const uint8_t revisionNoFormat[] = { 0xCA, 0x01, 0x35 };
+  rig.port.inject(revisionNoFormat, sizeof(revisionNoFormat));
+  CHECK(rig.port.tx.empty());
+  CHECK(rig.latency().find("n=0") != std::string::npos);
+}
+
+int main() {
+  return HostTest::runAll();
+}
@@ -0,0 +1,135 @@
+// Waveform and alarm settings arriving on the binary channel and the text
+// CLI are checked against SettingLimits before anything is applied or
+// queued for saving.
+#include <Arduino.h>
+#include <Preferences.h>
+#include <math.h>
+#include <vector>
+#include "BinaryChannel.h"
+#include "CommandLineInterface.h"
+#include "HostTest.h"
+
+class Rig {
+public:
+  WaveformGenerator waveform;
+  AlarmManager alarms;
+  DeviceState device;
+  ConfigStorage storage;
+  HardwareSerial port;
+  BinaryChannel binary;
+  CommandLineInterface cli;
+
+  Rig() : binary(waveform, alarms, device, storage, port),
+          cli(waveform, alarms, device, storage, port) {
+    Preferences::eraseAll();
+    storage.begin();
+    storage.setAutosave(true);
+    waveform.loadFromConfig(ConfigStorage::defaults());
+    alarms.loadFromConfig(ConfigStorage::defaults());
+    binary.activate();
+  }
+
+  std::vector<uint8_t> set(const std::vector<std::pair<uint8_t, float> >& params) {
+    std::vector<uint8_t> frame = { BinaryChannel::SOF, BinaryChannel::TYPE_SET, 0 };
+    for (const auto& p : params) {
+      frame.push_back(p.first);
+      const uint8_t* bytes = (const uint8_t*)&p.second;
+      frame.insert(frame.end(), bytes, bytes + 4);
+    }
+    frame[2] = frame.size() - 3;
+    uint16_t crc = BinaryChannel::crc16(&frame[1], frame.size() - 1);
+    frame.push_back(crc & 0xFF);
+    frame.push_back(crc >> 8);
+
+    port.tx.clear();
+    for (uint8_t b : frame) binary.feed(b);
+    return port.tx;
+  }
+
+  void line(const char* text) {
+    port.tx.clear();
+    port.rx.insert(port.rx.end(), text, text + strlen(text));
+    port.rx.push_back('\n');
+    cli.update();
+  }
+
+  // True if an autosave was queued, flushing it
+  bool saved() {
+    uint32_t before = storage.getWriteCount();
+    delay(5000);
+    storage.update();
+    return storage.getWriteCount() != before;
+  }
+};
+
+static bool isNak(const std::vector<uint8_t>& reply, uint8_t error) {
+  return reply.size() == 6 && reply[1] == BinaryChannel::TYPE_NAK && reply[3] == error;
+}
+
+static bool isAck(const std::vector<uint8_t>& reply) {
+  return reply.size() >= 4 && reply[1] == (BinaryChannel::TYPE_SET | 0x80);
+}
+
+TEST_CASE(binarySetRejectsNonFiniteAndOutOfRange) {
+  const float bad[] = { NAN, INFINITY, -INFINITY, -1.0f, 1e9f };
+  for (uint8_t id = BinaryChannel::PARAM_AMPLITUDE; id < BinaryChannel::PARAM_COUNT; id++) {
+    for (float value : bad) {
+      Rig rig;
+      float amplitude = rig.waveform.getAmplitude();
+      float high = rig.alarms.getHighThreshold();
+      // A valid parameter first: it must not take effect either
+      std::vector<uint8_t> reply = rig.set({ { BinaryChannel::PARAM_AMPLITUDE, 12.5f },
+                                             { BinaryChannel::PARAM_ETCO2_HIGH, 45.0f },
+                                             { id, value } });
+      bool rejected = isNak(reply, BinaryChannel::ERR_BAD_PARAM);
+      // Baseline and phase legitimately go negative
+      if (value == -1.0f && (id == BinaryChannel::PARAM_BASELINE || id == BinaryChannel::PARAM_PHASE)) {
+        CHECK(isAck(reply));
+        continue;
+      }
+      if (!CHECK(rejected)) printf("  param %u value %g accepted\n", id, value);
+      CHECK(rig.waveform.getAmplitude() == amplitude);
+      CHECK(rig.alarms.getHighThreshold() == high);
+      CHECK(!rig.saved());
+    }
+  }
+}
+
+TEST_CASE(binarySetAppliesLimitValues) {
+  Rig rig;
+  std::vector<uint8_t> reply = rig.set({ { BinaryChannel::PARAM_AMPLITUDE, SettingLimits::AMPLITUDE.max },
+                                         { BinaryChannel::PARAM_FREQUENCY, SettingLimits::FREQUENCY.min },
+                                         { BinaryChannel::PARAM_PHASE, SettingLimits::PHASE.min },
+                                         { BinaryChannel::PARAM_RR_HIGH, SettingLimits::RR_ALARM.max },
+                                         { BinaryChannel::PARAM_LATCHING, 1 } });
+  CHECK(isAck(reply));
+  CHECK(rig.waveform.getAmplitude() == SettingLimits::AMPLITUDE.max);
+  CHECK(rig.waveform.getFrequency() == SettingLimits::FREQUENCY.min);
+  CHECK(rig.alarms.getRRHighThreshold() == SettingLimits::RR_ALARM.max);
+  CHECK(rig.alarms.isLatching());
+  CHECK(rig.saved());
+
+  CHECK(isNak(rig.set({ { BinaryChannel::PARAM_LATCHING, 2 } }), BinaryChannel::ERR_BAD_PARAM));
+  CHECK(isNak(rig.set({ { BinaryChannel::PARAM_COUNT, 0 } }), BinaryChannel::ERR_BAD_PARAM));
+}
+
+TEST_CASE(cliRejectsWhatTheBinaryChannelRejects) {
+  const char* lines[] = { "amp nan", "amp inf", "amp -1", "amp 1e9", "amp abc", "freq 3",
+                          "phase 720", "high -5", "rrlow 1e30" };
+  for (const char* line : lines) {
+    Rig fresh;
+    fresh.line(line);
+    std::string out(fresh.port.tx.begin(), fresh.port.tx.end());
+    if (!CHECK(out.find("Out of range") != std::string::npos)) printf("  '%s' accepted\n", line);
+    CHECK(!fresh.saved());
+  }
+
+  Rig rig;
+  rig.line("amp 150");
+  CHECK(rig.waveform.getAmplitude() == 150.0f);
+  CHECK(rig.saved());
+}
+
+int main() {
+  return HostTest::runAll();
+}
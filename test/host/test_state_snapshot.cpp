@@ -0,0 +1,163 @@
+// StateSnapshot::validate/restore against records edited on the wire:
+// every field out of range, truncated sizes and non-0/1 bools.
+#include <Arduino.h>
+#include <math.h>
+#include <stddef.h>
+#include <vector>
+#include "StateSnapshot.h"
+#include "ConfigStorage.h"
+#include "HostTest.h"
+
+class Rig {
+public:
+  DeviceState device;
+  WaveformGenerator waveform;
+  AlarmManager alarms;
+  ProtocolTrace trace;
+  HardwareSerial port;
+  ProtocolHandler protocol;
+  StateSnapshot snapshot;
+
+  Rig() : protocol(device, waveform, alarms, port, trace),
+          snapshot(device, waveform, alarms, protocol) {
+    protocol.begin();
+    waveform.loadFromConfig(ConfigStorage::defaults());
+    alarms.loadFromConfig(ConfigStorage::defaults());
+  }
+
+  std::vector<uint8_t> capture() {
+    std::vector<uint8_t> rec(StateSnapshot::MAX_SIZE);
+    rec.resize(snapshot.capture(rec.data(), rec.size()));
+    return rec;
+  }
+};
+
+static const size_t STATE = offsetof(SnapshotRecord, state);
+
+// Cuts the state to `size` bytes and re-signs the record
+static std::vector<uint8_t> reseal(std::vector<uint8_t> rec, size_t size) {
+  rec.resize(STATE + size);
+  uint16_t size16 = size;
+  memcpy(&rec[offsetof(SnapshotRecord, size)], &size16, sizeof(size16));
+  uint32_t crc = ConfigStorage::crc32(rec.data(), rec.size());
+  const uint8_t* p = (const uint8_t*)&crc;
+  rec.insert(rec.end(), p, p + sizeof(crc));
+  return rec;
+}
+
+template <typename T>
+static std::vector<uint8_t> edit(const std::vector<uint8_t>& rec, size_t offset, T value) {
+  std::vector<uint8_t> out = rec;
+  memcpy(&out[STATE + offset], &value, sizeof(value));
+  return reseal(out, sizeof(SnapshotState));
+}
+
+#define FIELD(path) offsetof(SnapshotState, path)
+
+TEST_CASE(roundTripRestores) {
+  Rig a;
+  a.device.setBarometricPressure(700);
+  a.device.setCO2Units(DeviceState::UNITS_PERCENT);
+  a.waveform.setAmplitude(42);
+  std::vector<uint8_t> rec = a.capture();
+  CHECK(StateSnapshot::validate(rec.data(), rec.size()) == nullptr);
+
+  Rig b;
+  CHECK(b.snapshot.restore(rec.data(), rec.size()) == nullptr);
+  CHECK_EQ(b.device.getBarometricPressure(), 700);
+  CHECK_EQ(b.device.getCO2Units(), DeviceState::UNITS_PERCENT);
+  CHECK(b.waveform.getAmplitude() == 42.0f);
+}
+
+// Used to divide by zero in the unit scale
+TEST_CASE(zeroPressureInPercentIsRejected) {
+  Rig a;
+  a.device.setCO2Units(DeviceState::UNITS_PERCENT);
+  std::vector<uint8_t> rec = edit<uint16_t>(a.capture(), FIELD(device.barometricPressure), 0);
+
+  Rig b;
+  uint16_t baro = b.device.getBarometricPressure();
+  CHECK(b.snapshot.restore(rec.data(), rec.size()) != nullptr);
+  CHECK_EQ(b.device.getBarometricPressure(), baro);
+  CHECK_EQ(b.device.getCO2Units(), DeviceState::UNITS_MMHG);
+  CHECK(b.snapshot.stage(rec.data(), rec.size()) != nullptr);
+}
+
+TEST_CASE(outOfRangeFieldsAreRejected) {
+  Rig a;
+  std::vector<uint8_t> rec = a.capture();
+  struct { const char* name; std::vector<uint8_t> rec; } cases[] = {
+    { "baro 399", edit<uint16_t>(rec, FIELD(device.barometricPressure), 399) },
+    { "baro 851", edit<uint16_t>(rec, FIELD(device.barometricPressure), 851) },
+    { "units 3", edit<uint8_t>(rec, FIELD(device.co2Units), 3) },
+    { "period 0", edit<uint8_t>(rec, FIELD(device.etco2TimePeriod), 0) },
+    { "no breath 61", edit<uint8_t>(rec, FIELD(device.noBreathTimeout), 61) },
+    { "sleep 3", edit<uint8_t>(rec, FIELD(device.sleepMode), 3) },
+    { "zero gas 2", edit<uint8_t>(rec, FIELD(device.zeroGasType), 2) },
+    { "o2 101", edit<uint8_t>(rec, FIELD(device.o2Compensation), 101) },
+    { "balance 3", edit<uint8_t>(rec, FIELD(device.balanceGas), 3) },
+    { "agent 201", edit<uint16_t>(rec, FIELD(device.anestheticAgent), 201) },
+    { "temp 501", edit<uint16_t>(rec, FIELD(device.gasTemp), 501) },
+    { "status 0x80", edit<uint8_t>(rec, FIELD(device.statusByte1), 0x80) },
+    { "amplitude NaN", edit<float>(rec, FIELD(waveform.amplitude), NAN) },
+    { "frequency inf", edit<float>(rec, FIELD(waveform.frequency), INFINITY) },
+    { "baseline -1e9", edit<float>(rec, FIELD(waveform.baseline), -1e9f) },
+    { "phase 10 rad", edit<float>(rec, FIELD(waveform.phase), 10.0f) },
+    { "high -1", edit<float>(rec, FIELD(alarms.highThreshold), -1.0f) },
+    { "rr low NaN", edit<float>(rec, FIELD(alarms.rrLowThreshold), NAN) },
+  };
+  for (const auto& c : cases) {
+    Rig b;
+    if (!CHECK(b.snapshot.restore(c.rec.data(), c.rec.size()) != nullptr)) printf("  %s accepted\n", c.name);
+  }
+}
+
+TEST_CASE(sizeMustEndOnAFieldBoundary) {
+  Rig a;
+  std::vector<uint8_t> rec = a.capture();
+  size_t baro = FIELD(device.barometricPressure);
+
+  std::vector<uint8_t> split = reseal(rec, baro + 1);
+  CHECK(StateSnapshot::validate(split.data(), split.size()) != nullptr);
+  std::vector<uint8_t> inFloat = reseal(rec, FIELD(waveform.amplitude) + 2);
+  CHECK(StateSnapshot::validate(inFloat.data(), inFloat.size()) != nullptr);
+  std::vector<uint8_t> empty = reseal(rec, 0);
+  CHECK(StateSnapshot::validate(empty.data(), empty.size()) != nullptr);
+
+  // An older, shorter writer: what it has is restored, the rest kept
+  std::vector<uint8_t> older = reseal(rec, baro + 2);
+  CHECK(StateSnapshot::validate(older.data(), older.size()) == nullptr);
+  Rig b;
+  b.waveform.setAmplitude(11);
+  CHECK(b.snapshot.restore(older.data(), older.size()) == nullptr);
+  CHECK(b.waveform.getAmplitude() == 11.0f);
+}
+
+// No writer ever used version 0, as with ConfigStorage records
+TEST_CASE(versionZeroIsRejected) {
+  Rig a;
+  std::vector<uint8_t> rec = a.capture();
+  uint16_t zero = 0;
+  memcpy(&rec[offsetof(SnapshotRecord, version)], &zero, sizeof(zero));
+  rec = reseal(rec, sizeof(SnapshotState));
+  CHECK(StateSnapshot::validate(rec.data(), rec.size()) != nullptr);
+}
+
+TEST_CASE(boolBytesAreNormalised) {
+  Rig a;
+  std::vector<uint8_t> rec = a.capture();
+  rec = edit<uint8_t>(rec, FIELD(device.continuousMode), 0x5A);
+  rec = edit<uint8_t>(rec, FIELD(alarms.latching), 0xFF);
+
+  Rig b;
+  CHECK(b.snapshot.restore(rec.data(), rec.size()) == nullptr);
+  CHECK(b.device.isContinuousMode());
+  CHECK(b.alarms.isLatching());
+  std::vector<uint8_t> back = b.capture();
+  CHECK_EQ(back[STATE + FIELD(device.continuousMode)], 1);
+  CHECK_EQ(back[STATE + FIELD(alarms.latching)], 1);
+}
+
+int main() {
+  return HostTest::runAll();
+}
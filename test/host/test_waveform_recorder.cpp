@@ -0,0 +1,94 @@
+// Recordings the importer is writing or the player is reading are never
+// deleted, by the user or by the file-count limit.
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "WaveformImporter.h"
+#include "WaveformPlayer.h"
+#include "HostTest.h"
+
+static bool exists(uint32_t sequence) {
+  char path[WaveformRecorder::MAX_PATH];
+  WaveformRecorder::filePath(sequence, path, sizeof(path));
+  return LittleFS.exists(path);
+}
+
+// RECORDER_MAX_FILES recordings #1..#N, so the next file needs room
+class Rig {
+public:
+  WaveformGenerator waveform;
+  WaveformRecorder recorder;
+  WaveformPlayer player;
+
+  Rig() : recorder(waveform), player(waveform, recorder) {
+    FS::eraseAll();
+    LittleFS.mkdir("/rec");
+    for (uint32_t seq = 1; seq <= RECORDER_MAX_FILES; seq++) {
+      char path[WaveformRecorder::MAX_PATH];
+      WaveformRecorder::filePath(seq, path, sizeof(path));
+      WaveformRecorder::FileHeader header = { {'C', 'O', '2', 'R'}, WaveformRecorder::FILE_VERSION,
+                                              sizeof(WaveformRecorder::Record),
+                                              WaveformRecorder::SAMPLE_INTERVAL_MS, seq };
+      File f = LittleFS.open(path, FILE_WRITE);
+      f.write((const uint8_t*)&header, sizeof(header));
+    }
+    recorder.begin();
+    player.begin(true);
+  }
+
+  void play(uint32_t sequence) {
+    player.requestPlay(sequence);
+    player.update();
+  }
+};
+
+TEST_CASE(evictionSkipsTheFileThatIsPlaying) {
+  Rig rig;
+  rig.play(1);
+  CHECK(rig.player.isPlaying());
+  rig.recorder.enforceLimits();
+  CHECK(exists(1));
+  CHECK(!exists(2));
+  CHECK(exists(3));
+
+  rig.player.requestStop();
+  rig.player.update();
+  rig.recorder.enforceLimits();
+  CHECK(exists(1));
+  CHECK(rig.recorder.deleteFile(1));
+  CHECK(!exists(1));
+}
+
+TEST_CASE(playingFileCannotBeDeleted) {
+  Rig rig;
+  rig.play(4);
+  CHECK(!rig.recorder.deleteFile(4));
+  CHECK(exists(4));
+  CHECK(rig.recorder.deleteFile(5));
+
+  // Switching replays releases the first file
+  rig.play(6);
+  CHECK(rig.recorder.deleteFile(4));
+  CHECK(!rig.recorder.deleteFile(6));
+}
+
+TEST_CASE(uploadInProgressIsKept) {
+  Rig rig;
+  WaveformImporter importer(rig.recorder);
+  CHECK(importer.begin());
+  uint32_t upload = importer.getResult().sequence;
+  const char csv[] = "0,38.5\n10,39.0\n";
+  CHECK(importer.feed((const uint8_t*)csv, sizeof(csv) - 1));
+
+  CHECK(!rig.recorder.deleteFile(upload));
+  rig.recorder.enforceLimits();
+  CHECK(exists(upload));
+  CHECK(!exists(1));
+  CHECK(!exists(2));
+
+  CHECK(importer.finish());
+  CHECK(rig.recorder.deleteFile(upload));
+}
+
+int main() {
+  return HostTest::runAll();
+}
@@ -0,0 +1,166 @@
+// Host build stand-in for the parts of the Arduino-ESP32 core the emulator
+// uses. Time is driven by the test (see HostStubs.h); serial ports are
+// in-memory buffers.
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <ctype.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+#include <deque>
+
+using std::min;
+using std::max;
+
+#define PI 3.14159265358979
+#define HEX 16
+#define DEC 10
+#define PROGMEM
+#define OUTPUT 1
+#define INPUT 0
+#define HIGH 1
+#define LOW 0
+#define SERIAL_8N1 0x800001c
+#define constrain(a, l, h) ((a) < (l) ? (l) : ((a) > (h) ? (h) : (a)))
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void yield();
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+
+class String {
+private:
+  std::string s;
+
+public:
+  String(const char* str = "") : s(str ? str : "") {}
+  String(const std::string& str) : s(str) {}
+  String(int value) : s(std::to_string(value)) {}
+  const char* c_str() const { return s.c_str(); }
+  size_t length() const { return s.size(); }
+  void trim();
+  void toLowerCase();
+  int indexOf(char c) const;
+  String substring(int from, int to = -1) const;
+  float toFloat() const { return atof(s.c_str()); }
+  long toInt() const { return atol(s.c_str()); }
+  bool operator==(const char* other) const { return s == other; }
+  bool operator==(const String& other) const { return s == other.s; }
+  String& operator+=(char c) { s += c; return *this; }
+  String& operator+=(const char* str) { s += str; return *this; }
+};
+
+class Print;
+
+class Printable {
+public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print& p) const = 0;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t* data, size_t len);
+  virtual int availableForWrite() { return 0; }
+  size_t write(const char* str) { return write((const uint8_t*)str, strlen(str)); }
+
+  size_t print(const char* str) { return write(str); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int value, int base = DEC) { return print((long)value, base); }
+  size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(double value, int digits = 2);
+  size_t print(const String& str) { return write(str.c_str()); }
+  size_t print(const Printable& p) { return p.printTo(*this); }
+
+  template <typename T> size_t println(const T& value) { size_t n = print(value); return n + println(); }
+  template <typename T> size_t println(const T& value, int arg) { size_t n = print(value, arg); return n + println(); }
+  size_t println() { return write("\r\n"); }
+  size_t printf(const char* format, ...);
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual void flush() {}
+  size_t readBytes(uint8_t* buffer, size_t len);
+};
+
+// Bytes written are kept in tx; bytes queued with inject() are read back
+// and raise the receive callback, as the UART event task would
+class HardwareSerial : public Stream {
+public:
+  std::vector<uint8_t> tx;
+  std::deque<uint8_t> rx;
+  std::function<void(void)> onReceiveCb;
+  uint32_t baud = 0;
+
+  void begin(unsigned long rate, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1) { baud = rate; }
+  uint32_t baudRate() { return baud; }
+  int available() override { return (int)rx.size(); }
+  int read() override;
+  int peek() override { return rx.empty() ? -1 : rx.front(); }
+  size_t write(uint8_t b) override { tx.push_back(b); return 1; }
+  size_t write(const uint8_t* data, size_t len) override { tx.insert(tx.end(), data, data + len); return len; }
+  using Print::write;
+  int availableForWrite() override { return 4096; }
+  void onReceive(std::function<void(void)> cb, bool onlyOnTimeout = false) { onReceiveCb = cb; }
+  bool setRxTimeout(uint8_t symbols) { return true; }
+  bool setRxFIFOFull(uint8_t bytes) { return true; }
+  size_t setRxBufferSize(size_t size) { return size; }
+  operator bool() const { return true; }
+
+  void inject(const uint8_t* data, size_t len);
+};
+
+class HWCDC : public HardwareSerial {};
+
+extern HWCDC Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+
+class IPAddress : public Printable {
+public:
+  size_t printTo(Print& p) const override { return p.print("0.0.0.0"); }
+  String toString() const { return String("0.0.0.0"); }
+};
+
+class EspClass {
+public:
+  uint32_t getFreeHeap() { return 200000; }
+  uint32_t getMinFreeHeap() { return 150000; }
+  uint32_t getMaxAllocHeap() { return 100000; }
+  uint32_t getHeapSize() { return 320000; }
+  uint32_t getPsramSize() { return 8 << 20; }
+  uint32_t getFreePsram() { return 8 << 20; }
+  uint32_t getSketchSize() { return 0; }
+  uint32_t getCycleCount() { return micros() * 240; }
+};
+
+extern EspClass ESP;
+
+inline void* ps_malloc(size_t size) { return malloc(size); }
+inline void* ps_calloc(size_t n, size_t size) { return calloc(n, size); }
+inline bool psramFound() { return true; }
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+#endif // HOST_ARDUINO_H
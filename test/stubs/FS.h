@@ -0,0 +1,93 @@
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <set>
+
+// In-memory filesystem. Files live in one process-wide store, so a test
+// can look at what the firmware wrote; eraseAll() empties it. A removed
+// file stays readable through a handle that was already open.
+namespace fs {
+
+typedef std::shared_ptr<std::vector<uint8_t> > FileData;
+
+class File : public Stream {
+private:
+  std::string filePath;
+  FileData data;                    // null for a directory or no file
+  std::vector<std::string> entries; // a directory's children, sorted
+  size_t pos;
+  size_t nextEntry;
+  bool writable;
+  bool isOpen;
+
+public:
+  File() : pos(0), nextEntry(0), writable(false), isOpen(false) {}
+  File(const std::string& path, FileData contents, bool forWriting, size_t at)
+    : filePath(path), data(contents), pos(at), nextEntry(0), writable(forWriting), isOpen(true) {}
+  File(const std::string& path, const std::vector<std::string>& children)
+    : filePath(path), entries(children), pos(0), nextEntry(0), writable(false), isOpen(true) {}
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* buf, size_t len) override {
+    if (!isOpen || !writable || !data) return 0;
+    if (data->size() < pos + len) data->resize(pos + len);
+    memcpy(data->data() + pos, buf, len);
+    pos += len;
+    return len;
+  }
+  int available() override { return isOpen && data && pos < data->size() ? data->size() - pos : 0; }
+  int read() override { return available() ? (*data)[pos++] : -1; }
+  int peek() override { return available() ? (*data)[pos] : -1; }
+  size_t read(uint8_t* buf, size_t len) {
+    size_t n = available();
+    if (n > len) n = len;
+    if (n) memcpy(buf, data->data() + pos, n);
+    pos += n;
+    return n;
+  }
+  bool seek(uint32_t at) {
+    if (!isOpen || !data || at > data->size()) return false;
+    pos = at;
+    return true;
+  }
+  size_t position() const { return pos; }
+  size_t size() const { return data ? data->size() : 0; }
+  void close() { isOpen = false; }
+  operator bool() const { return isOpen; }
+  const char* path() const { return filePath.c_str(); }
+  const char* name() const {
+    size_t slash = filePath.rfind('/');
+    return filePath.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+  }
+  bool isDirectory() { return isOpen && !data; }
+  File openNextFile(const char* mode = "r");
+};
+
+class FS {
+public:
+  static std::map<std::string, FileData>& files();
+  static std::set<std::string>& dirs();
+  static void eraseAll() { files().clear(); dirs().clear(); }
+
+  File open(const char* path, const char* mode = "r", bool create = false);
+  File open(const String& path, const char* mode = "r", bool create = false) { return open(path.c_str(), mode, create); }
+  bool exists(const char* path);
+  bool exists(const String& path) { return exists(path.c_str()); }
+  bool remove(const char* path) { return files().erase(path) > 0; }
+  bool rename(const char* from, const char* to);
+  bool mkdir(const char* path) { return dirs().insert(path).second; }
+};
+
+}  // namespace fs
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+using fs::File;
+using fs::FS;
+
+#endif // HOST_FS_H
@@ -0,0 +1,189 @@
+// Definitions behind the host stand-ins in this directory.
+#include <Arduino.h>
+#include <Preferences.h>
+#include <Wire.h>
+#include <LittleFS.h>
+
+// Wall time only moves when a test says so; protocol timing uses Clock
+static uint32_t hostMicros = 0;
+
+uint32_t millis() { return hostMicros / 1000; }
+uint32_t micros() { return hostMicros; }
+void delay(uint32_t ms) { hostMicros += ms * 1000; }
+void yield() {}
+void pinMode(int, int) {}
+void digitalWrite(int, int) {}
+
+HWCDC Serial;
+HardwareSerial Serial1;
+HardwareSerial Serial2;
+EspClass ESP;
+TwoWire Wire;
+fs::LittleFSFS LittleFS;
+
+void String::trim() {
+  size_t first = s.find_first_not_of(" \t\r\n");
+  size_t last = s.find_last_not_of(" \t\r\n");
+  s = first == std::string::npos ? std::string() : s.substr(first, last - first + 1);
+}
+
+void String::toLowerCase() {
+  for (size_t i = 0; i < s.size(); i++) s[i] = (char)tolower((unsigned char)s[i]);
+}
+
+int String::indexOf(char c) const {
+  size_t pos = s.find(c);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(int from, int to) const {
+  int len = (int)s.size();
+  if (to < 0 || to > len) to = len;
+  if (from < 0) from = 0;
+  if (from >= to) return String();
+  return String(s.substr(from, to - from));
+}
+
+size_t Print::write(const uint8_t* data, size_t len) {
+  size_t n = 0;
+  while (len--) n += write(*data++);
+  return n;
+}
+
+size_t Print::print(long value, int base) {
+  if (base == DEC) return printf("%ld", value);
+  return print((unsigned long)value, base);
+}
+
+size_t Print::print(unsigned long value, int base) {
+  return printf(base == HEX ? "%lX" : "%lu", value);
+}
+
+size_t Print::print(double value, int digits) {
+  return printf("%.*f", digits, value);
+}
+
+size_t Print::printf(const char* format, ...) {
+  char buf[512];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (len < 0) return 0;
+  if (len >= (int)sizeof(buf)) len = sizeof(buf) - 1;
+  return write((const uint8_t*)buf, len);
+}
+
+size_t Stream::readBytes(uint8_t* buffer, size_t len) {
+  size_t n = 0;
+  while (n < len && available() > 0) buffer[n++] = (uint8_t)read();
+  return n;
+}
+
+int HardwareSerial::read() {
+  if (rx.empty()) return -1;
+  uint8_t b = rx.front();
+  rx.pop_front();
+  return b;
+}
+
+void HardwareSerial::inject(const uint8_t* data, size_t len) {
+  rx.insert(rx.end(), data, data + len);
+  if (onReceiveCb) onReceiveCb();
+}
+
+std::map<std::string, std::vector<uint8_t> >& Preferences::store() {
+  static std::map<std::string, std::vector<uint8_t> > entries;
+  return entries;
+}
+
+bool Preferences::clear() {
+  std::string prefix = ns + "/";
+  std::map<std::string, std::vector<uint8_t> >& entries = store();
+  for (auto it = entries.begin(); it != entries.end();) {
+    if (it->first.compare(0, prefix.size(), prefix) == 0) it = entries.erase(it);
+    else ++it;
+  }
+  return true;
+}
+
+size_t Preferences::putBytes(const char* name, const void* data, size_t len) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  store()[key(name)] = std::vector<uint8_t>(bytes, bytes + len);
+  return len;
+}
+
+size_t Preferences::getBytes(const char* name, void* data, size_t len) {
+  auto it = store().find(key(name));
+  if (it == store().end() || it->second.size() > len) return 0;
+  memcpy(data, it->second.data(), it->second.size());
+  return it->second.size();
+}
+
+size_t Preferences::getBytesLength(const char* name) {
+  auto it = store().find(key(name));
+  return it == store().end() ? 0 : it->second.size();
+}
+
+std::map<std::string, fs::FileData>& fs::FS::files() {
+  static std::map<std::string, FileData> entries;
+  return entries;
+}
+
+std::set<std::string>& fs::FS::dirs() {
+  static std::set<std::string> entries;
+  return entries;
+}
+
+// A directory exists once made or once a file sits in it
+static bool isHostDir(const std::string& path) {
+  if (fs::FS::dirs().count(path)) return true;
+  auto it = fs::FS::files().lower_bound(path + "/");
+  return it != fs::FS::files().end() && it->first.compare(0, path.size() + 1, path + "/") == 0;
+}
+
+fs::File fs::FS::open(const char* path, const char* mode, bool /*create*/) {
+  std::map<std::string, FileData>& entries = files();
+  auto it = entries.find(path);
+  if (mode[0] == 'w' || (mode[0] == 'a' && it == entries.end())) {
+    FileData data = std::make_shared<std::vector<uint8_t> >();
+    entries[path] = data;
+    return File(path, data, true, 0);
+  }
+  if (it != entries.end()) return File(path, it->second, mode[0] == 'a', mode[0] == 'a' ? it->second->size() : 0);
+  if (!isHostDir(path)) return File();
+
+  std::string prefix = std::string(path) + "/";
+  std::vector<std::string> children;
+  for (auto e = entries.lower_bound(prefix); e != entries.end() && e->first.compare(0, prefix.size(), prefix) == 0; ++e) {
+    if (e->first.find('/', prefix.size()) == std::string::npos) children.push_back(e->first);
+  }
+  return File(path, children);
+}
+
+fs::File fs::File::openNextFile(const char* mode) {
+  while (isOpen && nextEntry < entries.size()) {
+    File f = FS().open(entries[nextEntry++].c_str(), mode);
+    if (f) return f;
+  }
+  return File();
+}
+
+bool fs::FS::exists(const char* path) {
+  return files().count(path) || isHostDir(path);
+}
+
+bool fs::FS::rename(const char* from, const char* to) {
+  auto it = files().find(from);
+  if (it == files().end()) return false;
+  FileData data = it->second;
+  files().erase(it);
+  files()[to] = data;
+  return true;
+}
+
+size_t fs::LittleFSFS::usedBytes() {
+  size_t used = 0;
+  for (auto& e : files()) used += e.second->size();
+  return used;
+}
@@ -0,0 +1,21 @@
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+#include "FS.h"
+
+namespace fs {
+
+class LittleFSFS : public FS {
+public:
+  bool begin(bool formatOnFail = false, const char* base = "/littlefs", uint8_t maxOpen = 10,
+             const char* label = "spiffs") { return true; }
+  size_t totalBytes() { return 1 << 20; }
+  size_t usedBytes();
+  void end() {}
+};
+
+}  // namespace fs
+
+extern fs::LittleFSFS LittleFS;
+
+#endif // HOST_LITTLEFS_H
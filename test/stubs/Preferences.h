@@ -0,0 +1,38 @@
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include <Arduino.h>
+#include <map>
+
+// NVS stand-in. Entries live in one process-wide store that outlives the
+// Preferences object, so a test can "reboot" by constructing a new one.
+class Preferences {
+private:
+  std::string ns;
+  std::string key(const char* name) const { return ns + "/" + name; }
+
+public:
+  static std::map<std::string, std::vector<uint8_t> >& store();
+  static void eraseAll() { store().clear(); }
+
+  bool begin(const char* name, bool readOnly = false, const char* partition = nullptr) { ns = name; return true; }
+  void end() {}
+  bool clear();
+  bool remove(const char* name) { return store().erase(key(name)) > 0; }
+  bool isKey(const char* name) { return store().count(key(name)) > 0; }
+
+  size_t putBytes(const char* name, const void* data, size_t len);
+  size_t getBytes(const char* name, void* data, size_t len);
+  size_t getBytesLength(const char* name);
+
+  size_t putFloat(const char* name, float v) { return putBytes(name, &v, sizeof(v)); }
+  float getFloat(const char* name, float def = 0) { float v = def; getBytes(name, &v, sizeof(v)); return v; }
+  size_t putBool(const char* name, bool v) { return putBytes(name, &v, sizeof(v)); }
+  bool getBool(const char* name, bool def = false) { bool v = def; getBytes(name, &v, sizeof(v)); return v; }
+  size_t putUInt(const char* name, uint32_t v) { return putBytes(name, &v, sizeof(v)); }
+  uint32_t getUInt(const char* name, uint32_t def = 0) { uint32_t v = def; getBytes(name, &v, sizeof(v)); return v; }
+  size_t putUChar(const char* name, uint8_t v) { return putBytes(name, &v, sizeof(v)); }
+  uint8_t getUChar(const char* name, uint8_t def = 0) { uint8_t v = def; getBytes(name, &v, sizeof(v)); return v; }
+};
+
+#endif // HOST_PREFERENCES_H
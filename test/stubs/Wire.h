@@ -0,0 +1,24 @@
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+#include <Arduino.h>
+
+// No device answers; sensor tests use a mock I2CBus instead
+class TwoWire : public Stream {
+public:
+  bool begin(int sda, int scl, uint32_t freq = 0) { return true; }
+  bool setClock(uint32_t freq) { return true; }
+  void beginTransmission(uint8_t address) {}
+  uint8_t endTransmission(bool stop = true) { return 2; }
+  size_t requestFrom(uint8_t address, size_t len, bool stop = true) { return 0; }
+  size_t write(uint8_t b) override { return 1; }
+  size_t write(const uint8_t* data, size_t len) override { return len; }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  void setTimeOut(uint16_t ms) {}
+};
+
+extern TwoWire Wire;
+
+#endif // HOST_WIRE_H
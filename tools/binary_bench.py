@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""Host-side benchmark for the binary rig channel on the USB command port.
+
+Measures PING round-trip latency, batch SET latency and sustained sample
+streaming throughput. Requires pyserial.
+
+    python3 tools/binary_bench.py /dev/ttyACM0 --pings 1000 --rate 1000 --seconds 10
+"""
+
+import argparse
+import statistics
+import struct
+import sys
+import time
+
+import serial
+
+SOF = 0xA5
+TYPE_PING, TYPE_SET, TYPE_GET, TYPE_STREAM, TYPE_STATS, TYPE_MODE_TEXT = range(1, 7)
+TYPE_SAMPLES = 0x90
+TYPE_NAK = 0xFF
+
+
+def crc16(data, crc=0xFFFF):
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def encode(frame_type, payload=b""):
+    body = bytes([frame_type, len(payload)]) + payload
+    return bytes([SOF]) + body + struct.pack("<H", crc16(body))
+
+
+class Channel:
+    def __init__(self, port, baud):
+        self.ser = serial.Serial(port, baud, timeout=1)
+        self.buf = bytearray()
+        self.ser.write(b"\n")  # terminate any partial text command
+
+    def send(self, frame_type, payload=b""):
+        self.ser.write(encode(frame_type, payload))
+
+    def receive(self, timeout=1.0):
+        """Return the next valid (type, payload), skipping text and bad frames."""
+        deadline = time.perf_counter() + timeout
+        while time.perf_counter() < deadline:
+            start = self.buf.find(SOF)
+            if start < 0:
+                self.buf.clear()
+            elif len(self.buf) - start >= 5:
+                length = self.buf[start + 2]
+                end = start + 3 + length + 2
+                if len(self.buf) >= end:
+                    body = bytes(self.buf[start + 1:start + 3 + length])
+                    (crc,) = struct.unpack_from("<H", self.buf, end - 2)
+                    if crc == crc16(body):
+                        del self.buf[:end]
+                        return body[0], body[2:]
+                    del self.buf[:start + 1]  # resync on the next SOF
+                    continue
+            self.buf += self.ser.read(max(1, self.ser.in_waiting))
+        raise TimeoutError("no frame received")
+
+    def request(self, frame_type, payload=b""):
+        self.send(frame_type, payload)
+        while True:
+            rtype, rpayload = self.receive()
+            if rtype == TYPE_NAK:
+                raise RuntimeError(f"NAK error {rpayload[0]}")
+            if rtype == frame_type | 0x80:
+                return rpayload
+
+
+def percentile(values, pct):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * pct / 100))]
+
+
+def bench_ping(ch, count):
+    rtts = []
+    for i in range(count):
+        payload = struct.pack("<I", i)
+        t0 = time.perf_counter()
+        if ch.request(TYPE_PING, payload) != payload:
+            raise RuntimeError("PING echo mismatch")
+        rtts.append((time.perf_counter() - t0) * 1e6)
+    print(f"PING x{count}: min {min(rtts):.0f} us, median {statistics.median(rtts):.0f} us, "
+          f"p99 {percentile(rtts, 99):.0f} us, max {max(rtts):.0f} us")
+
+
+def bench_set(ch, count):
+    # Ten parameters per frame, values unchanged so the device state is kept
+    current = ch.request(TYPE_GET)
+    params = [current[i:i + 5] for i in range(0, len(current), 5)][:10]
+    payload = b"".join(params)
+    rtts = []
+    for _ in range(count):
+        t0 = time.perf_counter()
+        ch.request(TYPE_SET, payload)
+        rtts.append((time.perf_counter() - t0) * 1e6)
+    print(f"SET ({len(params)} params) x{count}: median {statistics.median(rtts):.0f} us, "
+          f"p99 {percentile(rtts, 99):.0f} us")
+
+
+def bench_stream(ch, rate, seconds):
+    ch.request(TYPE_STREAM, struct.pack("<H", rate))
+    samples = 0
+    gaps = 0
+    expected = None
+    t0 = time.perf_counter()
+    while time.perf_counter() - t0 < seconds:
+        rtype, payload = ch.receive()
+        if rtype != TYPE_SAMPLES:
+            continue
+        (seq,) = struct.unpack_from("<I", payload)
+        count = (len(payload) - 4) // 6
+        if expected is not None and seq != expected:
+            gaps += (seq - expected) & 0xFFFFFFFF
+        expected = seq + count
+        samples += count
+    elapsed = time.perf_counter() - t0
+    ch.send(TYPE_STREAM, struct.pack("<H", 0))
+    time.sleep(0.1)
+    ch.ser.reset_input_buffer()
+    ch.buf.clear()
+    print(f"STREAM @ {rate} Hz for {elapsed:.1f} s: {samples / elapsed:.0f} samples/s, "
+          f"{gaps} samples missing")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("port")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--pings", type=int, default=1000)
+    parser.add_argument("--sets", type=int, default=200)
+    parser.add_argument("--rate", type=int, default=1000)
+    parser.add_argument("--seconds", type=float, default=10.0)
+    args = parser.parse_args()
+
+    ch = Channel(args.port, args.baud)
+    try:
+        bench_ping(ch, args.pings)
+        bench_set(ch, args.sets)
+        bench_stream(ch, args.rate, args.seconds)
+        stats = struct.unpack("<5I", ch.request(TYPE_STATS))
+        print("Device: rx %d, tx %d, crc errors %d, dropped frames %d, overruns %d" % stats)
+    finally:
+        ch.request(TYPE_MODE_TEXT)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
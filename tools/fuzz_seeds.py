@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+"""Writes the seed corpus for the fuzz targets in test/fuzz/.
+
+Every seed is a well-formed input, so the fuzzer starts from frames and
+files the firmware accepts and mutates outward from there.
+
+    python3 tools/fuzz_seeds.py
+"""
+import os
+import struct
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "test", "fuzz", "corpus")
+
+
+def capnostat(cmd, *data):
+    frame = bytes([cmd, len(data) + 1]) + bytes(data)
+    return frame + bytes([(-sum(frame)) & 0x7F])
+
+
+def crc16(data, crc=0xFFFF):
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def binary(frame_type, payload=b""):
+    body = bytes([frame_type, len(payload)]) + payload
+    return b"\xA5" + body + struct.pack("<H", crc16(body))
+
+
+def two_byte(value):
+    return (value >> 7) & 0x7F, value & 0x7F
+
+
+def host_frames():
+    # First byte: gap between bytes in 4 ms steps
+    seeds = {
+        "start_stop": [capnostat(0x80), capnostat(0xC9)],
+        "start_dpi": [capnostat(0x80, 0x01), capnostat(0x80, 0x02), capnostat(0xC9)],
+        "revision": [capnostat(0xCA, 0x00), capnostat(0xCA, 0x01)],
+        "caps": [capnostat(0xCB, 0x00), capnostat(0xCB, 0x01)],
+        "zero": [capnostat(0x82), capnostat(0x82)],
+        "reset_no_breath": [capnostat(0xCC)],
+        "set_baro": [capnostat(0x84, 0x01, *two_byte(760)), capnostat(0x84, 0x01)],
+        "set_units": [capnostat(0x84, 0x07, 0x01), capnostat(0x84, 0x07, 0x02), capnostat(0x84, 0x07)],
+        "set_compensations": [capnostat(0x84, 0x0B, 0x15, 0x00, 0x00, 0x00), capnostat(0x84, 0x0B)],
+        "get_all": [capnostat(0x84, isb) for isb in range(0x20)],
+        "bad_checksum": [bytes([0xC9, 0x01, 0x00]), capnostat(0xC9)],
+        "bad_length": [bytes([0x84, 0x03]), bytes([0x05]), capnostat(0xC9)],
+    }
+    for name, frames in seeds.items():
+        yield name, bytes([1]) + b"".join(frames)
+    yield "timeout", bytes([150]) + bytes([0x84, 0x02]) + capnostat(0xC9)
+
+
+def binary_channel():
+    f32 = lambda ident, value: struct.pack("<Bf", ident, value)
+    yield "ping", binary(0x01, b"hello")
+    yield "get", binary(0x03)
+    yield "set", binary(0x02, f32(1, 40.0) + f32(2, 0.5) + f32(4, -90.0) + f32(13, 1.0))
+    yield "stream", binary(0x04, struct.pack("<H", 100)) + binary(0x04, struct.pack("<H", 0))
+    yield "stats", binary(0x05)
+    yield "snapshot", binary(0x07)
+    yield "text", binary(0x06)
+
+
+def cli():
+    yield "settings", b"amp 40\nfreq 0.5\nbase 2\nphase 90\nhigh 50\nlow 30\nhighen 1\nlowen 1\n"
+    yield "alarms", b"rrhigh 30\nrrlow 8\nrrhighen 1\nrrlowen 1\nlatch 1\nalarms\nack\n"
+    yield "status", b"help\nstatus\nheap\nlatency\nloop\nmetrics\nboot\nip\nsensor\n"
+    yield "storage", b"save\nload\nautosave 1\npreset save a\npreset load a\npreset del a\npreset\nclear\n"
+    yield "snapshot", b"snap\nsnap 00\n"
+    yield "recorder", b"rec start\nrec stop\nrec\nrec play 1\nrec halt\nrec del 1\n"
+    yield "bridge_fault", b"bridge\nbridge wave 1\nbridge off\nfault\nfault seed 7\nfault delayms 5\n"
+    yield "binary", b"binary\n" + binary(0x01, b"x") + binary(0x03) + binary(0x06) + b"status\n"
+
+
+def uploads():
+    # Mode 1 with a zero XOR pattern is the captured record, unchanged
+    yield "snapshot_valid", bytes([1, 0xFF]) + bytes(16)
+    yield "snapshot_short", bytes([1, 8])
+    yield "snapshot_raw", bytes([0]) + b"CO2S" + bytes(12)
+    yield "csv_two_column", bytes([2, 31]) + b"time_ms,co2_mmHg\n0,0.5\n10,12.25\n20,38.0\n30,4.0\n"
+    yield "csv_one_column", bytes([2, 7]) + b"1.5\n20\n38.2\n0\n"
+    header = b"CO2R" + struct.pack("<HHII", 1, 8, 10, 1)
+    records = b"".join(struct.pack("<IBBh", t * 10, 0, 0, v) for t, v in enumerate((0, 1200, 3800, 400)))
+    yield "recording", bytes([2, 5]) + header + records
+    header = b"CO2T" + bytes([1, 0]) + struct.pack("<H", 6) + bytes(8)
+    records = b"".join(struct.pack("<Ih", t * 10, v) for t, v in enumerate((0, 1200, 3800, 400)))
+    yield "trend", bytes([2, 255]) + header + records
+
+
+def main():
+    for target, seeds in (("host_frames", host_frames), ("binary_channel", binary_channel),
+                          ("cli", cli), ("uploads", uploads)):
+        path = os.path.join(ROOT, target)
+        os.makedirs(path, exist_ok=True)
+        for name, data in seeds():
+            with open(os.path.join(path, name), "wb") as f:
+                f.write(data)
+
+
+if __name__ == "__main__":
+    main()